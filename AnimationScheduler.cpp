@@ -0,0 +1,160 @@
+//--------------------------------------------------------------------------------------
+// Class that schedules how often each animated model is updated
+//--------------------------------------------------------------------------------------
+
+#include "AnimationScheduler.h"
+#include "Model.h"
+
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// Models closer than fullRateDistance are updated every frame. Each time the distance doubles beyond that the update period
+// doubles, up to maxPeriod frames (rounded up to a power of 2)
+AnimationScheduler::AnimationScheduler(float fullRateDistance /*= 100.0f*/, unsigned int maxPeriod /*= 8*/,
+                                       EAnimationBlend blend /*= EAnimationBlend::Interpolate*/)
+    : mFullRateDistance(fullRateDistance), mBlend(blend), mFrame(0), mNumUpdated(0)
+{
+    mMaxPeriod = 1;
+    while (mMaxPeriod < maxPeriod)  mMaxPeriod *= 2;
+}
+
+
+// Add a model to be scheduled, returns a handle used for the functions below. The model's current pose is the first sample
+unsigned int AnimationScheduler::Add(Model* model)
+{
+    ScheduledModel scheduledModel;
+    scheduledModel.model = model;
+    scheduledModel.period = 1;
+    scheduledModel.framesSinceUpdate = 0;
+    scheduledModel.updateTime = 0;
+    scheduledModel.updateThisFrame = false;
+    scheduledModel.interpolated = false;
+
+    // Give each model a different phase, so models with the same period are updated on different frames
+    scheduledModel.phase = static_cast<unsigned int>(mModels.size()) % mMaxPeriod;
+
+    SamplePose(scheduledModel);
+    scheduledModel.previousPose = scheduledModel.currentPose;
+
+    mModels.push_back(scheduledModel);
+    return static_cast<unsigned int>(mModels.size() - 1);
+}
+
+
+// Call at the start of each frame's update, before any models are animated. Chooses the update period of each model from
+// its distance to the given camera position and decides which models are updated this frame. Models being updated are
+// returned to their last updated pose, ready to be animated
+void AnimationScheduler::BeginFrame(const CVector3& cameraPosition, float frameTime)
+{
+    ++mFrame;
+    mNumUpdated = 0;
+    for (auto& scheduledModel : mModels)
+    {
+        // Period doubles each time the distance doubles
+        float distance = Length(scheduledModel.model->Position() - cameraPosition);
+        unsigned int period = 1;
+        float periodDistance = mFullRateDistance;
+        while (distance > periodDistance && period < mMaxPeriod)
+        {
+            period *= 2;
+            periodDistance *= 2;
+        }
+        scheduledModel.period = period;
+
+        // Periods are powers of 2, so the models sharing a period are spread evenly over its frames by their phases
+        scheduledModel.updateTime += frameTime;
+        ++scheduledModel.framesSinceUpdate;
+        scheduledModel.updateThisFrame = ((mFrame + scheduledModel.phase) & (period - 1)) == 0;
+        if (!scheduledModel.updateThisFrame)  continue;
+
+        // If the model is showing an interpolated pose put back the real one before it is animated. Each write marks the
+        // node and its children for recalculation, so nodes already in their real pose are left alone
+        if (scheduledModel.interpolated)
+        {
+            for (unsigned int node = 1; node < scheduledModel.currentMatrices.size(); ++node)
+            {
+                CMatrix4x4 matrix = scheduledModel.model->WorldMatrix(node);
+                if (std::memcmp(&matrix, &scheduledModel.currentMatrices[node], sizeof(CMatrix4x4)) != 0)
+                {
+                    scheduledModel.model->SetWorldMatrix(scheduledModel.currentMatrices[node], node);
+                }
+            }
+            scheduledModel.interpolated = false;
+        }
+        ++mNumUpdated;
+    }
+}
+
+
+// Call after all models have been animated for this frame. Stores the new pose of updated models and sets the pose of
+// the other models according to the blend setting
+void AnimationScheduler::EndFrame()
+{
+    for (auto& scheduledModel : mModels)
+    {
+        if (scheduledModel.updateThisFrame)
+        {
+            SamplePose(scheduledModel);
+            scheduledModel.framesSinceUpdate = 0;
+            scheduledModel.updateTime = 0;
+
+            // Models updated every frame show their real pose, otherwise start moving from the previous pose towards this one
+            if (scheduledModel.period == 1 || mBlend == EAnimationBlend::Hold)  continue;
+        }
+        else if (mBlend == EAnimationBlend::Hold)
+        {
+            continue; // Model already holds its last updated pose
+        }
+
+        // Interpolate from the previous pose to the latest one, reaching it just as the next update is due
+        float t = static_cast<float>(scheduledModel.framesSinceUpdate) / scheduledModel.period;
+        if (t > 1.0f)  t = 1.0f; // The period may have got shorter since the last update
+        for (unsigned int node = 1; node < scheduledModel.currentMatrices.size(); ++node)
+        {
+            const NodePose& from = scheduledModel.previousPose[node];
+            const NodePose& to   = scheduledModel.currentPose[node];
+            CQuaternion rotation = Slerp(from.rotation, to.rotation, t);
+            CVector3    position = from.position + (to.position - from.position) * t;
+            CVector3    scale    = from.scale    + (to.scale    - from.scale   ) * t;
+
+            CMatrix4x4 matrix = MatrixFromQuaternion(rotation);
+            matrix.SetRow(0, matrix.GetRow(0) * scale.x);
+            matrix.SetRow(1, matrix.GetRow(1) * scale.y);
+            matrix.SetRow(2, matrix.GetRow(2) * scale.z);
+            matrix.SetRow(3, position);
+            scheduledModel.model->SetWorldMatrix(matrix, node);
+        }
+        scheduledModel.interpolated = true;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private members
+//--------------------------------------------------------------------------------------
+
+// Store the model's matrices as its latest pose, the existing latest pose becomes the previous one
+void AnimationScheduler::SamplePose(ScheduledModel& scheduledModel)
+{
+    Model* model = scheduledModel.model;
+    unsigned int numNodes = model->NumberNodes();
+
+    scheduledModel.previousPose.swap(scheduledModel.currentPose);
+    scheduledModel.currentPose.resize(numNodes);
+    scheduledModel.currentMatrices.resize(numNodes);
+    for (unsigned int node = 1; node < numNodes; ++node)
+    {
+        CMatrix4x4 matrix = model->WorldMatrix(node);
+        scheduledModel.currentMatrices[node] = matrix;
+
+        // Decompose once here rather than on every interpolated frame
+        NodePose& pose = scheduledModel.currentPose[node];
+        pose.rotation = QuaternionFromMatrix(matrix);
+        pose.position = matrix.GetPosition();
+        pose.scale    = matrix.GetScale();
+    }
+}
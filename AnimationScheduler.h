@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// Class that schedules how often each animated model is updated
+//--------------------------------------------------------------------------------------
+// Distant characters don't need to be re-posed every frame. Each model is given an update period (every frame, every 2nd,
+// every 4th frame...) based on its distance from the camera. Updates are staggered so models with the same period are
+// updated on different frames, which keeps the animation cost per frame flat rather than spiking every few frames.
+// On frames a model is not updated its pose is either held or interpolated between the last two updated poses.
+
+#include "Common.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CQuaternion.h"
+
+#include <vector>
+
+#ifndef _ANIMATION_SCHEDULER_H_INCLUDED_
+#define _ANIMATION_SCHEDULER_H_INCLUDED_
+
+class Model;
+
+// What a model shows on frames it is not updated
+enum class EAnimationBlend : int
+{
+	Hold = 1,       // Keep the last updated pose. Cheapest, motion is visibly steppy at longer periods
+	Interpolate = 2 // Blend between the last two updated poses. Smooth, but the pose lags by up to one period
+};
+
+
+class AnimationScheduler
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Models closer than fullRateDistance are updated every frame. Each time the distance doubles beyond that the update period
+	// doubles, up to maxPeriod frames (rounded up to a power of 2)
+	AnimationScheduler(float fullRateDistance = 100.0f, unsigned int maxPeriod = 8, EAnimationBlend blend = EAnimationBlend::Interpolate);
+
+
+	// Add a model to be scheduled, returns a handle used for the functions below. The model's current pose is the first sample
+	unsigned int Add(Model* model);
+
+
+	// Call at the start of each frame's update, before any models are animated. Chooses the update period of each model from
+	// its distance to the given camera position and decides which models are updated this frame. Models being updated are
+	// returned to their last updated pose, ready to be animated
+	void BeginFrame(const CVector3& cameraPosition, float frameTime);
+
+	// Whether the given model should be animated this frame. Animate it using UpdateTime rather than the frame time
+	bool IsUpdateFrame(unsigned int handle)  { return mModels[handle].updateThisFrame; }
+
+	// Time passed since the given model was last updated (seconds) - pass this to the animation on update frames
+	float UpdateTime(unsigned int handle)  { return mModels[handle].updateTime; }
+
+	// Call after all models have been animated for this frame. Stores the new pose of updated models and sets the pose of
+	// the other models according to the blend setting
+	void EndFrame();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Getters / setters
+	unsigned int UpdatePeriod(unsigned int handle)  { return mModels[handle].period; }
+	unsigned int NumUpdated()  { return mNumUpdated; } // Number of models updated in the current / last frame
+
+	EAnimationBlend Blend()  { return mBlend; }
+	void SetBlend(EAnimationBlend blend)  { mBlend = blend; }
+
+	void SetFullRateDistance(float fullRateDistance)  { mFullRateDistance = fullRateDistance; }
+
+
+//-------------------------------------
+// Private members
+//-------------------------------------
+private:
+	// A node's transform split into parts that can be interpolated
+	struct NodePose
+	{
+		CQuaternion rotation;
+		CVector3    position;
+		CVector3    scale;
+	};
+
+	struct ScheduledModel
+	{
+		Model*       model;
+		unsigned int period;            // Update every this many frames
+		unsigned int phase;             // Offset from the frame counter, spreads the updates of models with the same period
+		unsigned int framesSinceUpdate; // Used to find how far between the last two poses to interpolate
+		float        updateTime;        // Time passed since the last update
+		bool         updateThisFrame;
+		bool         interpolated;      // Showing a pose between the last two updates rather than the latest one
+
+		// The last two updated poses. The root node is not included - it positions the whole model so is never interpolated
+		std::vector<NodePose>   previousPose;
+		std::vector<NodePose>   currentPose;
+		std::vector<CMatrix4x4> currentMatrices; // The latest updated pose as matrices, restored before animating the model
+	};
+
+	// Store the model's matrices as its latest pose, the existing latest pose becomes the previous one
+	void SamplePose(ScheduledModel& scheduledModel);
+
+
+	float           mFullRateDistance;
+	unsigned int    mMaxPeriod;
+	EAnimationBlend mBlend;
+
+	std::vector<ScheduledModel> mModels;
+
+	unsigned int mFrame;      // Frame counter, used with the phase of each model to decide when to update it
+	unsigned int mNumUpdated;
+};
+
+
+#endif //_ANIMATION_SCHEDULER_H_INCLUDED_
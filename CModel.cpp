@@ -164,11 +164,11 @@ CModel::~CModel() // Deletes everything
 	}
 }
 
-void CModel::SetMesh(std::string mesh, bool requireTangent) // Sets The mesh, and if the tangent is required or not
+void CModel::SetMesh(std::string mesh, bool requireTangent, ENodeImport nodeImport) // Sets The mesh, if the tangent is required or not, and how its nodes are imported
 {
 	delete mMesh; // Deletes previous mesh
 	delete mModel; // Deletes previous model
-	mMesh = new Mesh(mesh, requireTangent); // Sets the mesh
+	mMesh = new Mesh(mesh, requireTangent, MAX_BONES, nodeImport); // Sets the mesh
 	mModel = new Model(mMesh); // Creates the model
 }
 
@@ -228,17 +228,32 @@ void CModel::SetSampler(ESamplerType type) // Sets the sampler type using enum c
 	}
 }
 
+bool CModel::IsTransparent() // True if the model uses a blending state
+{
+	return mBlendState != gNoBlendingState;
+}
+
 void CModel::Render() // Renders everything with the correct settings
 {
-	mSetVSShader(mVertexShader);
-	
-	mSetPSShader(mPixelShader);                 // PS Shader
-	
-	SetBlendState(mBlendState);                // Blend State
-	SetDepthStencilState(mDepthStencilState);  // Depth Stencil
-	SetRasterizerState(mRasterizerState);      // Rat State
-	
-	if (mDiffusesMapSRVs.empty())
+	Render(nullptr);
+}
+
+unsigned int CModel::Render(const CModel* previous) // Renders, only setting the states that differ from the previous model
+{
+	unsigned int skipped = 0;
+
+	if (!previous || previous->mVertexShader != mVertexShader)  mSetVSShader(mVertexShader);  else ++skipped; // VS Shader
+	if (!previous || previous->mPixelShader  != mPixelShader)   mSetPSShader(mPixelShader);   else ++skipped; // PS Shader
+
+	if (!previous || previous->mBlendState        != mBlendState)         SetBlendState(mBlendState);               else ++skipped; // Blend State
+	if (!previous || previous->mDepthStencilState != mDepthStencilState)  SetDepthStencilState(mDepthStencilState); else ++skipped; // Depth Stencil
+	if (!previous || previous->mRasterizerState   != mRasterizerState)    SetRasterizerState(mRasterizerState);     else ++skipped; // Rat State
+
+	if (previous && previous->mDiffuseMapSRV == mDiffuseMapSRV && previous->mDiffusesMapSRVs == mDiffusesMapSRVs)
+	{
+		++skipped;
+	}
+	else if (mDiffusesMapSRVs.empty())
 	{
 		SetPSShaderResource(mDiffuseMapSRV);		 
 	}
@@ -246,9 +261,10 @@ void CModel::Render() // Renders everything with the correct settings
 	{
 		SetPSShaderResource(mDiffusesMapSRVs);
 	}
-	SetSampler(mSamplerState);                 // Samplers
+	if (!previous || previous->mSamplerState != mSamplerState)  SetSampler(mSamplerState);  else ++skipped; // Samplers
 
 	mModel->Render(); // Render
+	return skipped;
 }
 
 void CModel::LoadAllTextures(std::vector<std::string> textures) // Function to load all the textures in an array
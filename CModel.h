@@ -5,6 +5,7 @@
 #include "Model.h"
 #include "CTexture.h"
 #include "GraphicsHelpers.h"
+#include "StateCache.h"
 
 // Class has some bugs so may not always be the best to use it
 // -- Texture array doesn't work properly (For two textures, you need an array size of 3 because it skips the second element in the array)
@@ -68,7 +69,7 @@ public:
 	// Setters
 	void SetName(std::string name) { mName = name; }
 
-	void SetMesh(std::string mesh, bool requireTangent = false);
+	void SetMesh(std::string mesh, bool requireTangent = false, ENodeImport nodeImport = ENodeImport::Hierarchy);
 	
 	void SetMesh(Mesh* mesh)
 	{
@@ -104,50 +105,68 @@ public:
 	CVector3 GetRotation(int node = 0) { return mModel->Rotation(node); }
 	CVector3 GetScale(int node = 0) { return mModel->Scale(node); }
 	Model* GetModel() { return mModel; }
+	Mesh* GetMesh() { return mMesh; }
 	std::string GetName() { return mName; }
 
+	// Getters used to sort draws (see RenderQueue)
+	ID3D11VertexShader*       GetVSShader()          { return mVertexShader; }
+	ID3D11PixelShader*        GetPSShader()          { return mPixelShader; }
+	ID3D11BlendState*         GetBlendState()        { return mBlendState; }
+	ID3D11DepthStencilState*  GetDepthStencilState() { return mDepthStencilState; }
+	ID3D11RasterizerState*    GetRasterizerState()   { return mRasterizerState; }
+	ID3D11SamplerState*       GetSamplerState()      { return mSamplerState; }
+	ID3D11ShaderResourceView* GetDiffuseMapSRV()     { return mDiffusesMapSRVs.empty() ? mDiffuseMapSRV : mDiffusesMapSRVs[0]; }
+	bool IsTransparent(); // True if the model uses a blending state
+
 	
 	void Render(); // Render Function
 
+	// Number of states set by the render functions: shaders (2), blend, depth stencil, rasterizer, textures, sampler
+	static const unsigned int NUM_RENDER_STATES = 7;
+
+	// Render straight after the given model, only setting the states that differ from it. The states must not have been
+	// changed since that model was rendered. Pass nullptr to set every state. Returns the number of state changes skipped
+	unsigned int Render(const CModel* previous);
+
 private:
 
 	// Private setter functions (Used for rendering)
 	void mSetShaders(ID3D11VertexShader* vs, ID3D11PixelShader* ps)
 	{
-		gD3DContext->VSSetShader(vs, nullptr, 0);
-		gD3DContext->PSSetShader(ps, nullptr, 0);
+		gStateCache.VSSetShader(vs);
+		gStateCache.PSSetShader(ps);
 	}
-	void mSetVSShader(ID3D11VertexShader* vs) { gD3DContext->VSSetShader(vs, nullptr, 0); }
-	void mSetPSShader(ID3D11PixelShader* ps) { gD3DContext->PSSetShader(ps, nullptr, 0); }
+	void mSetVSShader(ID3D11VertexShader* vs) { gStateCache.VSSetShader(vs); }
+	void mSetPSShader(ID3D11PixelShader* ps) { gStateCache.PSSetShader(ps); }
 
 	void SetStates(ID3D11BlendState* blend, ID3D11DepthStencilState* depthStencil, ID3D11RasterizerState* rasterizerState)
 	{
-		gD3DContext->OMSetBlendState(blend, nullptr, 0xffffff);
-		gD3DContext->OMSetDepthStencilState(depthStencil, 0);
-		gD3DContext->RSSetState(rasterizerState);
+		gStateCache.OMSetBlendState(blend);
+		gStateCache.OMSetDepthStencilState(depthStencil);
+		gStateCache.RSSetState(rasterizerState);
 	}
-	void SetBlendState       (ID3D11BlendState* blend)                { gD3DContext->OMSetBlendState(blend, nullptr, 0xffffff); }
-	void SetDepthStencilState(ID3D11DepthStencilState* depthStencil)  { gD3DContext->OMSetDepthStencilState(depthStencil, 0); }
-	void SetRasterizerState  (ID3D11RasterizerState* rasterizerState) { gD3DContext->RSSetState(rasterizerState); }
+	void SetBlendState       (ID3D11BlendState* blend)                { gStateCache.OMSetBlendState(blend); }
+	void SetDepthStencilState(ID3D11DepthStencilState* depthStencil)  { gStateCache.OMSetDepthStencilState(depthStencil); }
+	void SetRasterizerState  (ID3D11RasterizerState* rasterizerState) { gStateCache.RSSetState(rasterizerState); }
 
 	void SetPSShaderResource(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* shaderResourceView)
 	{
-		gD3DContext->PSSetShaderResources(StartSlot, NumViews, &shaderResourceView);
+		gRenderBackend->PSSetShaderResources(StartSlot, NumViews, &shaderResourceView);
 	}
 	void SetPSShaderResource(ID3D11ShaderResourceView* shaderResourceView) 
 	{
-		gD3DContext->PSSetShaderResources(0, 1, &shaderResourceView);
+		gRenderBackend->PSSetShaderResources(0, 1, &shaderResourceView);
 	}
 	
 	void SetPSShaderResource(std::vector<ID3D11ShaderResourceView*> shaderResourceView)
 	{
 		for (int i = 0; i < mDiffusesMapSRVs.size(); ++i)
 		{
-			gD3DContext->PSSetShaderResources(i, 1, &mDiffusesMapSRVs[i]);
+			gRenderBackend->PSSetShaderResources(i, 1, &mDiffusesMapSRVs[i]);
 		}
 	}
 
-	void SetSampler(ID3D11SamplerState* state) { gD3DContext->PSSetSamplers(0, 1, &state); }
+	void SetSampler(ID3D11SamplerState* state) { gStateCache.PSSetSampler(0, state); }
 
 	// Used for loading an array of functions
 	void LoadAllTextures(std::vector<std::string> textures);
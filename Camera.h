@@ -3,9 +3,9 @@
 //--------------------------------------------------------------------------------------
 // Holds position, rotation, near/far clip and field of view. These to a view and projection matrices as required
 
-#include "Common.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CFrustum.h"
 #include "MathHelpers.h"
 #include "Input.h"
 
@@ -43,9 +43,10 @@ public:
 	void SetPosition(CVector3 position)  { mPosition = position; }
 	void SetRotation(CVector3 rotation)  { mRotation = rotation; }
 
-	float FOV()       { return mFOVx;     }
-	float NearClip()  { return mNearClip; }
-	float FarClip()   { return mFarClip;  }
+	float FOV()          { return mFOVx;        }
+	float AspectRatio()  { return mAspectRatio; }
+	float NearClip()     { return mNearClip;    }
+	float FarClip()      { return mFarClip;     }
 
 	void SetFOV     (float fov     )  { mFOVx     = fov;      }
 	void SetNearClip(float nearClip)  { mNearClip = nearClip; }
@@ -57,6 +58,9 @@ public:
 	CMatrix4x4 ProjectionMatrix()      { UpdateMatrices(); return mProjectionMatrix;     }
 	CMatrix4x4 ViewProjectionMatrix()  { UpdateMatrices(); return mViewProjectionMatrix; }
 
+	// The volume the camera can see, for culling (see CFrustum.h)
+	CFrustum Frustum()  { return CFrustum(ViewProjectionMatrix()); }
+
 	
 //-------------------------------------
 // Private members
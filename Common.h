@@ -8,10 +8,13 @@
 #include <windows.h>
 #include <d3d11.h>
 #include <string>
+#include <cstdint>
 
 #include "CVector2.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "CDualQuaternion.h"
 
 
 //--------------------------------------------------------------------------------------
@@ -38,9 +41,8 @@ extern ID3D11RenderTargetView* gBackBufferRenderTarget;  // Back buffer is where
 extern ID3D11DepthStencilView* gDepthStencil;            // The depth buffer contains a depth for each back buffer pixel
 extern ID3D11ShaderResourceView* gDepthShaderView;
 
-// Input constsnts
-extern const float ROTATION_SPEED;
-extern const float MOVEMENT_SPEED;
+// Input constants (ROTATION_SPEED and MOVEMENT_SPEED)
+#include "ControlSpeeds.h"
 
 
 // A global error message to help track down fatal errors - set it to a useful message
@@ -54,6 +56,9 @@ extern std::string gLastError;
 //--------------------------------------------------------------------------------------
 // Variables sent over to the GPU each frame
 
+// Most shadow cascades of a directional light (see ShadowCascades.h)
+static const int MAX_SHADOW_CASCADES = 4;
+
 // Data that remains constant for an entire frame, updated from C++ to the GPU shaders *once per frame*
 // We hold them together in a structure and send the whole thing to a "constant buffer" on the GPU each frame when
 // we have finished updating the scene. There is a structure in the shader code that exactly matches this one
@@ -65,95 +70,120 @@ struct PerFrameConstants
     CMatrix4x4 projectionMatrix;
     CMatrix4x4 viewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    CVector3   light1Position; // 3 floats: x, y z
-    float      viewportWidth;       // Pad above variable to float4 (HLSL requirement - which we must duplicate in this the C++ version of the structure)
-    CVector3   light1Colour;
+    float      viewportWidth;
     float      viewportHeight;
-    CVector3   light1Facing;
-    float      light1CosHalfAngle;
-    CMatrix4x4 light1ViewMatrix;
-    CMatrix4x4 light1ProjectionMatrix;
-    int        light1Type; // Used for setting the light type
-    CVector3   padding3;
-
-    CVector3   light2Position;
-    float      padding4;
-    CVector3   light2Colour;
-    float      padding5;
-    CVector3   light2Facing;
-    float      light2CosHalfAngle;
-    CMatrix4x4 light2ViewMatrix;
-    CMatrix4x4 light2ProjectionMatrix;
-    int        light2Type;
-    CVector3   padding6;
-
-    CVector3   light3Position;
-    float      padding7;
-    CVector3   light3Colour;
-    float      padding8;
-    CVector3   light3Facing;
-    float      light3CosHalfAngle;
-    CMatrix4x4 light3ViewMatrix;
-    CMatrix4x4 light3ProjectionMatrix;
-    int        light3Type;
-    CVector3   padding9;
-
-    CVector3   light4Position;
-    float      padding10;
-    CVector3   light4Colour;
-    float      padding11;
-    CVector3   light4Facing;
-    float      light4CosHalfAngle;
-    CMatrix4x4 light4ViewMatrix;
-    CMatrix4x4 light4ProjectionMatrix;
-    int        light4Type;
-    CVector3   padding12;
-
-    CVector3   light5Position;
-    float      padding13;
-    CVector3   light5Colour;
-    float      padding14;
-    CVector3   light5Facing;
-    float      light5CosHalfAngle;
-    CMatrix4x4 light5ViewMatrix;
-    CMatrix4x4 light5ProjectionMatrix;
-    int        light5Type;
-    CVector3   padding15;
+    int        numLights; // Number of lights in the light buffer (see LightManager.h)
+    float      padding3;  // Pad above variables to float4 (HLSL requirement - which we must duplicate in this the C++ version of the structure)
 
     CVector3   ambientColour;
-    float      specularPower;
+    float      padding16; // Specular power is now in PerMaterialConstants
 
     CVector3   cameraPosition;
     float      frameTime;
 
     float      wiggle; // Used for controlling the wiggle variable C++ (CPU) side
-    float      parallaxDepth; // Used for setting the parallx depth  C++ (CPU) side
+    float      padding18;     // Parallax depth is now in PerMaterialConstants
     float      pad; // Padding variables (hlsl requires everything to be grouped in fours otherwise there is weird graphical errors
     float      pad2;
 
     CVector3   outlineColour;    // Cell shading outline colour
     float      outlineThickness; // Cell shading outline thickness
+
+    int        clusterCountX;     // Light clusters across, down and in depth, 0 if clustered lighting is not in use (see LightClusters.h)
+    int        clusterCountY;
+    int        clusterCountZ;
+    float      clusterDepthScale; // Depth slice of view space depth z is log(z) * clusterDepthScale + clusterDepthBias
+    float      clusterDepthBias;
+    CVector3   padding20;
+
+    CMatrix4x4 shadowCascadeMatrices[MAX_SHADOW_CASCADES];   // View-projection matrix of each cascade of the directional light's shadows
+    float      shadowCascadeUVRects[MAX_SHADOW_CASCADES][4]; // Each cascade's tile of the shadow atlas: UV offset x, y and scale x, y. Scale is 0 if it has no tile
+    int        numShadowCascades;                            // 0 if no directional light has shadows
+    int        shadowCascadeLight;                           // Index in the light buffer of the light using the cascades, -1 if none
+    CVector2   padding21;
 };
 
 extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU-side constant buffer described above
 extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
 
+// One light in the light buffer, which holds all the lights in the scene (see LightManager.h). Lights are not kept in this
+// form on the CPU, they are only packed like this to send to the GPU. Matches the Light structure in Lighting.hlsli
+struct PackedLight
+{
+    CVector3   position;
+    int        type;
+    CVector3   colour;
+    float      cosHalfAngle;
+    CVector3   facing;
+    float      range;                // Distance beyond which the light has no effect
+    CMatrix4x4 viewProjectionMatrix; // For spotlight shadows
+    CVector2   shadowUVOffset;       // Tile of the shadow atlas holding the spotlight's shadows, as an offset and scale
+    CVector2   shadowUVScale;        // from shadow map UVs to atlas UVs. Scale is 0 if the light has no tile
+};
+
 
 
 static const int MAX_BONES = 64;
 
+// Most lights a model is lit by when per-object light lists are used (see LightSelector.h). A multiple of 4 to match the
+// uint4 array in the shaders
+static const int MAX_OBJECT_LIGHTS = 8;
+
 // This is the matrix that positions the next thing to be rendered in the scene. Unlike the structure above this data can be
-// updated and sent to the GPU several times every frame (once per model). However, apart from that it works in the same way.
+// updated and sent to the GPU several times every frame (once per model, or per node of a rigid mesh). However, apart from
+// that it works in the same way. It is kept small as it is sent so often - the bone palette and material are separate below
 struct PerModelConstants
 {
     CMatrix4x4 worldMatrix;
     CVector3   objectColour; // Allows each light model to be tinted to match the light colour they cast
     float      padding17;
-    CMatrix4x4 boneMatrices[MAX_BONES]; /*** MISSING - fill in this array size - easy. Relates to another MISSING*/
+
+    int        numObjectLights; // Number of lights in objectLights, or -1 to use the scene's lights (see Model::SetObjectLights)
+    CVector3   padding21;
+    uint32_t   objectLights[MAX_OBJECT_LIGHTS]; // Indexes into the light buffer
 };
 extern PerModelConstants gPerModelConstants;      // This variable holds the CPU-side constant buffer described above
 extern ID3D11Buffer*     gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
 
+// Bone palette for skinned meshes, sent for each sub-mesh. Only as many bones as the sub-mesh uses are sent (see Mesh::Render)
+struct PerSkeletonConstants
+{
+    union // Format depends on the skinning mode of the mesh (see Mesh.h)
+    {
+        CMatrix3x4      boneMatrices[MAX_BONES];        // Compact 3x4 form of each bone matrix (see CMatrix3x4.h)
+        CDualQuaternion boneDualQuaternions[MAX_BONES]; // Dual quaternion for each bone, relative to the world matrix in PerModelConstants
+    };
+};
+extern PerSkeletonConstants gPerSkeletonConstants;
+extern ID3D11Buffer*        gPerSkeletonConstantBuffer;
+
+// Surface settings for the next thing to be rendered. Set these like the object colour above before rendering, they are only
+// sent to the GPU when they differ from those last sent (see Mesh::Render)
+struct PerMaterialConstants
+{
+    float    specularPower; // Specular power controls shininess
+    float    parallaxDepth; // Depth of the surface for parallax mapping
+    CVector2 padding19;
+};
+extern PerMaterialConstants gPerMaterialConstants;
+extern ID3D11Buffer*        gPerMaterialConstantBuffer;
+
+// The material constants last sent to the GPU, so they are only sent again when they change (see Mesh::Render). Call
+// Invalidate if the buffer may no longer hold them, e.g. after rendering through another backend
+class MaterialConstantsCache
+{
+public:
+    // Send gPerMaterialConstants to the GPU and bind them if they differ from those last sent
+    void Update();
+
+    void Invalidate()  { mHasSent = false; }
+
+private:
+    PerMaterialConstants mSentConstants;
+    bool                 mHasSent = false;
+};
+extern MaterialConstantsCache gMaterialConstantsCache;
+
 struct PostProcessingConstants // From future module (post processing lab)
 {
     // Tint post-process settings
@@ -35,8 +35,7 @@ struct SkinningVertex
     float3 normal   : normal;
     float2 uv       : uv;
     uint4  bones    : bones;   // This is the first time we have used integers in a shader: these are indexes into the list of nodes for the skeleton
-	//*** MISSING - below the "xxxxxx" should be the correct type for the bone weights
-	uint4 weights   : weights;
+    float4 weights  : weights; // Weights are floats in the vertex buffer (see Mesh.cpp)
 };
 
 //*******************
@@ -122,6 +121,8 @@ struct VertexOut
 // They are called constants but that only means they are constant for the duration of a single GPU draw call.
 // These "constants" correspond to variables in C++ that we will change per-model, or per-frame etc.
 
+static const int MAX_SHADOW_CASCADES = 4; // Must match Common.h
+
 // In this exercise the matrices used to position the camera are updated from C++ to GPU every frame along with lighting information
 // These variables must match exactly the gPerFrameConstants structure in Scene.cpp
 cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer the number 0 - used in the C++ code
@@ -131,80 +132,44 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
     float4x4 gProjectionMatrix;
     float4x4 gViewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    float3   gLight1Position; // 3 floats: x, y z
-    float    gViewportWidth; // Pad above variable to float4 (HLSL requirement - copied in the the C++ version of this structure)
-    float3   gLight1Colour;
+    float    gViewportWidth;
     float    gViewportHeight;
-    float3   gLight1Facing;
-    float    gLight1CosHalfAngle;
-    float4x4 gLight1ViewMatrix;
-    float4x4 gLight1ProjectionMatrix;
-    int      gLight1Type;
-    float3   padding3;
-    
-    float3   gLight2Position;
-    float    padding4;
-    float3   gLight2Colour;
-    float    padding5;
-    float3   gLight2Facing;
-    float    gLight2CosHalfAngle;
-    float4x4 gLight2ViewMatrix;
-    float4x4 gLight2ProjectionMatrix;
-    int      gLight2Type;
-    float3   padding6;
-    
-    float3   gLight3Position;
-    float    padding7;
-    float3   gLight3Colour;
-    float    padding8;
-    float3   gLight3Facing;
-    float    gLight3CosHalfAngle;
-    float4x4 gLight3ViewMatrix;
-    float4x4 gLight3ProjectionMatrix;
-    int      gLight3Type;
-    float3   padding9;
-
-    float3   gLight4Position;
-    float    padding10;
-    float3   gLight4Colour;
-    float    padding11;
-    float3   gLight4Facing;
-    float    gLight4CosHalfAngle;
-    float4x4 gLight4ViewMatrix;
-    float4x4 gLight4ProjectionMatrix;
-    int      gLight4Type;
-    float3   padding12;
-    
-    float3 gLight5Position;
-    float padding13;
-    float3 gLight5Colour;
-    float padding14;
-    float3 gLight5Facing;
-    float gLight5CosHalfAngle;
-    float4x4 gLight5ViewMatrix;
-    float4x4 gLight5ProjectionMatrix;
-    int gLight5Type;
-    float3 padding15;
-    
+    int      gNumLights; // Number of lights in gLights (see Lighting.hlsli)
+    float    padding3;   // Pad above variables to float4 (HLSL requirement - copied in the the C++ version of this structure)
+
     float3   gAmbientColour;
-    float    gSpecularPower;
+    float    padding16; // Specular power is now in PerMaterialConstants
 
     float3   gCameraPosition;
     float    gFrameTime;
     
     float    gWiggle;
-    float    gParallaxDepth;
+    float    padding18; // Parallax depth is now in PerMaterialConstants
     float    pad;
     float    pad2;
     
     float3 gOutlineColour; 
     float  gOutlineThickness; 
+
+    int    gClusterCountX; // Light clusters across, down and in depth, 0 if clustered lighting is not in use (see Lighting.hlsli)
+    int    gClusterCountY;
+    int    gClusterCountZ;
+    float  gClusterDepthScale;
+    float  gClusterDepthBias;
+    float3 padding20;
+
+    float4x4 gShadowCascadeMatrices[MAX_SHADOW_CASCADES]; // Cascades of the directional light's shadows, see Lighting.hlsli
+    float4   gShadowCascadeUVRects[MAX_SHADOW_CASCADES];  // Tile of the shadow atlas for each cascade: UV offset in xy, scale in zw
+    int      gNumShadowCascades;
+    int      gShadowCascadeLight; // Index in gLights of the directional light using the cascades, -1 if none
+    float2   padding21;
 }
 // Note constant buffers are not structs: we don't use the name of the constant buffer, these are really just a collection of global variables (hence the 'g')
 
 
 
 static const int MAX_BONES = 64;//*** MISSING - what is the maximum number of bones expected? Relates to a MISSING elsewhere
+static const int MAX_OBJECT_LIGHTS = 8; // Must match Common.h, a multiple of 4
 
 // If we have multiple models then we need to update the world matrix from C++ to GPU multiple times per frame because we
 // only have one world matrix here. Because this data is updated more frequently it is kept in a different buffer for better performance.
@@ -217,7 +182,32 @@ cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer th
     float3   gObjectColour;
     float    padding17;  // See notes on padding in structure above
 
-    float4x4 gBoneMatrices[MAX_BONES];
+    int      gNumObjectLights; // Number of lights in gObjectLights, or -1 to use the scene's lights (see Lighting.hlsli)
+    float3   padding21;
+    uint4    gObjectLights[MAX_OBJECT_LIGHTS / 4]; // Indexes into gLights, four to each element
+}
+
+// Bone palette of a skinned mesh, sent for each sub-mesh. Kept apart from the world matrix so models without bones only send
+// the small buffer above
+cbuffer PerSkeletonConstants : register(b2)
+{
+    // Bone matrices are sent in compact 3x4 form (the right-hand column of an affine matrix is always 0,0,0,1 so it is not sent)
+    // Only the bones used by the current mesh are updated, the rest of this array holds garbage
+    // Shaders that define DUAL_QUATERNION_SKINNING before including this file get dual quaternions instead, two float4s
+    // per bone (real part then dual part). These are relative to gWorldMatrix. Same memory as the matrices on the C++ side
+#ifdef DUAL_QUATERNION_SKINNING
+    float4 gBoneDualQuaternions[MAX_BONES * 2];
+#else
+    row_major float3x4 gBoneMatrices[MAX_BONES];
+#endif
+}
+
+// Surface settings, which rarely change between models so are only sent when they do
+cbuffer PerMaterialConstants : register(b3)
+{
+    float  gSpecularPower;
+    float  gParallaxDepth;
+    float2 padding19;
 }
 
 cbuffer PostProcessingConstants : register(b1)
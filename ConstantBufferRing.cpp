@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Large constant buffer that per-draw constants are written into one after another
+//--------------------------------------------------------------------------------------
+
+#include "ConstantBufferRing.h"
+
+
+// Create the buffer using gRenderBackend. If the backend does not support constant buffer offsets the ring is not
+// used and this still succeeds. Returns false on failure
+bool ConstantBufferRing::Init()
+{
+	if (!gRenderBackend->SupportsConstantBufferOffsets())  return true;
+
+	RenderBufferDesc bufferDesc;
+	bufferDesc.type = ERenderBufferType::Constant;
+	bufferDesc.usage = ERenderBufferUsage::Dynamic;
+	bufferDesc.size = static_cast<unsigned int>(mAllocator.Size());
+	if (!gRenderBackend->CreateBuffer(bufferDesc, nullptr, &mBuffer))
+	{
+		mBuffer = nullptr;
+		return false;
+	}
+
+	mAllocator.Reset();
+	mNeedsDiscard = true;
+	return true;
+}
+
+
+// Release the buffer using gRenderBackend, so call before the backend is destroyed. The ring is not used after this
+void ConstantBufferRing::Release()
+{
+	if (mBuffer)  gRenderBackend->ReleaseBuffer(mBuffer);
+	mBuffer = nullptr;
+}
+
+
+// Write constants to the ring and bind them to the given slot of the vertex shader, and pixel shader if requested.
+// Returns false if the ring is not in use or the constants are too large, nothing is done in that case
+bool ConstantBufferRing::SetConstants(unsigned int slot, const void* data, size_t size, bool pixelShader)
+{
+	if (mBuffer == nullptr || size > RENDER_MAX_CONSTANT_BUFFER_RANGE)  return false;
+
+	// When the ring is full discard the buffer - the driver keeps the old memory for draws still using it - and start again
+	size_t offset = mAllocator.Allocate(size);
+	if (offset == RingAllocator::ALLOCATION_FAILED)
+	{
+		mAllocator.Reset();
+		offset = mAllocator.Allocate(size);
+		mNeedsDiscard = true;
+		++mNumDiscards;
+	}
+
+	gRenderBackend->WriteBuffer(mBuffer, offset, data, size, mNeedsDiscard);
+	mNeedsDiscard = false;
+
+	// Ranges are given in constants (16 bytes), the size is rounded up to the allocation size
+	unsigned int firstConstant = static_cast<unsigned int>(offset / 16);
+	unsigned int numConstants  = static_cast<unsigned int>((size + mAllocator.Alignment() - 1) / mAllocator.Alignment() * (mAllocator.Alignment() / 16));
+	gRenderBackend->VSSetConstantBuffers1(slot, 1, &mBuffer, &firstConstant, &numConstants);
+	if (pixelShader)  gRenderBackend->PSSetConstantBuffers1(slot, 1, &mBuffer, &firstConstant, &numConstants);
+	return true;
+}
+
+
+// Write constants for the next draw and bind them to the given slot of the vertex shader, and pixel shader if requested.
+// Uses gConstantBufferRing if it is in use, otherwise updates and binds the given constant buffer
+void SetDrawConstants(RenderBuffer* buffer, unsigned int slot, const void* data, size_t size, bool pixelShader)
+{
+	if (gConstantBufferRing.SetConstants(slot, data, size, pixelShader))  return;
+
+	gRenderBackend->UpdateBuffer(buffer, data, size);
+	gRenderBackend->VSSetConstantBuffers(slot, 1, &buffer);
+	if (pixelShader)  gRenderBackend->PSSetConstantBuffers(slot, 1, &buffer);
+}
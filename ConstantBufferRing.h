@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Large constant buffer that per-draw constants are written into one after another
+//--------------------------------------------------------------------------------------
+// Updating a small constant buffer with discard for every draw makes the driver find new memory for the buffer each
+// time. Instead each draw's constants are written to the next free part of one large buffer (without discard, so
+// nothing is renamed) and that part of the buffer is bound using Direct3D 11.1 constant buffer offsets. Space is
+// handed out by a RingAllocator and reused three frames later, when the GPU has finished with it. If the ring fills
+// up, the whole buffer is discarded once and the ring starts again.
+//
+// Needs Direct3D 11.1 (see RenderBackend::SupportsConstantBufferOffsets). Without it the ring is not created and
+// SetDrawConstants updates and binds the ordinary constant buffer passed to it instead
+
+#ifndef _CONSTANT_BUFFER_RING_H_INCLUDED_
+#define _CONSTANT_BUFFER_RING_H_INCLUDED_
+
+#include "RenderBackend.h"
+#include "RingAllocator.h"
+
+
+class ConstantBufferRing
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Pass the size of the buffer in bytes. The buffer is created by Init
+	ConstantBufferRing(size_t size)  : mAllocator(size, 256 /*bytes, the offset granularity*/, 3 /*frames in flight*/) {}
+
+	// Create the buffer using gRenderBackend. If the backend does not support constant buffer offsets the ring is not
+	// used and this still succeeds. Returns false on failure
+	bool Init();
+
+	// Release the buffer using gRenderBackend, so call before the backend is destroyed. The ring is not used after this
+	void Release();
+
+	// Write constants to the ring and bind them to the given slot of the vertex shader, and pixel shader if requested.
+	// Returns false if the ring is not in use or the constants are too large, nothing is done in that case
+	bool SetConstants(unsigned int slot, const void* data, size_t size, bool pixelShader);
+
+	// Call at the end of each frame, after Present
+	void EndFrame()  { mAllocator.EndFrame(); }
+
+	// Start the ring again, discarding the buffer on the next write. Call if frames were ended without the GPU seeing them
+	// (e.g. rendered through another backend), the space they freed may still be in use by frames the GPU has been sent
+	void Invalidate()  { mAllocator.Reset(); mNeedsDiscard = true; }
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Times the ring filled up and the buffer was discarded, since the statistics were last reset
+	unsigned int NumDiscards()  { return mNumDiscards; }
+	void ResetStatistics()  { mNumDiscards = 0; }
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	RingAllocator mAllocator;
+	RenderBuffer* mBuffer = nullptr;
+	bool          mNeedsDiscard = true; // The first write to a buffer must discard
+
+	unsigned int mNumDiscards = 0;
+};
+
+
+// Write constants for the next draw and bind them to the given slot of the vertex shader, and pixel shader if requested.
+// Uses gConstantBufferRing if it is in use, otherwise updates and binds the given constant buffer
+void SetDrawConstants(RenderBuffer* buffer, unsigned int slot, const void* data, size_t size, bool pixelShader);
+
+
+// The ring used by the app (in Scene.cpp)
+extern ConstantBufferRing gConstantBufferRing;
+
+
+#endif //_CONSTANT_BUFFER_RING_H_INCLUDED_
@@ -0,0 +1,14 @@
+//--------------------------------------------------------------------------------------
+// Speeds for keyboard control of the camera and models
+//--------------------------------------------------------------------------------------
+// Separate from Common.h so the camera builds without the Windows and Direct3D headers (e.g. for the tests)
+
+#ifndef _CONTROL_SPEEDS_H_INCLUDED_
+#define _CONTROL_SPEEDS_H_INCLUDED_
+
+// Defined in Scene.cpp (and Tests.cpp)
+extern const float ROTATION_SPEED; // Radians per second
+extern const float MOVEMENT_SPEED; // Units per second
+
+
+#endif //_CONTROL_SPEEDS_H_INCLUDED_
@@ -0,0 +1,426 @@
+//--------------------------------------------------------------------------------------
+// Checks and a benchmark for the frustum culling maths (see CFrustum.h)
+//--------------------------------------------------------------------------------------
+
+#include "CullingBenchmark.h"
+#include "Camera.h"
+#include "CFrustum.h"
+#include "CConvexVolume.h"
+#include "CBoundingVolumes.h"
+#include "SceneBVH.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+
+namespace
+{
+    // A frustum to check and the matrix it was extracted from
+    struct TestFrustum
+    {
+        std::string name;
+        CMatrix4x4  viewProjectionMatrix;
+        CFrustum    frustum;
+    };
+
+    // An orthographic projection of the given width, height and depth range, like a directional light's shadow map uses
+    CMatrix4x4 OrthographicMatrix(float width, float height, float nearClip, float farClip)
+    {
+        CMatrix4x4 m = MatrixIdentity();
+        m.e00 = 2.0f / width;
+        m.e11 = 2.0f / height;
+        m.e22 = 1.0f / (farClip - nearClip);
+        m.e32 = -nearClip / (farClip - nearClip);
+        return m;
+    }
+
+    // A random point inside a box
+    CVector3 RandomPointIn(const CAABB& box)
+    {
+        return { Random(box.minimum.x, box.maximum.x), Random(box.minimum.y, box.maximum.y), Random(box.minimum.z, box.maximum.z) };
+    }
+}
+
+
+// Check the frustum tests against several camera, spotlight and orthographic frustums, then time them. Writes a report to
+// the given stream and returns the number of checks failed
+unsigned int RunCullingBenchmark(std::ostream& report, unsigned int numVolumes /*= 10000*/, unsigned int numRepeats /*= 100*/)
+{
+    numVolumes = std::max(numVolumes, 4u) | 3; // Not a multiple of 4, so the batch tests finish with some single tests
+
+    // Frustums from cameras, a spotlight and an orthographic light
+    std::vector<TestFrustum> frustums;
+    auto addFrustum = [&](const std::string& name, const CMatrix4x4& viewProjectionMatrix)
+    {
+        frustums.push_back({ name, viewProjectionMatrix, CFrustum(viewProjectionMatrix) });
+    };
+    Camera sceneCamera({ 0, 0, 0 }, { 0, 0, 0 }, ToRadians(60), 16.0f / 9.0f, 1.0f, 1000.0f);
+    Camera turnedCamera({ 50, 20, -30 }, { 0.3f, 1.2f, 0.1f }, ToRadians(90), 4.0f / 3.0f, 0.1f, 10000.0f);
+    Camera narrowCamera({ -200, 0, 500 }, { 0, PI, 0 }, ToRadians(10), 1.0f, 10.0f, 2000.0f);
+    addFrustum("camera",         sceneCamera.ViewProjectionMatrix());
+    addFrustum("turned camera",  turnedCamera.ViewProjectionMatrix());
+    addFrustum("narrow camera",  narrowCamera.ViewProjectionMatrix());
+    Camera spotlightCamera({ 30, 200, -100 }, { ToRadians(40), ToRadians(-30), 0 }, ToRadians(90), 1.0f);
+    CMatrix4x4 lightMatrix = spotlightCamera.WorldMatrix();
+    addFrustum("spotlight",      spotlightCamera.ViewProjectionMatrix());
+    addFrustum("orthographic",   InverseAffine(lightMatrix) * OrthographicMatrix(400, 300, -500, 500));
+
+    report.precision(3);
+    report << std::fixed;
+    report << "Culling checks and benchmark: " << frustums.size() << " frustums, " << numVolumes << " volumes, " << numRepeats << " repeats\n";
+    unsigned int numFailures = 0;
+
+    //-----------------------------------
+    // Known cases, for the scene camera looking down z from the origin with clip distances 1 to 1000
+
+    struct KnownCase { CVector3 centre; float size; bool visible; const char* description; };
+    const KnownCase knownCases[] =
+    {
+        { {     0,    0,  100 },  1, true,  "in front"               },
+        { {     0,    0, -100 },  1, false, "behind"                 },
+        { {     0,    0, 1200 }, 10, false, "beyond far clip"        },
+        { {     0,    0,  995 }, 10, true,  "across far clip"        },
+        { {     0,    0, -0.5f }, 2, true,  "across near clip"       },
+        { {     0,    0,  0.5f }, 0.1f, false, "before near clip"    },
+        { { -1000,    0,  100 },  1, false, "left"                   },
+        { {  1000,    0,  100 },  1, false, "right"                  },
+        { {     0,  500,  100 },  1, false, "above"                  },
+        { {     0, -500,  100 },  1, false, "below"                  },
+        { {    57,    0,  100 },  2, true,  "across right side"      },
+    };
+    const CFrustum& cameraFrustum = frustums[0].frustum;
+    for (auto& knownCase : knownCases)
+    {
+        CVector3 extents = { knownCase.size, knownCase.size, knownCase.size };
+        bool sphereVisible = cameraFrustum.Intersects(CSphere{ knownCase.centre, knownCase.size });
+        bool boxVisible    = cameraFrustum.Intersects(CAABB{ knownCase.centre - extents, knownCase.centre + extents });
+        bool orientedVisible = cameraFrustum.Intersects(COBB(CAABB{ knownCase.centre - extents, knownCase.centre + extents }, MatrixIdentity()));
+        if (sphereVisible != knownCase.visible || boxVisible != knownCase.visible || orientedVisible != knownCase.visible)
+        {
+            report << "  FAILED known case: " << knownCase.description << "\n";
+            ++numFailures;
+        }
+    }
+
+    //-----------------------------------
+    // Random volumes around the frustums
+
+    std::vector<float> sphereX(numVolumes), sphereY(numVolumes), sphereZ(numVolumes), sphereRadius(numVolumes);
+    std::vector<float> minX(numVolumes), minY(numVolumes), minZ(numVolumes), maxX(numVolumes), maxY(numVolumes), maxZ(numVolumes);
+    std::vector<CSphere> spheres(numVolumes);
+    std::vector<CAABB>   boxes(numVolumes);
+    for (unsigned int i = 0; i < numVolumes; ++i)
+    {
+        CVector3 centre = { Random(-1500, 1500), Random(-500, 500), Random(-500, 1500) };
+        float size = Random(0.5f, 50);
+        spheres[i] = { centre, size };
+        sphereX[i] = centre.x;  sphereY[i] = centre.y;  sphereZ[i] = centre.z;  sphereRadius[i] = size;
+
+        CVector3 extents = { Random(0.5f, 50), Random(0.5f, 50), Random(0.5f, 50) };
+        boxes[i] = { centre - extents, centre + extents };
+        minX[i] = boxes[i].minimum.x;  minY[i] = boxes[i].minimum.y;  minZ[i] = boxes[i].minimum.z;
+        maxX[i] = boxes[i].maximum.x;  maxY[i] = boxes[i].maximum.y;  maxZ[i] = boxes[i].maximum.z;
+    }
+    std::vector<uint8_t> sphereVisible(numVolumes), boxVisible(numVolumes);
+
+    for (auto& test : frustums)
+    {
+        const CFrustum& frustum = test.frustum;
+        unsigned int planeFailures = 0, batchFailures = 0, conservativeFailures = 0;
+
+        // Plane extraction: points near the sides are skipped, rounding can put them either side
+        const CMatrix4x4& m = test.viewProjectionMatrix;
+        for (unsigned int i = 0; i < numVolumes; ++i)
+        {
+            CVector3 p = { sphereX[i], sphereY[i], sphereZ[i] };
+            float x = p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30;
+            float y = p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31;
+            float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+            float w = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+            float margin = std::min(std::min(w - std::abs(x), w - std::abs(y)), std::min(z, w - z));
+            if (std::abs(margin) < 1e-4f * (std::abs(w) + 1))  continue;
+            if (frustum.Contains(p) != (margin > 0))  ++planeFailures;
+        }
+
+        // Batch tests against single tests
+        frustum.TestSpheres(sphereX.data(), sphereY.data(), sphereZ.data(), sphereRadius.data(), numVolumes, sphereVisible.data());
+        frustum.TestAABBs(minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data(), numVolumes, boxVisible.data());
+        for (unsigned int i = 0; i < numVolumes; ++i)
+        {
+            if ((sphereVisible[i] != 0) != frustum.Intersects(spheres[i]))  ++batchFailures;
+            if ((boxVisible[i]    != 0) != frustum.Intersects(boxes[i]))    ++batchFailures;
+        }
+        for (unsigned int i = 0; i + 4 <= numVolumes; i += 4)
+        {
+            int sphereMask = frustum.TestSpheres4(&sphereX[i], &sphereY[i], &sphereZ[i], &sphereRadius[i]);
+            int boxMask    = frustum.TestAABBs4(&minX[i], &minY[i], &minZ[i], &maxX[i], &maxY[i], &maxZ[i]);
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (((sphereMask >> lane) & 1) != sphereVisible[i + lane])  ++batchFailures;
+                if (((boxMask    >> lane) & 1) != boxVisible[i + lane])     ++batchFailures;
+            }
+        }
+
+        // Volumes reported not visible must have no points in the frustum. Oriented boxes are the random boxes turned about
+        // their centres, points are tested in the box's own space
+        for (unsigned int i = 0; i < numVolumes; ++i)
+        {
+            CMatrix4x4 rotation = MatrixRotationZ(Random(-PI, PI)) * MatrixRotationX(Random(-PI, PI)) * MatrixRotationY(Random(-PI, PI));
+            CVector3 boxCentre = boxes[i].Centre();
+            CAABB localBox = { boxes[i].minimum - boxCentre, boxes[i].maximum - boxCentre };
+            rotation.SetRow(3, boxCentre);
+            bool orientedVisible = frustum.Intersects(COBB(localBox, rotation));
+            if (sphereVisible[i] && boxVisible[i] && orientedVisible)  continue;
+
+            for (int sample = 0; sample < 16; ++sample)
+            {
+                CVector3 sphereOffset = RandomPointIn({ { -1, -1, -1 }, { 1, 1, 1 } });
+                if (Length(sphereOffset) > 1)  sphereOffset = Normalise(sphereOffset);
+                if (!sphereVisible[i] && frustum.Contains(spheres[i].centre + sphereOffset * spheres[i].radius))  ++conservativeFailures;
+                if (!boxVisible[i] && frustum.Contains(RandomPointIn(boxes[i])))  ++conservativeFailures;
+                if (!orientedVisible && frustum.Contains(rotation.TransformPoint(RandomPointIn(localBox))))  ++conservativeFailures;
+            }
+        }
+
+        unsigned int numSpheresVisible = static_cast<unsigned int>(std::count(sphereVisible.begin(), sphereVisible.end(), 1));
+        unsigned int numBoxesVisible   = static_cast<unsigned int>(std::count(boxVisible.begin(),    boxVisible.end(),    1));
+        report << "  " << test.name << ": " << numSpheresVisible << " spheres and " << numBoxesVisible << " boxes visible";
+        if (planeFailures + batchFailures + conservativeFailures == 0)
+        {
+            report << ", checks passed\n";
+        }
+        else
+        {
+            report << ", FAILED " << planeFailures << " plane, " << batchFailures << " batch and "
+                   << conservativeFailures << " conservative checks\n";
+        }
+        numFailures += planeFailures + batchFailures + conservativeFailures;
+    }
+
+    //-----------------------------------
+    // Scene BVH (see SceneBVH.h): the queries must find exactly the boxes that testing every box finds, after building,
+    // after boxes move (refit and partial rebuilds) and after boxes are removed (full rebuild)
+
+    SceneBVH bvh;
+    for (auto& box : boxes)  bvh.Add(box); // Ids are 0 to numVolumes - 1 in a new BVH
+    bvh.Update();
+    std::vector<uint8_t> present(numVolumes, 1);
+    std::vector<unsigned int> found, expected;
+    std::vector<std::pair<float, unsigned int>> rayHits;
+    unsigned int bvhFailures = 0;
+    auto checkBVH = [&]()
+    {
+        for (auto& test : frustums)
+        {
+            bvh.QueryFrustum(test.frustum, found);
+            expected.clear();
+            for (unsigned int id = 0; id < numVolumes; ++id)
+            {
+                if (present[id] && test.frustum.Intersects(bvh.Bounds(id)))  expected.push_back(id);
+            }
+            std::sort(found.begin(), found.end());
+            if (found != expected)  ++bvhFailures;
+        }
+        for (int query = 0; query < 20; ++query)
+        {
+            CSphere sphere = { { Random(-1500, 1500), Random(-500, 500), Random(-500, 1500) }, Random(10, 300) };
+            bvh.QuerySphere(sphere, found);
+            expected.clear();
+            for (unsigned int id = 0; id < numVolumes; ++id)
+            {
+                if (present[id] && Intersects(sphere, bvh.Bounds(id)))  expected.push_back(id);
+            }
+            std::sort(found.begin(), found.end());
+            if (found != expected)  ++bvhFailures;
+
+            // Rays return the nearest first, boxes at the same distance can come in any order so compare distances
+            CVector3 origin = sphere.centre;
+            CVector3 direction = Normalise(RandomPointIn({ { -1, -1, -1 }, { 1, 1, 1 } }));
+            CVector3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+            bvh.QueryRay(origin, direction, 2000, found);
+            rayHits.clear();
+            float distance;
+            for (unsigned int id = 0; id < numVolumes; ++id)
+            {
+                if (present[id] && RayIntersects(origin, inverseDirection, 2000, bvh.Bounds(id), distance))  rayHits.push_back({ distance, id });
+            }
+            std::sort(rayHits.begin(), rayHits.end());
+            if (found.size() != rayHits.size())
+            {
+                ++bvhFailures;
+                continue;
+            }
+            for (unsigned int i = 0; i < found.size(); ++i)
+            {
+                RayIntersects(origin, inverseDirection, 2000, bvh.Bounds(found[i]), distance);
+                if (distance != rayHits[i].first)  ++bvhFailures;
+            }
+        }
+    };
+    checkBVH();
+    unsigned int numBVHNodes = bvh.NumNodes();
+
+    for (unsigned int id = 0; id < numVolumes; id += 4)
+    {
+        CVector3 move = { Random(-200, 200), Random(-200, 200), Random(-200, 200) };
+        bvh.SetBounds(id, { bvh.Bounds(id).minimum + move, bvh.Bounds(id).maximum + move });
+    }
+    bvh.Update();
+    unsigned int numNodesRebuilt = bvh.NumNodesRebuilt();
+    checkBVH();
+
+    for (unsigned int id = 0; id < numVolumes; id += 10)
+    {
+        bvh.Remove(id);
+        present[id] = 0;
+    }
+    bvh.Update();
+    checkBVH();
+
+    report << "  BVH: " << numBVHNodes << " nodes for " << numVolumes << " boxes, " << numNodesRebuilt
+           << " rebuilt after moving a quarter of them";
+    if (bvhFailures == 0)  report << ", checks passed\n";
+    else                   report << ", FAILED " << bvhFailures << " checks\n";
+    numFailures += bvhFailures;
+
+    //-----------------------------------
+    // Several views at once (see SceneBVH::QueryVolumes): the camera's view and shadow views for a spotlight, a point light
+    // and a directional light. The masks must match testing every box against every volume, and each shadow caster volume
+    // must contain all the lines from its light to points in the camera's view
+
+    struct ShadowView { CVector3 light; bool directional; const CFrustum* lightFrustum; };
+    CVector3 spotlightPosition = lightMatrix.GetPosition();
+    const ShadowView shadowViews[] =
+    {
+        { spotlightPosition,      false, &frustums[3].frustum }, // Spotlight
+        { lightMatrix.GetZAxis(), true,  &frustums[4].frustum }, // Directional light, orthographic shadow map
+        { { 0, 0, 100 },          false, &frustums[1].frustum }, // Light in the camera's view, the volume is the view
+        { { 0, 50, -300 },        false, &frustums[2].frustum }, // Light behind the camera
+    };
+    std::vector<CConvexVolume> views = { CConvexVolume(cameraFrustum) };
+    unsigned int multiViewFailures = 0;
+    CVector3 cameraCorners[8];
+    cameraFrustum.GetCorners(cameraCorners);
+    for (auto& shadowView : shadowViews)
+    {
+        CConvexVolume view(*shadowView.lightFrustum);
+        view.AddShadowCasterPlanes(cameraFrustum, shadowView.light, shadowView.directional);
+        views.push_back(view);
+
+        // Points on lines from the light to the view, allowing for rounding near the planes
+        CConvexVolume casters;
+        casters.AddShadowCasterPlanes(cameraFrustum, shadowView.light, shadowView.directional);
+        for (int sample = 0; sample < 1000; ++sample)
+        {
+            float u = Random(0, 1), v = Random(0, 1), w = Random(0, 1);
+            CVector3 nearPoint = (cameraCorners[0] * (1 - u) + cameraCorners[1] * u) * (1 - v) + (cameraCorners[2] * (1 - u) + cameraCorners[3] * u) * v;
+            CVector3 farPoint  = (cameraCorners[4] * (1 - u) + cameraCorners[5] * u) * (1 - v) + (cameraCorners[6] * (1 - u) + cameraCorners[7] * u) * v;
+            CVector3 viewPoint = nearPoint * (1 - w) + farPoint * w;
+            float t = Random(0, 1);
+            CVector3 linePoint = shadowView.directional ? viewPoint - shadowView.light * (t * 2000)
+                                                        : shadowView.light + (viewPoint - shadowView.light) * t;
+            for (int i = 0; i < casters.numPlanes; ++i)
+            {
+                if (casters.planes[i].Distance(linePoint) < -0.01f * (1 + Length(linePoint)))
+                {
+                    ++multiViewFailures;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> viewMasks;
+    bvh.QueryVolumes(views.data(), static_cast<unsigned int>(views.size()), viewMasks);
+    unsigned int numCasters = 0;
+    for (unsigned int id = 0; id < numVolumes; ++id)
+    {
+        uint32_t expectedMask = 0;
+        for (unsigned int v = 0; v < views.size(); ++v)
+        {
+            if (present[id] && views[v].Intersects(bvh.Bounds(id)))  expectedMask |= 1u << v;
+        }
+        if (viewMasks[id] != expectedMask)  ++multiViewFailures;
+        if (viewMasks[id] & 2)  ++numCasters;
+    }
+    unsigned int numInSpotlight = 0;
+    for (unsigned int id = 0; id < numVolumes; ++id)
+    {
+        if (present[id] && frustums[3].frustum.Intersects(bvh.Bounds(id)))  ++numInSpotlight;
+    }
+
+    report << "  Views: " << views.size() << " culled together, " << numCasters << " of the " << numInSpotlight
+           << " boxes in the spotlight can shadow the camera's view";
+    if (multiViewFailures == 0)  report << ", checks passed\n";
+    else                         report << ", FAILED " << multiViewFailures << " checks\n";
+    numFailures += multiViewFailures;
+
+    //-----------------------------------
+    // Timing with the scene camera
+
+    Timer timer;
+    unsigned int checkSum = 0; // Results are summed so the compiler can't remove the work being timed
+
+    timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        for (auto& sphere : spheres)  checkSum += cameraFrustum.Intersects(sphere) ? 1 : 0;
+    }
+    float singleSphereTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        checkSum += cameraFrustum.TestSpheres(sphereX.data(), sphereY.data(), sphereZ.data(), sphereRadius.data(), numVolumes, sphereVisible.data());
+    }
+    float batchSphereTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        for (auto& box : boxes)  checkSum += cameraFrustum.Intersects(box) ? 1 : 0;
+    }
+    float singleBoxTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        checkSum += cameraFrustum.TestAABBs(minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data(), numVolumes, boxVisible.data());
+    }
+    float batchBoxTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        bvh.QueryFrustum(cameraFrustum, found);
+        checkSum += static_cast<unsigned int>(found.size());
+    }
+    float bvhQueryTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        bvh.Update();
+    }
+    float bvhUpdateTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        bvh.QueryVolumes(views.data(), static_cast<unsigned int>(views.size()), viewMasks);
+        checkSum += viewMasks[r % numVolumes];
+    }
+    float multiViewTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        for (auto& view : views)
+        {
+            for (unsigned int id = 0; id < numVolumes; ++id)  checkSum += view.Intersects(bvh.Bounds(id)) ? 1 : 0;
+        }
+    }
+    float separateViewsTime = timer.GetLapTime();
+
+    // Report times in nanoseconds per volume
+    float scale = 1000000000.0f / (static_cast<float>(numRepeats) * numVolumes);
+    report << "  Spheres: " << singleSphereTime * scale << "ns each singly, " << batchSphereTime * scale << "ns each in batches\n";
+    report << "  Boxes:   " << singleBoxTime    * scale << "ns each singly, " << batchBoxTime    * scale << "ns each in batches\n";
+    report << "  BVH:     " << bvhQueryTime * scale << "ns each when queried, update " << bvhUpdateTime * 1000000 / numRepeats << "us\n";
+    report << "  " << views.size() << " views: " << multiViewTime * scale << "ns each with the BVH, "
+           << separateViewsTime * scale << "ns each testing every view\n";
+    report << "  " << (numFailures == 0 ? "All checks passed" : "SOME CHECKS FAILED") << " (checksum " << checkSum << ")\n";
+    return numFailures;
+}
@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Checks and a benchmark for the frustum culling maths (see CFrustum.h)
+//--------------------------------------------------------------------------------------
+
+#ifndef _CULLING_BENCHMARK_H_INCLUDED_
+#define _CULLING_BENCHMARK_H_INCLUDED_
+
+#include <ostream>
+
+
+// Check the frustum tests against several camera, spotlight and orthographic frustums, then time them. The checks are:
+// - spheres and boxes in known places relative to the camera give the expected results
+// - points are inside the extracted planes exactly when they are inside the clip space volume of the matrix
+// - the batch tests agree with the single volume tests for every volume, including counts that aren't a multiple of 4
+// - no volume reported as not visible has any point inside the frustum (for spheres, axis-aligned and oriented boxes)
+// - the scene BVH's frustum, sphere and ray queries find the same boxes as testing every box, after building, after boxes
+//   move and after boxes are removed
+// - culling several views in one pass down the BVH gives the same results as testing each view, and shadow caster volumes
+//   contain every line from their light to the camera's view
+// Then times testing random volumes one at a time, four at a time and with the BVH, for one view and several. Writes a
+// report of the results to the given stream and returns the number of checks failed (see Tests.cpp)
+unsigned int RunCullingBenchmark(std::ostream& report, unsigned int numVolumes = 10000, unsigned int numRepeats = 100);
+
+
+#endif //_CULLING_BENCHMARK_H_INCLUDED_
@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+// Render backend that passes calls on to Direct3D 11
+//--------------------------------------------------------------------------------------
+
+#include "D3D11RenderBackend.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+D3D11RenderBackend::D3D11RenderBackend(ID3D11Device* device, ID3D11DeviceContext* context, IDXGISwapChain* swapChain)
+	: mDevice(device), mContext(context), mSwapChain(swapChain)
+{
+	// Constant buffer offsets need a Direct3D 11.1 context, and the driver must allow constant buffers to be mapped without
+	// discard. Without both, constant buffers are only ever updated whole
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	mDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		if (FAILED(mContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&mContext1))))  mContext1 = nullptr;
+	}
+}
+
+D3D11RenderBackend::~D3D11RenderBackend()
+{
+	if (mContext1)  mContext1->Release();
+}
+
+
+bool D3D11RenderBackend::CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer)
+{
+	D3D11_BUFFER_DESC bufferDesc = BufferDesc(desc);
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = initialData;
+	return SUCCEEDED(mDevice->CreateBuffer(&bufferDesc, initialData != nullptr ? &data : nullptr, buffer));
+}
+
+void D3D11RenderBackend::ReleaseBuffer(RenderBuffer* buffer)
+{
+	if (buffer)  buffer->Release();
+}
+
+void D3D11RenderBackend::UpdateBuffer(RenderBuffer* buffer, const void* data, size_t size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(mContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return;
+	std::memcpy(mapped.pData, data, size);
+	mContext->Unmap(buffer, 0);
+}
+
+void D3D11RenderBackend::WriteBuffer(RenderBuffer* buffer, size_t offset, const void* data, size_t size, bool discard)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(mContext->Map(buffer, 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))  return;
+	std::memcpy(static_cast<char*>(mapped.pData) + offset, data, size);
+	mContext->Unmap(buffer, 0);
+}
+
+void D3D11RenderBackend::UpdateBufferRegion(RenderBuffer* buffer, size_t offset, const void* data, size_t size)
+{
+	D3D11_BOX box = { static_cast<UINT>(offset), 0, 0, static_cast<UINT>(offset + size), 1, 1 };
+	mContext->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
+
+
+void D3D11RenderBackend::VSSetShader(RenderVertexShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	mContext->VSSetShader(shader, classInstances, numClassInstances);
+}
+void D3D11RenderBackend::GSSetShader(RenderGeometryShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	mContext->GSSetShader(shader, classInstances, numClassInstances);
+}
+void D3D11RenderBackend::PSSetShader(RenderPixelShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	mContext->PSSetShader(shader, classInstances, numClassInstances);
+}
+
+void D3D11RenderBackend::VSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	mContext->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+void D3D11RenderBackend::GSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	mContext->GSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+void D3D11RenderBackend::PSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	mContext->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderBackend::VSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+                                               const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	mContext1->VSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+}
+void D3D11RenderBackend::PSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+                                               const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	mContext1->PSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+}
+
+void D3D11RenderBackend::PSSetShaderResources(unsigned int startSlot, unsigned int numViews, RenderShaderResourceView* const* views)
+{
+	mContext->PSSetShaderResources(startSlot, numViews, views);
+}
+void D3D11RenderBackend::PSSetSamplers(unsigned int startSlot, unsigned int numSamplers, RenderSamplerState* const* samplers)
+{
+	mContext->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void D3D11RenderBackend::OMSetBlendState(RenderBlendState* state, const float blendFactor[4], unsigned int sampleMask)
+{
+	mContext->OMSetBlendState(state, blendFactor, sampleMask);
+}
+void D3D11RenderBackend::OMSetDepthStencilState(RenderDepthStencilState* state, unsigned int stencilRef)
+{
+	mContext->OMSetDepthStencilState(state, stencilRef);
+}
+void D3D11RenderBackend::RSSetState(RenderRasterizerState* state)
+{
+	mContext->RSSetState(state);
+}
+void D3D11RenderBackend::RSSetViewports(unsigned int numViewports, const RenderViewport* viewports)
+{
+	D3D11_VIEWPORT d3dViewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+	numViewports = std::min(numViewports, static_cast<unsigned int>(D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE));
+	for (unsigned int i = 0; i < numViewports; ++i)  d3dViewports[i] = Viewport(viewports[i]);
+	mContext->RSSetViewports(numViewports, d3dViewports);
+}
+
+
+void D3D11RenderBackend::IASetInputLayout(RenderInputLayout* layout)
+{
+	mContext->IASetInputLayout(layout);
+}
+void D3D11RenderBackend::IASetPrimitiveTopology(ERenderTopology topology)
+{
+	mContext->IASetPrimitiveTopology(Topology(topology));
+}
+void D3D11RenderBackend::IASetVertexBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	mContext->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+void D3D11RenderBackend::IASetIndexBuffer(RenderBuffer* buffer, ERenderIndexFormat format, unsigned int offset)
+{
+	mContext->IASetIndexBuffer(buffer, IndexFormat(format), offset);
+}
+
+void D3D11RenderBackend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	mContext->Draw(vertexCount, startVertex);
+}
+void D3D11RenderBackend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	mContext->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+
+void D3D11RenderBackend::OMSetRenderTargets(unsigned int numViews, RenderTargetView* const* renderTargets, RenderDepthStencilView* depthStencil)
+{
+	mContext->OMSetRenderTargets(numViews, renderTargets, depthStencil);
+}
+void D3D11RenderBackend::ClearRenderTargetView(RenderTargetView* renderTarget, const float colour[4])
+{
+	mContext->ClearRenderTargetView(renderTarget, colour);
+}
+void D3D11RenderBackend::ClearDepthStencilView(RenderDepthStencilView* depthStencil, unsigned int clearFlags, float depth, uint8_t stencil)
+{
+	mContext->ClearDepthStencilView(depthStencil, ClearFlags(clearFlags), depth, stencil);
+}
+
+void D3D11RenderBackend::Present(unsigned int syncInterval, unsigned int flags)
+{
+	mSwapChain->Present(syncInterval, flags);
+}
+
+
+//-------------------------------------
+// Conversions
+//-------------------------------------
+
+D3D11_BUFFER_DESC D3D11RenderBackend::BufferDesc(const RenderBufferDesc& desc)
+{
+	static const UINT bindFlags[] = { D3D11_BIND_VERTEX_BUFFER, D3D11_BIND_INDEX_BUFFER, D3D11_BIND_CONSTANT_BUFFER, D3D11_BIND_SHADER_RESOURCE };
+	bool dynamic    = desc.usage == ERenderBufferUsage::Dynamic;
+	bool structured = desc.type == ERenderBufferType::Structured;
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags           = bindFlags[static_cast<int>(desc.type)];
+	bufferDesc.ByteWidth           = desc.size;
+	bufferDesc.Usage               = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	bufferDesc.CPUAccessFlags      = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+	bufferDesc.MiscFlags           = structured ? D3D11_RESOURCE_MISC_BUFFER_STRUCTURED : 0;
+	bufferDesc.StructureByteStride = structured ? desc.elementSize : 0;
+	return bufferDesc;
+}
+
+D3D11_VIEWPORT D3D11RenderBackend::Viewport(const RenderViewport& viewport)
+{
+	return { viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth };
+}
+
+D3D11_PRIMITIVE_TOPOLOGY D3D11RenderBackend::Topology(ERenderTopology topology)
+{
+	switch (topology)
+	{
+		case ERenderTopology::PointList:     return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+		case ERenderTopology::LineList:      return D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+		case ERenderTopology::TriangleList:  return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		case ERenderTopology::TriangleStrip: return D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+	}
+	return D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+}
+
+DXGI_FORMAT D3D11RenderBackend::IndexFormat(ERenderIndexFormat format)
+{
+	return format == ERenderIndexFormat::UInt16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+UINT D3D11RenderBackend::ClearFlags(unsigned int clearFlags)
+{
+	return ((clearFlags & RENDER_CLEAR_DEPTH)   ? D3D11_CLEAR_DEPTH   : 0) |
+	       ((clearFlags & RENDER_CLEAR_STENCIL) ? D3D11_CLEAR_STENCIL : 0);
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Render backend that passes calls on to Direct3D 11
+//--------------------------------------------------------------------------------------
+// The handles in RenderTypes.h are the Direct3D objects themselves so they are passed on as they are, the descriptions
+// and values are converted to their Direct3D equivalents here. This is the only backend code that needs the Windows SDK
+
+#ifndef _D3D11_RENDER_BACKEND_H_INCLUDED_
+#define _D3D11_RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderBackend.h"
+
+#include <d3d11_1.h>
+
+
+// Backend that passes every call on to a Direct3D 11 device, context and swap chain
+class D3D11RenderBackend : public RenderBackend
+{
+public:
+	D3D11RenderBackend(ID3D11Device* device, ID3D11DeviceContext* context, IDXGISwapChain* swapChain);
+	~D3D11RenderBackend();
+
+	bool CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) override;
+	void ReleaseBuffer(RenderBuffer* buffer) override;
+	void UpdateBuffer(RenderBuffer* buffer, const void* data, size_t size) override;
+	void WriteBuffer(RenderBuffer* buffer, size_t offset, const void* data, size_t size, bool discard) override;
+	void UpdateBufferRegion(RenderBuffer* buffer, size_t offset, const void* data, size_t size) override;
+	bool SupportsConstantBufferOffsets() override  { return mContext1 != nullptr; }
+
+	void VSSetShader(RenderVertexShader*   shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+	void GSSetShader(RenderGeometryShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+	void PSSetShader(RenderPixelShader*    shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+
+	void VSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+	void GSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+	void PSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+
+	void VSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                           const unsigned int* firstConstants, const unsigned int* numConstants) override;
+	void PSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                           const unsigned int* firstConstants, const unsigned int* numConstants) override;
+
+	void PSSetShaderResources(unsigned int startSlot, unsigned int numViews, RenderShaderResourceView* const* views) override;
+	void PSSetSamplers(unsigned int startSlot, unsigned int numSamplers, RenderSamplerState* const* samplers) override;
+
+	void OMSetBlendState(RenderBlendState* state, const float blendFactor[4], unsigned int sampleMask) override;
+	void OMSetDepthStencilState(RenderDepthStencilState* state, unsigned int stencilRef) override;
+	void RSSetState(RenderRasterizerState* state) override;
+	void RSSetViewports(unsigned int numViewports, const RenderViewport* viewports) override;
+
+	void IASetInputLayout(RenderInputLayout* layout) override;
+	void IASetPrimitiveTopology(ERenderTopology topology) override;
+	void IASetVertexBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers, const unsigned int* strides, const unsigned int* offsets) override;
+	void IASetIndexBuffer(RenderBuffer* buffer, ERenderIndexFormat format, unsigned int offset) override;
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+
+	void OMSetRenderTargets(unsigned int numViews, RenderTargetView* const* renderTargets, RenderDepthStencilView* depthStencil) override;
+	void ClearRenderTargetView(RenderTargetView* renderTarget, const float colour[4]) override;
+	void ClearDepthStencilView(RenderDepthStencilView* depthStencil, unsigned int clearFlags, float depth, uint8_t stencil) override;
+
+	void Present(unsigned int syncInterval, unsigned int flags) override;
+
+	// Conversions from the types in RenderTypes.h
+	static D3D11_BUFFER_DESC        BufferDesc(const RenderBufferDesc& desc);
+	static D3D11_VIEWPORT           Viewport(const RenderViewport& viewport);
+	static D3D11_PRIMITIVE_TOPOLOGY Topology(ERenderTopology topology);
+	static DXGI_FORMAT              IndexFormat(ERenderIndexFormat format);
+	static UINT                     ClearFlags(unsigned int clearFlags);
+
+private:
+	ID3D11Device*        mDevice;
+	ID3D11DeviceContext* mContext;
+	IDXGISwapChain*      mSwapChain;
+
+	// Direct3D 11.1 context for constant buffer offsets, nullptr if not supported
+	ID3D11DeviceContext1* mContext1 = nullptr;
+};
+
+
+#endif //_D3D11_RENDER_BACKEND_H_INCLUDED_
@@ -5,6 +5,9 @@
 #include "Direct3DSetup.h"
 #include "Shader.h"
 #include "Common.h"
+#include "StateCache.h"
+#include "D3D11RenderBackend.h"
+#include <memory>
 #include <d3d11.h>
 #include <vector>
 
@@ -17,6 +20,10 @@
 // The main Direct3D (D3D) variables
 ID3D11Device*        gD3DDevice  = nullptr; // D3D device for overall features
 ID3D11DeviceContext* gD3DContext = nullptr; // D3D context for specific rendering tasks
+RenderBackend*       gRenderBackend = nullptr; // Rendering calls go through this, normally passed on to gD3DContext
+StateCache           gStateCache;              // Filters redundant state changes sent to gRenderBackend - use for shaders and states
+
+static std::unique_ptr<D3D11RenderBackend> gD3D11RenderBackend; // The backend normally used
 
 // Swap chain and back buffer
 IDXGISwapChain*         gSwapChain              = nullptr;
@@ -63,6 +70,9 @@ bool InitDirect3D()
         gLastError = "Error creating Direct3D device";
         return false;
     }
+    gD3D11RenderBackend.reset(new D3D11RenderBackend(gD3DDevice, gD3DContext, gSwapChain));
+    gRenderBackend = gD3D11RenderBackend.get();
+    gStateCache.SetContext(gRenderBackend);
 
 
     // Get a "render target view" of back-buffer - standard behaviour
@@ -145,7 +155,10 @@ void ShutdownDirect3D()
     {
         gD3DContext->ClearState(); // This line is also needed to reset the GPU before shutting down DirectX
         gD3DContext->Release();
+        gStateCache.SetContext(nullptr);
     }
+    gRenderBackend = nullptr;
+    gD3D11RenderBackend.reset();
     if (gDepthShaderView)        gDepthShaderView->Release();
     if (gDepthStencil)           gDepthStencil->Release();
     if (gDepthStencilTexture)    gDepthStencilTexture->Release();
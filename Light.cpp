@@ -3,6 +3,9 @@
 #include "Shader.h"
 #include "State.h"
 #include "Direct3DSetup.h"
+#include "StateCache.h"
+
+#include <algorithm>
 
 
 Light::Light() // Constructer that sets up the lights
@@ -17,13 +20,14 @@ Light::Light() // Constructer that sets up the lights
 	mSpotlightConeAngle = 90; // Sets the default cone angle
 
 	// Sets the default lighting data
-	mLightColour = Colour * Strength; 
-	mLightPosition = mModel->Position(); 
-	mLightFacing = Normalise(mModel->WorldMatrix().GetZAxis());
-	mLightCosHalfAngle = cos(ToRadians(mSpotlightConeAngle / 2));
-	mLightViewMatrix = CalculateLightViewMatrix();
-	mLightProjectionMatrix = CalculateLightProjectionMatrix();
-	mLightType = 0; // Sets default light type
+	mLightIndex = gLightManager.AddLight();
+	gLightManager.SetColour(mLightIndex, Colour * Strength);
+	gLightManager.SetPosition(mLightIndex, mModel->Position());
+	gLightManager.SetFacing(mLightIndex, Normalise(mModel->WorldMatrix().GetZAxis()));
+	gLightManager.SetCosHalfAngle(mLightIndex, cos(ToRadians(mSpotlightConeAngle / 2)));
+	gLightManager.SetViewMatrix(mLightIndex, CalculateLightViewMatrix());
+	gLightManager.SetProjectionMatrix(mLightIndex, CalculateLightProjectionMatrix());
+	gLightManager.SetType(mLightIndex, ELightType::Point); // Sets default light type
 	mEffectType = 0; // Sets default effect type
 }
 
@@ -38,50 +42,20 @@ Light::~Light() // Deletes everything
 
 void Light::RenderLightFromCamera() // Renders the lights from the camera
 {
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0); // VS Shader
-	gD3DContext->PSSetShader(gLightModelPixelShader, nullptr, 0); // PS Shader
+	gStateCache.VSSetShader(gBasicTransformVertexShader); // VS Shader
+	gStateCache.PSSetShader(gLightModelPixelShader); // PS Shader
 	
-	gD3DContext->PSSetShaderResources(0, 1, &mLightDiffuseMapSRV); // PS Shader Resources
-	gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler); // PS Sampler
+	gRenderBackend->PSSetShaderResources(0, 1, &mLightDiffuseMapSRV); // PS Shader Resources
+	gStateCache.PSSetSampler(0, gAnisotropic4xSampler); // PS Sampler
 
-	gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff); // Set BlendState
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);// Set DepthStencil
-	gD3DContext->RSSetState(gCullNoneState); // Set Cull State
+	gStateCache.OMSetBlendState(gAdditiveBlendingState); // Set BlendState
+	gStateCache.OMSetDepthStencilState(gDepthReadOnlyState);// Set DepthStencil
+	gStateCache.RSSetState(gCullNoneState); // Set Cull State
 
 	gPerModelConstants.objectColour = Colour; // SetColour
 	mModel->Render(); // Render
 }
 
-void Light::RenderDepthBufferFromLight()  // Renders the light from the depth buffer
-{
-	// Get camera-like matrices from the spotlight, seet in the constant buffer and send over to GPU
-	gPerFrameConstants.viewMatrix = CalculateLightViewMatrix();
-	gPerFrameConstants.projectionMatrix = CalculateLightProjectionMatrix();
-	gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
-	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
-
-	// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-	gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-	gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
-
-
-	//// Only render models that cast shadows ////
-
-	// Use special depth-only rendering shaders
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gDepthOnlyPixelShader, nullptr, 0);
-
-	// States - no blending, normal depth buffer and culling
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullFrontState);
-
-	// Render models (Get an array)
-}
-
-
-
-
 void Light::UpdateScene(float frameTime, Model* modelToObit) // If the light has an effect then this gets called in update scene 
 {
 	const float gLightOrbit = 20.0f;
@@ -152,6 +126,22 @@ void Light::UpdateScene(float frameTime, Model* modelToObit) // If the light has
 }
 
 
+void Light::SetPosition(CVector3 position) // Moves the light model and the light, the light's view matrix moves with it
+{
+	mModel->SetPosition(position);
+	gLightManager.SetPosition(mLightIndex, position);
+	gLightManager.SetViewMatrix(mLightIndex, CalculateLightViewMatrix());
+}
+
+void Light::SetFacing(CVector3 facing) // Turns the light model and the light, the light's view matrix turns with it
+{
+	CMatrix4x4 worldMatrix = mModel->WorldMatrix();
+	worldMatrix.FaceTarget(worldMatrix.GetPosition() + facing);
+	mModel->SetWorldMatrix(worldMatrix);
+	gLightManager.SetFacing(mLightIndex, Normalise(facing));
+	gLightManager.SetViewMatrix(mLightIndex, CalculateLightViewMatrix());
+}
+
 void Light::Render() // Renders the light
 {
 	mModel->Render();
@@ -167,3 +157,34 @@ CMatrix4x4 Light::CalculateLightProjectionMatrix()
 {
 	return MakeProjectionMatrix(1.0f, ToRadians(mSpotlightConeAngle));
 }
+
+// Get the frustums this light's shadow maps would be rendered from, for culling shadow casters. One for a spotlight, the
+// six faces of a cube around a point light (reaching as far as its light does) and none for a directional light, which
+// has no position to render from - its shadow cascades are fitted to the camera instead (see ShadowCascades.h). Returns
+// the number of frustums
+int Light::GetShadowFrustums(CFrustum frustums[6])
+{
+	ELightType type = gLightManager.Type(mLightIndex);
+	if (type == ELightType::Spot)
+	{
+		frustums[0] = GetLightFrustum();
+		return 1;
+	}
+	if (type != ELightType::Point)  return 0;
+
+	// Cube faces look along each axis in turn, the up direction only needs to be at right angles to the facing
+	const CVector3 facings[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const CVector3 ups[6]     = { { 0, 1, 0 }, {  0, 1, 0 }, { 0, 0,-1 }, { 0,  0, 1 }, { 0, 1, 0 }, {  0, 1,  0 } };
+	float range = std::min(std::max(gLightManager.Range(mLightIndex), 1.0f), 10000.0f);
+	CMatrix4x4 projectionMatrix = MakeProjectionMatrix(1.0f, ToRadians(90), 0.1f, range);
+	for (int face = 0; face < 6; ++face)
+	{
+		CMatrix4x4 faceMatrix = MatrixIdentity();
+		faceMatrix.SetRow(0, Cross(ups[face], facings[face]));
+		faceMatrix.SetRow(1, ups[face]);
+		faceMatrix.SetRow(2, facings[face]);
+		faceMatrix.SetRow(3, GetLightPosition());
+		frustums[face] = CFrustum(InverseAffine(faceMatrix) * projectionMatrix);
+	}
+	return 6;
+}
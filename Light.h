@@ -1,6 +1,8 @@
 #pragma once
 #include "Model.h"
 #include "Mesh.h"
+#include "LightManager.h"
+#include "CFrustum.h"
 
 class Light
 {
@@ -12,14 +14,8 @@ private:
 	ID3D11ShaderResourceView* mLightDiffuseMapSRV; // Stores the resource srv
 	float mSpotlightConeAngle; // Stores the code
 
-	// Scene Properties
-	CVector3 mLightColour; 
-	CVector3 mLightPosition;
-	CVector3 mLightFacing;
-	float mLightCosHalfAngle;
-	CMatrix4x4 mLightViewMatrix;
-	CMatrix4x4 mLightProjectionMatrix;
-	int mLightType;
+	// Scene Properties are kept in gLightManager, this is the light's index there
+	unsigned int mLightIndex;
 	int mEffectType;
 	
 	CVector3 Colour; 
@@ -31,29 +27,34 @@ public:
 	
 	// Public functions for rendering
 	void RenderLightFromCamera(); 
-	void RenderDepthBufferFromLight();
 	void Render();
 
 	// Public function for update scene
 	void UpdateScene(float frameTime, Model* modelToObit);
 	
 	// Setters
-	void SetLightColour(CVector3 lightColour) { Colour = lightColour; mLightColour = lightColour * Strength; }
-	void SetStrength(float strength) { Strength = strength; mLightColour = Colour * Strength;  }
-	void SetPosition(CVector3 position) { mModel->SetPosition(position); mLightPosition = position; }
+	void SetLightColour(CVector3 lightColour) { Colour = lightColour; gLightManager.SetColour(mLightIndex, lightColour * Strength); }
+	void SetStrength(float strength) { Strength = strength; gLightManager.SetColour(mLightIndex, Colour * Strength); }
+	void SetPosition(CVector3 position);
+	void SetFacing(CVector3 facing); // Direction a spotlight points or a directional light shines
 	void SetScale(float scale) { mModel->SetScale(scale); }
-	void SetType(int type) { mLightType = type; }
+	void SetType(int type) { gLightManager.SetType(mLightIndex, static_cast<ELightType>(type)); }
 	void SetEffect(int type) { mEffectType = type; }
+	void SetShadowTile(CVector2 uvOffset, CVector2 uvScale) { gLightManager.SetShadowTile(mLightIndex, uvOffset, uvScale); } // Where the light's shadow map is in the shadow atlas
 
 	// Getters
-	CVector3 GetLightColour() { return mLightColour; }
+	CVector3 GetLightColour() { return gLightManager.Colour(mLightIndex); }
 	float GetStrength() { return Strength; }
-	CVector3 GetLightPosition() { return mLightPosition; }
-	CVector3 GetLightFacing() { return mLightFacing; }
-	float GetLightCosHalfAngle() { return mLightCosHalfAngle; }
-	CMatrix4x4 GetLightViewMatrix() { return mLightViewMatrix; }
-	CMatrix4x4 GetLightProjectionMatrix() { return mLightProjectionMatrix; }
-	int GetLightType() { return mLightType; }
+	CVector3 GetLightPosition() { return gLightManager.Position(mLightIndex); }
+	CVector3 GetLightFacing() { return gLightManager.Facing(mLightIndex); }
+	float GetLightCosHalfAngle() { return gLightManager.CosHalfAngle(mLightIndex); }
+	float GetLightRange() { return gLightManager.Range(mLightIndex); }
+	CMatrix4x4 GetLightViewMatrix() { return gLightManager.ViewMatrix(mLightIndex); }
+	CMatrix4x4 GetLightProjectionMatrix() { return gLightManager.ProjectionMatrix(mLightIndex); }
+	CFrustum GetLightFrustum() { return CFrustum(GetLightViewMatrix() * GetLightProjectionMatrix()); } // Volume lit by a spotlight, for culling shadow casters
+	int GetShadowFrustums(CFrustum frustums[6]); // Views a shadow map would be rendered from, see Light.cpp
+	int GetLightType() { return static_cast<int>(gLightManager.Type(mLightIndex)); }
+	unsigned int GetLightIndex() { return mLightIndex; } // Index of the light in the shaders' light buffer
 	int GetEffect() { return mEffectType; }
 
 	// Helper functions
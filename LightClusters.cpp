@@ -0,0 +1,441 @@
+//--------------------------------------------------------------------------------------
+// Clustered lighting - lists of the lights affecting each part of the camera's view
+//--------------------------------------------------------------------------------------
+
+#include "LightClusters.h"
+#include "RenderBackend.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <emmintrin.h> // SSE2 intrinsics
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+
+// Smallest light index buffer created, the buffer doubles in size when more indices are needed
+static const unsigned int MIN_INDEX_BUFFER_CAPACITY = 4096;
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// Divide the view into the given number of clusters across, down and in depth. Binning is shared between the calling
+// thread and the given number of worker threads, -1 for one less than the number of CPU cores
+LightClusters::LightClusters(unsigned int numX, unsigned int numY, unsigned int numZ, int numWorkerThreads)
+	: mNumX(numX), mNumY(numY), mNumZ(numZ), mNextSlice(0)
+{
+	mSlices.resize(mNumZ);
+	mSliceDepths.resize(mNumZ + 1);
+	mClusters.resize(mNumX * mNumY * mNumZ);
+
+	// No point having more threads than slices
+	if (numWorkerThreads < 0)  numWorkerThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+	numWorkerThreads = std::min(numWorkerThreads, static_cast<int>(mNumZ) - 1);
+	for (int i = 0; i < numWorkerThreads; ++i)
+	{
+		mThreads.emplace_back(&LightClusters::WorkerThread, this);
+	}
+}
+
+LightClusters::~LightClusters()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mStartWork.notify_all();
+	for (auto& thread : mThreads)  thread.join();
+
+	Release();
+}
+
+
+// Bin the lights into the clusters of the given camera's view
+void LightClusters::Build(LightManager& lights, Camera& camera)
+{
+	// Exponential depth slices from the near to far clip
+	float nearClip = camera.NearClip();
+	float farClip  = camera.FarClip();
+	for (unsigned int z = 0; z <= mNumZ; ++z)
+	{
+		mSliceDepths[z] = nearClip * std::pow(farClip / nearClip, static_cast<float>(z) / mNumZ);
+	}
+	mDepthScale = mNumZ / std::log(farClip / nearClip);
+	mDepthBias  = -std::log(nearClip) * mDepthScale;
+
+	mTanHalfFOVx = std::tan(camera.FOV() * 0.5f);
+	mTanHalfFOVy = mTanHalfFOVx / camera.AspectRatio();
+
+	// Put the point and spot lights into view space
+	CMatrix4x4 viewMatrix = camera.ViewMatrix();
+	mLightX.clear();  mLightY.clear();  mLightZ.clear();  mLightRange.clear();
+	mConeX.clear();   mConeY.clear();   mConeZ.clear();   mConeCos.clear();  mConeSin.clear();
+	mIsCone.clear();  mLightIndex.clear();
+	mDirectionalLights.clear();
+	for (unsigned int light = 0; light < lights.NumLights(); ++light)
+	{
+		ELightType type = lights.Type(light);
+		if (type == ELightType::Directional)
+		{
+			mDirectionalLights.push_back(light);
+			continue;
+		}
+
+		const CVector3& p = lights.Position(light);
+		mLightX.push_back(p.x * viewMatrix.e00 + p.y * viewMatrix.e10 + p.z * viewMatrix.e20 + viewMatrix.e30);
+		mLightY.push_back(p.x * viewMatrix.e01 + p.y * viewMatrix.e11 + p.z * viewMatrix.e21 + viewMatrix.e31);
+		mLightZ.push_back(p.x * viewMatrix.e02 + p.y * viewMatrix.e12 + p.z * viewMatrix.e22 + viewMatrix.e32);
+		mLightRange.push_back(lights.Range(light));
+		mLightIndex.push_back(light);
+
+		if (type == ELightType::Spot)
+		{
+			const CVector3& f = lights.Facing(light);
+			CVector3 cone = Normalise(CVector3{ f.x * viewMatrix.e00 + f.y * viewMatrix.e10 + f.z * viewMatrix.e20,
+			                                    f.x * viewMatrix.e01 + f.y * viewMatrix.e11 + f.z * viewMatrix.e21,
+			                                    f.x * viewMatrix.e02 + f.y * viewMatrix.e12 + f.z * viewMatrix.e22 });
+			float cosHalfAngle = lights.CosHalfAngle(light);
+			mConeX.push_back(cone.x);
+			mConeY.push_back(cone.y);
+			mConeZ.push_back(cone.z);
+			mConeCos.push_back(cosHalfAngle);
+			mConeSin.push_back(std::sqrt(std::max(1.0f - cosHalfAngle * cosHalfAngle, 0.0f)));
+			mIsCone.push_back(-1);
+		}
+		else
+		{
+			mConeX.push_back(0);  mConeY.push_back(0);  mConeZ.push_back(0);
+			mConeCos.push_back(0);  mConeSin.push_back(0);
+			mIsCone.push_back(0);
+		}
+	}
+
+	// Bin the slices, sharing them with the worker threads
+	mNextSlice = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mNumWorking = static_cast<unsigned int>(mThreads.size());
+		++mJob;
+	}
+	mStartWork.notify_all();
+	BinSlices();
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWorkDone.wait(lock, [this] { return mNumWorking == 0; });
+	}
+
+	// Join the slices into one list
+	mLightIndices.clear();
+	unsigned int tilesPerSlice = mNumX * mNumY;
+	for (unsigned int z = 0; z < mNumZ; ++z)
+	{
+		const Slice& slice = mSlices[z];
+		uint32_t sliceStart = static_cast<uint32_t>(mLightIndices.size());
+		for (unsigned int tile = 0; tile < tilesPerSlice; ++tile)
+		{
+			mClusters[z * tilesPerSlice + tile] = { sliceStart + slice.clusters[tile].firstIndex, slice.clusters[tile].numLights };
+		}
+		mLightIndices.insert(mLightIndices.end(), slice.indices.begin(), slice.indices.end());
+	}
+}
+
+
+// Send the result of the last Build to the GPU, creating or growing the buffers if needed. Returns false on failure
+bool LightClusters::Upload()
+{
+	if (mClusterBuffer == nullptr)
+	{
+		if (!CreateBuffer(static_cast<unsigned int>(mClusters.size()), sizeof(LightClusterRange), &mClusterBuffer, &mClusterBufferSRV))  return false;
+	}
+	if (mIndexBuffer == nullptr || mLightIndices.size() > mIndexCapacity)
+	{
+		if (mIndexBufferSRV)  mIndexBufferSRV->Release();
+		if (mIndexBuffer)     mIndexBuffer->Release();
+		mIndexBufferSRV = nullptr;
+		mIndexBuffer    = nullptr;
+
+		unsigned int capacity = std::max(mIndexCapacity, MIN_INDEX_BUFFER_CAPACITY);
+		while (capacity < mLightIndices.size())  capacity *= 2;
+		mIndexCapacity = 0;
+		if (!CreateBuffer(capacity, sizeof(uint32_t), &mIndexBuffer, &mIndexBufferSRV))  return false;
+		mIndexCapacity = capacity;
+	}
+
+	gRenderBackend->UpdateBuffer(mClusterBuffer, mClusters.data(), mClusters.size() * sizeof(LightClusterRange));
+	if (!mLightIndices.empty())
+	{
+		gRenderBackend->UpdateBuffer(mIndexBuffer, mLightIndices.data(), mLightIndices.size() * sizeof(uint32_t));
+	}
+	return true;
+}
+
+
+// Release the GPU buffers
+void LightClusters::Release()
+{
+	if (mClusterBufferSRV)  mClusterBufferSRV->Release();
+	if (mClusterBuffer)     mClusterBuffer->Release();
+	if (mIndexBufferSRV)    mIndexBufferSRV->Release();
+	if (mIndexBuffer)       mIndexBuffer->Release();
+	mClusterBufferSRV = nullptr;
+	mClusterBuffer    = nullptr;
+	mIndexBufferSRV   = nullptr;
+	mIndexBuffer      = nullptr;
+	mIndexCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Binning
+//--------------------------------------------------------------------------------------
+
+// Worker threads wait here for each Build, then help bin slices
+void LightClusters::WorkerThread()
+{
+	unsigned int lastJob = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mStartWork.wait(lock, [&] { return mQuit || mJob != lastJob; });
+			if (mQuit)  return;
+			lastJob = mJob;
+		}
+
+		BinSlices();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (--mNumWorking == 0)  mWorkDone.notify_one();
+		}
+	}
+}
+
+
+// Bin slices until there are none left, called by the worker threads and Build
+void LightClusters::BinSlices()
+{
+	unsigned int z;
+	while ((z = mNextSlice++) < mNumZ)
+	{
+		BinSlice(z);
+	}
+}
+
+
+// Bin the lights into the clusters of one depth slice
+void LightClusters::BinSlice(unsigned int z)
+{
+	Slice& slice = mSlices[z];
+	float sliceNear = mSliceDepths[z];
+	float sliceFar  = mSliceDepths[z + 1];
+
+	// Gather the lights whose range overlaps the slice depths
+	slice.x.clear();  slice.y.clear();  slice.z.clear();  slice.rangeSquared.clear();
+	slice.coneX.clear();  slice.coneY.clear();  slice.coneZ.clear();
+	slice.coneCos.clear();  slice.coneSin.clear();  slice.coneRange.clear();
+	slice.isCone.clear();  slice.lightIndex.clear();
+	for (size_t i = 0; i < mLightZ.size(); ++i)
+	{
+		if (mLightZ[i] + mLightRange[i] < sliceNear || mLightZ[i] - mLightRange[i] > sliceFar)  continue;
+		slice.x.push_back(mLightX[i]);
+		slice.y.push_back(mLightY[i]);
+		slice.z.push_back(mLightZ[i]);
+		slice.rangeSquared.push_back(mLightRange[i] * mLightRange[i]);
+		slice.coneX.push_back(mConeX[i]);
+		slice.coneY.push_back(mConeY[i]);
+		slice.coneZ.push_back(mConeZ[i]);
+		slice.coneCos.push_back(mConeCos[i]);
+		slice.coneSin.push_back(mConeSin[i]);
+		slice.coneRange.push_back(mLightRange[i]);
+		slice.isCone.push_back(mIsCone[i]);
+		slice.lightIndex.push_back(mLightIndex[i]);
+	}
+
+	// Pad to a multiple of 4 with lights of no range a long way off, which never touch a cluster
+	while (slice.x.size() % 4 != 0)
+	{
+		slice.x.push_back(1e30f);  slice.y.push_back(1e30f);  slice.z.push_back(1e30f);  slice.rangeSquared.push_back(0);
+		slice.coneX.push_back(0);  slice.coneY.push_back(0);  slice.coneZ.push_back(0);
+		slice.coneCos.push_back(0);  slice.coneSin.push_back(0);  slice.coneRange.push_back(0);
+		slice.isCone.push_back(0);  slice.lightIndex.push_back(0);
+	}
+
+	slice.clusters.resize(mNumX * mNumY);
+	slice.indices.clear();
+	const __m128 zero = _mm_setzero_ps();
+	for (unsigned int y = 0; y < mNumY; ++y)
+	{
+		// Tile edges as view space x/z and y/z slopes, tiles go down the screen from the top
+		float top    = (1.0f - 2.0f *  y      / mNumY) * mTanHalfFOVy;
+		float bottom = (1.0f - 2.0f * (y + 1) / mNumY) * mTanHalfFOVy;
+		float minY = std::min(bottom * sliceNear, bottom * sliceFar);
+		float maxY = std::max(top    * sliceNear, top    * sliceFar);
+
+		for (unsigned int x = 0; x < mNumX; ++x)
+		{
+			float left  = (-1.0f + 2.0f *  x      / mNumX) * mTanHalfFOVx;
+			float right = (-1.0f + 2.0f * (x + 1) / mNumX) * mTanHalfFOVx;
+			float minX = std::min(left  * sliceNear, left  * sliceFar);
+			float maxX = std::max(right * sliceNear, right * sliceFar);
+
+			LightClusterRange& cluster = slice.clusters[y * mNumX + x];
+			cluster.firstIndex = static_cast<uint32_t>(slice.indices.size());
+			slice.indices.insert(slice.indices.end(), mDirectionalLights.begin(), mDirectionalLights.end());
+
+			// Bounding box of the cluster, and a bounding sphere of that for the cone test
+			__m128 boxMinX = _mm_set1_ps(minX),       boxMaxX = _mm_set1_ps(maxX);
+			__m128 boxMinY = _mm_set1_ps(minY),       boxMaxY = _mm_set1_ps(maxY);
+			__m128 boxMinZ = _mm_set1_ps(sliceNear),  boxMaxZ = _mm_set1_ps(sliceFar);
+			__m128 centreX = _mm_set1_ps((minX + maxX) * 0.5f);
+			__m128 centreY = _mm_set1_ps((minY + maxY) * 0.5f);
+			__m128 centreZ = _mm_set1_ps((sliceNear + sliceFar) * 0.5f);
+			float  radius  = 0.5f * std::sqrt((maxX - minX) * (maxX - minX) + (maxY - minY) * (maxY - minY) +
+			                                  (sliceFar - sliceNear) * (sliceFar - sliceNear));
+			__m128 sphereRadius    = _mm_set1_ps(radius);
+			__m128 negSphereRadius = _mm_set1_ps(-radius);
+
+			for (size_t i = 0; i < slice.x.size(); i += 4)
+			{
+				// Sphere against box: distance from the light to the nearest point in the box
+				__m128 lightX = _mm_loadu_ps(&slice.x[i]);
+				__m128 lightY = _mm_loadu_ps(&slice.y[i]);
+				__m128 lightZ = _mm_loadu_ps(&slice.z[i]);
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(boxMinX, lightX), _mm_sub_ps(lightX, boxMaxX)), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(boxMinY, lightY), _mm_sub_ps(lightY, boxMaxY)), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(boxMinZ, lightZ), _mm_sub_ps(lightZ, boxMaxZ)), zero);
+				__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 hit = _mm_cmple_ps(distanceSquared, _mm_loadu_ps(&slice.rangeSquared[i]));
+
+				// Cone against the cluster's bounding sphere for spotlights (Bart Wronski, "Cull that cone!"). Culls
+				// clusters outside the cone's angle, beyond its range or behind it
+				__m128 isCone = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&slice.isCone[i])));
+				if (_mm_movemask_ps(_mm_and_ps(hit, isCone)) != 0)
+				{
+					__m128 vx = _mm_sub_ps(centreX, lightX);
+					__m128 vy = _mm_sub_ps(centreY, lightY);
+					__m128 vz = _mm_sub_ps(centreZ, lightZ);
+					__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+					__m128 alongAxis = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&slice.coneX[i])),
+					                                         _mm_mul_ps(vy, _mm_loadu_ps(&slice.coneY[i]))),
+					                                         _mm_mul_ps(vz, _mm_loadu_ps(&slice.coneZ[i])));
+					__m128 fromAxis = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSquared, _mm_mul_ps(alongAxis, alongAxis)), zero));
+					__m128 closest  = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&slice.coneCos[i]), fromAxis),
+					                             _mm_mul_ps(_mm_loadu_ps(&slice.coneSin[i]), alongAxis));
+					__m128 outsideAngle = _mm_cmpgt_ps(closest, sphereRadius);
+					__m128 beyondRange  = _mm_cmpgt_ps(alongAxis, _mm_add_ps(sphereRadius, _mm_loadu_ps(&slice.coneRange[i])));
+					__m128 behind       = _mm_cmplt_ps(alongAxis, negSphereRadius);
+					__m128 cull = _mm_and_ps(_mm_or_ps(outsideAngle, _mm_or_ps(beyondRange, behind)), isCone);
+					hit = _mm_andnot_ps(cull, hit);
+				}
+
+				int mask = _mm_movemask_ps(hit);
+				for (int lane = 0; mask != 0; ++lane, mask >>= 1)
+				{
+					if (mask & 1)  slice.indices.push_back(slice.lightIndex[i + lane]);
+				}
+			}
+
+			cluster.numLights = static_cast<uint32_t>(slice.indices.size()) - cluster.firstIndex;
+		}
+	}
+}
+
+
+// Create a dynamic structured buffer and a shader resource view of it
+bool LightClusters::CreateBuffer(unsigned int numElements, unsigned int elementSize, ID3D11Buffer** buffer, ID3D11ShaderResourceView** srv)
+{
+	RenderBufferDesc bufferDesc;
+	bufferDesc.type = ERenderBufferType::Structured;
+	bufferDesc.usage = ERenderBufferUsage::Dynamic;
+	bufferDesc.size = numElements * elementSize;
+	bufferDesc.elementSize = elementSize;
+	if (!gRenderBackend->CreateBuffer(bufferDesc, nullptr, buffer))
+	{
+		*buffer = nullptr;
+		return false;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = numElements;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(*buffer, &srvDesc, srv)))
+	{
+		*srv = nullptr;
+		(*buffer)->Release();
+		*buffer = nullptr;
+		return false;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Time building clusters for increasing numbers of random point and spot lights, with one thread and with several threads.
+// Also checks both give the same result. Writes a report to the given stream and returns the number of checks that failed
+// (see Tests.cpp)
+unsigned int RunLightClusterBenchmark(std::ostream& report, unsigned int numRepeats /*= 20*/)
+{
+	LightClusters singleThreaded(16, 9, 24, 0);
+	LightClusters multiThreaded(16, 9, 24, std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 3)); // Split even on one core
+	Camera camera; // At the origin looking along z
+
+	std::vector<std::string> failures;
+	auto check = [&](bool passed, const std::string& description)  { if (!passed)  failures.push_back(description); };
+
+	report.precision(3);
+	report << std::fixed;
+	report << "Light cluster benchmark: " << singleThreaded.NumX() << "x" << singleThreaded.NumY() << "x" << singleThreaded.NumZ()
+	       << " clusters, " << numRepeats << " repeats, " << multiThreaded.NumThreads() << " threads\n";
+
+	Timer timer;
+	const unsigned int lightCounts[] = { 16, 64, 256, 1024, 4096 };
+	for (unsigned int numLights : lightCounts)
+	{
+		// Random lights in front of the camera, half of them spotlights
+		LightManager lights;
+		for (unsigned int i = 0; i < numLights; ++i)
+		{
+			unsigned int light = lights.AddLight();
+			lights.SetPosition(light, { Random(-500, 500), Random(-200, 200), Random(0, 1000) });
+			lights.SetRange(light, Random(5, 50));
+			if (i % 2 == 1)
+			{
+				lights.SetType(light, ELightType::Spot);
+				lights.SetFacing(light, Normalise(CVector3{ Random(-1, 1), Random(-1, 1), Random(-1, 1) }));
+				lights.SetCosHalfAngle(light, std::cos(ToRadians(Random(10, 45))));
+			}
+		}
+
+		timer.GetLapTime();
+		for (unsigned int r = 0; r < numRepeats; ++r)  singleThreaded.Build(lights, camera);
+		float singleThreadedTime = timer.GetLapTime();
+		for (unsigned int r = 0; r < numRepeats; ++r)  multiThreaded.Build(lights, camera);
+		float multiThreadedTime = timer.GetLapTime();
+
+		bool match = singleThreaded.LightIndices() == multiThreaded.LightIndices();
+		for (size_t c = 0; c < singleThreaded.Clusters().size() && match; ++c)
+		{
+			match = singleThreaded.Clusters()[c].firstIndex == multiThreaded.Clusters()[c].firstIndex &&
+			        singleThreaded.Clusters()[c].numLights  == multiThreaded.Clusters()[c].numLights;
+		}
+
+		// Report times in microseconds per build
+		float scale = 1000000.0f / numRepeats;
+		report << "  " << numLights << " lights: 1 thread " << singleThreadedTime * scale << "us, "
+		       << multiThreaded.NumThreads() << " threads " << multiThreadedTime * scale << "us, "
+		       << static_cast<float>(multiThreaded.LightIndices().size()) / multiThreaded.Clusters().size() << " lights per cluster\n";
+		check(match, std::to_string(numLights) + " lights: clusters built with " + std::to_string(multiThreaded.NumThreads()) +
+		             " threads differ from those built with 1");
+	}
+	report << "  Checks: " << (failures.empty() ? "all passed" : std::to_string(failures.size()) + " FAILED") << "\n";
+	for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+	return static_cast<unsigned int>(failures.size());
+}
@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------------------------
+// Clustered lighting - lists of the lights affecting each part of the camera's view
+//--------------------------------------------------------------------------------------
+// The camera's view is divided into a grid of clusters: tiles across the screen, and slices in depth that get exponentially
+// thicker with distance (so clusters are roughly cube shaped). Each frame the lights are binned on the CPU: every point
+// light's range and every spotlight's cone is tested against the bounding box of each cluster (four lights at a time using
+// SSE) and the lights that touch it go in the cluster's list. Directional lights are in every list. The pixel shaders
+// find their cluster from screen position and depth, then only light with that cluster's list (see Lighting.hlsli).
+//
+// Each depth slice is binned separately, spread across worker threads that are kept waiting between frames
+
+#ifndef _LIGHT_CLUSTERS_H_INCLUDED_
+#define _LIGHT_CLUSTERS_H_INCLUDED_
+
+#include "Common.h"
+#include "LightManager.h"
+#include "Camera.h"
+
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+// The lights affecting one cluster: a range of the light index list. Matches the uint2 used in Lighting.hlsli
+struct LightClusterRange
+{
+	uint32_t firstIndex;
+	uint32_t numLights;
+};
+
+
+class LightClusters
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Divide the view into the given number of clusters across, down and in depth. Binning is shared between the calling
+	// thread and the given number of worker threads, -1 for one less than the number of CPU cores
+	LightClusters(unsigned int numX = 16, unsigned int numY = 9, unsigned int numZ = 24, int numWorkerThreads = -1);
+	~LightClusters();
+
+	// Bin the lights into the clusters of the given camera's view
+	void Build(LightManager& lights, Camera& camera);
+
+	// Send the result of the last Build to the GPU, creating or growing the buffers if needed. Returns false on failure
+	bool Upload();
+
+	// Buffers for the shaders - the range of each cluster and the light index lists. nullptr until Upload is called
+	ID3D11ShaderResourceView* ClusterSRV()     { return mClusterBufferSRV; }
+	ID3D11ShaderResourceView* LightIndexSRV()  { return mIndexBufferSRV; }
+
+	// Release the GPU buffers
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	unsigned int NumX()  { return mNumX; }
+	unsigned int NumY()  { return mNumY; }
+	unsigned int NumZ()  { return mNumZ; }
+
+	// The depth slice containing a point at view space depth z is log(z) * DepthScale + DepthBias (from the last Build)
+	float DepthScale()  { return mDepthScale; }
+	float DepthBias()   { return mDepthBias; }
+
+	// Results of the last Build. Clusters are ordered across, then down, then in depth
+	const std::vector<LightClusterRange>& Clusters()      { return mClusters; }
+	const std::vector<uint32_t>&          LightIndices()  { return mLightIndices; }
+
+	unsigned int NumThreads()  { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Not copyable, the worker threads refer to this object
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	// Worker threads wait here for each Build, then help bin slices
+	void WorkerThread();
+
+	// Bin slices until there are none left, called by the worker threads and Build
+	void BinSlices();
+
+	// Bin the lights into the clusters of one depth slice
+	void BinSlice(unsigned int z);
+
+	// Create a dynamic structured buffer and a shader resource view of it
+	bool CreateBuffer(unsigned int numElements, unsigned int elementSize, ID3D11Buffer** buffer, ID3D11ShaderResourceView** srv);
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	unsigned int mNumX, mNumY, mNumZ;
+
+	// View settings for the current Build
+	float mTanHalfFOVx = 0;
+	float mTanHalfFOVy = 0;
+	float mDepthScale  = 0;
+	float mDepthBias   = 0;
+	std::vector<float> mSliceDepths; // mNumZ + 1 depths, the near and far of each slice
+
+	// Point and spot lights in view space, one element per light. Spotlights have a cone direction and the cos and sin of
+	// the cone's half angle, other lights have a cone flag of 0
+	std::vector<float>    mLightX, mLightY, mLightZ, mLightRange;
+	std::vector<float>    mConeX, mConeY, mConeZ, mConeCos, mConeSin;
+	std::vector<int32_t>  mIsCone;
+	std::vector<uint32_t> mLightIndex; // Index in the light manager
+	std::vector<uint32_t> mDirectionalLights;
+
+	// Lights that reach a slice, packed for SSE and padded to a multiple of 4, and the binned result for the slice
+	struct Slice
+	{
+		std::vector<float>    x, y, z, rangeSquared;
+		std::vector<float>    coneX, coneY, coneZ, coneCos, coneSin, coneRange;
+		std::vector<int32_t>  isCone;
+		std::vector<uint32_t> lightIndex;
+
+		std::vector<LightClusterRange> clusters; // Ranges are relative to this slice's indices
+		std::vector<uint32_t>          indices;
+	};
+	std::vector<Slice> mSlices;
+
+	// Results
+	std::vector<LightClusterRange> mClusters;
+	std::vector<uint32_t>          mLightIndices;
+
+	// Worker threads. Each Build increases the job number to wake them, slices are taken in turn using mNextSlice
+	std::vector<std::thread>  mThreads;
+	std::mutex                mMutex;
+	std::condition_variable   mStartWork;
+	std::condition_variable   mWorkDone;
+	unsigned int              mJob = 0;
+	unsigned int              mNumWorking = 0;
+	bool                      mQuit = false;
+	std::atomic<unsigned int> mNextSlice;
+
+	// GPU buffers
+	ID3D11Buffer*             mClusterBuffer    = nullptr;
+	ID3D11ShaderResourceView* mClusterBufferSRV = nullptr;
+	ID3D11Buffer*             mIndexBuffer      = nullptr;
+	ID3D11ShaderResourceView* mIndexBufferSRV   = nullptr;
+	unsigned int              mIndexCapacity    = 0;
+};
+
+
+// Time building clusters for increasing numbers of random point and spot lights, with one thread and with several threads.
+// Also checks both give the same result. Writes a report to the given stream and returns the number of checks that failed
+// (see Tests.cpp)
+unsigned int RunLightClusterBenchmark(std::ostream& report, unsigned int numRepeats = 20);
+
+
+#endif //_LIGHT_CLUSTERS_H_INCLUDED_
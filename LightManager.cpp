@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------
+// Holds any number of lights and sends them to the GPU in a structured buffer
+//--------------------------------------------------------------------------------------
+
+#include "LightManager.h"
+#include "RenderBackend.h"
+
+#include <algorithm>
+
+
+// Smallest light buffer created, the buffer doubles in size when more lights are added
+static const unsigned int MIN_LIGHT_BUFFER_CAPACITY = 16;
+
+// Light intensity below which a light is treated as having no effect, used to set the range of lights from their colour
+static const float MIN_LIGHT_INTENSITY = 0.01f;
+
+
+// Add a white point light at the origin, returns its index for the functions below
+unsigned int LightManager::AddLight()
+{
+	unsigned int light = NumLights();
+	mPositions.push_back({ 0, 0, 0 });
+	mColours.push_back({ 1, 1, 1 });
+	mFacings.push_back({ 0, 0, 1 });
+	mCosHalfAngles.push_back(0.0f);
+	mTypes.push_back(ELightType::Point);
+	mViewMatrices.push_back(MatrixIdentity());
+	mProjectionMatrices.push_back(MatrixIdentity());
+	mRanges.push_back(0.0f);
+	mShadowUVOffsets.push_back({ 0, 0 });
+	mShadowUVScales.push_back({ 0, 0 });
+
+	mChanged.push_back(0);
+	SetColour(light, mColours[light]); // Sets the range and marks the light as changed
+	return light;
+}
+
+
+// Set the colour of a light and its range to match. Light fades as 1 / distance, so the range is where the brightest
+// colour component falls to MIN_LIGHT_INTENSITY
+void LightManager::SetColour(unsigned int light, const CVector3& colour)
+{
+	mColours[light] = colour;
+	mRanges[light] = std::max(colour.x, std::max(colour.y, colour.z)) / MIN_LIGHT_INTENSITY;
+	SetChanged(light);
+}
+
+
+// Set the tile of the shadow atlas a spotlight's shadows are read from. Only marks the light as changed if the tile differs
+void LightManager::SetShadowTile(unsigned int light, const CVector2& uvOffset, const CVector2& uvScale)
+{
+	CVector2& offset = mShadowUVOffsets[light];
+	CVector2& scale  = mShadowUVScales[light];
+	if (offset.x == uvOffset.x && offset.y == uvOffset.y && scale.x == uvScale.x && scale.y == uvScale.y)  return;
+	offset = uvOffset;
+	scale  = uvScale;
+	SetChanged(light);
+}
+
+
+// Send the lights that have changed since the last call to the GPU, creating or growing the light buffer if needed
+// Call once per frame before rendering. Returns false if the light buffer could not be created
+bool LightManager::Update()
+{
+	mNumLightsUploaded = 0;
+
+	if (NumLights() > mCapacity)
+	{
+		unsigned int capacity = std::max(mCapacity, MIN_LIGHT_BUFFER_CAPACITY);
+		while (capacity < NumLights())  capacity *= 2;
+		if (!CreateLightBuffer(capacity))  return false;
+
+		// A new buffer is empty, so every light must be sent
+		for (unsigned int light = 0; light < NumLights(); ++light)  SetChanged(light);
+	}
+
+	if (mChangedLights.empty())  return true;
+
+	// Pack changed lights in index order and send each run of consecutive lights with one copy
+	std::sort(mChangedLights.begin(), mChangedLights.end());
+	mUploadLights.resize(mChangedLights.size());
+	size_t runStart = 0;
+	for (size_t i = 0; i < mChangedLights.size(); ++i)
+	{
+		unsigned int light = mChangedLights[i];
+		PackedLight& packed = mUploadLights[i];
+		packed.position     = mPositions[light];
+		packed.type         = static_cast<int>(mTypes[light]);
+		packed.colour       = mColours[light];
+		packed.cosHalfAngle = mCosHalfAngles[light];
+		packed.facing       = mFacings[light];
+		packed.range        = mRanges[light];
+		packed.viewProjectionMatrix = mViewMatrices[light] * mProjectionMatrices[light];
+		packed.shadowUVOffset = mShadowUVOffsets[light];
+		packed.shadowUVScale  = mShadowUVScales[light];
+		mChanged[light] = 0;
+
+		bool runEnds = (i + 1 == mChangedLights.size() || mChangedLights[i + 1] != light + 1);
+		if (runEnds)
+		{
+			size_t runLength = i + 1 - runStart;
+			gRenderBackend->UpdateBufferRegion(mLightBuffer, mChangedLights[runStart] * sizeof(PackedLight),
+			                                   &mUploadLights[runStart], runLength * sizeof(PackedLight));
+			runStart = i + 1;
+		}
+	}
+
+	mNumLightsUploaded = static_cast<unsigned int>(mChangedLights.size());
+	mChangedLights.clear();
+	return true;
+}
+
+
+// Release the light buffer and remove all the lights
+void LightManager::Release()
+{
+	if (mLightBufferSRV)  mLightBufferSRV->Release();
+	if (mLightBuffer)     mLightBuffer->Release();
+	mLightBufferSRV = nullptr;
+	mLightBuffer    = nullptr;
+	mCapacity = 0;
+
+	mPositions.clear();
+	mColours.clear();
+	mFacings.clear();
+	mCosHalfAngles.clear();
+	mTypes.clear();
+	mViewMatrices.clear();
+	mProjectionMatrices.clear();
+	mRanges.clear();
+	mShadowUVOffsets.clear();
+	mShadowUVScales.clear();
+	mChanged.clear();
+	mChangedLights.clear();
+}
+
+
+// Create a light buffer that can hold the given number of lights, replacing any existing one
+bool LightManager::CreateLightBuffer(unsigned int capacity)
+{
+	if (mLightBufferSRV)  mLightBufferSRV->Release();
+	if (mLightBuffer)     mLightBuffer->Release();
+	mLightBufferSRV = nullptr;
+	mLightBuffer    = nullptr;
+	mCapacity = 0;
+
+	// Default usage rather than dynamic, so parts of the buffer can be updated without the rest being lost
+	RenderBufferDesc bufferDesc;
+	bufferDesc.type = ERenderBufferType::Structured;
+	bufferDesc.usage = ERenderBufferUsage::Default;
+	bufferDesc.size = capacity * sizeof(PackedLight);
+	bufferDesc.elementSize = sizeof(PackedLight);
+	if (!gRenderBackend->CreateBuffer(bufferDesc, nullptr, &mLightBuffer))
+	{
+		mLightBuffer = nullptr;
+		return false;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = capacity;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(mLightBuffer, &srvDesc, &mLightBufferSRV)))
+	{
+		mLightBufferSRV = nullptr;
+		mLightBuffer->Release();
+		mLightBuffer = nullptr;
+		return false;
+	}
+
+	mCapacity = capacity;
+	return true;
+}
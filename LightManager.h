@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+// Holds any number of lights and sends them to the GPU in a structured buffer
+//--------------------------------------------------------------------------------------
+// Each light property is kept in its own array (structure of arrays), indexed by the number returned from AddLight. The
+// setters record which lights have changed and Update sends only those lights to the GPU, packed into the form the shaders
+// use (PackedLight in Common.h), so the cost each frame depends on how many lights changed rather than how many there are.
+// Shaders loop over the first NumLights lights in the buffer (see Lighting.hlsli)
+
+#ifndef _LIGHT_MANAGER_H_INCLUDED_
+#define _LIGHT_MANAGER_H_INCLUDED_
+
+#include "Common.h"
+
+#include <vector>
+#include <cstdint>
+
+
+// Light types, the values must match those in Lighting.hlsli
+enum class ELightType
+{
+	Point       = 0,
+	Spot        = 1,
+	Directional = 2,
+};
+
+
+class LightManager
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Add a white point light at the origin, returns its index for the functions below
+	unsigned int AddLight();
+
+	unsigned int NumLights()  { return static_cast<unsigned int>(mPositions.size()); }
+
+	// Send the lights that have changed since the last call to the GPU, creating or growing the light buffer if needed
+	// Call once per frame before rendering. Returns false if the light buffer could not be created
+	bool Update();
+
+	// Send every light in the next Update, for when the light buffer may not hold what was last sent
+	void Invalidate()  { for (unsigned int light = 0; light < NumLights(); ++light)  SetChanged(light); }
+
+	// The light buffer for the shaders, nullptr until Update is first called
+	ID3D11ShaderResourceView* LightBufferSRV()  { return mLightBufferSRV; }
+
+	// Release the light buffer and remove all the lights
+	void Release();
+
+
+	//-------------------------------------
+	// Light properties
+	//-------------------------------------
+
+	void SetPosition        (unsigned int light, const CVector3& position)           { mPositions[light]          = position;         SetChanged(light); }
+	void SetColour          (unsigned int light, const CVector3& colour); // Also sets the range, see below
+	void SetFacing          (unsigned int light, const CVector3& facing)             { mFacings[light]            = facing;           SetChanged(light); }
+	void SetCosHalfAngle    (unsigned int light, float cosHalfAngle)                 { mCosHalfAngles[light]      = cosHalfAngle;     SetChanged(light); }
+	void SetType            (unsigned int light, ELightType type)                    { mTypes[light]              = type;             SetChanged(light); }
+	void SetViewMatrix      (unsigned int light, const CMatrix4x4& viewMatrix)       { mViewMatrices[light]       = viewMatrix;       SetChanged(light); }
+	void SetProjectionMatrix(unsigned int light, const CMatrix4x4& projectionMatrix) { mProjectionMatrices[light] = projectionMatrix; SetChanged(light); }
+
+	// Lights fade with distance (see Lighting.hlsli), the range is where a light becomes too dim to see. Setting the colour
+	// sets the range to match, set it afterwards to override
+	void SetRange           (unsigned int light, float range)                        { mRanges[light]             = range;            SetChanged(light); }
+
+	// Spotlight shadows are read from a tile of the shadow atlas (see ShadowAtlas.h), given as the offset and scale from the
+	// light's shadow map UVs to the atlas UVs. A scale of 0 (the default) means the light casts no shadows. Only marks the
+	// light as changed if the tile differs, so it can be set every frame
+	void SetShadowTile      (unsigned int light, const CVector2& uvOffset, const CVector2& uvScale);
+
+	const CVector3&   Position        (unsigned int light)  { return mPositions[light]; }
+	const CVector3&   Colour          (unsigned int light)  { return mColours[light]; }
+	const CVector3&   Facing          (unsigned int light)  { return mFacings[light]; }
+	float             CosHalfAngle    (unsigned int light)  { return mCosHalfAngles[light]; }
+	ELightType        Type            (unsigned int light)  { return mTypes[light]; }
+	const CMatrix4x4& ViewMatrix      (unsigned int light)  { return mViewMatrices[light]; }
+	const CMatrix4x4& ProjectionMatrix(unsigned int light)  { return mProjectionMatrices[light]; }
+	float             Range           (unsigned int light)  { return mRanges[light]; }
+	const CVector2&   ShadowUVOffset  (unsigned int light)  { return mShadowUVOffsets[light]; }
+	const CVector2&   ShadowUVScale   (unsigned int light)  { return mShadowUVScales[light]; }
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Number of lights sent to the GPU by the last call to Update
+	unsigned int NumLightsUploaded()  { return mNumLightsUploaded; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Add a light to the list to send in the next Update, if it is not already there
+	void SetChanged(unsigned int light)
+	{
+		if (mChanged[light])  return;
+		mChanged[light] = 1;
+		mChangedLights.push_back(light);
+	}
+
+	// Create a light buffer that can hold the given number of lights, replacing any existing one
+	bool CreateLightBuffer(unsigned int capacity);
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	// Light properties, one element per light
+	std::vector<CVector3>   mPositions;
+	std::vector<CVector3>   mColours;
+	std::vector<CVector3>   mFacings;
+	std::vector<float>      mCosHalfAngles;
+	std::vector<ELightType> mTypes;
+	std::vector<CMatrix4x4> mViewMatrices;
+	std::vector<CMatrix4x4> mProjectionMatrices;
+	std::vector<float>      mRanges;
+	std::vector<CVector2>   mShadowUVOffsets;
+	std::vector<CVector2>   mShadowUVScales;
+
+	// Lights changed since the last Update - a flag per light and a list of the changed lights
+	std::vector<uint8_t>      mChanged;
+	std::vector<unsigned int> mChangedLights;
+
+	// Lights are packed here before sending, only the changed ones
+	std::vector<PackedLight> mUploadLights;
+
+	ID3D11Buffer*             mLightBuffer    = nullptr;
+	ID3D11ShaderResourceView* mLightBufferSRV = nullptr;
+	unsigned int              mCapacity       = 0; // Number of lights the buffer can hold
+
+	unsigned int mNumLightsUploaded = 0;
+};
+
+
+// The lights in the scene (in Scene.cpp)
+extern LightManager gLightManager;
+
+
+#endif //_LIGHT_MANAGER_H_INCLUDED_
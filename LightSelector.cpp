@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------
+// Chooses the few lights that most affect each model
+//--------------------------------------------------------------------------------------
+
+#include "LightSelector.h"
+#include "Model.h"
+
+#include <emmintrin.h> // SSE2 intrinsics
+#include <algorithm>
+
+
+// Call at the start of each frame, before adding the frame's models
+void LightSelector::Clear()
+{
+	mModels.clear();
+	mCentres.clear();
+	mRadii.clear();
+}
+
+
+// Add a model to choose lights for. Its bounding sphere is read now, so add it after it has been moved for the frame
+void LightSelector::Add(Model* model)
+{
+	CVector3 centre;
+	float radius;
+	model->BoundingSphere(centre, radius);
+	mModels.push_back(model);
+	mCentres.push_back(centre);
+	mRadii.push_back(radius);
+}
+
+
+// Choose the most influential lights for each model added, up to the given number (at most MAX_OBJECT_LIGHTS), and give
+// them to the models (see Model::SetObjectLights). Models are then lit by only those lights until this is called again
+void LightSelector::Select(LightManager& lights, unsigned int maxLights /*= MAX_OBJECT_LIGHTS*/)
+{
+	maxLights = std::min(maxLights, static_cast<unsigned int>(MAX_OBJECT_LIGHTS));
+	mNumLightsSelected = 0;
+
+	// Pack the lights, padding with lights a long way off with no range or brightness
+	mLightX.clear();  mLightY.clear();  mLightZ.clear();  mLightRange.clear();  mLightBrightness.clear();
+	mIsDirectional.clear();
+	for (unsigned int light = 0; light < lights.NumLights(); ++light)
+	{
+		const CVector3& position = lights.Position(light);
+		const CVector3& colour   = lights.Colour(light);
+		mLightX.push_back(position.x);
+		mLightY.push_back(position.y);
+		mLightZ.push_back(position.z);
+		mLightRange.push_back(lights.Range(light));
+		mLightBrightness.push_back(std::max(colour.x, std::max(colour.y, colour.z)));
+		mIsDirectional.push_back(lights.Type(light) == ELightType::Directional ? -1 : 0);
+	}
+	while (mLightX.size() % 4 != 0)
+	{
+		mLightX.push_back(1e30f);  mLightY.push_back(1e30f);  mLightZ.push_back(1e30f);
+		mLightRange.push_back(0);  mLightBrightness.push_back(0);
+		mIsDirectional.push_back(0);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+	for (size_t model = 0; model < mModels.size(); ++model)
+	{
+		// The best lights found so far for this model, strongest first. Once the list is full a light must beat the weakest
+		float    bestScores[MAX_OBJECT_LIGHTS];
+		uint32_t bestLights[MAX_OBJECT_LIGHTS];
+		unsigned int numBest = 0;
+		float threshold = 0; // Lights with no effect are never picked
+
+		__m128 centreX = _mm_set1_ps(mCentres[model].x);
+		__m128 centreY = _mm_set1_ps(mCentres[model].y);
+		__m128 centreZ = _mm_set1_ps(mCentres[model].z);
+		__m128 radius  = _mm_set1_ps(mRadii[model]);
+		for (size_t i = 0; maxLights > 0 && i < mLightX.size(); i += 4)
+		{
+			// Distance from each light to the nearest point of the sphere, 0 inside it
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(&mLightX[i]), centreX);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(&mLightY[i]), centreY);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(&mLightZ[i]), centreZ);
+			__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 gap = _mm_max_ps(_mm_sub_ps(distance, radius), zero);
+
+			// Strength at that point, distances under 1 are treated as 1 to avoid huge scores for lights inside the sphere.
+			// Lights out of range score 0, directional lights score their brightness
+			__m128 brightness    = _mm_loadu_ps(&mLightBrightness[i]);
+			__m128 isDirectional = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&mIsDirectional[i])));
+			__m128 inRange       = _mm_cmple_ps(gap, _mm_loadu_ps(&mLightRange[i]));
+			__m128 score = _mm_and_ps(_mm_div_ps(brightness, _mm_max_ps(gap, one)), inRange);
+			score = _mm_or_ps(_mm_and_ps(isDirectional, brightness), _mm_andnot_ps(isDirectional, score));
+
+			int mask = _mm_movemask_ps(_mm_cmpgt_ps(score, _mm_set1_ps(threshold)));
+			if (mask == 0)  continue;
+
+			// Insert the lights that beat the threshold into the sorted list
+			alignas(16) float scores[4];
+			_mm_store_ps(scores, score);
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				if (!(mask & (1 << lane)) || scores[lane] <= threshold)  continue;
+
+				unsigned int position = std::min(numBest, maxLights - 1); // When full, the weakest light is replaced
+				while (position > 0 && bestScores[position - 1] < scores[lane])
+				{
+					bestScores[position] = bestScores[position - 1];
+					bestLights[position] = bestLights[position - 1];
+					--position;
+				}
+				bestScores[position] = scores[lane];
+				bestLights[position] = static_cast<uint32_t>(i + lane);
+				if (numBest < maxLights)  ++numBest;
+				if (numBest == maxLights)  threshold = bestScores[numBest - 1];
+			}
+		}
+
+		mModels[model]->SetObjectLights(bestLights, numBest);
+		mNumLightsSelected += numBest;
+	}
+}
+
+
+// Set each model added to be lit by the scene's lights as usual rather than their own list
+void LightSelector::UseSceneLights()
+{
+	for (auto model : mModels)  model->SetObjectLights(nullptr, -1);
+}
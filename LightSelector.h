@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// Chooses the few lights that most affect each model
+//--------------------------------------------------------------------------------------
+// An alternative to clustered lighting for forward rendering: each model is lit by at most MAX_OBJECT_LIGHTS lights, so the
+// cost of its pixels stays the same however many lights the scene has. Lights are ranked by their strength at the model's
+// bounding sphere. Lights fade as 1 / distance (see Lighting.hlsli) so the strength of a light is its brightest colour
+// component over the distance to the nearest point of the sphere. Lights whose range doesn't reach the sphere are never
+// picked and directional lights are the same strength everywhere. Spotlights are ranked as point lights, their cones are
+// not considered.
+//
+// Models are added each frame then all selected in one pass, which scores four lights at a time with SSE
+
+#ifndef _LIGHT_SELECTOR_H_INCLUDED_
+#define _LIGHT_SELECTOR_H_INCLUDED_
+
+#include "Common.h"
+#include "LightManager.h"
+#include "CVector3.h"
+
+#include <vector>
+#include <cstdint>
+
+class Model;
+
+
+class LightSelector
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Call at the start of each frame, before adding the frame's models
+	void Clear();
+
+	// Add a model to choose lights for. Its bounding sphere is read now, so add it after it has been moved for the frame
+	void Add(Model* model);
+
+	// Choose the most influential lights for each model added, up to the given number (at most MAX_OBJECT_LIGHTS), and give
+	// them to the models (see Model::SetObjectLights). Models are then lit by only those lights until this is called again
+	void Select(LightManager& lights, unsigned int maxLights = MAX_OBJECT_LIGHTS);
+
+	// Set each model added to be lit by the scene's lights as usual rather than their own list
+	void UseSceneLights();
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	unsigned int NumModels()          { return static_cast<unsigned int>(mModels.size()); }
+	unsigned int NumLightsSelected()  { return mNumLightsSelected; } // Total over all models in the last Select
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	// Models added this frame and their world space bounding spheres
+	std::vector<Model*>   mModels;
+	std::vector<CVector3> mCentres;
+	std::vector<float>    mRadii;
+
+	// The lights packed for SSE and padded to a multiple of 4 with lights that are never picked (kept to avoid allocations)
+	std::vector<float>   mLightX, mLightY, mLightZ, mLightRange, mLightBrightness;
+	std::vector<int32_t> mIsDirectional;
+
+	unsigned int mNumLightsSelected = 0;
+};
+
+
+#endif //_LIGHT_SELECTOR_H_INCLUDED_
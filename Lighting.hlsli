@@ -0,0 +1,172 @@
+//--------------------------------------------------------------------------------------
+// Lighting include file for the pixel shaders that light surfaces
+//--------------------------------------------------------------------------------------
+// The scene's lights are in a structured buffer rather than the per-frame constants so any number can be used, the number
+// in the buffer is gNumLights (see LightManager.h for the C++ side). Include Common.hlsli before this file.
+//
+// When clustered lighting is in use (gClusterCountZ > 0) only the lights in the pixel's cluster are used - the C++ side
+// lists the lights that reach each part of the view (see LightClusters.h). Models given their own list of lights
+// (gNumObjectLights >= 0) use only those instead (see LightSelector.h).
+//
+// Shaders that change how the diffuse level is turned into light (e.g. cell shading) can define LIGHT_DIFFUSE_LEVEL(level)
+// before including this file. Textures sampled in the light loop must use SampleLevel - gradients are not available in
+// loops with branches
+
+
+//--------------------------------------------------------------------------------------
+// Light data
+//--------------------------------------------------------------------------------------
+
+// Light types, must match ELightType in LightManager.h
+static const int LIGHT_TYPE_POINT       = 0;
+static const int LIGHT_TYPE_SPOT        = 1;
+static const int LIGHT_TYPE_DIRECTIONAL = 2;
+
+// One light, must match PackedLight in Common.h
+struct Light
+{
+    float3   position;
+    int      type;
+    float3   colour;
+    float    cosHalfAngle;
+    float3   facing;
+    float    range;                // Distance beyond which the light has no effect
+    float4x4 viewProjectionMatrix; // For spotlight shadows
+    float2   shadowUVOffset;       // Tile of the shadow atlas holding the spotlight's shadows, as an offset and scale
+    float2   shadowUVScale;        // from shadow map UVs to atlas UVs. Scale is 0 if the light has no tile
+};
+
+StructuredBuffer<Light> gLights : register(t8);
+
+// Light clusters, the range of gClusterLightIndices used by each cluster (first index, number of lights)
+StructuredBuffer<uint2> gLightClusters       : register(t9);
+StructuredBuffer<uint>  gClusterLightIndices : register(t10);
+
+Texture2D    ShadowAtlas     : register(t1); // Shadow maps of the spotlights and shadow cascades, each in its own tile (see ShadowAtlas.h)
+SamplerState PointClamp      : register(s1);
+
+
+#ifndef LIGHT_DIFFUSE_LEVEL
+#define LIGHT_DIFFUSE_LEVEL(level) (level)
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Lighting
+//--------------------------------------------------------------------------------------
+
+// Whether a point is in the shadow of the directional light using the shadow cascades (see ShadowCascades.h). The first
+// cascade the point is across that has a tile in the shadow atlas is used, points across none of them are lit
+bool InCascadeShadow(float3 worldPosition)
+{
+    const float DepthAdjust = 0.0005f;
+
+    for (int i = 0; i < gNumShadowCascades; ++i)
+    {
+        float4 uvRect = gShadowCascadeUVRects[i];
+        if (uvRect.z == 0)  continue;
+
+        // Cascades are orthographic so w is 1
+        float4 lightProjection = mul(gShadowCascadeMatrices[i], float4(worldPosition, 1.0f));
+        if (any(abs(lightProjection.xy) > 1.0f))  continue;
+        float2 shadowMapUV = 0.5f * lightProjection.xy + float2(0.5f, 0.5f);
+        shadowMapUV.y = 1.0f - shadowMapUV.y;
+        shadowMapUV = uvRect.xy + shadowMapUV * uvRect.zw;
+        // Points beyond the far side of the cascade (past every caster) compare as if on the far side, so they are only
+        // shadowed where a caster was drawn into the tile
+        return min(lightProjection.z, 1.0f) - DepthAdjust > ShadowAtlas.SampleLevel(PointClamp, shadowMapUV, 0).r;
+    }
+    return false;
+}
+
+
+// Add the diffuse and specular light from the light with the given index in gLights at a point on a surface
+void AddLight(uint lightIndex, float3 worldPosition, float3 worldNormal, float3 cameraDirection,
+              inout float3 diffuseLight, inout float3 specularLight)
+{
+    const float DepthAdjust = 0.0005f;
+    Light light = gLights[lightIndex];
+
+    if (light.type == LIGHT_TYPE_DIRECTIONAL)
+    {
+        // A directional light shines along its facing from far away, so it comes from the same direction everywhere and
+        // doesn't fade with distance
+        float diffuseFactor = dot(-light.facing, worldNormal);
+        if (diffuseFactor <= 0.0f)  return;
+        if (int(lightIndex) == gShadowCascadeLight && InCascadeShadow(worldPosition))  return;
+        float3 directionalHalfway = normalize(cameraDirection - light.facing);
+        diffuseLight  += diffuseFactor;
+        specularLight += pow(max(dot(worldNormal, directionalHalfway), 0.0f), gSpecularPower);
+        return;
+    }
+
+    // Direction and distance from pixel to light
+    float3 lightDirection = normalize(light.position - worldPosition);
+    float  lightDist      = length(light.position - worldPosition);
+    if (lightDist > light.range)  return;
+    float3 halfway        = normalize(lightDirection + cameraDirection);
+
+    if (light.type == LIGHT_TYPE_SPOT)
+    {
+        // Check if the pixel is within the cone
+        if (dot(-light.facing, lightDirection) <= light.cosHalfAngle)  return;
+
+        // Shadow map, in the light's tile of the shadow atlas. Lights without a tile are unshadowed
+        if (light.shadowUVScale.x > 0)
+        {
+            float4 lightProjection = mul(light.viewProjectionMatrix, float4(worldPosition, 1.0f));
+            float2 shadowMapUV = 0.5f * lightProjection.xy / lightProjection.w + float2(0.5f, 0.5f);
+            shadowMapUV.y = 1.0f - shadowMapUV.y;
+            shadowMapUV = light.shadowUVOffset + saturate(shadowMapUV) * light.shadowUVScale;
+            float depthFromLight = lightProjection.z / lightProjection.w - DepthAdjust;
+            if (depthFromLight > ShadowAtlas.SampleLevel(PointClamp, shadowMapUV, 0).r)  return;
+        }
+    }
+
+    // Point lights and lit spotlight pixels
+    float3 diffuse = light.colour * LIGHT_DIFFUSE_LEVEL(max(dot(worldNormal, lightDirection), 0)) / lightDist;
+    diffuseLight  += diffuse;
+    specularLight += diffuse * pow(max(dot(worldNormal, halfway), 0), gSpecularPower);
+}
+
+
+// Sum the diffuse and specular light from the scene's lights at a point on a surface with the given world normal. Pass
+// the pixel's SV_Position to find its light cluster. Ambient light is not included
+void CalculateLighting(float4 projectedPosition, float3 worldPosition, float3 worldNormal,
+                       out float3 diffuseLight, out float3 specularLight)
+{
+    diffuseLight  = 0;
+    specularLight = 0;
+
+    // Direction from pixel to camera
+    float3 cameraDirection = normalize(gCameraPosition - worldPosition);
+
+    if (gNumObjectLights >= 0)
+    {
+        for (int k = 0; k < gNumObjectLights; ++k)
+        {
+            AddLight(gObjectLights[k / 4][k % 4], worldPosition, worldNormal, cameraDirection, diffuseLight, specularLight);
+        }
+        return;
+    }
+
+    if (gClusterCountZ == 0)
+    {
+        for (int i = 0; i < gNumLights; ++i)
+        {
+            AddLight(i, worldPosition, worldNormal, cameraDirection, diffuseLight, specularLight);
+        }
+        return;
+    }
+
+    // Find the cluster from the pixel's screen position and its view space depth (w of SV_Position)
+    int clusterX = min(int(projectedPosition.x * gClusterCountX / gViewportWidth),  gClusterCountX - 1);
+    int clusterY = min(int(projectedPosition.y * gClusterCountY / gViewportHeight), gClusterCountY - 1);
+    int clusterZ = clamp(int(log(projectedPosition.w) * gClusterDepthScale + gClusterDepthBias), 0, gClusterCountZ - 1);
+    uint2 cluster = gLightClusters[(clusterZ * gClusterCountY + clusterY) * gClusterCountX + clusterX];
+
+    for (uint j = 0; j < cluster.y; ++j)
+    {
+        AddLight(gClusterLightIndices[cluster.x + j], worldPosition, worldNormal, cameraDirection, diffuseLight, specularLight);
+    }
+}
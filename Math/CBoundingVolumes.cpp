@@ -0,0 +1,151 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume classes: sphere, axis-aligned box (AABB) and oriented box (OBB)
+//--------------------------------------------------------------------------------------
+
+#include "CBoundingVolumes.h"
+
+#include <algorithm>
+#include <cfloat>
+
+
+/*-----------------------------------------------------------------------------------------
+    Sphere
+-----------------------------------------------------------------------------------------*/
+
+// Return this sphere transformed by the given matrix. Non-uniform scaling grows the sphere by the largest scale
+CSphere CSphere::Transform(const CMatrix4x4& m) const
+{
+    CVector3 scale = m.GetScale();
+    return { m.TransformPoint(centre), radius * std::max(scale.x, std::max(scale.y, scale.z)) };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Axis-aligned bounding box
+-----------------------------------------------------------------------------------------*/
+
+// Return a box containing nothing, which can be grown with Expand
+CAABB CAABB::Empty()
+{
+    return { {  FLT_MAX,  FLT_MAX,  FLT_MAX },
+             { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+}
+
+
+// Grow the box to contain a point or another box
+void CAABB::Expand(const CVector3& point)
+{
+    minimum = { std::min(minimum.x, point.x), std::min(minimum.y, point.y), std::min(minimum.z, point.z) };
+    maximum = { std::max(maximum.x, point.x), std::max(maximum.y, point.y), std::max(maximum.z, point.z) };
+}
+
+void CAABB::Expand(const CAABB& box)
+{
+    minimum = { std::min(minimum.x, box.minimum.x), std::min(minimum.y, box.minimum.y), std::min(minimum.z, box.minimum.z) };
+    maximum = { std::max(maximum.x, box.maximum.x), std::max(maximum.y, box.maximum.y), std::max(maximum.z, box.maximum.z) };
+}
+
+
+// Surface area of the box, 0 for an empty box. Used to estimate how likely the box is to be hit when building trees
+float CAABB::SurfaceArea() const
+{
+    CVector3 size = maximum - minimum;
+    if (size.x < 0 || size.y < 0 || size.z < 0)  return 0;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+
+// Whether the box contains a point, points on the surface are inside
+bool CAABB::Contains(const CVector3& point) const
+{
+    return point.x >= minimum.x && point.x <= maximum.x &&
+           point.y >= minimum.y && point.y <= maximum.y &&
+           point.z >= minimum.z && point.z <= maximum.z;
+}
+
+
+// Return a box enclosing this box transformed by the given matrix (which can rotate, so the result is usually larger)
+// Transforms the centre, then each new extent is the sum of the old extents scaled by the size of the matrix elements
+// (Jim Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems 1990)
+CAABB CAABB::Transform(const CMatrix4x4& m) const
+{
+    CVector3 centre  = m.TransformPoint(Centre());
+    CVector3 extents = Extents();
+    CVector3 newExtents = { extents.x * std::abs(m.e00) + extents.y * std::abs(m.e10) + extents.z * std::abs(m.e20),
+                            extents.x * std::abs(m.e01) + extents.y * std::abs(m.e11) + extents.z * std::abs(m.e21),
+                            extents.x * std::abs(m.e02) + extents.y * std::abs(m.e12) + extents.z * std::abs(m.e22) };
+    return { centre - newExtents, centre + newExtents };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Oriented bounding box
+-----------------------------------------------------------------------------------------*/
+
+// Construct from an axis-aligned box in model space and the model's world matrix (which must not be sheared)
+COBB::COBB(const CAABB& box, const CMatrix4x4& m)
+{
+    centre = m.TransformPoint(box.Centre());
+
+    // Scaling is moved from the axes into the extents
+    CVector3 boxExtents = box.Extents();
+    CVector3 scale = m.GetScale();
+    axes[0] = Normalise(m.GetXAxis());
+    axes[1] = Normalise(m.GetYAxis());
+    axes[2] = Normalise(m.GetZAxis());
+    extents = { boxExtents.x * scale.x, boxExtents.y * scale.y, boxExtents.z * scale.z };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Whether two volumes overlap, touching counts as overlapping
+bool Intersects(const CAABB& a, const CAABB& b)
+{
+    return a.minimum.x <= b.maximum.x && a.maximum.x >= b.minimum.x &&
+           a.minimum.y <= b.maximum.y && a.maximum.y >= b.minimum.y &&
+           a.minimum.z <= b.maximum.z && a.maximum.z >= b.minimum.z;
+}
+
+bool Intersects(const CSphere& sphere, const CAABB& box)
+{
+    // Distance from the centre to the nearest point in the box
+    float dx = std::max(std::max(box.minimum.x - sphere.centre.x, sphere.centre.x - box.maximum.x), 0.0f);
+    float dy = std::max(std::max(box.minimum.y - sphere.centre.y, sphere.centre.y - box.maximum.y), 0.0f);
+    float dz = std::max(std::max(box.minimum.z - sphere.centre.z, sphere.centre.z - box.maximum.z), 0.0f);
+    return dx * dx + dy * dy + dz * dz <= sphere.radius * sphere.radius;
+}
+
+bool Intersects(const CSphere& a, const CSphere& b)
+{
+    CVector3 offset = b.centre - a.centre;
+    float radii = a.radius + b.radius;
+    return Dot(offset, offset) <= radii * radii;
+}
+
+
+// Whether a ray hits a box before the given distance along it, and if so the distance where it enters the box (0 if it
+// starts inside). Takes 1 / each component of the ray direction. The ray is clipped to the pair of planes bounding the box
+// on each axis in turn, it misses if nothing is left
+bool RayIntersects(const CVector3& origin, const CVector3& inverseDirection, float maxDistance, const CAABB& box, float& distance)
+{
+    float nearX = (box.minimum.x - origin.x) * inverseDirection.x,  farX = (box.maximum.x - origin.x) * inverseDirection.x;
+    float nearY = (box.minimum.y - origin.y) * inverseDirection.y,  farY = (box.maximum.y - origin.y) * inverseDirection.y;
+    float nearZ = (box.minimum.z - origin.z) * inverseDirection.z,  farZ = (box.maximum.z - origin.z) * inverseDirection.z;
+    float enter = std::max(std::max(std::min(nearX, farX), std::min(nearY, farY)), std::max(std::min(nearZ, farZ), 0.0f));
+    float exit  = std::min(std::min(std::max(nearX, farX), std::max(nearY, farY)), std::min(std::max(nearZ, farZ), maxDistance));
+    if (enter > exit)  return false;
+    distance = enter;
+    return true;
+}
+
+
+// Return the smallest box containing both the given boxes
+CAABB Merge(const CAABB& a, const CAABB& b)
+{
+    CAABB box = a;
+    box.Expand(b);
+    return box;
+}
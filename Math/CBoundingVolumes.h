@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume classes: sphere, axis-aligned box (AABB) and oriented box (OBB)
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Used to cull things that can't be seen (see CFrustum.h). Each volume is a simple shape enclosing something more complex,
+// so if the volume can't be seen neither can what it encloses
+
+#ifndef _CBOUNDING_VOLUMES_H_DEFINED_
+#define _CBOUNDING_VOLUMES_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Sphere
+-----------------------------------------------------------------------------------------*/
+
+class CSphere
+{
+// Concrete class - public access
+public:
+    CVector3 centre;
+    float    radius;
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CSphere() {}
+
+    // Construct with a centre and radius
+    CSphere(const CVector3& centreIn, const float radiusIn)
+        : centre(centreIn), radius(radiusIn) {}
+
+    // Return this sphere transformed by the given matrix. Non-uniform scaling grows the sphere by the largest scale
+    CSphere Transform(const CMatrix4x4& m) const;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Axis-aligned bounding box
+-----------------------------------------------------------------------------------------*/
+
+class CAABB
+{
+// Concrete class - public access
+public:
+    // Corners with the smallest and largest coordinates. An empty box has minimum greater than maximum (see Empty)
+    CVector3 minimum;
+    CVector3 maximum;
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CAABB() {}
+
+    // Construct from the two corners
+    CAABB(const CVector3& minimumIn, const CVector3& maximumIn)
+        : minimum(minimumIn), maximum(maximumIn) {}
+
+    // Return a box containing nothing, which can be grown with Expand
+    static CAABB Empty();
+
+    CVector3 Centre()  const  { return (minimum + maximum) * 0.5f; }
+    CVector3 Extents() const  { return (maximum - minimum) * 0.5f; } // Half the size in each direction
+
+    // Grow the box to contain a point or another box
+    void Expand(const CVector3& point);
+    void Expand(const CAABB& box);
+
+    // Surface area of the box, 0 for an empty box. Used to estimate how likely the box is to be hit when building trees
+    float SurfaceArea() const;
+
+    // Whether the box contains a point, points on the surface are inside
+    bool Contains(const CVector3& point) const;
+
+    // Return a box enclosing this box transformed by the given matrix (which can rotate, so the result is usually larger)
+    CAABB Transform(const CMatrix4x4& m) const;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Oriented bounding box
+-----------------------------------------------------------------------------------------*/
+
+class COBB
+{
+// Concrete class - public access
+public:
+    CVector3 centre;
+    CVector3 axes[3]; // Unit length and at right angles to each other
+    CVector3 extents; // Half the size along each axis
+
+    // Default constructor - leaves values uninitialised (for performance)
+    COBB() {}
+
+    // Construct from an axis-aligned box in model space and the model's world matrix (which must not be sheared)
+    COBB(const CAABB& box, const CMatrix4x4& m);
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Whether two volumes overlap, touching counts as overlapping
+bool Intersects(const CAABB& a, const CAABB& b);
+bool Intersects(const CSphere& sphere, const CAABB& box);
+bool Intersects(const CSphere& a, const CSphere& b);
+
+// Whether a ray hits a box before the given distance along it, and if so the distance where it enters the box (0 if it
+// starts inside). Takes 1 / each component of the ray direction, which can be calculated once for many boxes. Distances
+// are in multiples of the direction's length
+bool RayIntersects(const CVector3& origin, const CVector3& inverseDirection, float maxDistance, const CAABB& box, float& distance);
+
+// Return the smallest box containing both the given boxes
+CAABB Merge(const CAABB& a, const CAABB& b);
+
+
+#endif // _CBOUNDING_VOLUMES_H_DEFINED_
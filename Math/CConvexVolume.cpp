@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------------------------
+// Convex volume class, a set of planes for culling that can be more than a frustum
+//--------------------------------------------------------------------------------------
+
+#include "CConvexVolume.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct from the planes of a frustum
+CConvexVolume::CConvexVolume(const CFrustum& frustum)
+{
+    numPlanes = 6;
+    for (int i = 0; i < 6; ++i)
+    {
+        planes[i] = frustum.planes[i];
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Add a plane, the volume is cut down to the part in front of it. Does nothing if the volume has MAX_PLANES already
+void CConvexVolume::AddPlane(const CPlane& plane)
+{
+    if (numPlanes < MAX_PLANES)  planes[numPlanes++] = plane;
+}
+
+
+// Cut the volume down to where objects can cast shadows into a view: the convex hull of the light and the view's frustum.
+// The hull is bounded by the frustum planes that face the light, and by planes joining the light to the frustum edges
+// where a plane facing the light meets one facing away (the frustum's silhouette seen from the light)
+void CConvexVolume::AddShadowCasterPlanes(const CFrustum& view, const CVector3& light, bool directional /*= false*/)
+{
+    // Whether each plane of the view has the light in front of it. A directional light is infinitely far away, towards
+    // where its light comes from
+    bool facesLight[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        facesLight[i] = directional ? Dot(view.planes[i].normal, light) <= 0 : view.planes[i].Distance(light) >= 0;
+        if (facesLight[i])  AddPlane(view.planes[i]);
+    }
+
+    // The twelve edges of the frustum, as the two planes that meet there and the corners at each end (see CFrustum::GetCorners)
+    const int L = static_cast<int>(EFrustumPlane::Left),   R = static_cast<int>(EFrustumPlane::Right);
+    const int B = static_cast<int>(EFrustumPlane::Bottom), T = static_cast<int>(EFrustumPlane::Top);
+    const int N = static_cast<int>(EFrustumPlane::Near),   F = static_cast<int>(EFrustumPlane::Far);
+    const struct { int plane1, plane2, corner1, corner2; } edges[12] =
+    {
+        { L, B, 0, 4 }, { R, B, 1, 5 }, { L, T, 2, 6 }, { R, T, 3, 7 }, // Near to far
+        { N, B, 0, 1 }, { N, T, 2, 3 }, { N, L, 0, 2 }, { N, R, 1, 3 }, // Around the near plane
+        { F, B, 4, 5 }, { F, T, 6, 7 }, { F, L, 4, 6 }, { F, R, 5, 7 }, // Around the far plane
+    };
+    CVector3 corners[8];
+    view.GetCorners(corners);
+    CVector3 centre = { 0, 0, 0 };
+    for (auto& corner : corners)  centre += corner * 0.125f;
+
+    for (auto& edge : edges)
+    {
+        if (facesLight[edge.plane1] == facesLight[edge.plane2])  continue;
+
+        // Plane containing the edge and the light (or the light's direction), facing the frustum. Skipped if the light is
+        // in line with the edge, leaving the volume larger
+        const CVector3& start = corners[edge.corner1];
+        CVector3 toLight = directional ? light * -1.0f : light - start;
+        CVector3 normal = Cross(corners[edge.corner2] - start, toLight);
+        if (IsZero(Length(normal)))  continue;
+
+        CPlane plane(start, normal);
+        if (plane.Distance(centre) < 0)  plane = CPlane(start, normal * -1.0f);
+        AddPlane(plane);
+    }
+}
+
+
+// Whether a point is inside the volume, points on the sides are inside
+bool CConvexVolume::Contains(const CVector3& point) const
+{
+    for (int i = 0; i < numPlanes; ++i)
+    {
+        if (planes[i].Distance(point) < 0)  return false;
+    }
+    return true;
+}
+
+
+// Whether a box may be inside the volume
+bool CConvexVolume::Intersects(const CAABB& box) const
+{
+    uint32_t planeMask = AllPlanes();
+    return Intersects(box, planeMask);
+}
+
+
+// Whether a box may be inside the volume, testing only the planes whose bits are set in planeMask. Clears the bits of
+// planes the box is entirely inside. Uses the same corners as CFrustum so gives the same results for the same planes
+bool CConvexVolume::Intersects(const CAABB& box, uint32_t& planeMask) const
+{
+    for (int i = 0; i < numPlanes; ++i)
+    {
+        if ((planeMask & (1u << i)) == 0)  continue;
+
+        const CPlane& plane = planes[i];
+        CVector3 furthest = { plane.normal.x >= 0 ? box.maximum.x : box.minimum.x,
+                              plane.normal.y >= 0 ? box.maximum.y : box.minimum.y,
+                              plane.normal.z >= 0 ? box.maximum.z : box.minimum.z };
+        if (plane.Distance(furthest) < 0)  return false;
+
+        CVector3 nearest = { plane.normal.x >= 0 ? box.minimum.x : box.maximum.x,
+                             plane.normal.y >= 0 ? box.minimum.y : box.maximum.y,
+                             plane.normal.z >= 0 ? box.minimum.z : box.maximum.z };
+        if (plane.Distance(nearest) >= 0)  planeMask &= ~(1u << i);
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Convex volume class, a set of planes for culling that can be more than a frustum
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The volume is the space in front of all its planes. Made from a frustum then optionally cut down further, e.g. to the
+// part of a light's frustum where objects can cast shadows that a camera can see (see AddShadowCasterPlanes).
+//
+// Like CFrustum the tests are conservative: a box reported as outside is certainly outside, a box near an edge or corner
+// may be reported as inside when it isn't
+
+#ifndef _CCONVEX_VOLUME_H_DEFINED_
+#define _CCONVEX_VOLUME_H_DEFINED_
+
+#include "CVector3.h"
+#include "CPlane.h"
+#include "CFrustum.h"
+#include "CBoundingVolumes.h"
+
+#include <cstdint>
+
+
+class CConvexVolume
+{
+// Concrete class - public access
+public:
+    // Enough for a frustum plus the shadow caster planes of another frustum (6 facing the light and 6 silhouette edges)
+    static const int MAX_PLANES = 18;
+
+    CPlane planes[MAX_PLANES]; // Normalised with normals facing inwards
+    int    numPlanes;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - a volume with no planes, which contains everything
+    CConvexVolume() : numPlanes(0) {}
+
+    // Construct from the planes of a frustum
+    explicit CConvexVolume(const CFrustum& frustum);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Add a plane, the volume is cut down to the part in front of it. Does nothing if the volume has MAX_PLANES already,
+    // which leaves the volume larger than it should be but still safe for culling
+    void AddPlane(const CPlane& plane);
+
+    // Cut the volume down to where objects can cast shadows into a view: between the light and the view's frustum (the
+    // convex hull of the two). Pass the light's position, or for a directional light the direction its light travels and
+    // directional = true. Anything outside can't shadow anything the view sees, so needn't be drawn into a shadow map
+    void AddShadowCasterPlanes(const CFrustum& view, const CVector3& light, bool directional = false);
+
+    // Whether a point is inside the volume, points on the sides are inside
+    bool Contains(const CVector3& point) const;
+
+    // Whether a box may be inside the volume
+    bool Intersects(const CAABB& box) const;
+
+    // Whether a box may be inside the volume, testing only the planes whose bits are set in planeMask (bit n for plane n).
+    // Clears the bits of planes the box is entirely inside, the mask is 0 afterwards if the box is entirely inside the
+    // volume (see CFrustum for use). Start with AllPlanes()
+    bool Intersects(const CAABB& box, uint32_t& planeMask) const;
+    uint32_t AllPlanes() const  { return (1u << numPlanes) - 1; }
+};
+
+
+#endif // _CCONVEX_VOLUME_H_DEFINED_
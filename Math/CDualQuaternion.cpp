@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Dual quaternion class to hold rigid transforms (rotation + translation), used for skinning
+//--------------------------------------------------------------------------------------
+
+#include "CDualQuaternion.h"
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity dual quaternion (no rotation or translation)
+CDualQuaternion DualQuaternionIdentity()
+{
+    return { { 0, 0, 0, 1 }, { 0, 0, 0, 0 } };
+}
+
+// Return a dual quaternion of the rigid part of the given affine matrix - rotation and translation, any scaling is lost
+CDualQuaternion DualQuaternionFromMatrix(const CMatrix4x4& m)
+{
+    // Dual part is (translation * rotation) / 2, where the translation is treated as a quaternion with w = 0
+    CDualQuaternion dq;
+    dq.real = QuaternionFromMatrix(m);
+    CVector3 t = m.GetPosition();
+    dq.dual = CQuaternion{ t.x, t.y, t.z, 0 } * dq.real * 0.5f;
+    return dq;
+}
+
+// Return a matrix holding the transform in the given unit dual quaternion
+CMatrix4x4 MatrixFromDualQuaternion(const CDualQuaternion& dq)
+{
+    // Translation is 2 * dual * conjugate(real)
+    CMatrix4x4 m = MatrixFromQuaternion(dq.real);
+    CQuaternion t = dq.dual * Conjugate(dq.real) * 2.0f;
+    m.SetRow(3, t.GetAxis());
+    return m;
+}
+
+
+// Transform a point / vector by a unit dual quaternion. Vectors are only rotated
+CVector3 TransformPosition(const CDualQuaternion& dq, const CVector3& p)
+{
+    // Expanded form of the translation calculation in MatrixFromDualQuaternion, the same calculation is used in the shader
+    CVector3 realAxis = dq.real.GetAxis();
+    CVector3 dualAxis = dq.dual.GetAxis();
+    CVector3 t = 2.0f * (dq.real.w * dualAxis - dq.dual.w * realAxis + Cross(realAxis, dualAxis));
+    return Rotate(dq.real, p) + t;
+}
+
+CVector3 TransformVector(const CDualQuaternion& dq, const CVector3& v)
+{
+    return Rotate(dq.real, v);
+}
+
+
+// Blend the dual quaternions in the palette selected by the given indexes using the given weights. Each one is flipped
+// to the same hemisphere as the first before adding so rotations take the short way round. The result is normalised
+CDualQuaternion BlendDualQuaternions(const CDualQuaternion* palette, const unsigned int* indexes, const float* weights,
+                                     unsigned int count)
+{
+    const CDualQuaternion& first = palette[indexes[0]];
+    CDualQuaternion blend = { first.real * weights[0], first.dual * weights[0] };
+    for (unsigned int i = 1; i < count; ++i)
+    {
+        const CDualQuaternion& dq = palette[indexes[i]];
+        float weight = Dot(first.real, dq.real) < 0.0f ? -weights[i] : weights[i];
+        blend.real = blend.real + dq.real * weight;
+        blend.dual = blend.dual + dq.dual * weight;
+    }
+
+    // Normalise using the length of the real part, which the dual part must be scaled by too
+    float lengthSq = Dot(blend.real, blend.real);
+    if (IsZero(lengthSq))  return DualQuaternionIdentity();
+    float invLength = InvSqrt(lengthSq);
+    return { blend.real * invLength, blend.dual * invLength };
+}
+
+
+// Build a palette of dual quaternions from an array of affine matrices, selected by a list of indexes into the given array
+// (e.g. a bone palette). Matrices should be rigid, any scaling is lost
+void BuildDualQuaternionPalette(const CMatrix4x4* matrices, const unsigned int* indexes, CDualQuaternion* palette,
+                                unsigned int count)
+{
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        palette[i] = DualQuaternionFromMatrix(matrices[indexes[i]]);
+    }
+}
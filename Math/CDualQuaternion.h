@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Dual quaternion class to hold rigid transforms (rotation + translation), used for skinning
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _CDUALQUATERNION_H_DEFINED_
+#define _CDUALQUATERNION_H_DEFINED_
+
+#include "CQuaternion.h"
+
+
+// A unit dual quaternion holds a rotation (the real part) and a translation (stored in the dual part). It can only represent
+// rigid transforms - no scaling. Blending several of them and renormalising gives a rigid transform that rotates around the
+// joint, whereas blending matrices shrinks the mesh on twisting joints ("candy-wrapper" artifacts).
+// Takes 8 floats, half the size of a CMatrix4x4. Layout matches two HLSL float4s: real then dual
+class CDualQuaternion
+{
+// Concrete class - public access
+public:
+	CQuaternion real; // Rotation
+	CQuaternion dual; // Half the translation multiplied by the rotation
+};
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity dual quaternion (no rotation or translation)
+CDualQuaternion DualQuaternionIdentity();
+
+// Return a dual quaternion of the rigid part of the given affine matrix - rotation and translation, any scaling is lost
+CDualQuaternion DualQuaternionFromMatrix(const CMatrix4x4& m);
+
+// Return a matrix holding the transform in the given unit dual quaternion
+CMatrix4x4 MatrixFromDualQuaternion(const CDualQuaternion& dq);
+
+
+// Transform a point / vector by a unit dual quaternion. Vectors are only rotated
+CVector3 TransformPosition(const CDualQuaternion& dq, const CVector3& p);
+CVector3 TransformVector(const CDualQuaternion& dq, const CVector3& v);
+
+
+// Blend the dual quaternions in the palette selected by the given indexes using the given weights. Each one is flipped
+// to the same hemisphere as the first before adding so rotations take the short way round. The result is normalised
+CDualQuaternion BlendDualQuaternions(const CDualQuaternion* palette, const unsigned int* indexes, const float* weights,
+                                     unsigned int count);
+
+
+// Build a palette of dual quaternions from an array of affine matrices, selected by a list of indexes into the given array
+// (e.g. a bone palette). Matrices should be rigid, any scaling is lost
+void BuildDualQuaternionPalette(const CMatrix4x4* matrices, const unsigned int* indexes, CDualQuaternion* palette,
+                                unsigned int count);
+
+
+#endif // _CDUALQUATERNION_H_DEFINED_
@@ -0,0 +1,288 @@
+//--------------------------------------------------------------------------------------
+// View frustum class, for culling bounding volumes that a camera or light can't see
+//--------------------------------------------------------------------------------------
+
+#include "CFrustum.h"
+
+#include <xmmintrin.h> // SSE intrinsics
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct the frustum seen through a view-projection matrix, e.g. Camera::ViewProjectionMatrix(). Uses the DirectX
+// convention of clip space depth from 0 to 1
+CFrustum::CFrustum(const CMatrix4x4& m)
+{
+    // A point p is transformed to clip space by p * m, so each clip coordinate is the dot product of p (with w = 1) with a
+    // column of m. The point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w, each of which is a plane
+    auto columnPlane = [](float x0, float x1, float x2, float x3)
+    {
+        CPlane plane = { { x0, x1, x2 }, x3 };
+        plane.Normalise();
+        return plane;
+    };
+    planes[static_cast<int>(EFrustumPlane::Left)]   = columnPlane(m.e03 + m.e00, m.e13 + m.e10, m.e23 + m.e20, m.e33 + m.e30);
+    planes[static_cast<int>(EFrustumPlane::Right)]  = columnPlane(m.e03 - m.e00, m.e13 - m.e10, m.e23 - m.e20, m.e33 - m.e30);
+    planes[static_cast<int>(EFrustumPlane::Bottom)] = columnPlane(m.e03 + m.e01, m.e13 + m.e11, m.e23 + m.e21, m.e33 + m.e31);
+    planes[static_cast<int>(EFrustumPlane::Top)]    = columnPlane(m.e03 - m.e01, m.e13 - m.e11, m.e23 - m.e21, m.e33 - m.e31);
+    planes[static_cast<int>(EFrustumPlane::Near)]   = columnPlane(m.e02,         m.e12,         m.e22,         m.e32);
+    planes[static_cast<int>(EFrustumPlane::Far)]    = columnPlane(m.e03 - m.e02, m.e13 - m.e12, m.e23 - m.e22, m.e33 - m.e32);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Get the eight corners of the frustum, where its planes meet (see header for order)
+void CFrustum::GetCorners(CVector3 corners[8]) const
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        // The point on three planes a, b and c (Graphics Gems 1, "Intersection of Three Planes")
+        const CPlane& a = planes[static_cast<int>((i & 1) ? EFrustumPlane::Right : EFrustumPlane::Left)];
+        const CPlane& b = planes[static_cast<int>((i & 2) ? EFrustumPlane::Top   : EFrustumPlane::Bottom)];
+        const CPlane& c = planes[static_cast<int>((i & 4) ? EFrustumPlane::Far   : EFrustumPlane::Near)];
+        CVector3 bc = Cross(b.normal, c.normal);
+        float scale = -1.0f / Dot(a.normal, bc);
+        corners[i] = (bc * a.d + Cross(c.normal, a.normal) * b.d + Cross(a.normal, b.normal) * c.d) * scale;
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Single volume tests
+-----------------------------------------------------------------------------------------*/
+
+// Whether a point is inside the frustum, points on the sides are inside
+bool CFrustum::Contains(const CVector3& point) const
+{
+    for (auto& plane : planes)
+    {
+        if (plane.Distance(point) < 0)  return false;
+    }
+    return true;
+}
+
+
+// Whether a volume may be visible (see notes at top of header)
+bool CFrustum::Intersects(const CSphere& sphere) const
+{
+    for (auto& plane : planes)
+    {
+        if (plane.Distance(sphere.centre) < -sphere.radius)  return false;
+    }
+    return true;
+}
+
+bool CFrustum::Intersects(const CAABB& box) const
+{
+    // Only the corner furthest along the plane normal needs testing - if it is behind the plane, the whole box is
+    for (auto& plane : planes)
+    {
+        CVector3 corner = { plane.normal.x >= 0 ? box.maximum.x : box.minimum.x,
+                            plane.normal.y >= 0 ? box.maximum.y : box.minimum.y,
+                            plane.normal.z >= 0 ? box.maximum.z : box.minimum.z };
+        if (plane.Distance(corner) < 0)  return false;
+    }
+    return true;
+}
+
+bool CFrustum::Intersects(const COBB& box) const
+{
+    // The box reaches this far towards the plane from its centre
+    for (auto& plane : planes)
+    {
+        float reach = box.extents.x * std::abs(Dot(plane.normal, box.axes[0])) +
+                      box.extents.y * std::abs(Dot(plane.normal, box.axes[1])) +
+                      box.extents.z * std::abs(Dot(plane.normal, box.axes[2]));
+        if (plane.Distance(box.centre) < -reach)  return false;
+    }
+    return true;
+}
+
+
+// Whether a box is entirely inside the frustum, so anything within it is visible without further tests
+bool CFrustum::Contains(const CAABB& box) const
+{
+    // Only the corner furthest against the plane normal needs testing - if it is in front of the plane, the whole box is
+    for (auto& plane : planes)
+    {
+        CVector3 corner = { plane.normal.x >= 0 ? box.minimum.x : box.maximum.x,
+                            plane.normal.y >= 0 ? box.minimum.y : box.maximum.y,
+                            plane.normal.z >= 0 ? box.minimum.z : box.maximum.z };
+        if (plane.Distance(corner) < 0)  return false;
+    }
+    return true;
+}
+
+
+// Whether a box may be visible, testing only the planes whose bits are set in planeMask. Clears the bits of planes the box
+// is entirely inside. Uses the same corners as the tests above so gives the same results
+bool CFrustum::Intersects(const CAABB& box, unsigned int& planeMask) const
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if ((planeMask & (1 << i)) == 0)  continue;
+
+        const CPlane& plane = planes[i];
+        CVector3 furthest = { plane.normal.x >= 0 ? box.maximum.x : box.minimum.x,
+                              plane.normal.y >= 0 ? box.maximum.y : box.minimum.y,
+                              plane.normal.z >= 0 ? box.maximum.z : box.minimum.z };
+        if (plane.Distance(furthest) < 0)  return false;
+
+        CVector3 nearest = { plane.normal.x >= 0 ? box.minimum.x : box.maximum.x,
+                             plane.normal.y >= 0 ? box.minimum.y : box.maximum.y,
+                             plane.normal.z >= 0 ? box.minimum.z : box.maximum.z };
+        if (plane.Distance(nearest) >= 0)  planeMask &= ~(1 << i);
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Batch tests
+-----------------------------------------------------------------------------------------*/
+// The arithmetic is done in the same order as the single volume tests so the results match exactly
+
+namespace
+{
+    // The frustum planes with each value copied to all four lanes of an SSE register
+    struct SSEPlanes
+    {
+        __m128 nx[6], ny[6], nz[6], d[6];
+        bool   positiveX[6], positiveY[6], positiveZ[6]; // Signs of the normals, to pick box corners
+    };
+
+    void LoadPlanes(const CPlane* planes, SSEPlanes& out)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            out.nx[i] = _mm_set1_ps(planes[i].normal.x);
+            out.ny[i] = _mm_set1_ps(planes[i].normal.y);
+            out.nz[i] = _mm_set1_ps(planes[i].normal.z);
+            out.d[i]  = _mm_set1_ps(planes[i].d);
+            out.positiveX[i] = planes[i].normal.x >= 0;
+            out.positiveY[i] = planes[i].normal.y >= 0;
+            out.positiveZ[i] = planes[i].normal.z >= 0;
+        }
+    }
+
+    // Distance from each plane to four points
+    inline __m128 PlaneDistance(const SSEPlanes& planes, int i, __m128 x, __m128 y, __m128 z)
+    {
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.nx[i], x), _mm_mul_ps(planes.ny[i], y)), _mm_mul_ps(planes.nz[i], z));
+        return _mm_add_ps(dot, planes.d[i]);
+    }
+
+    // Visibility masks for four spheres or boxes
+    inline int SpheresMask(const SSEPlanes& planes, __m128 x, __m128 y, __m128 z, __m128 radius)
+    {
+        // Culled if behind any plane
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+        __m128 culled = _mm_setzero_ps();
+        for (int i = 0; i < 6; ++i)
+        {
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(PlaneDistance(planes, i, x, y, z), negRadius));
+        }
+        return ~_mm_movemask_ps(culled) & 0xf;
+    }
+
+    inline int AABBsMask(const SSEPlanes& planes, __m128 minX, __m128 minY, __m128 minZ, __m128 maxX, __m128 maxY, __m128 maxZ)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 culled = zero;
+        for (int i = 0; i < 6; ++i)
+        {
+            __m128 cornerX = planes.positiveX[i] ? maxX : minX;
+            __m128 cornerY = planes.positiveY[i] ? maxY : minY;
+            __m128 cornerZ = planes.positiveZ[i] ? maxZ : minZ;
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(PlaneDistance(planes, i, cornerX, cornerY, cornerZ), zero));
+        }
+        return ~_mm_movemask_ps(culled) & 0xf;
+    }
+}
+
+
+// Test four spheres, given as arrays of four centre x, y, z and radius values. Returns a mask with bit n set if sphere n
+// may be visible
+int CFrustum::TestSpheres4(const float* x, const float* y, const float* z, const float* radius) const
+{
+    SSEPlanes ssePlanes;
+    LoadPlanes(planes, ssePlanes);
+    return SpheresMask(ssePlanes, _mm_loadu_ps(x), _mm_loadu_ps(y), _mm_loadu_ps(z), _mm_loadu_ps(radius));
+}
+
+
+// Test four boxes, given as arrays of four values for each coordinate of their minimum and maximum corners. Returns a
+// mask with bit n set if box n may be visible
+int CFrustum::TestAABBs4(const float* minX, const float* minY, const float* minZ,
+                         const float* maxX, const float* maxY, const float* maxZ) const
+{
+    SSEPlanes ssePlanes;
+    LoadPlanes(planes, ssePlanes);
+    return AABBsMask(ssePlanes, _mm_loadu_ps(minX), _mm_loadu_ps(minY), _mm_loadu_ps(minZ),
+                                _mm_loadu_ps(maxX), _mm_loadu_ps(maxY), _mm_loadu_ps(maxZ));
+}
+
+
+// Test any number of spheres or boxes given as above, writing 1 for each volume that may be visible and 0 otherwise
+// to the visible array. Returns the number that may be visible
+unsigned int CFrustum::TestSpheres(const float* x, const float* y, const float* z, const float* radius,
+                                   unsigned int count, uint8_t* visible) const
+{
+    SSEPlanes ssePlanes;
+    LoadPlanes(planes, ssePlanes);
+
+    unsigned int numVisible = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int mask = SpheresMask(ssePlanes, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i), _mm_loadu_ps(radius + i));
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+            numVisible += visible[i + lane];
+        }
+    }
+
+    // Last few spheres one at a time
+    for (; i < count; ++i)
+    {
+        visible[i] = Intersects(CSphere{ { x[i], y[i], z[i] }, radius[i] }) ? 1 : 0;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+unsigned int CFrustum::TestAABBs(const float* minX, const float* minY, const float* minZ,
+                                 const float* maxX, const float* maxY, const float* maxZ,
+                                 unsigned int count, uint8_t* visible) const
+{
+    SSEPlanes ssePlanes;
+    LoadPlanes(planes, ssePlanes);
+
+    unsigned int numVisible = 0;
+    unsigned int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int mask = AABBsMask(ssePlanes, _mm_loadu_ps(minX + i), _mm_loadu_ps(minY + i), _mm_loadu_ps(minZ + i),
+                                        _mm_loadu_ps(maxX + i), _mm_loadu_ps(maxY + i), _mm_loadu_ps(maxZ + i));
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+            numVisible += visible[i + lane];
+        }
+    }
+
+    // Last few boxes one at a time
+    for (; i < count; ++i)
+    {
+        visible[i] = Intersects(CAABB{ { minX[i], minY[i], minZ[i] }, { maxX[i], maxY[i], maxZ[i] } }) ? 1 : 0;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// View frustum class, for culling bounding volumes that a camera or light can't see
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The six planes are extracted from a view-projection matrix (Gil Gribb and Klaus Hartmann, "Fast Extraction of Viewing
+// Frustum Planes from the World-View-Projection Matrix"), so works for any camera or light, perspective or orthographic.
+// The plane normals face into the frustum.
+//
+// The tests are conservative: a volume reported as not visible is certainly outside the frustum, but a volume outside
+// near an edge or corner of the frustum may still be reported as visible. That is fine for culling.
+//
+// The batch tests take volumes as separate arrays of each component (structure of arrays) and test four volumes at a time
+// against all six planes with SSE. They give the same results as the single volume tests
+
+#ifndef _CFRUSTUM_H_DEFINED_
+#define _CFRUSTUM_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CPlane.h"
+#include "CBoundingVolumes.h"
+
+#include <cstdint>
+
+
+// Index of each plane in CFrustum::planes
+enum class EFrustumPlane : int
+{
+    Left   = 0,
+    Right  = 1,
+    Bottom = 2,
+    Top    = 3,
+    Near   = 4,
+    Far    = 5,
+};
+
+
+class CFrustum
+{
+// Concrete class - public access
+public:
+    CPlane planes[6]; // In the order of EFrustumPlane above, normalised with normals facing inwards
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CFrustum() {}
+
+    // Construct the frustum seen through a view-projection matrix, e.g. Camera::ViewProjectionMatrix(). Uses the DirectX
+    // convention of clip space depth from 0 to 1
+    explicit CFrustum(const CMatrix4x4& viewProjectionMatrix);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Get the eight corners of the frustum, where its planes meet. Corner i is on the right plane if bit 0 of i is set
+    // (otherwise the left), the top if bit 1 is set (otherwise the bottom) and the far plane if bit 2 is set (otherwise
+    // the near)
+    void GetCorners(CVector3 corners[8]) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Single volume tests
+    -----------------------------------------------------------------------------------------*/
+
+    // Whether a point is inside the frustum, points on the sides are inside
+    bool Contains(const CVector3& point) const;
+
+    // Whether a volume may be visible (see notes at top of file)
+    bool Intersects(const CSphere& sphere) const;
+    bool Intersects(const CAABB& box) const;
+    bool Intersects(const COBB& box) const;
+
+    // Whether a box is entirely inside the frustum, so anything within it is visible without further tests
+    bool Contains(const CAABB& box) const;
+
+    // Whether a box may be visible, testing only the planes whose bits are set in planeMask (bit n for plane n). Clears the
+    // bits of planes the box is entirely inside, so boxes within this one needn't test those planes again - useful when
+    // culling a tree of boxes. The mask is 0 afterwards if the box is entirely inside the frustum. Start with ALL_PLANES
+    static const unsigned int ALL_PLANES = 0x3f;
+    bool Intersects(const CAABB& box, unsigned int& planeMask) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Batch tests
+    -----------------------------------------------------------------------------------------*/
+
+    // Test four spheres, given as arrays of four centre x, y, z and radius values. Returns a mask with bit n set if sphere n
+    // may be visible
+    int TestSpheres4(const float* x, const float* y, const float* z, const float* radius) const;
+
+    // Test four boxes, given as arrays of four values for each coordinate of their minimum and maximum corners. Returns a
+    // mask with bit n set if box n may be visible
+    int TestAABBs4(const float* minX, const float* minY, const float* minZ,
+                   const float* maxX, const float* maxY, const float* maxZ) const;
+
+    // Test any number of spheres or boxes given as above, writing 1 for each volume that may be visible and 0 otherwise
+    // to the visible array. Returns the number that may be visible
+    unsigned int TestSpheres(const float* x, const float* y, const float* z, const float* radius,
+                             unsigned int count, uint8_t* visible) const;
+    unsigned int TestAABBs(const float* minX, const float* minY, const float* minZ,
+                           const float* maxX, const float* maxY, const float* maxZ,
+                           unsigned int count, uint8_t* visible) const;
+};
+
+
+#endif // _CFRUSTUM_H_DEFINED_
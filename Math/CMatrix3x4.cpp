@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Matrix3x4 class - compact form of an affine CMatrix4x4, used for sending bone matrices to the GPU
+//--------------------------------------------------------------------------------------
+
+#include "CMatrix3x4.h"
+
+#include <xmmintrin.h> // SSE intrinsics
+
+
+/*-----------------------------------------------------------------------------------------
+  Helper functions
+-----------------------------------------------------------------------------------------*/
+
+// Pack a single matrix using SSE. Neither matrix is guaranteed to be 16-byte aligned so use unaligned loads / stores
+// (no penalty on modern CPUs when the data happens to be aligned)
+static inline void PackMatrix3x4(const CMatrix4x4& matrix, CMatrix3x4& packedMatrix)
+{
+    const float* in  = &matrix.e00;
+    float*       out = &packedMatrix.e00;
+
+    __m128 row0 = _mm_loadu_ps(in);
+    __m128 row1 = _mm_loadu_ps(in + 4);
+    __m128 row2 = _mm_loadu_ps(in + 8);
+    __m128 row3 = _mm_loadu_ps(in + 12);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+    // After the transpose row3 holds the right-hand column (0,0,0,1), which is the part we drop
+    _mm_storeu_ps(out,     row0);
+    _mm_storeu_ps(out + 4, row1);
+    _mm_storeu_ps(out + 8, row2);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the compact form of the given affine matrix
+CMatrix3x4 ToMatrix3x4(const CMatrix4x4& m)
+{
+    return CMatrix3x4{ m.e00, m.e10, m.e20, m.e30,
+                       m.e01, m.e11, m.e21, m.e31,
+                       m.e02, m.e12, m.e22, m.e32 };
+}
+
+// Return the given compact matrix expanded back to a full affine matrix
+CMatrix4x4 ToMatrix4x4(const CMatrix3x4& m)
+{
+    return CMatrix4x4{ m.e00, m.e10, m.e20, 0,
+                       m.e01, m.e11, m.e21, 0,
+                       m.e02, m.e12, m.e22, 0,
+                       m.e03, m.e13, m.e23, 1 };
+}
+
+
+// Pack an array of affine matrices into compact form. Uses SSE to transpose each matrix in registers, this is called
+// for every bone of every skinned model each frame so it is worth the effort
+void PackMatrices3x4(const CMatrix4x4* matrices, CMatrix3x4* packedMatrices, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        PackMatrix3x4(matrices[i], packedMatrices[i]);
+    }
+}
+
+// As above, but gathers the matrices to pack using a list of indexes into the given array (e.g. a bone palette)
+void PackMatrices3x4(const CMatrix4x4* matrices, const unsigned int* indexes, CMatrix3x4* packedMatrices, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        PackMatrix3x4(matrices[indexes[i]], packedMatrices[i]);
+    }
+}
@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// Matrix3x4 class - compact form of an affine CMatrix4x4, used for sending bone matrices to the GPU
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _CMATRIX3X4_H_DEFINED_
+#define _CMATRIX3X4_H_DEFINED_
+
+#include "CMatrix4x4.h"
+
+
+// The right-hand column of an affine CMatrix4x4 is always (0,0,0,1), so it can be dropped. What is left is transposed
+// so that each row here is one column of the original matrix. That matches a "row_major float3x4" in HLSL, which takes
+// three shader registers instead of four - a 25% saving on every bone uploaded. Only use with affine matrices.
+class CMatrix3x4
+{
+// Concrete class - public access
+public:
+	// Matrix elements - row n holds column n of the CMatrix4x4 it came from
+	float e00, e01, e02, e03;
+	float e10, e11, e12, e13;
+	float e20, e21, e22, e23;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the compact form of the given affine matrix
+CMatrix3x4 ToMatrix3x4(const CMatrix4x4& m);
+
+// Return the given compact matrix expanded back to a full affine matrix
+CMatrix4x4 ToMatrix4x4(const CMatrix3x4& m);
+
+
+// Pack an array of affine matrices into compact form. Uses SSE to transpose each matrix in registers, this is called
+// for every bone of every skinned model each frame so it is worth the effort
+void PackMatrices3x4(const CMatrix4x4* matrices, CMatrix3x4* packedMatrices, unsigned int count);
+
+// As above, but gathers the matrices to pack using a list of indexes into the given array (e.g. a bone palette)
+void PackMatrices3x4(const CMatrix4x4* matrices, const unsigned int* indexes, CMatrix3x4* packedMatrices, unsigned int count);
+
+
+#endif // _CMATRIX3X4_H_DEFINED_
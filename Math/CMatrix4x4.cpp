@@ -29,6 +29,15 @@ CVector3 CMatrix4x4::GetRow(int iRow) const
 }
 
 
+// Transform a point by this matrix (the point is treated as a row vector with w = 1, so translation is applied)
+CVector3 CMatrix4x4::TransformPoint(const CVector3& p) const
+{
+    return { p.x * e00 + p.y * e10 + p.z * e20 + e30,
+             p.x * e01 + p.y * e11 + p.z * e21 + e31,
+             p.x * e02 + p.y * e12 + p.z * e22 + e32 };
+}
+
+
 // Post-multiply this matrix by the given one
 CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
 {
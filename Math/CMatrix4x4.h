@@ -46,6 +46,9 @@ public:
     CVector3 GetEulerAngles();
     CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
 
+    // Transform a point by this matrix (the point is treated as a row vector with w = 1, so translation is applied)
+    CVector3 TransformPoint(const CVector3& p) const;
+
     // Post-multiply this matrix by the given one
     CMatrix4x4& operator*=(const CMatrix4x4& m);
 
@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Plane class, mainly for the sides of view frustums (see CFrustum.h)
+//--------------------------------------------------------------------------------------
+
+#include "CPlane.h"
+
+
+// Construct from a point on the plane and the plane's normal (which need not be normalised)
+CPlane::CPlane(const CVector3& point, const CVector3& normalIn)
+{
+    normal = ::Normalise(normalIn); // The free function, not the member below
+    d = -Dot(normal, point);
+}
+
+
+// Scale the plane so its normal has length 1, the plane itself is unchanged
+void CPlane::Normalise()
+{
+    float length = Length(normal);
+    if (IsZero(length))  return;
+
+    float invLength = 1.0f / length;
+    normal *= invLength;
+    d *= invLength;
+}
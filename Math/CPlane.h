@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// Plane class, mainly for the sides of view frustums (see CFrustum.h)
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A plane is held as a normal and a distance: points p on the plane have Dot(normal, p) + d = 0. Points on the side the
+// normal faces are at a positive distance, points behind it at a negative distance
+
+#ifndef _CPLANE_H_DEFINED_
+#define _CPLANE_H_DEFINED_
+
+#include "CVector3.h"
+
+
+class CPlane
+{
+// Concrete class - public access
+public:
+    // Plane normal and distance
+    CVector3 normal;
+    float    d;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CPlane() {}
+
+    // Construct with a normal and distance
+    CPlane(const CVector3& normalIn, const float dIn)
+        : normal(normalIn), d(dIn) {}
+
+    // Construct from a point on the plane and the plane's normal (which need not be normalised)
+    CPlane(const CVector3& point, const CVector3& normalIn);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Signed distance from the plane to a point, positive on the side the normal faces. Only a true distance when the
+    // normal has length 1 (see Normalise)
+    float Distance(const CVector3& p) const  { return Dot(normal, p) + d; }
+
+    // Scale the plane so its normal has length 1, the plane itself is unchanged
+    void Normalise();
+};
+
+
+#endif // _CPLANE_H_DEFINED_
@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version) to hold rotations for 3D
+//--------------------------------------------------------------------------------------
+
+#include "CQuaternion.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion-quaternion addition / subtraction
+CQuaternion operator+(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return { q1.x + q2.x, q1.y + q2.y, q1.z + q2.z, q1.w + q2.w };
+}
+
+CQuaternion operator-(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return { q1.x - q2.x, q1.y - q2.y, q1.z - q2.z, q1.w - q2.w };
+}
+
+
+// Quaternion-scalar multiplication
+CQuaternion operator*(const CQuaternion& q, float s)
+{
+    return { q.x * s, q.y * s, q.z * s, q.w * s };
+}
+
+CQuaternion operator*(float s, const CQuaternion& q)
+{
+    return { q.x * s, q.y * s, q.z * s, q.w * s };
+}
+
+
+// Quaternion-quaternion multiplication. Note the order is the reverse of matrices: q1 * q2 rotates by q2 first then q1
+CQuaternion operator*(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return { q1.w*q2.x + q1.x*q2.w + q1.y*q2.z - q1.z*q2.y,
+             q1.w*q2.y + q1.y*q2.w + q1.z*q2.x - q1.x*q2.z,
+             q1.w*q2.z + q1.z*q2.w + q1.x*q2.y - q1.y*q2.x,
+             q1.w*q2.w - q1.x*q2.x - q1.y*q2.y - q1.z*q2.z };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity quaternion (no rotation)
+CQuaternion QuaternionIdentity()
+{
+    return { 0, 0, 0, 1 };
+}
+
+// Dot product of two quaternions
+float Dot(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w;
+}
+
+// Return the conjugate of a quaternion. For unit quaternions this is the inverse rotation
+CQuaternion Conjugate(const CQuaternion& q)
+{
+    return { -q.x, -q.y, -q.z, q.w };
+}
+
+// Return unit length quaternion in the same direction as given one
+CQuaternion Normalise(const CQuaternion& q)
+{
+    float lengthSq = Dot(q, q);
+
+    // Ensure not zero length, return identity if so
+    if (IsZero(lengthSq))  return QuaternionIdentity();
+    return q * InvSqrt(lengthSq);
+}
+
+
+// Return the rotation in the given affine matrix as a unit quaternion. Any scaling in the matrix is removed first
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m)
+{
+    // Remove scaling from the rows to leave a pure rotation
+    CVector3 axisX = Normalise(m.GetXAxis());
+    CVector3 axisY = Normalise(m.GetYAxis());
+    CVector3 axisZ = Normalise(m.GetZAxis());
+
+    // Use the largest of w, x, y or z to calculate the others - avoids dividing by small numbers
+    CQuaternion q;
+    float trace = axisX.x + axisY.y + axisZ.z;
+    if (trace > 0.0f)
+    {
+        float s = 0.5f * InvSqrt(trace + 1.0f);
+        q = { (axisY.z - axisZ.y) * s, (axisZ.x - axisX.z) * s, (axisX.y - axisY.x) * s, 0.25f / s };
+    }
+    else if (axisX.x > axisY.y && axisX.x > axisZ.z)
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisX.x - axisY.y - axisZ.z);
+        q = { 0.25f / s, (axisY.x + axisX.y) * s, (axisZ.x + axisX.z) * s, (axisY.z - axisZ.y) * s };
+    }
+    else if (axisY.y > axisZ.z)
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisY.y - axisX.x - axisZ.z);
+        q = { (axisY.x + axisX.y) * s, 0.25f / s, (axisZ.y + axisY.z) * s, (axisZ.x - axisX.z) * s };
+    }
+    else
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisZ.z - axisX.x - axisY.y);
+        q = { (axisZ.x + axisX.z) * s, (axisZ.y + axisY.z) * s, 0.25f / s, (axisX.y - axisY.x) * s };
+    }
+    return Normalise(q);
+}
+
+// Return a rotation matrix of the given unit quaternion
+CMatrix4x4 MatrixFromQuaternion(const CQuaternion& q)
+{
+    float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+
+    return CMatrix4x4{ 1 - 2*(yy + zz),     2*(xy + wz),     2*(xz - wy), 0,
+                           2*(xy - wz), 1 - 2*(xx + zz),     2*(yz + wx), 0,
+                           2*(xz + wy),     2*(yz - wx), 1 - 2*(xx + yy), 0,
+                                     0,               0,               0, 1 };
+}
+
+
+// Rotate a vector by a unit quaternion
+CVector3 Rotate(const CQuaternion& q, const CVector3& v)
+{
+    // Optimised form of q * v * conjugate(q)
+    CVector3 axis = q.GetAxis();
+    CVector3 t = 2.0f * Cross(axis, v);
+    return v + q.w * t + Cross(axis, t);
+}
+
+
+// Spherical linear interpolation between two unit quaternions, t from 0 (q1) to 1 (q2). Takes the shortest route
+CQuaternion Slerp(const CQuaternion& q1, const CQuaternion& q2, float t)
+{
+    // q and -q are the same rotation, flip the second quaternion if needed so the interpolation takes the short way round
+    float cosAngle = Dot(q1, q2);
+    CQuaternion end = q2;
+    if (cosAngle < 0.0f)
+    {
+        cosAngle = -cosAngle;
+        end = end * -1.0f;
+    }
+
+    // When the quaternions are very close the sine below is near zero, a normalised linear interpolation is accurate enough
+    if (cosAngle > 0.9995f)  return Normalise(q1 + (end - q1) * t);
+
+    float angle = std::acos(cosAngle);
+    float invSinAngle = 1.0f / std::sin(angle);
+    return q1 * (std::sin((1.0f - t) * angle) * invSinAngle) + end * (std::sin(t * angle) * invSinAngle);
+}
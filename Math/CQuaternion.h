@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version) to hold rotations for 3D
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _CQUATERNION_H_DEFINED_
+#define _CQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+// Quaternion class. A unit quaternion represents a rotation about an axis, (x,y,z) is the axis scaled by sin(angle/2)
+// and w is cos(angle/2). Rotations are the same direction as the matching CMatrix4x4 rotation functions.
+// No constructors so it can be used in constant buffer structures (use brace initialisation, e.g. { 0, 0, 0, 1 })
+class CQuaternion
+{
+// Concrete class - public access
+public:
+	// Quaternion components, same order as HLSL float4 so they can be sent to the GPU directly
+	float x, y, z, w;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Helper functions
+    CVector3 GetAxis() const  { return { x, y, z }; } // The vector part - not normalised
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion-quaternion addition / subtraction
+CQuaternion operator+(const CQuaternion& q1, const CQuaternion& q2);
+CQuaternion operator-(const CQuaternion& q1, const CQuaternion& q2);
+
+// Quaternion-scalar multiplication
+CQuaternion operator*(const CQuaternion& q, float s);
+CQuaternion operator*(float s, const CQuaternion& q);
+
+// Quaternion-quaternion multiplication. Note the order is the reverse of matrices: q1 * q2 rotates by q2 first then q1
+CQuaternion operator*(const CQuaternion& q1, const CQuaternion& q2);
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity quaternion (no rotation)
+CQuaternion QuaternionIdentity();
+
+// Dot product of two quaternions
+float Dot(const CQuaternion& q1, const CQuaternion& q2);
+
+// Return the conjugate of a quaternion. For unit quaternions this is the inverse rotation
+CQuaternion Conjugate(const CQuaternion& q);
+
+// Return unit length quaternion in the same direction as given one
+CQuaternion Normalise(const CQuaternion& q);
+
+
+// Return the rotation in the given affine matrix as a unit quaternion. Any scaling in the matrix is removed first
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m);
+
+// Return a rotation matrix of the given unit quaternion
+CMatrix4x4 MatrixFromQuaternion(const CQuaternion& q);
+
+
+// Rotate a vector by a unit quaternion
+CVector3 Rotate(const CQuaternion& q, const CVector3& v);
+
+
+// Spherical linear interpolation between two unit quaternions, t from 0 (q1) to 1 (q2). Takes the shortest route
+CQuaternion Slerp(const CQuaternion& q1, const CQuaternion& q2, float t);
+
+
+#endif // _CQUATERNION_H_DEFINED_
@@ -10,6 +10,9 @@
 #include "CVector2.h" 
 #include "CVector3.h" 
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
+#include "CDualQuaternion.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/DefaultLogger.hpp>
@@ -17,12 +20,26 @@
 #include <assimp/scene.h>
 
 #include <memory>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+// Skeleton LODs keep this fraction of the bones, the bones with the least influence on the vertices are removed first
+static const float SKELETON_LOD_BONE_FRACTIONS[NUM_SKELETON_LODS] = { 1.0f, 0.5f, 0.25f };
 
 
 // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
 // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+// Optionally set the maximum number of bones used by a single sub-mesh (clamped to MAX_BONES). Sub-meshes that
+// use more bones are split into several smaller sub-meshes
+// Optionally choose how a mesh without bones is imported (see ENodeImport in Mesh.h). Only PreTransformed affects skinned
+// meshes (they lose their bones)
 // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/, unsigned int maxBonesPerSubMesh /*= MAX_BONES*/,
+           ENodeImport nodeImport /*= ENodeImport::Hierarchy*/)
 {
     Assimp::Importer importer;
 
@@ -53,6 +70,12 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS | 
                            aiComponent_ANIMATIONS | aiComponent_MATERIALS;
 
+    // Static meshes have the node matrices baked into the vertices, assimp then merges the sub-meshes and removes the hierarchy
+    if (nodeImport == ENodeImport::PreTransformed)
+    {
+        assimpFlags |= aiProcess_PreTransformVertices;
+    }
+
     // Add / remove tangents as required by user
     if (requireTangents)
     {
@@ -70,8 +93,11 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
 
 	// Set maximum bones that can affect one vertex, and also maximum bones affecting a single mesh
+    // Each sub-mesh has its own bone palette, which is what is sent to the shader, so the limit per mesh is the size of the
+    // shader's bone array. Assimp splits any sub-mesh that uses more bones than this (aiProcess_SplitByBoneCount)
     unsigned int maxBonesPerVertex = 4; // The shaders support 4 bones per verted (null bones are added if necessary)
-    unsigned int maxBonesPerMesh = 256; // Bone indexes are stored in a byte, so no more than 256 
+    unsigned int maxBonesPerMesh = maxBonesPerSubMesh < MAX_BONES ? maxBonesPerSubMesh : MAX_BONES;
+    if (maxBonesPerMesh == 0)  maxBonesPerMesh = 1;
     importer.SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, maxBonesPerVertex);
     importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, maxBonesPerMesh);
   
@@ -91,8 +117,33 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     // Read node hierachy - each node has a matrix and contains sub-meshes //
 
     // Uses recursive helper functions to build node hierarchy    
-    mNodes.resize(CountNodes(scene->mRootNode));
+    mNumNodes = CountNodes(scene->mRootNode);
+    if (mNumNodes > UINT16_MAX)  throw std::runtime_error("Too many nodes in mesh: " + fileName);
+    mParentIndexes.resize(mNumNodes);
+    mDefaultMatrices.resize(mNumNodes);
+    mSubMeshStarts.resize(mNumNodes + 1);
+    mNodeSubMeshes.reserve(scene->mNumMeshes);
+    mNodeNameOffsets.resize(mNumNodes);
     ReadNodes(scene->mRootNode, 0, 0);
+    mSubMeshStarts[mNumNodes] = static_cast<unsigned int>(mNodeSubMeshes.size());
+    BuildChildRanges();
+    BuildNodeHashTable(fileName);
+
+    // Default pose of each node relative to the root, kept for models in the default pose (see DefaultPoseMatrices). With the
+    // node holding each sub-mesh it also finds the mesh's bounds
+    mDefaultPoseMatrices.resize(mNumNodes);
+    mDefaultPoseMatrices[0] = MatrixIdentity();
+    for (unsigned int nodeIndex = 1; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        mDefaultPoseMatrices[nodeIndex] = mDefaultMatrices[nodeIndex] * mDefaultPoseMatrices[mParentIndexes[nodeIndex]];
+    }
+    std::vector<unsigned int> subMeshNodes(scene->mNumMeshes, 0);
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)  subMeshNodes[mNodeSubMeshes[i]] = nodeIndex;
+    }
+    CVector3 boundsMin = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    CVector3 boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 
 
 
@@ -100,9 +151,41 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     // Read geometry - multiple parts supported //
 
 	mHasBones = false;
+	mSkinningMode = ESkinningMode::Linear;
 	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
         if (scene->mMeshes[m]->HasBones())  mHasBones = true;
 
+    // A rigid mesh with batched nodes is given bones in the same way as the sub-meshes without bones in a skinned mesh (below):
+    // each vertex is fully weighted to the node it is attached to. Not worth doing if there is only one node
+    mBatchedNodes = !mHasBones && nodeImport == ENodeImport::BatchedNodes && mNumNodes > 1;
+    if (mBatchedNodes)  mHasBones = true;
+
+    // Bone offset matrices are filled in as bones are found in the sub-meshes below, nodes that aren't bones keep the identity
+    mOffsetMatrices.assign(mNumNodes, MatrixIdentity());
+
+    // For skinned meshes, the LOD 0 bone indexes of each sub-mesh, the influence of each bone on the vertices and the nodes
+    // that rigid sub-meshes are attached to are collected as the sub-meshes are read. They are used to build the skeleton
+    // LODs once every sub-mesh has been read
+    std::vector<std::vector<unsigned char>> subMeshBoneIndexes(scene->mNumMeshes);
+    std::vector<float>        nodeWeights(mNumNodes, 0.0f);
+    std::vector<unsigned int> nodeVertexCounts(mNumNodes, 0);
+    std::vector<bool>         rigidNodes(mNumNodes, false);
+
+    // Boxes around each node's vertices, for the bounds of posed models (see PosedBoundingSphere). Skinned vertices are
+    // added with their bone's offset applied, the vertices of rigid sub-meshes as they are - their node's offset may not
+    // be known until a later sub-mesh, so it is applied once they have all been read
+    std::vector<CAABB> skinnedNodeBoxes(mNumNodes, CAABB::Empty());
+    std::vector<CAABB> rigidNodeBoxes(mNumNodes, CAABB::Empty());
+
+    // For batched nodes the CPU-side vertices and indexes are kept, the sub-meshes are merged once they have all been read
+    std::vector<std::unique_ptr<unsigned char[]>> subMeshVertices;
+    std::vector<std::unique_ptr<unsigned char[]>> subMeshIndices;
+    if (mBatchedNodes)
+    {
+        subMeshVertices.resize(scene->mNumMeshes);
+        subMeshIndices.resize(scene->mNumMeshes);
+    }
+
 
     // A mesh is made of sub-meshes, each one can have a different material (texture)
     // Import each sub-mesh in the file to seperate index / vertex buffer (could share buffers between sub-meshes but that would make things more complex)
@@ -146,12 +229,12 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
             offset += 8;
         }
 
-        unsigned int bonesOffset = offset;
+        // Bone indexes change with the skeleton LOD so they are in a second vertex buffer (slot 1), one for each LOD
+        unsigned int weightsOffset = offset;
         if (mHasBones)
         {
-            vertexElements.push_back( { "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, bonesOffset,     D3D11_INPUT_PER_VERTEX_DATA, 0 } );
-            offset += 4;
-            vertexElements.push_back( { "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, bonesOffset + 4, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+            vertexElements.push_back( { "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      1, 0,             D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+            vertexElements.push_back( { "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, weightsOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
             offset += 16;
         }
 
@@ -182,12 +265,23 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
         // Copy mesh data from assimp to our CPU-side vertex buffer
 
+        // Positions are also kept in mPositions relative to the root node, for the bounds and for software rendering
+        uint32_t firstPosition = static_cast<uint32_t>(mPositions.size());
         CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
         unsigned char* position = vertices.get() + positionOffset;
         unsigned char* positionEnd = position + subMesh.numVertices * subMesh.vertexSize;
+        const CMatrix4x4& boundsMatrix = mDefaultPoseMatrices[subMeshNodes[m]];
+        CAABB subMeshBox = CAABB::Empty();
         while (position != positionEnd)
         {
             *(CVector3*)position = *assimpPosition;
+            subMeshBox.Expand(*assimpPosition);
+
+            CVector3 boundsPoint = boundsMatrix.TransformPoint(*assimpPosition);
+            boundsMin = { std::min(boundsMin.x, boundsPoint.x), std::min(boundsMin.y, boundsPoint.y), std::min(boundsMin.z, boundsPoint.z) };
+            boundsMax = { std::max(boundsMax.x, boundsPoint.x), std::max(boundsMax.y, boundsPoint.y), std::max(boundsMax.z, boundsPoint.z) };
+            mPositions.push_back(boundsPoint);
+
             position += subMesh.vertexSize;
             ++assimpPosition;
         }
@@ -231,40 +325,36 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
 		if (mHasBones)
 		{
-			if (assimpMesh->HasBones())
+			// Bone indexes for skeleton LOD 0 are kept CPU-side, the bone vertex buffers for each LOD are created from them later
+			std::vector<unsigned char>& boneIndexes = subMeshBoneIndexes[m];
+			boneIndexes.assign(subMesh.numVertices * 4, 0);
+			std::vector<unsigned int>& bonePalette = subMesh.skeletonLODs[0].bonePalette;
+
+			// Set all weights to 0 to start with
+			unsigned char* weights = vertices.get() + weightsOffset;
+			unsigned char* weightsEnd = weights + subMesh.numVertices * subMesh.vertexSize;
+			while (weights != weightsEnd)
 			{
-				// Set all bones and weights to 0 to start with
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
-				{
-					memset(bones, 0, 20);
-					bones += subMesh.vertexSize;
-				}
-
-				for (auto& node : mNodes)
-				{
-					node.offsetMatrix = MatrixIdentity();
-				}
+				memset(weights, 0, 16);
+				weights += subMesh.vertexSize;
+			}
 
-				// Go through each assimp bone
-				bones = vertices.get() + bonesOffset;
+			if (assimpMesh->HasBones())
+			{
+				// Go through each assimp bone. The vertices store the bone's position in this sub-mesh's palette rather than the
+				// node index, the palette maps it back to the node. So bone indexes stay small however large the skeleton is
+				bonePalette.resize(assimpMesh->mNumBones);
 				for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
 				{
 					// Get offset matrix for the bone (transform from skinned mesh root to bone root
 					aiBone* assimpBone = assimpMesh->mBones[i];
-					std::string boneName = assimpBone->mName.C_Str();
-                    unsigned int nodeIndex;
-					for (nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-					{
-						if (mNodes[nodeIndex].name == boneName)
-						{
-							mNodes[nodeIndex].offsetMatrix.SetValues(&assimpBone->mOffsetMatrix.a1);
-							mNodes[nodeIndex].offsetMatrix.Transpose(); // Assimp stores matrices differently to this app
-							break;
-						}
-					}
-                    if (nodeIndex == mNodes.size())  throw std::runtime_error("Bone with no matching node in " + fileName);
+					const char* boneName = assimpBone->mName.C_Str();
+                    unsigned int nodeIndex = FindNode(HashName(boneName));
+                    if (nodeIndex == NODE_NOT_FOUND || strcmp(GetNodeName(nodeIndex), boneName) != 0)
+                        throw std::runtime_error("Bone with no matching node in " + fileName);
+					mOffsetMatrices[nodeIndex].SetValues(&assimpBone->mOffsetMatrix.a1);
+					mOffsetMatrices[nodeIndex].Transpose(); // Assimp stores matrices differently to this app
+					bonePalette[i] = nodeIndex;
 
 					// Go through each weight of the bone and update the vertex it influences
 					// Find the first 0 weight on that vertex and put the new influence / weight there.
@@ -272,8 +362,8 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 					for (unsigned int j = 0; j < assimpBone->mNumWeights; ++j)
 					{
 						unsigned int vertexIndex = assimpBone->mWeights[j].mVertexId;
-						unsigned char* bone = bones + vertexIndex * subMesh.vertexSize;
-						float* weight = (float*)(bone + 4);
+						unsigned char* bone = &boneIndexes[vertexIndex * 4];
+						float* weight = (float*)(vertices.get() + weightsOffset + vertexIndex * subMesh.vertexSize);
 						float* lastWeight = weight + 3;
 						while (*weight != 0.0f && weight != lastWeight)
 						{
@@ -281,35 +371,56 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 						}
 						if (*weight == 0.0f)
 						{
-							*bone = nodeIndex;
+							*bone = i;
 							*weight = assimpBone->mWeights[j].mWeight;
 						}
+						CVector3 vertexPosition = *reinterpret_cast<CVector3*>(&assimpMesh->mVertices[vertexIndex]);
+						skinnedNodeBoxes[nodeIndex].Expand(mOffsetMatrices[nodeIndex].TransformPoint(vertexPosition));
 					}
 				}
 			}
 			else
 			{
 				// In a mesh that uses skinning any sub-meshes that don't contain bones are given bones so the whole mesh can use one shader
+				// The sub-mesh's palette has a single entry, the node it is attached to. Batched nodes give a sub-mesh used by
+				// several nodes a copy for each of them when merging (see MergeBatchedNodes), so all of those nodes are rigid
 				unsigned int subMeshNode = 0;
-				for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+				for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
 				{
-					for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+					for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)
 					{
-						if (subMeshIndex == m)
+						if (mNodeSubMeshes[i] == m)
+						{
 							subMeshNode = nodeIndex;
+							rigidNodes[nodeIndex] = true;
+						}
 					}
 				}
 				
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
+				weights = vertices.get() + weightsOffset;
+				while (weights != weightsEnd)
 				{
-					memset(bones, 0, 20);
-					bones[0] = subMeshNode;
-					*(float*)(bones + 4) = 1.0f;
-					bones += subMesh.vertexSize;
+					*(float*)weights = 1.0f;
+					weights += subMesh.vertexSize;
 				}
+				bonePalette.assign(1, subMeshNode);
+			}
+
+			// Should have been split by assimp above, but the shaders only have room for MAX_BONES bone matrices
+			if (bonePalette.size() > MAX_BONES)  throw std::runtime_error("Too many bones in " + subMeshName + " in " + fileName);
 
+			// Total up how much each bone influences the vertices, used to choose which bones to remove in the skeleton LODs.
+			// Nodes given to rigid sub-meshes above aren't ranked, they are kept in every LOD
+			for (unsigned int v = 0; assimpMesh->HasBones() && v < subMesh.numVertices; ++v)
+			{
+				const float* weight = (const float*)(vertices.get() + weightsOffset + v * subMesh.vertexSize);
+				for (unsigned int i = 0; i < 4; ++i)
+				{
+					if (weight[i] <= 0.0f)  continue;
+					unsigned int nodeIndex = bonePalette[boneIndexes[v * 4 + i]];
+					nodeWeights[nodeIndex] += weight[i];
+					++nodeVertexCounts[nodeIndex];
+				}
 			}
 		}
             
@@ -326,36 +437,97 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
             *index++ = assimpMesh->mFaces[face].mIndices[0];
             *index++ = assimpMesh->mFaces[face].mIndices[1];
             *index++ = assimpMesh->mFaces[face].mIndices[2];
+            for (int corner = 0; corner < 3; ++corner)  mTriangleIndices.push_back(firstPosition + assimpMesh->mFaces[face].mIndices[corner]);
+        }
+
+        // Every node a rigid sub-mesh is attached to holds its vertices
+        if (!assimpMesh->HasBones())
+        {
+            for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+            {
+                for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)
+                {
+                    if (mNodeSubMeshes[i] == m)  rigidNodeBoxes[nodeIndex].Expand(subMeshBox);
+                }
+            }
+        }
+
+        // A rigid sub-mesh used by several nodes is drawn at each of them, so its positions and triangles are added again for
+        // the other nodes, for the bounds and software rendering. A skinned mesh only draws it at its palette node
+        if (!mHasBones || mBatchedNodes)
+        {
+            const CVector3* subMeshPositions = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+            size_t firstTriangleIndex = mTriangleIndices.size() - assimpMesh->mNumFaces * 3;
+            for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+            {
+                for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)
+                {
+                    if (mNodeSubMeshes[i] != m || nodeIndex == subMeshNodes[m])  continue;
+
+                    uint32_t nodeFirstPosition = static_cast<uint32_t>(mPositions.size());
+                    for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+                    {
+                        CVector3 boundsPoint = mDefaultPoseMatrices[nodeIndex].TransformPoint(subMeshPositions[v]);
+                        boundsMin = { std::min(boundsMin.x, boundsPoint.x), std::min(boundsMin.y, boundsPoint.y), std::min(boundsMin.z, boundsPoint.z) };
+                        boundsMax = { std::max(boundsMax.x, boundsPoint.x), std::max(boundsMax.y, boundsPoint.y), std::max(boundsMax.z, boundsPoint.z) };
+                        mPositions.push_back(boundsPoint);
+                    }
+                    for (unsigned int t = 0; t < assimpMesh->mNumFaces * 3; ++t)
+                    {
+                        uint32_t position = mTriangleIndices[firstTriangleIndex + t] - firstPosition;
+                        mTriangleIndices.push_back(nodeFirstPosition + position);
+                    }
+                }
+            }
         }
 
 
         //-----------------------------------
 
-        D3D11_BUFFER_DESC bufferDesc;
-        D3D11_SUBRESOURCE_DATA initData;
+        if (mBatchedNodes)
+        {
+            subMeshVertices[m] = std::move(vertices);
+            subMeshIndices[m]  = std::move(indices);
+        }
+        else
+        {
+            CreateSubMeshBuffers(subMesh, vertices.get(), indices.get(), fileName);
+        }
+    }
 
-        // Create GPU-side vertex buffer and copy the vertices imported by assimp into it
-        bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-        bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
-        bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
-        bufferDesc.CPUAccessFlags = 0;
-        bufferDesc.MiscFlags = 0;
-        initData.pSysMem = vertices.get(); // Fill the new vertex buffer with data loaded by assimp
-    
-        hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.vertexBuffer);
-        if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
+    // Bounding sphere centred on the bounding box of the vertices, just enclosing the furthest vertex
+    mBoundingCentre = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0;
+    for (auto& boundsPoint : mPositions)
+    {
+        CVector3 offset = boundsPoint - mBoundingCentre;
+        radiusSquared = std::max(radiusSquared, Dot(offset, offset));
+    }
+    mBoundingRadius = std::sqrt(radiusSquared);
+
+    // Merge the sub-meshes of a rigid mesh with batched nodes now they have all been read
+    if (mBatchedNodes)  MergeBatchedNodes(subMeshVertices, subMeshIndices, subMeshBoneIndexes, fileName);
 
+    // Now every offset is known, finish the box around each node's vertices
+    std::vector<CAABB> nodeBoxes = skinnedNodeBoxes;
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        const CAABB& rigidBox = rigidNodeBoxes[nodeIndex];
+        if (rigidBox.minimum.x <= rigidBox.maximum.x)  nodeBoxes[nodeIndex].Expand(rigidBox.Transform(mOffsetMatrices[nodeIndex]));
+    }
 
-        // Create GPU-side index buffer and copy the vertices imported by assimp into it
-        bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
-        bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-        bufferDesc.ByteWidth = subMesh.numIndices * sizeof(DWORD); // Size of the buffer in bytes
-        bufferDesc.CPUAccessFlags = 0;
-        bufferDesc.MiscFlags = 0;
-        initData.pSysMem = indices.get(); // Fill the new index buffer with data loaded by assimp
+    // Now the influence of every bone is known the skeleton LODs can be built, with the node bounds for each
+    if (mHasBones)  BuildSkeletonLODs(subMeshBoneIndexes, nodeWeights, nodeVertexCounts, rigidNodes, nodeBoxes, fileName);
+    else            StoreNodeBounds(0, nodeBoxes);
 
-        hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.indexBuffer);
-        if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
+    // Likewise the bone offsets, so the default pose skinning matrices can be found
+    if (mHasBones)
+    {
+        mDefaultSkinningMatrices.resize(mNumNodes);
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            mDefaultSkinningMatrices[nodeIndex] = mOffsetMatrices[nodeIndex] * mDefaultPoseMatrices[nodeIndex];
+        }
     }
 }
 
@@ -364,6 +536,10 @@ Mesh::~Mesh()
 {
     for (auto& subMesh : mSubMeshes)
     {
+        for (auto& skeletonLOD : subMesh.skeletonLODs)
+        {
+            if (skeletonLOD.boneBuffer)  skeletonLOD.boneBuffer->Release();
+        }
         if (subMesh.indexBuffer)   subMesh.indexBuffer ->Release();
         if (subMesh.vertexBuffer)  subMesh.vertexBuffer->Release();
         if (subMesh.vertexLayout)  subMesh.vertexLayout->Release();
@@ -374,77 +550,237 @@ Mesh::~Mesh()
 //--------------------------------------------------------------------------------------
 
 // Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-void Mesh::RenderSubMesh(const SubMesh& subMesh)
+void Mesh::RenderSubMesh(const SubMesh& subMesh, unsigned int skeletonLOD /*= 0*/)
 {
     // Set vertex buffer as next data source for GPU
     UINT stride = subMesh.vertexSize;
     UINT offset = 0;
-    gD3DContext->IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+    gRenderBackend->IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+
+    // Skinned meshes have a second vertex buffer holding the bone indexes for the skeleton LOD being rendered
+    if (mHasBones)
+    {
+        UINT boneStride = 4;
+        gRenderBackend->IASetVertexBuffers(1, 1, &subMesh.skeletonLODs[skeletonLOD].boneBuffer, &boneStride, &offset);
+    }
 
     // Indicate the layout of vertex buffer
-    gD3DContext->IASetInputLayout(subMesh.vertexLayout);
+    gStateCache.IASetInputLayout(subMesh.vertexLayout);
 
     // Set index buffer as next data source for GPU, indicate it uses 32-bit integers
-    gD3DContext->IASetIndexBuffer(subMesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+    gRenderBackend->IASetIndexBuffer(subMesh.indexBuffer, ERenderIndexFormat::UInt32, 0);
 
     // Using triangle lists only in this class
-    gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    gStateCache.IASetPrimitiveTopology(ERenderTopology::TriangleList);
 
     // Render mesh
-    gD3DContext->DrawIndexed(subMesh.numIndices, 0, 0);
+    gRenderBackend->DrawIndexed(subMesh.numIndices, 0, 0);
 }
 
 
 
-// Render the mesh with the given matrices
-// Handles rigid body meshes (including single part meshes) as well as skinned meshes
-// LIMITATION: The mesh must use a single texture throughout
-void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
+// Calculate the absolute world matrices of a model's nodes from their matrices relative to their parents, and for skinned
+// meshes the skinning matrices (bone offset applied). The caller keeps these between frames - only nodes flagged as dirty
+// and their descendants are recalculated, the rest are reused. The flags of recalculated nodes are cleared.
+// Skinned meshes only update the nodes used by the given skeleton LOD, other nodes stay dirty until a LOD uses them
+// Returns the number of nodes recalculated
+// Pass the model's root matrix and its node matrices (relative to their parents, entry 0 is not used)
+unsigned int Mesh::UpdateMatrices(const CMatrix4x4& rootMatrix, const CMatrix4x4* nodeMatrices, std::vector<unsigned char>& dirtyNodes,
+                                  std::vector<CMatrix4x4>& absoluteMatrices, std::vector<CMatrix4x4>& skinningMatrices,
+                                  unsigned int skeletonLOD /*= 0*/)
 {
-	// Skinning needs all matrices available in the shader at the same time, so first calculate all the absolute
-	// matrices before rendering anything
-    std::vector<CMatrix4x4> absoluteMatrices(modelMatrices.size());
-    absoluteMatrices[0] = modelMatrices[0]; // First matrix for a model is the root matrix, already in world space
-    for (unsigned int nodeIndex = 1; nodeIndex < mNodes.size(); ++nodeIndex)
+    if (skeletonLOD >= NumberSkeletonLODs())  skeletonLOD = NumberSkeletonLODs() - 1;
+    absoluteMatrices.resize(mNumNodes);
+    if (mHasBones)  skinningMatrices.resize(mNumNodes);
+
+    // Nodes are in depth-first order so parents are always updated before their children. When a node is recalculated its
+    // children are flagged so they are recalculated in turn - only the changed parts of the hierarchy are visited.
+    // Skinned meshes only need the nodes used by the skeleton LOD - its bones and their ancestors, also in depth-first order
+    unsigned int numUpdated = 0;
+    auto updateNode = [&](unsigned int nodeIndex)
     {
-		// Multiply each model matrix by its parent's absolute world matrix (already calculated earlier in this loop)
-		// Same process as for rigid bodies, simply done prior to rendering now
-        absoluteMatrices[nodeIndex] = modelMatrices[nodeIndex] * absoluteMatrices[mNodes[nodeIndex].parentIndex];
+        if (!dirtyNodes[nodeIndex])  return;
+        dirtyNodes[nodeIndex] = 0;
+        ++numUpdated;
+
+        // Multiply each model matrix by its parent's absolute world matrix. First matrix for a model is the root matrix,
+        // already in world space
+        if (nodeIndex == 0)  absoluteMatrices[0] = rootMatrix;
+        else                 absoluteMatrices[nodeIndex] = nodeMatrices[nodeIndex] * absoluteMatrices[mParentIndexes[nodeIndex]];
+
+		// Advanced point: the absolute world matrices are **of the bones**. However, they are not actually rendered, they
+		// merely influence the skinned mesh, which has its origin at a particular node. So for each bone there is a fixed
+		// offset (transform) between where that bone is and where the root of the skinned mesh is. We need to apply that
+		// offset to each of the bone matrices to make the bone influences work on the skinned mesh.
+		// These offset matrices are fixed for the model and have been calculated when the mesh was imported
+        if (mHasBones)  skinningMatrices[nodeIndex] = mOffsetMatrices[nodeIndex] * absoluteMatrices[nodeIndex];
+
+        for (unsigned int i = mChildStarts[nodeIndex]; i < mChildStarts[nodeIndex + 1]; ++i)
+        {
+            dirtyNodes[mChildNodes[i]] = 1;
+        }
+    };
+
+    if (mHasBones)
+    {
+        for (auto nodeIndex : mSkeletonLODNodes[skeletonLOD])  updateNode(nodeIndex);
     }
+    else
+    {
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)  updateNode(nodeIndex);
+    }
+    return numUpdated;
+}
 
-	if (mHasBones) // Render a mesh that uses skinning
-	{
-		// Advanced point: the above loop will get the absolute world matrices **of the bones**. However, they are
-		// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
-		// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
-		// skinned mesh is. We need to apply that offset to each of the bone matrices calculated in the last loop to make
-		// the bone influences work on the skinned mesh.
-		// These offset matrices are fixed for the model and have been calculated when the mesh was imported
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-		{
-			absoluteMatrices[nodeIndex] = mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex];
-		}
 
-		// Send all matrices over to the GPU for skinning via a constant buffer - each matrix can represent a bone which influences nearby vertices
-		// MISSING - code to fill the gPerModelConstants.boneMatrices array with the contents of the absoluteMatrices vector
-        //-->
+// Place the default pose in the world with a model's root matrix. Each node's default matrix relative to the root was found
+// on import, so this is one multiply per node with no hierarchy to walk. Returns the number of nodes calculated
+unsigned int Mesh::DefaultPoseMatrices(const CMatrix4x4& rootMatrix, std::vector<CMatrix4x4>& absoluteMatrices,
+                                       std::vector<CMatrix4x4>& skinningMatrices, unsigned int skeletonLOD /*= 0*/)
+{
+    if (skeletonLOD >= NumberSkeletonLODs())  skeletonLOD = NumberSkeletonLODs() - 1;
+    absoluteMatrices.resize(mNumNodes);
+    if (mHasBones)  skinningMatrices.resize(mNumNodes);
 
-        for (int i = 0; i < absoluteMatrices.size(); i++)
+    if (mHasBones)
+    {
+        for (auto nodeIndex : mSkeletonLODNodes[skeletonLOD])
         {
-            gPerModelConstants.boneMatrices[i] = absoluteMatrices[i];
+            absoluteMatrices[nodeIndex] = mDefaultPoseMatrices[nodeIndex] * rootMatrix;
+            skinningMatrices[nodeIndex] = mDefaultSkinningMatrices[nodeIndex] * rootMatrix;
         }
+        return static_cast<unsigned int>(mSkeletonLODNodes[skeletonLOD].size());
+    }
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        absoluteMatrices[nodeIndex] = mDefaultPoseMatrices[nodeIndex] * rootMatrix;
+    }
+    return mNumNodes;
+}
+
 
-        UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+// Keep the bounds of the nodes with vertices for the given skeleton LOD, from a box in each node's space (see mNodeBounds)
+void Mesh::StoreNodeBounds(unsigned int skeletonLOD, const std::vector<CAABB>& nodeBoxes)
+{
+    mNodeBounds[skeletonLOD].clear();
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        const CAABB& box = nodeBoxes[nodeIndex];
+        if (box.minimum.x > box.maximum.x)  continue; // Empty
+        mNodeBounds[skeletonLOD].push_back({ nodeIndex, CSphere(box.Centre(), Length(box.Extents())) });
+    }
+}
+
+
+// World space bounding sphere of a model posed with the given absolute matrices at the given skeleton LOD (see
+// UpdateMatrices). Made from a sphere around the vertices of each node placed by the node's matrix, so it follows any
+// pose. Encloses linear blend skinning, which keeps each vertex between its bones' placings of it
+void Mesh::PosedBoundingSphere(const std::vector<CMatrix4x4>& absoluteMatrices, unsigned int skeletonLOD,
+                               CVector3& centre, float& radius)
+{
+    if (skeletonLOD >= NumberSkeletonLODs())  skeletonLOD = NumberSkeletonLODs() - 1;
+    const auto& nodeBounds = mNodeBounds[skeletonLOD];
+    if (nodeBounds.empty())
+    {
+        centre = absoluteMatrices[0].GetPosition();
+        radius = 0;
+        return;
+    }
+
+    // Place each node's sphere, then find a sphere around them all centred on the box around them
+    static std::vector<CSphere> spheres; // Kept to save reallocating
+    spheres.clear();
+    CAABB box = CAABB::Empty();
+    for (const auto& node : nodeBounds)
+    {
+        CSphere sphere = node.bounds.Transform(absoluteMatrices[node.node]);
+        CVector3 extents = { sphere.radius, sphere.radius, sphere.radius };
+        box.Expand(CAABB(sphere.centre - extents, sphere.centre + extents));
+        spheres.push_back(sphere);
+    }
+    centre = box.Centre();
+    radius = 0;
+    for (const auto& sphere : spheres)  radius = std::max(radius, Length(sphere.centre - centre) + sphere.radius);
+}
+
+
+// Find a node from the hash of its name (see NameHash.h), returns NODE_NOT_FOUND if there is no such node
+unsigned int Mesh::FindNode(uint32_t nameHash)
+{
+    // The table is never more than half full so there is always an empty slot to end the search
+    unsigned int mask = static_cast<unsigned int>(mNodeHashTable.size()) - 1;
+    for (unsigned int slot = nameHash & mask; mNodeHashTable[slot] != UINT16_MAX; slot = (slot + 1) & mask)
+    {
+        unsigned int nodeIndex = mNodeHashTable[slot];
+        if (mNodeNameHashes[nodeIndex] == nameHash)  return nodeIndex;
+    }
+    return NODE_NOT_FOUND;
+}
+
+
+// Send the current material constants to the GPU if they differ from those last sent. They are set for each model but
+// rarely change, so most draws send nothing
+void MaterialConstantsCache::Update()
+{
+    if (mHasSent && std::memcmp(&mSentConstants, &gPerMaterialConstants, sizeof(PerMaterialConstants)) == 0)  return;
+
+    UpdateConstantBuffer(gPerMaterialConstantBuffer, gPerMaterialConstants); // Send to GPU
+    gRenderBackend->PSSetConstantBuffers(3, 1, &gPerMaterialConstantBuffer);
+    mSentConstants = gPerMaterialConstants;
+    mHasSent = true;
+}
+
+
+// Render the mesh with matrices calculated by UpdateMatrices
+// Handles rigid body meshes (including single part meshes) as well as skinned meshes
+// LIMITATION: The mesh must use a single texture throughout
+void Mesh::Render(const std::vector<CMatrix4x4>& absoluteMatrices, const std::vector<CMatrix4x4>& skinningMatrices,
+                  unsigned int skeletonLOD /*= 0*/)
+{
+    if (skeletonLOD >= NumberSkeletonLODs())  skeletonLOD = NumberSkeletonLODs() - 1;
 
-		// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-		gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+    gMaterialConstantsCache.Update();
 
-		// Already sent over all the absolute matrices for the entire mesh so we can render sub-meshes directly
-		// rather than iterating through the nodes. 
+	if (mHasBones) // Render a mesh that uses skinning
+	{
+		// Dual quaternions can't hold scaling, and models are usually scaled at the root. So for dual quaternion skinning the
+		// bones are made relative to the root (model space) and the root matrix is applied afterwards in the shader
+		bool dualQuaternionSkinning = mSkinningMode == ESkinningMode::DualQuaternion;
+		CMatrix4x4 inverseRootMatrix;
+		if (dualQuaternionSkinning)  inverseRootMatrix = InverseAffine(absoluteMatrices[0]);
+
+		// The world matrix and object colour are sent once for the whole mesh, for use in the vertex shader (VS) and pixel
+		// shader (PS). Slot numbers must match the constant buffer numbers in the shader. The world matrix is the root's: dual
+		// quaternion skinning needs it, and a pass drawing the mesh with a rigid vertex shader (e.g. a batched nodes mesh) gets
+		// this model's matrix rather than whatever the previous model left
+		gPerModelConstants.worldMatrix = absoluteMatrices[0];
+		SetDrawConstants(gPerModelConstantBuffer, 1, &gPerModelConstants, sizeof(gPerModelConstants), true);
+
+		// Each sub-mesh has its own palette of bones for each skeleton LOD (see constructor), so send the matrices for those bones
+		// over to the GPU for skinning via a constant buffer before rendering that sub-mesh. Matrices are packed to compact 3x4
+		// form and only as many as are in the palette are sent rather than the whole array
+		// Dual quaternion skinning sends 8 floats per bone rather than 12, plus the root matrix as the world matrix
 		for (auto& subMesh : mSubMeshes)
 		{ 
-			RenderSubMesh(subMesh);
+			const auto& bonePalette = subMesh.skeletonLODs[skeletonLOD].bonePalette;
+			unsigned int numBones = static_cast<unsigned int>(bonePalette.size());
+			size_t paletteSize;
+			if (dualQuaternionSkinning)
+			{
+				for (unsigned int i = 0; i < numBones; ++i)
+				{
+					gPerSkeletonConstants.boneDualQuaternions[i] = DualQuaternionFromMatrix(skinningMatrices[bonePalette[i]] * inverseRootMatrix);
+				}
+				paletteSize = numBones * sizeof(CDualQuaternion);
+			}
+			else
+			{
+				PackMatrices3x4(skinningMatrices.data(), bonePalette.data(), gPerSkeletonConstants.boneMatrices, numBones);
+				paletteSize = numBones * sizeof(CMatrix3x4);
+			}
+			SetDrawConstants(gPerSkeletonConstantBuffer, 2, &gPerSkeletonConstants, paletteSize, false); // Vertex shader only
+
+			RenderSubMesh(subMesh, skeletonLOD);
 		}
 	}
 	else
@@ -452,20 +788,17 @@ void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
 		// Render a mesh without skinning. Although slightly reorganised to use the matrices calculated
 		// above, this is basically the same code as the rigid body animation lab
 		// Iterate through each node
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
 		{
-			// Send this node's matrix to the GPU via a constant buffer
+			// Send this node's matrix to the GPU via a constant buffer, for use in the vertex shader (VS) and pixel shader (PS)
+			// Second parameter must match constant buffer number in the shader
 			gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
-			UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
-
-			// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-			gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+			SetDrawConstants(gPerModelConstantBuffer, 1, &gPerModelConstants, sizeof(gPerModelConstants), true);
 
 			// Render the sub-meshes attached to this node (no bones - rigid movement)
-			for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+			for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)
 			{ 
-				RenderSubMesh(mSubMeshes[subMeshIndex]);
+				RenderSubMesh(mSubMeshes[mNodeSubMeshes[i]]);
 			}
 		}
 	}
@@ -486,31 +819,341 @@ unsigned int Mesh::CountNodes(aiNode* assimpNode)
 }
 
 
-// Help build the arrays of submeshes and nodes from the assimp data - recursive
+// Help build the node arrays from the assimp data - recursive
+// Nodes are visited in depth-first order, so each node's sub-meshes and name are appended after those of the nodes before it
 unsigned int Mesh::ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex)
 {
-    auto& node = mNodes[nodeIndex];
-    node.parentIndex = parentIndex;
+    mParentIndexes[nodeIndex] = static_cast<uint16_t>(parentIndex);
     unsigned int thisIndex = nodeIndex;
     ++nodeIndex;
 
-    node.name = assimpNode->mName.C_Str();
+    mNodeNameOffsets[thisIndex] = static_cast<unsigned int>(mNodeNames.size());
+    mNodeNames.append(assimpNode->mName.C_Str());
+    mNodeNames.push_back('\0');
 
-    node.defaultMatrix.SetValues(&assimpNode->mTransformation.a1);
-    node.defaultMatrix.Transpose(); // Assimp stores matrices differently to this app
+    mDefaultMatrices[thisIndex].SetValues(&assimpNode->mTransformation.a1);
+    mDefaultMatrices[thisIndex].Transpose(); // Assimp stores matrices differently to this app
 
-    node.subMeshes.resize(assimpNode->mNumMeshes);
+    mSubMeshStarts[thisIndex] = static_cast<unsigned int>(mNodeSubMeshes.size());
     for (unsigned int i = 0; i < assimpNode->mNumMeshes; ++i)
     {
-        node.subMeshes[i] = assimpNode->mMeshes[i];
+        mNodeSubMeshes.push_back(assimpNode->mMeshes[i]);
     }
 
-    node.childNodes.resize(assimpNode->mNumChildren);
     for (unsigned int i = 0; i < assimpNode->mNumChildren; ++i)
     {
-        node.childNodes[i] = nodeIndex;
         nodeIndex = ReadNodes(assimpNode->mChildren[i], nodeIndex, thisIndex);
     }
 
     return nodeIndex;
 }
+
+
+// Build the child node ranges from the parent indexes once all nodes have been read
+// Every node apart from the root is the child of exactly one node, so count the children of each node, turn the counts
+// into start positions, then place each child. Visiting the nodes in order keeps each node's children in order too
+void Mesh::BuildChildRanges()
+{
+    mChildStarts.assign(mNumNodes + 1, 0);
+    for (unsigned int nodeIndex = 1; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        ++mChildStarts[mParentIndexes[nodeIndex] + 1];
+    }
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        mChildStarts[nodeIndex + 1] += mChildStarts[nodeIndex];
+    }
+
+    mChildNodes.resize(mNumNodes > 0 ? mNumNodes - 1 : 0);
+    std::vector<unsigned int> nextChild(mChildStarts.begin(), mChildStarts.end() - 1);
+    for (unsigned int nodeIndex = 1; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        mChildNodes[nextChild[mParentIndexes[nodeIndex]]++] = nodeIndex;
+    }
+}
+
+
+// Build the hash table used by FindNode once all nodes have been read. Will throw a std::runtime_error exception if
+// two different node names have the same hash
+void Mesh::BuildNodeHashTable(const std::string& fileName)
+{
+    unsigned int tableSize = 1;
+    while (tableSize < mNumNodes * 2)  tableSize *= 2;
+    unsigned int mask = tableSize - 1;
+
+    mNodeNameHashes.resize(mNumNodes);
+    mNodeHashTable.assign(tableSize, UINT16_MAX);
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        uint32_t hash = HashName(GetNodeName(nodeIndex));
+        mNodeNameHashes[nodeIndex] = hash;
+
+        // Probe from the hash's slot to the first empty one. A node already there with the same hash either has the same
+        // name, in which case the earlier node is kept, or is a clash that FindNode couldn't tell apart
+        unsigned int slot;
+        for (slot = hash & mask; mNodeHashTable[slot] != UINT16_MAX; slot = (slot + 1) & mask)
+        {
+            unsigned int otherNode = mNodeHashTable[slot];
+            if (mNodeNameHashes[otherNode] == hash)
+            {
+                if (strcmp(GetNodeName(otherNode), GetNodeName(nodeIndex)) != 0)
+                    throw std::runtime_error("Node names with the same hash in " + fileName);
+                break;
+            }
+        }
+        if (mNodeHashTable[slot] == UINT16_MAX)  mNodeHashTable[slot] = static_cast<uint16_t>(nodeIndex);
+    }
+}
+
+
+// Create the GPU-side vertex and index buffers for a sub-mesh from CPU-side data (32-bit indexes). Will throw a
+// std::runtime_error exception on failure
+void Mesh::CreateSubMeshBuffers(SubMesh& subMesh, const unsigned char* vertices, const unsigned char* indices,
+                                const std::string& fileName)
+{
+    RenderBufferDesc bufferDesc;
+
+    // Create GPU-side vertex buffer and copy the vertices imported by assimp into it
+    bufferDesc.type = ERenderBufferType::Vertex;     // Indicate it is a vertex buffer
+    bufferDesc.usage = ERenderBufferUsage::Default;  // Default usage for this buffer - we'll see other usages later
+    bufferDesc.size = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
+
+    // Fill the new vertex buffer with data loaded by assimp
+    if (!gRenderBackend->CreateBuffer(bufferDesc, vertices, &subMesh.vertexBuffer))
+    {
+        throw std::runtime_error("Failure creating vertex buffer for " + fileName);
+    }
+
+
+    // Create GPU-side index buffer and copy the vertices imported by assimp into it
+    bufferDesc.type = ERenderBufferType::Index;      // Indicate it is an index buffer
+    bufferDesc.usage = ERenderBufferUsage::Default;  // Default usage for this buffer - we'll see other usages later
+    bufferDesc.size = subMesh.numIndices * sizeof(DWORD); // Size of the buffer in bytes
+
+    // Fill the new index buffer with data loaded by assimp
+    if (!gRenderBackend->CreateBuffer(bufferDesc, indices, &subMesh.indexBuffer))
+    {
+        throw std::runtime_error("Failure creating index buffer for " + fileName);
+    }
+}
+
+
+// Batched nodes only: merge the sub-meshes into as few sub-meshes as possible, then create their buffers. Each node's
+// sub-meshes are added with the node as their bone, so a sub-mesh used by several nodes is added once for each of them.
+// Sub-meshes with matching vertex layouts are merged, up to MAX_BONES nodes each. Pass the CPU-side vertices and indexes
+// of each sub-mesh, and their LOD 0 bone indexes, which are replaced by those of the merged sub-meshes. Will throw a
+// std::runtime_error exception on failure
+void Mesh::MergeBatchedNodes(const std::vector<std::unique_ptr<unsigned char[]>>& subMeshVertices,
+                             const std::vector<std::unique_ptr<unsigned char[]>>& subMeshIndices,
+                             std::vector<std::vector<unsigned char>>& subMeshBoneIndexes, const std::string& fileName)
+{
+    // Vertex layouts only differ by which optional elements are present, so the vertex size identifies the layout. The
+    // entries of mNodeSubMeshes are the node / sub-mesh pairs to add, the node of each found from the ranges in mSubMeshStarts
+    std::vector<unsigned int> entryNodes(mNodeSubMeshes.size());
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        for (unsigned int i = mSubMeshStarts[nodeIndex]; i < mSubMeshStarts[nodeIndex + 1]; ++i)  entryNodes[i] = nodeIndex;
+    }
+
+    std::vector<SubMesh> batches;
+    std::vector<std::vector<unsigned char>> batchBoneIndexes;
+    std::vector<bool> merged(mNodeSubMeshes.size(), false);
+    std::vector<bool> layoutUsed(mSubMeshes.size(), false);
+    for (unsigned int first = 0; first < mNodeSubMeshes.size(); ++first)
+    {
+        if (merged[first])  continue;
+
+        SubMesh batch;
+        batch.vertexSize   = mSubMeshes[mNodeSubMeshes[first]].vertexSize;
+        batch.vertexLayout = mSubMeshes[mNodeSubMeshes[first]].vertexLayout;
+        if (layoutUsed[mNodeSubMeshes[first]])  batch.vertexLayout->AddRef(); // Each batch releases its layout, see ~Mesh
+        layoutUsed[mNodeSubMeshes[first]] = true;
+        auto& bonePalette = batch.skeletonLODs[0].bonePalette;
+        std::vector<unsigned char> vertices;
+        std::vector<DWORD>         indices;
+        std::vector<unsigned char> boneIndexes;
+
+        for (unsigned int entry = first; entry < mNodeSubMeshes.size(); ++entry)
+        {
+            unsigned int m = mNodeSubMeshes[entry];
+            auto& subMesh = mSubMeshes[m];
+            if (merged[entry] || subMesh.vertexSize != batch.vertexSize)  continue;
+
+            // Find the entry's node in the batch palette, leave the entry for a later batch if the palette is full
+            unsigned int nodeIndex = entryNodes[entry];
+            auto paletteEntry = std::find(bonePalette.begin(), bonePalette.end(), nodeIndex);
+            if (paletteEntry == bonePalette.end())
+            {
+                if (bonePalette.size() == MAX_BONES)  continue;
+                bonePalette.push_back(nodeIndex);
+                paletteEntry = bonePalette.end() - 1;
+            }
+            unsigned char paletteIndex = static_cast<unsigned char>(paletteEntry - bonePalette.begin());
+            merged[entry] = true;
+
+            // Append the vertices, their bone indexes (only the first bone is weighted) and the indexes offset to match
+            const unsigned char* subMeshVertexData = subMeshVertices[m].get();
+            vertices.insert(vertices.end(), subMeshVertexData, subMeshVertexData + subMesh.numVertices * subMesh.vertexSize);
+            for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+            {
+                boneIndexes.insert(boneIndexes.end(), { paletteIndex, 0, 0, 0 });
+            }
+            const DWORD* subMeshIndexData = reinterpret_cast<const DWORD*>(subMeshIndices[m].get());
+            for (unsigned int i = 0; i < subMesh.numIndices; ++i)
+            {
+                indices.push_back(subMeshIndexData[i] + batch.numVertices);
+            }
+            batch.numVertices += subMesh.numVertices;
+            batch.numIndices  += subMesh.numIndices;
+        }
+
+        CreateSubMeshBuffers(batch, vertices.data(), reinterpret_cast<const unsigned char*>(indices.data()), fileName);
+        batches.push_back(batch);
+        batchBoneIndexes.push_back(std::move(boneIndexes));
+    }
+
+    // Each batch holds a reference to the vertex layout of its first sub-mesh (a sub-mesh used by several nodes can start
+    // several batches when palettes fill up), the other sub-meshes' layouts are no longer needed
+    for (unsigned int m = 0; m < mSubMeshes.size(); ++m)
+    {
+        if (!layoutUsed[m])  mSubMeshes[m].vertexLayout->Release();
+    }
+
+    mSubMeshes = std::move(batches);
+    subMeshBoneIndexes = std::move(batchBoneIndexes);
+}
+
+
+// Build the skeleton LODs from the LOD 0 bone indexes of each sub-mesh and the total weight / number of vertices
+// influenced by each node. Will throw a std::runtime_error exception on failure
+void Mesh::BuildSkeletonLODs(const std::vector<std::vector<unsigned char>>& subMeshBoneIndexes,
+                             const std::vector<float>& nodeWeights, const std::vector<unsigned int>& nodeVertexCounts,
+                             const std::vector<bool>& rigidNodes, const std::vector<CAABB>& nodeBoxes,
+                             const std::string& fileName)
+{
+    // The bones are the nodes that influence any skinned vertices. Rank them most influential first, by total weight then
+    // vertex count. Nodes that rigid sub-meshes are attached to aren't ranked, removing one would move its whole sub-mesh
+    std::vector<unsigned int> bones;
+    for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+    {
+        if (nodeVertexCounts[nodeIndex] > 0 && !rigidNodes[nodeIndex])  bones.push_back(nodeIndex);
+    }
+    std::stable_sort(bones.begin(), bones.end(), [&](unsigned int a, unsigned int b)
+    {
+        if (nodeWeights[a] != nodeWeights[b])  return nodeWeights[a] > nodeWeights[b];
+        return nodeVertexCounts[a] > nodeVertexCounts[b];
+    });
+
+    for (unsigned int lod = 0; lod < NumberSkeletonLODs(); ++lod)
+    {
+        // Keep the most influential bones up to this LOD's share of the bones. The ancestor bones of each kept bone are also
+        // kept, so a removed bone is always replaced by the closest bone possible
+        std::vector<bool> kept(mNumNodes, false);
+        unsigned int maxKept = static_cast<unsigned int>(std::ceil(bones.size() * SKELETON_LOD_BONE_FRACTIONS[lod]));
+        unsigned int numKept = 0;
+        for (auto bone : bones)
+        {
+            if (numKept >= maxKept)  break;
+            for (unsigned int nodeIndex = bone; ; nodeIndex = mParentIndexes[nodeIndex])
+            {
+                if (nodeVertexCounts[nodeIndex] > 0)
+                {
+                    if (kept[nodeIndex])  break; // Its ancestors have already been kept too
+                    kept[nodeIndex] = true;
+                    ++numKept;
+                }
+                if (nodeIndex == 0)  break;
+            }
+        }
+
+        // Rigid sub-mesh nodes are always kept. Done after the ranking above, which relies on a kept bone's ancestors being kept
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            if (rigidNodes[nodeIndex])  kept[nodeIndex] = true;
+        }
+
+        // Replace each removed bone with its nearest kept ancestor. Parents are stored before their children, so a bone with no
+        // kept ancestor is kept itself (only happens for top level bones) and is then available for its children
+        std::vector<unsigned int> replacement(mNumNodes);
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            replacement[nodeIndex] = nodeIndex;
+            if (nodeVertexCounts[nodeIndex] == 0 || kept[nodeIndex])  continue;
+
+            unsigned int ancestor = mParentIndexes[nodeIndex];
+            while (!kept[ancestor] && ancestor != 0)  ancestor = mParentIndexes[ancestor];
+            if (kept[ancestor])  replacement[nodeIndex] = ancestor;
+            else                 kept[nodeIndex] = true;
+        }
+
+        // The nodes calculated at this LOD are the kept bones and all their ancestors, nothing below a removed bone is needed
+        std::vector<bool> used(mNumNodes, false);
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            if (!kept[nodeIndex])  continue;
+            for (unsigned int ancestor = nodeIndex; !used[ancestor]; ancestor = mParentIndexes[ancestor])
+            {
+                used[ancestor] = true;
+                if (ancestor == 0)  break;
+            }
+        }
+        mSkeletonLODNodes[lod].clear();
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            if (used[nodeIndex])  mSkeletonLODNodes[lod].push_back(nodeIndex);
+        }
+
+        // A removed bone's vertices are skinned by its replacement, so its box is moved from its own bone space into the
+        // replacement's: undo its offset and apply the replacement's
+        std::vector<CAABB> lodBoxes(mNumNodes, CAABB::Empty());
+        for (unsigned int nodeIndex = 0; nodeIndex < mNumNodes; ++nodeIndex)
+        {
+            const CAABB& box = nodeBoxes[nodeIndex];
+            if (box.minimum.x > box.maximum.x)  continue; // Empty
+
+            unsigned int replacementIndex = replacement[nodeIndex];
+            if (replacementIndex == nodeIndex)  lodBoxes[nodeIndex].Expand(box);
+            else  lodBoxes[replacementIndex].Expand(box.Transform(InverseAffine(mOffsetMatrices[nodeIndex]) * mOffsetMatrices[replacementIndex]));
+        }
+        StoreNodeBounds(lod, lodBoxes);
+
+
+        // Give each sub-mesh a palette for this LOD holding each of its replacement bones once, then rewrite the vertex bone
+        // indexes to refer to that palette. The weights are unchanged, so a removed bone's weight moves to its replacement
+        for (unsigned int m = 0; m < mSubMeshes.size(); ++m)
+        {
+            auto& subMesh = mSubMeshes[m];
+            const auto& lod0Palette = subMesh.skeletonLODs[0].bonePalette;
+            auto& skeletonLOD = subMesh.skeletonLODs[lod];
+
+            std::vector<unsigned int> bonePalette;
+            std::vector<unsigned char> paletteIndexes(lod0Palette.size()); // Position in the new palette of each LOD 0 palette entry
+            for (unsigned int i = 0; i < lod0Palette.size(); ++i)
+            {
+                unsigned int nodeIndex = replacement[lod0Palette[i]];
+                auto entry = std::find(bonePalette.begin(), bonePalette.end(), nodeIndex);
+                paletteIndexes[i] = static_cast<unsigned char>(entry - bonePalette.begin());
+                if (entry == bonePalette.end())  bonePalette.push_back(nodeIndex);
+            }
+
+            const auto& lod0BoneIndexes = subMeshBoneIndexes[m];
+            std::vector<unsigned char> boneIndexes(lod0BoneIndexes.size());
+            for (unsigned int i = 0; i < boneIndexes.size(); ++i)
+            {
+                boneIndexes[i] = paletteIndexes[lod0BoneIndexes[i]];
+            }
+            skeletonLOD.bonePalette = bonePalette; // Assigned after the loops as LOD 0's palette is used above
+
+
+            // Create GPU-side vertex buffer for the bone indexes
+            RenderBufferDesc bufferDesc;
+            bufferDesc.type = ERenderBufferType::Vertex;
+            bufferDesc.usage = ERenderBufferUsage::Default;
+            bufferDesc.size = static_cast<unsigned int>(boneIndexes.size());
+            if (!gRenderBackend->CreateBuffer(bufferDesc, boneIndexes.data(), &skeletonLOD.boneBuffer))
+            {
+                throw std::runtime_error("Failure creating bone buffer for " + fileName);
+            }
+        }
+    }
+}
@@ -6,15 +6,46 @@
 // expected to select these things
 
 #include "common.h"
+#include "NameHash.h"
+#include "CBoundingVolumes.h"
 
 #include <assimp/scene.h>
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
 
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
 
+// Skinned meshes have this many skeleton levels of detail (LODs). LOD 0 uses every bone, higher LODs remove the bones with
+// the least influence on the vertices, replacing them with their nearest kept ancestor (see constructor)
+static const int NUM_SKELETON_LODS = 3;
+
+// Returned by Mesh::FindNode when the mesh has no node with the given name
+static const unsigned int NODE_NOT_FOUND = 0xffffffff;
+
+// How a skinned mesh blends its bones. The vertex shader used to render the mesh must match:
+// Linear uses the Skinning vertex shader, DualQuaternion uses the SkinningDQ vertex shader
+enum class ESkinningMode : int
+{
+	Linear = 1,         // Blend bone matrices. Cheapest, but twisting joints collapse ("candy-wrapper" artifacts)
+	DualQuaternion = 2  // Blend bone dual quaternions. Joints keep their volume, bones must not be scaled relative to the root
+};
+
+// How the nodes of a mesh without bones (rigid body animation) are imported
+enum class ENodeImport : int
+{
+	Hierarchy = 1,    // Each node is rendered separately with its own world matrix. One draw per node per sub-mesh
+	BatchedNodes = 2, // Each vertex holds the index of its node, and sub-meshes are merged. All node matrices are sent as one
+	                  // palette and the mesh is drawn with one draw per sub-mesh layout. Must be rendered with the Skinning
+	                  // vertex shader, the same as a skinned mesh (each vertex is fully weighted to its node)
+	PreTransformed = 3 // For static scenery. The node matrices are baked into the vertices and sub-meshes are merged, leaving a
+	                   // single node. No per-node work when rendering, but the parts can't move. Any bones are discarded
+};
+
 class Mesh
 {
 //--------------------------------------------------------------------------------------
@@ -24,23 +55,92 @@ public:
 
     // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
     // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+    // Optionally set the maximum number of bones used by a single sub-mesh (clamped to MAX_BONES). Sub-meshes that
+    // use more bones are split into several smaller sub-meshes
+    // Optionally choose how a mesh without bones is imported (see ENodeImport above). Only PreTransformed affects skinned
+    // meshes (they lose their bones)
     // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-    Mesh(const std::string& fileName, bool requireTangents = false);
+    Mesh(const std::string& fileName, bool requireTangents = false, unsigned int maxBonesPerSubMesh = MAX_BONES,
+         ENodeImport nodeImport = ENodeImport::Hierarchy);
     ~Mesh();
 
 
     // How many nodes are in the hierarchy for this mesh. Nodes can control individual parts (rigid body animation),
 	// or bones (skinned animation), or they can be dummy nodes to create child parts in a more convenient way
-    unsigned int NumberNodes()  { return static_cast<unsigned int>(mNodes.size()); }
+    unsigned int NumberNodes()  { return mNumNodes; }
+
+    // The name of a given node, as given in the mesh file
+    const char* GetNodeName(unsigned int node)  { return mNodeNames.c_str() + mNodeNameOffsets[node]; }
+
+    // Find a node from the hash of its name (see NameHash.h), returns NODE_NOT_FOUND if there is no such node. The result
+    // can be passed as the node parameter to the Model functions. Hash literal names so no strings are involved, e.g.
+    //     unsigned int head = mesh->FindNode(HashName("Head"));
+    // Node numbers change when a mesh is re-exported so look them up rather than hard-coding them. If several nodes share
+    // a name the first (in depth-first order) is found. Uses a hash table built on import so doesn't depend on node count
+    unsigned int FindNode(uint32_t nameHash);
 
     // The default matrix for a given node - used to set the initial position for a new model
-    CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mNodes[node].defaultMatrix; }
+    CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mDefaultMatrices[node]; }
+
+    // The default matrices of all the nodes in one array. Models share these until they change a node (see Model)
+    const CMatrix4x4* DefaultMatrices()  { return mDefaultMatrices.data(); }
+
+    // Whether the mesh uses skinning, if so it is rendered with skinning matrices (see UpdateMatrices) and needs a skinning
+    // vertex shader. Also true for meshes imported with batched nodes (see ENodeImport above)
+    bool HasBones()  { return mHasBones; }
+
+    // Bounding sphere of the mesh in its default pose, relative to the root node (so the model's root matrix places it in the
+    // world, see Model::BoundingSphere). Animated parts may move outside it, see PosedBoundingSphere for those
+    const CVector3& BoundingCentre()  { return mBoundingCentre; }
+    float           BoundingRadius()  { return mBoundingRadius; }
+
+    // World space bounding sphere of a model posed with the given absolute matrices at the given skeleton LOD (see
+    // UpdateMatrices). Made from a sphere around the vertices of each node placed by the node's matrix, so it follows any
+    // pose. Encloses linear blend skinning, which keeps each vertex between its bones' placings of it
+    void PosedBoundingSphere(const std::vector<CMatrix4x4>& absoluteMatrices, unsigned int skeletonLOD,
+                             CVector3& centre, float& radius);
+
+    // Vertex positions of the mesh in its default pose relative to the root node, and three indices into them per triangle.
+    // Kept on the CPU for software rendering, e.g. of occluders (see OcclusionCuller.h)
+    const std::vector<CVector3>& Positions()        { return mPositions; }
+    const std::vector<uint32_t>& TriangleIndices()  { return mTriangleIndices; }
+
+    // Number of skeleton levels of detail, always 1 for meshes without bones (including batched nodes)
+    unsigned int NumberSkeletonLODs()  { return mHasBones && !mBatchedNodes ? NUM_SKELETON_LODS : 1; }
+
+    // Number of nodes UpdateMatrices calculates at the given skeleton LOD, all the nodes for meshes without bones
+    unsigned int NumberSkeletonLODNodes(unsigned int skeletonLOD)
+    {
+        if (!mHasBones)  return mNumNodes;
+        return static_cast<unsigned int>(mSkeletonLODNodes[std::min(skeletonLOD, NumberSkeletonLODs() - 1)].size());
+    }
+
+    // Select how the bones are blended for a skinned mesh (see ESkinningMode above). Has no effect on meshes without bones
+    ESkinningMode GetSkinningMode()  { return mSkinningMode; }
+    void SetSkinningMode(ESkinningMode mode)  { mSkinningMode = mode; }
 
  
-	// Render the mesh with the given matrices
+	// Calculate the absolute world matrices of a model's nodes from their matrices relative to their parents, and for skinned
+	// meshes the skinning matrices (bone offset applied). The caller keeps these between frames - only nodes flagged as dirty
+	// and their descendants are recalculated, the rest are reused. The flags of recalculated nodes are cleared.
+	// Skinned meshes only update the nodes used by the given skeleton LOD, other nodes stay dirty until a LOD uses them
+	// Returns the number of nodes recalculated
+    // Pass the model's root matrix and its node matrices (relative to their parents, entry 0 is not used)
+    unsigned int UpdateMatrices(const CMatrix4x4& rootMatrix, const CMatrix4x4* nodeMatrices, std::vector<unsigned char>& dirtyNodes,
+                                std::vector<CMatrix4x4>& absoluteMatrices, std::vector<CMatrix4x4>& skinningMatrices,
+                                unsigned int skeletonLOD = 0);
+
+    // As UpdateMatrices, but for a model still in the mesh's default pose: every node is its default pose placed by the root
+    // matrix, so no node matrices or dirty flags are needed. The matrices only change when the root does (see Model::Render)
+    unsigned int DefaultPoseMatrices(const CMatrix4x4& rootMatrix, std::vector<CMatrix4x4>& absoluteMatrices,
+                                     std::vector<CMatrix4x4>& skinningMatrices, unsigned int skeletonLOD = 0);
+
+	// Render the mesh with matrices calculated by UpdateMatrices or DefaultPoseMatrices
 	// Handles rigid body meshes (including single part meshes) as well as skinned meshes
+	// Skinned meshes can be rendered with a simpler skeleton (see NUM_SKELETON_LODS above), LODs past the last are clamped
 	// LIMITATION: The mesh must use a single texture throughout
-    void Render(std::vector<CMatrix4x4>& modelMatrices);
+    void Render(const std::vector<CMatrix4x4>& absoluteMatrices, const std::vector<CMatrix4x4>& skinningMatrices,
+                unsigned int skeletonLOD = 0);
 
 
 
@@ -62,25 +162,16 @@ private:
 
         unsigned int       numIndices = 0;
         ID3D11Buffer*      indexBuffer  = nullptr;
-    };
-
-
-    // A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
-    // A node can contain several sub-meshes (because a single node might use multiple textures)
-    // A node can also have child nodes. The children will follow the motion of the parent node
-    // Each node has a default matrix which is it's initial/ default position. Models using this mesh are
-    // given these default matrices as a starting position.
-    struct Node
-    {
-        std::string  name;
-
-        CMatrix4x4   defaultMatrix; // Starting position/rotation/scale for this node. Relative to parent. Used when first creating a model from this mesh
-        CMatrix4x4   offsetMatrix;
-
-        unsigned int parentIndex;   // Index of the parent node (from the mNodes vector below). Root node refers to itself (0)
 
-        std::vector<unsigned int> childNodes; // Child nodes that are controlled by this node (indexes into the mNodes vector below)
-        std::vector<unsigned int> subMeshes;  // The geometry representing this node (indexes into the mSubMeshes vector below)
+        // Skinned meshes only: each skeleton LOD has its own palette of the nodes used as bones by this sub-mesh, and its own
+        // vertex buffer of bone indexes (4 per vertex), which index the palette to give the node whose matrix to use.
+        // Only the palette's matrices are sent to the GPU for this sub-mesh. Bone weights are in the main vertex buffer
+        struct SkeletonLOD
+        {
+            std::vector<unsigned int> bonePalette;
+            ID3D11Buffer*             boneBuffer = nullptr;
+        };
+        SkeletonLOD skeletonLODs[NUM_SKELETON_LODS];
     };
 
 
@@ -92,11 +183,41 @@ private:
     // Count the number of nodes with given assimp node as root
     unsigned int CountNodes(aiNode* assimpNode);
 
-    // Help build the arrays of submeshes and nodes from the assimp data - recursive
+    // Help build the node arrays from the assimp data - recursive
     unsigned int ReadNodes(aiNode* assimpNode,unsigned int nodeIndex, unsigned int parentIndex);
 
+    // Build the child node ranges from the parent indexes once all nodes have been read
+    void BuildChildRanges();
+
+    // Build the hash table used by FindNode once all nodes have been read. Will throw a std::runtime_error exception if
+    // two different node names have the same hash
+    void BuildNodeHashTable(const std::string& fileName);
+
+    // Create the GPU-side vertex and index buffers for a sub-mesh from CPU-side data (32-bit indexes). Will throw a
+    // std::runtime_error exception on failure
+    void CreateSubMeshBuffers(SubMesh& subMesh, const unsigned char* vertices, const unsigned char* indices,
+                              const std::string& fileName);
+
+    // Batched nodes only: merge the sub-meshes, whose palette is the single node they are attached to, into as few sub-meshes
+    // as possible, then create their buffers. Sub-meshes with matching vertex layouts are merged, up to MAX_BONES nodes each.
+    // Pass the CPU-side vertices and indexes of each sub-mesh, and their LOD 0 bone indexes, which are replaced by those of
+    // the merged sub-meshes. Will throw a std::runtime_error exception on failure
+    void MergeBatchedNodes(const std::vector<std::unique_ptr<unsigned char[]>>& subMeshVertices,
+                           const std::vector<std::unique_ptr<unsigned char[]>>& subMeshIndices,
+                           std::vector<std::vector<unsigned char>>& subMeshBoneIndexes, const std::string& fileName);
+
+    // Build the skeleton LODs from the LOD 0 bone indexes of each sub-mesh, the total weight / number of vertices
+    // influenced by each bone and the nodes rigid sub-meshes are attached to. Will throw a std::runtime_error exception on failure
+    void BuildSkeletonLODs(const std::vector<std::vector<unsigned char>>& subMeshBoneIndexes,
+                           const std::vector<float>& nodeWeights, const std::vector<unsigned int>& nodeVertexCounts,
+                           const std::vector<bool>& rigidNodes, const std::vector<CAABB>& nodeBoxes,
+                           const std::string& fileName);
+
+    // Keep the bounds of the nodes with vertices for the given skeleton LOD, from a box in each node's space (see mNodeBounds)
+    void StoreNodeBounds(unsigned int skeletonLOD, const std::vector<CAABB>& nodeBoxes);
+
 	// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-	void RenderSubMesh(const SubMesh& subMesh);
+	void RenderSubMesh(const SubMesh& subMesh, unsigned int skeletonLOD = 0);
 
 
 
@@ -106,9 +227,74 @@ private:
 private:
 
     std::vector<SubMesh> mSubMeshes; // The mesh geometry. Nodes refer to sub-meshes in this vector
-    std::vector<Node>    mNodes;     // The mesh hierarchy. First entry is root. remainder aree stored in depth-first order
+
+    // A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
+    // A node can contain several sub-meshes (because a single node might use multiple textures)
+    // A node can also have child nodes. The children will follow the motion of the parent node
+    // The hierarchy is stored as parallel arrays indexed by node, rather than one structure per node, so walking the
+    // hierarchy reads each array in order and loading a mesh makes a fixed number of allocations however many nodes it has.
+    // First node is root, the remainder are stored in depth-first order
+    unsigned int mNumNodes;
+
+    // Index of the parent of each node. Root node refers to itself (0). Node count is limited to fit (see constructor)
+    std::vector<uint16_t> mParentIndexes;
+
+    // Starting position/rotation/scale for each node. Relative to parent. Used when first creating a model from this mesh
+    // Models use this array directly as their pose until they change it (see Model)
+    std::vector<CMatrix4x4> mDefaultMatrices;
+
+    // Skinned meshes: transform from the skinned mesh root to each bone. Identity for nodes that aren't bones
+    std::vector<CMatrix4x4> mOffsetMatrices;
+
+    // The default pose of each node relative to the root, and for skinned meshes with the bone offsets applied. A model's
+    // root matrix places them in the world (see DefaultPoseMatrices)
+    std::vector<CMatrix4x4> mDefaultPoseMatrices;
+    std::vector<CMatrix4x4> mDefaultSkinningMatrices;
+
+    // Child nodes that are controlled by each node are mChildNodes[mChildStarts[node]] to mChildNodes[mChildStarts[node + 1] - 1]
+    std::vector<unsigned int> mChildStarts;
+    std::vector<unsigned int> mChildNodes;
+
+    // The geometry representing each node, the same scheme as above. Entries are indexes into mSubMeshes
+    std::vector<unsigned int> mSubMeshStarts;
+    std::vector<unsigned int> mNodeSubMeshes;
+
+    // Node names, each null-terminated, all held in one string. Each node's name starts at its offset
+    std::string               mNodeNames;
+    std::vector<unsigned int> mNodeNameOffsets;
+
+    // Hash of each node's name, and an open-addressed hash table of node indexes (linear probing, size a power of 2 and
+    // at most half full). Empty slots hold UINT16_MAX, which can't be a node index (see constructor)
+    std::vector<uint32_t> mNodeNameHashes;
+    std::vector<uint16_t> mNodeHashTable;
+
+    // Bounding sphere of the default pose relative to the root node, see BoundingCentre
+    CVector3 mBoundingCentre;
+    float    mBoundingRadius;
+
+    // For each skeleton LOD, a sphere around the vertices of each node that has any, in the space the node's absolute matrix
+    // places in the world: bone offset applied for skinned vertices, relative to the node for rigid ones. At lower LODs a
+    // removed bone's vertices are in its replacement's sphere. See PosedBoundingSphere
+    struct NodeBounds
+    {
+        unsigned int node;
+        CSphere      bounds;
+    };
+    std::vector<NodeBounds> mNodeBounds[NUM_SKELETON_LODS];
+
+    // CPU copy of the geometry, see Positions
+    std::vector<CVector3> mPositions;
+    std::vector<uint32_t> mTriangleIndices;
 
 	bool mHasBones; // If any submesh has bones, then all submeshes are given bones - makes rendering easier (one shader for the whole mesh)
+
+	bool mBatchedNodes; // Rigid mesh imported with ENodeImport::BatchedNodes, it is given bones as above but has no skeleton LODs
+
+	ESkinningMode mSkinningMode; // Bone palette format sent to the GPU for skinned meshes
+
+	// Skinned meshes only: the nodes that must be calculated for each skeleton LOD - the bones kept in that LOD and their
+	// ancestors, in depth-first order
+	std::vector<unsigned int> mSkeletonLODNodes[NUM_SKELETON_LODS];
 };
 
 
@@ -10,14 +10,29 @@
 #include "GraphicsHelpers.h"
 #include "Mesh.h"
 
+#include <algorithm>
+
+
+unsigned int gNodeMatricesRecalculated = 0;
+unsigned int gNodeMatricesReused       = 0;
+unsigned int gRootMatricesPlaced       = 0;
+
+// Absolute and skinning matrices for models of single node meshes, which keep none of their own. Only used for the duration
+// of Model::Render, so one set is shared by all such models
+std::vector<CMatrix4x4> gScratchAbsoluteMatrices;
+std::vector<CMatrix4x4> gScratchSkinningMatrices;
+
 
 Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*= { 0,0,0 }*/, float scale /*= 1*/)
-    : mMesh(mesh)
+    : mMesh(mesh), mNumRecalculated(0), mSkeletonLOD(0), mNumObjectLights(-1)
 {
-    // Set default matrices from mesh
-    mWorldMatrices.resize(mesh->NumberNodes());
-    for (int i = 0; i < mWorldMatrices.size(); ++i)
-        mWorldMatrices[i] = mesh->GetNodeDefaultMatrix(i);
+    // Start with default matrices from mesh. Only the root is copied, the other nodes use the mesh's matrices until changed
+    mNumNodes = mesh->NumberNodes();
+    mDefaultMatrices = mesh->DefaultMatrices();
+    mRootMatrix = mDefaultMatrices[0];
+
+    // Nothing more is allocated until a node other than the root is changed (see WritableNodeMatrix)
+    mHasDirtyNodes = true;
 }
 
 
@@ -26,7 +41,86 @@ Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*
 // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
 void Model::Render()
 {
-    mMesh->Render(mWorldMatrices);
+    // A single node model only has its root matrix, placed into the shared scratch matrices
+    bool useScratch = mNodeMatrices.empty() && mNumNodes == 1;
+    unsigned int numRecalculated = 0;
+    if (useScratch)
+    {
+        mMesh->DefaultPoseMatrices(mRootMatrix, gScratchAbsoluteMatrices, gScratchSkinningMatrices, mSkeletonLOD);
+        mHasDirtyNodes = false;
+        ++gRootMatricesPlaced;
+    }
+
+    // A model in the default pose places the mesh's default pose with its root matrix, only when the root (or skeleton LOD)
+    // has changed since it was last placed
+    else if (mNodeMatrices.empty())
+    {
+        if (mHasDirtyNodes)
+        {
+            numRecalculated = mMesh->DefaultPoseMatrices(mRootMatrix, mAbsoluteMatrices, mSkinningMatrices, mSkeletonLOD);
+            mHasDirtyNodes = false;
+        }
+    }
+
+    // Otherwise bring this model's own matrices up to date. They may have been already this frame, for the bounds
+    else
+    {
+        UpdateMatrices();
+        numRecalculated = mNumRecalculated;
+        mNumRecalculated = 0;
+    }
+
+    // Nodes a lower skeleton LOD doesn't use are neither recalculated nor reused
+    if (!useScratch)
+    {
+        unsigned int numLODNodes = mMesh->NumberSkeletonLODNodes(mSkeletonLOD);
+        gNodeMatricesRecalculated += numRecalculated;
+        gNodeMatricesReused       += numLODNodes > numRecalculated ? numLODNodes - numRecalculated : 0;
+    }
+
+    gPerModelConstants.numObjectLights = mNumObjectLights;
+    std::copy(mObjectLights, mObjectLights + std::max(mNumObjectLights, 0), gPerModelConstants.objectLights);
+    if (useScratch)  mMesh->Render(gScratchAbsoluteMatrices, gScratchSkinningMatrices, mSkeletonLOD);
+    else             mMesh->Render(mAbsoluteMatrices, mSkinningMatrices, mSkeletonLOD);
+}
+
+
+// World space bounding sphere of the model. In the default pose it is the mesh's bounds placed by the root matrix (see
+// Mesh::BoundingCentre). Once the model has changed its nodes, e.g. to animate, the bounds follow the current pose
+void Model::BoundingSphere(CVector3& centre, float& radius)
+{
+    if (mNodeMatrices.empty())
+    {
+        centre = mRootMatrix.TransformPoint(mMesh->BoundingCentre());
+        CVector3 scale = mRootMatrix.GetScale();
+        radius = mMesh->BoundingRadius() * std::max(scale.x, std::max(scale.y, scale.z));
+        return;
+    }
+
+    UpdateMatrices();
+    mMesh->PosedBoundingSphere(mAbsoluteMatrices, mSkeletonLOD, centre, radius);
+}
+
+
+// Bring this model's own absolute matrices up to date, only recalculating the changed nodes and their children. Only for
+// models that have their own node matrices (see WritableNodeMatrix)
+void Model::UpdateMatrices()
+{
+    if (!mHasDirtyNodes)  return;
+
+    mNumRecalculated += mMesh->UpdateMatrices(mRootMatrix, mNodeMatrices.data(), mDirtyNodes, mAbsoluteMatrices, mSkinningMatrices, mSkeletonLOD);
+
+    // A skinned mesh at a lower skeleton LOD leaves nodes it doesn't use dirty
+    mHasDirtyNodes = std::find(mDirtyNodes.begin(), mDirtyNodes.end(), 1) != mDirtyNodes.end();
+}
+
+
+// Light the model with only the given lights (indexes in the light manager), up to MAX_OBJECT_LIGHTS of them. Pass a count
+// of -1 to light the model with the scene's lights as usual
+void Model::SetObjectLights(const uint32_t* lights, int numLights)
+{
+    mNumObjectLights = std::min(numLights, MAX_OBJECT_LIGHTS);
+    if (mNumObjectLights > 0)  std::copy(lights, lights + mNumObjectLights, mObjectLights);
 }
 
 
@@ -34,7 +128,7 @@ void Model::Render()
 void Model::Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
                                                KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
 {
-    auto& matrix = mWorldMatrices[node]; // Use reference to node matrix to make code below more readable
+    CMatrix4x4 matrix = NodeMatrix(node); // Work on a copy, only written back if a key is held (see end of function)
 
 	if (KeyHeld( turnUp ))
 	{
@@ -72,6 +166,10 @@ void Model::Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown,
 	{
 		matrix.SetRow(3, matrix.GetRow(3) - localZDir * MOVEMENT_SPEED * frameTime);
 	}
+
+    // Only write back if any key moved the node - writing flags it as changed and may allocate this model's node matrices
+    if (KeyHeld(turnUp) || KeyHeld(turnDown) || KeyHeld(turnRight) || KeyHeld(turnLeft) ||
+        KeyHeld(turnCW) || KeyHeld(turnCCW)  || KeyHeld(moveForward) || KeyHeld(moveBackward))  WritableNodeMatrix(node) = matrix;
 }
 
 
@@ -16,6 +16,13 @@
 
 class Mesh;
 
+// Number of node matrices recalculated / reused from the previous frame by all models rendered since these were last reset
+// Models only recalculate the nodes that have changed (see Model::Render). Single node models keep no matrices, placing
+// their one node with the root matrix each time they are rendered is counted separately
+extern unsigned int gNodeMatricesRecalculated;
+extern unsigned int gNodeMatricesReused;
+extern unsigned int gRootMatricesPlaced;
+
 class Model
 {
 public:
@@ -26,7 +33,7 @@ public:
     Model(Mesh* mesh, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1);
 
 
-    // The render function simply passes this model's matrices over to Mesh:Render.
+    // The render function brings this model's absolute matrices up to date then passes them over to Mesh:Render.
     // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
     void Render();
 
@@ -45,47 +52,121 @@ public:
     // The hierarchy is stored in depth-first order
 
 	// Getters - model only stores matrices. Position, rotation and scale are extracted if requested.
-	CVector3 Position(int node = 0)  { return mWorldMatrices[node].GetRow(3); }         // Position is on bottom row of matrix
-	CVector3 Rotation(int node = 0)  { return mWorldMatrices[node].GetEulerAngles(); }  // Getting angles from a matrix is complex - see .cpp file
-	CVector3 Scale(int node = 0)     { return { Length(mWorldMatrices[node].GetRow(0)),
-                                                Length(mWorldMatrices[node].GetRow(1)), 
-                                                Length(mWorldMatrices[node].GetRow(2)) }; } // Scale is length of rows 0-2 in matrix
-	CMatrix4x4 WorldMatrix(int node = 0)  { return mWorldMatrices[node]; }
+	CVector3 Position(int node = 0)  { return NodeMatrix(node).GetRow(3); }         // Position is on bottom row of matrix
+	CVector3 Rotation(int node = 0)  { CMatrix4x4 m = NodeMatrix(node); return m.GetEulerAngles(); }  // Getting angles from a matrix is complex - see .cpp file
+	CVector3 Scale(int node = 0)     { return { Length(NodeMatrix(node).GetRow(0)),
+                                                Length(NodeMatrix(node).GetRow(1)), 
+                                                Length(NodeMatrix(node).GetRow(2)) }; } // Scale is length of rows 0-2 in matrix
+	CMatrix4x4 WorldMatrix(int node = 0)  { return NodeMatrix(node); }
+
+    // How many nodes (matrices) this model has, the same as its mesh
+    unsigned int NumberNodes()  { return mNumNodes; }
 
     // Setters - model only stores matricies , so if user sets position, rotation or scale, just update those aspects of the matrix
-	void SetPosition(CVector3 position, int node = 0)  { mWorldMatrices[node].SetRow(3, position); }
+    // Setters mark the node as changed so its absolute matrix (and those of its children) are recalculated when next rendered
+	void SetPosition(CVector3 position, int node = 0)  { WritableNodeMatrix(node).SetRow(3, position); }
 
 	void SetRotation(CVector3 rotation, int node = 0)
     {
         // To put rotation angles into a matrix we need to build the matrix from scratch to make sure we retain existing scaling and position
-        mWorldMatrices[node] = MatrixScaling(Scale(node)) *
-                               MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
-                               MatrixTranslation(Position(node));
+        CMatrix4x4 matrix = MatrixScaling(Scale(node)) *
+                            MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
+                            MatrixTranslation(Position(node));
+        WritableNodeMatrix(node) = matrix;
     }
 
 	// Two ways to set scale: x,y,z separately, or all to the same value
     // To set scale without affecting rotation, normalise each row, then multiply it by the scale value.
 	void SetScale(CVector3 scale, int node = 0)
     {
-        mWorldMatrices[node].SetRow(0, Normalise(mWorldMatrices[node].GetRow(0)) * scale.x); 
-        mWorldMatrices[node].SetRow(1, Normalise(mWorldMatrices[node].GetRow(1)) * scale.y); 
-        mWorldMatrices[node].SetRow(2, Normalise(mWorldMatrices[node].GetRow(2)) * scale.z); 
+        CMatrix4x4& matrix = WritableNodeMatrix(node);
+        matrix.SetRow(0, Normalise(matrix.GetRow(0)) * scale.x); 
+        matrix.SetRow(1, Normalise(matrix.GetRow(1)) * scale.y); 
+        matrix.SetRow(2, Normalise(matrix.GetRow(2)) * scale.z); 
     }
 	void SetScale(float scale)  { SetScale({ scale, scale, scale });}
 
-    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { mWorldMatrices[node] = matrix; }
+    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { WritableNodeMatrix(node) = matrix; }
+
+    // The mesh this model is an instance of
+    Mesh* GetMesh()  { return mMesh; }
+
+    // Skeleton level of detail used when rendering a skinned model, 0 is the full skeleton (see Mesh.h)
+    unsigned int SkeletonLOD()  { return mSkeletonLOD; }
+    void SetSkeletonLOD(unsigned int skeletonLOD)  { if (skeletonLOD != mSkeletonLOD)  mHasDirtyNodes = true;  mSkeletonLOD = skeletonLOD; }
+
+    // World space bounding sphere of the model. In the default pose it is the mesh's bounds placed by the root matrix (see
+    // Mesh::BoundingCentre). Once the model has changed its nodes, e.g. to animate, the bounds follow the current pose, which
+    // brings the model's matrices up to date early (see Mesh::PosedBoundingSphere)
+    void BoundingSphere(CVector3& centre, float& radius);
+
+    // Light the model with only the given lights (indexes in the light manager), up to MAX_OBJECT_LIGHTS of them. Pass a count
+    // of -1 to light the model with the scene's lights as usual (the default). Sent to the shaders when the model is rendered
+    void SetObjectLights(const uint32_t* lights, int numLights);
 
 
 	//-------------------------------------
 	// Private data / members
 	//-------------------------------------
 private:
+    // Read access to a node's matrix, wherever it is stored (see member data below)
+    const CMatrix4x4& NodeMatrix(int node)
+    {
+        if (node == 0)  return mRootMatrix;
+        return mNodeMatrices.empty() ? mDefaultMatrices[node] : mNodeMatrices[node];
+    }
+
+    // Write access to a node's matrix. The first write to a node other than the root gives this model its own copy of the
+    // node matrices and the caches below. The node is flagged as changed so its absolute matrix is recalculated
+    CMatrix4x4& WritableNodeMatrix(int node)
+    {
+        if (node != 0 && mNodeMatrices.empty())
+        {
+            mNodeMatrices.assign(mDefaultMatrices, mDefaultMatrices + mNumNodes);
+            mDirtyNodes.assign(mNumNodes, 1); // No absolute matrices calculated yet
+        }
+        SetDirty(node);
+        if (node == 0)  return mRootMatrix;
+        return mNodeMatrices[node];
+    }
+
+    // Bring this model's own absolute matrices up to date, only recalculating the changed nodes and their children. Only for
+    // models that have their own node matrices (see WritableNodeMatrix)
+    void UpdateMatrices();
+
+    // Flag a node as changed since its absolute matrix was last calculated. Models in the default pose keep no flags, they
+    // recalculate every node when the root has changed
+    void SetDirty(int node)  { if (!mDirtyNodes.empty())  mDirtyNodes[node] = 1;  mHasDirtyNodes = true; }
+
+
     Mesh* mMesh;
 
 	// World matrices for the model
-    // Now that meshes have multiple parts, we need multiple matrices. The root matrix (the first one) is the world matrix
-    // for the entire model. The remaining matrices are relative to their parent part. The hierarchy is defined in the mesh (nodes)
-	std::vector<CMatrix4x4> mWorldMatrices;
+    // Now that meshes have multiple parts, we need multiple matrices. The root matrix is the world matrix for the entire
+    // model. The remaining matrices are relative to their parent part. The hierarchy is defined in the mesh (nodes)
+    unsigned int mNumNodes;
+    CMatrix4x4   mRootMatrix;
+
+    // Most models never change anything but the root, so until they do they share the mesh's default matrices. A model only
+    // allocates its own node matrices on the first change to a non-root node (copy-on-write). Entry 0 is unused - see root above
+    const CMatrix4x4*       mDefaultMatrices;
+	std::vector<CMatrix4x4> mNodeMatrices;
+
+    // Absolute world matrices of each node and, for skinned meshes, skinning matrices (bone offsets applied). Kept between
+    // frames and only recalculated for the nodes flagged as dirty and their children, or in the default pose for every node
+    // when the root has changed. Models of single node meshes keep none, they use scratch storage shared by all models
+    // instead (see Model::Render)
+    std::vector<CMatrix4x4>    mAbsoluteMatrices;
+    std::vector<CMatrix4x4>    mSkinningMatrices;
+    std::vector<unsigned char> mDirtyNodes;
+    bool                       mHasDirtyNodes;
+    unsigned int               mNumRecalculated; // Nodes recalculated since last rendered, for the statistics
+
+    unsigned int mSkeletonLOD;
+
+    // Lights used for this model, see SetObjectLights
+    int      mNumObjectLights;
+    uint32_t mObjectLights[MAX_OBJECT_LIGHTS];
 };
 
 
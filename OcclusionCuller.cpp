@@ -0,0 +1,642 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - finds the models hidden behind large occluders before they are drawn
+//--------------------------------------------------------------------------------------
+
+#include "OcclusionCuller.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <emmintrin.h> // SSE2 intrinsics
+#include <cmath>
+#include <cfloat>
+#include <sstream>
+#include <algorithm>
+
+
+// Triangles are clipped to this multiple of the screen's size around its centre, so the edge functions stay precise. Only
+// triangles reaching outside it are clipped at the sides, the rest are clipped to the screen as they are rasterised
+static const float GUARD_BAND = 2.0f;
+
+// Triangle edges are moved inwards by this fraction of a pixel, so rounding errors can't make a pixel centre just outside
+// a triangle count as covered
+static const float EDGE_MARGIN = 1.0f / 128.0f;
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// A depth buffer of the given size in pixels, rounded up to whole tiles. Rasterising is shared between the calling
+// thread and the given number of worker threads, -1 for one less than the number of CPU cores
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height, int numWorkerThreads)
+	: mNumTilesX((width + TILE_SIZE - 1) / TILE_SIZE), mNumTilesY((height + TILE_SIZE - 1) / TILE_SIZE), mNextRow(0)
+{
+	mTiles.resize(mNumTilesX * mNumTilesY);
+	mRowTriangles.resize(mNumTilesY);
+	Clear(MatrixIdentity());
+
+	// No point having more threads than rows
+	if (numWorkerThreads < 0)  numWorkerThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+	numWorkerThreads = std::min(numWorkerThreads, static_cast<int>(mNumTilesY) - 1);
+	for (int i = 0; i < numWorkerThreads; ++i)
+	{
+		mThreads.emplace_back(&OcclusionCuller::WorkerThread, this);
+	}
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mStartWork.notify_all();
+	for (auto& thread : mThreads)  thread.join();
+}
+
+
+// Start a new frame seen with the given view-projection matrix, removing the occluders of the last frame
+void OcclusionCuller::Clear(const CMatrix4x4& viewProjectionMatrix)
+{
+	mViewProjectionMatrix = viewProjectionMatrix;
+	mTriangles.clear();
+	for (auto& row : mRowTriangles)  row.clear();
+
+	// Nothing is further than the far clip
+	for (auto& tile : mTiles)  tile = { 0, 0.0f, 1.0f };
+}
+
+
+// Add occluder triangles: vertex positions in model space, three indices into them per triangle and the model's world
+// matrix. The triangles are transformed, clipped and sorted into rows of tiles straight away
+void OcclusionCuller::AddOccluder(const CVector3* positions, const uint32_t* indices, unsigned int numIndices,
+                                  const CMatrix4x4& worldMatrix)
+{
+	// Transform each vertex once, indices usually refer to each vertex several times. Vertices that need no clipping are
+	// projected to the screen here too
+	uint32_t numPositions = 0;
+	for (unsigned int i = 0; i < numIndices; ++i)  numPositions = std::max(numPositions, indices[i] + 1);
+	mClipVertices.resize(numPositions);
+	mScreenVertices.resize(numPositions);
+	mOutcodes.resize(numPositions);
+
+	const CMatrix4x4 m = worldMatrix * mViewProjectionMatrix;
+	for (uint32_t i = 0; i < numPositions; ++i)
+	{
+		const CVector3& p = positions[i];
+		ClipVertex& v = mClipVertices[i];
+		v = { p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30,
+		      p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31,
+		      p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32,
+		      p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33 };
+		mOutcodes[i] = Outcode(v);
+		if ((mOutcodes[i] & CLIP_PLANES) == 0)  mScreenVertices[i] = Project(v);
+	}
+
+	// Reject triangles entirely outside one side of the view, and clip those crossing the near plane or the guard band
+	for (unsigned int i = 0; i + 2 < numIndices; i += 3)
+	{
+		uint32_t i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+		if (mOutcodes[i0] & mOutcodes[i1] & mOutcodes[i2])  continue;
+
+		unsigned int clipPlanes = (mOutcodes[i0] | mOutcodes[i1] | mOutcodes[i2]) & CLIP_PLANES;
+		if (clipPlanes == 0)  SetupTriangle(mScreenVertices[i0], mScreenVertices[i1], mScreenVertices[i2]);
+		else                  ClipTriangle(mClipVertices[i0], mClipVertices[i1], mClipVertices[i2], clipPlanes);
+	}
+}
+
+
+// Rasterise the occluders added since Clear into the depth buffer
+void OcclusionCuller::Rasterise()
+{
+	// Rasterise the rows, sharing them with the worker threads
+	mNextRow = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mNumWorking = static_cast<unsigned int>(mThreads.size());
+		++mJob;
+	}
+	mStartWork.notify_all();
+	RasteriseRows();
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWorkDone.wait(lock, [this] { return mNumWorking == 0; });
+	}
+}
+
+
+// Whether a box in world space is certainly hidden by the occluders, call after Rasterise. Boxes crossing the near clip
+// plane or entirely off screen are never reported as occluded (frustum culling deals with those)
+bool OcclusionCuller::IsOccluded(const CAABB& box) const
+{
+	// Screen rectangle and nearest depth of the box's corners. The nearest point of the box is always at a corner
+	const CMatrix4x4& m = mViewProjectionMatrix;
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minDepth = FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		CVector3 p = { (corner & 1) ? box.maximum.x : box.minimum.x,
+		               (corner & 2) ? box.maximum.y : box.minimum.y,
+		               (corner & 4) ? box.maximum.z : box.minimum.z };
+		float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+		float w = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+		if (z < 0 || w <= 0)  return false; // In front of the near clip
+
+		float invW = 1.0f / w;
+		float x = ( (p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) * invW * 0.5f + 0.5f) * Width();
+		float y = (-(p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) * invW * 0.5f + 0.5f) * Height();
+		minX = std::min(minX, x);  maxX = std::max(maxX, x);
+		minY = std::min(minY, y);  maxY = std::max(maxY, y);
+		minDepth = std::min(minDepth, z * invW);
+	}
+	if (maxX < 0 || maxY < 0 || minX >= Width() || minY >= Height())  return false;
+
+	// Every pixel the rectangle touches must have occluders in front of the box
+	int firstX = static_cast<int>(std::max(minX, 0.0f)), lastX = static_cast<int>(std::min(maxX, Width()  - 1.0f));
+	int firstY = static_cast<int>(std::max(minY, 0.0f)), lastY = static_cast<int>(std::min(maxY, Height() - 1.0f));
+	for (int tileY = firstY / TILE_SIZE; tileY <= lastY / static_cast<int>(TILE_SIZE); ++tileY)
+	{
+		// Rows of this tile that the rectangle touches
+		int firstRow = std::max(firstY - tileY * static_cast<int>(TILE_SIZE), 0);
+		int lastRow  = std::min(lastY  - tileY * static_cast<int>(TILE_SIZE), static_cast<int>(TILE_SIZE) - 1);
+		uint64_t rowsMask = (~0ull >> (63 - lastRow * TILE_SIZE - 7)) & (~0ull << (firstRow * TILE_SIZE));
+
+		for (int tileX = firstX / TILE_SIZE; tileX <= lastX / static_cast<int>(TILE_SIZE); ++tileX)
+		{
+			int firstColumn = std::max(firstX - tileX * static_cast<int>(TILE_SIZE), 0);
+			int lastColumn  = std::min(lastX  - tileX * static_cast<int>(TILE_SIZE), static_cast<int>(TILE_SIZE) - 1);
+			uint64_t columnMask = (0xffull >> (7 - lastColumn)) & (0xffull << firstColumn);
+			uint64_t boxMask = rowsMask & (columnMask * 0x0101010101010101ull); // Copy the columns to each row
+
+			const Tile& tile = mTiles[tileY * mNumTilesX + tileX];
+			if (minDepth > tile.referenceDepth)  continue;
+			if ((boxMask & ~tile.mask) == 0 && minDepth > tile.workingDepth)  continue;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Triangle set-up
+//--------------------------------------------------------------------------------------
+
+// A bit for each plane of the view a vertex is outside and for each clipping plane it is outside (see OcclusionCuller.h)
+unsigned int OcclusionCuller::Outcode(const ClipVertex& v)
+{
+	float guardW = GUARD_BAND * v.w;
+	return (v.z < 0       ? NEAR_PLANE   : 0) | (v.z > v.w    ? FAR_PLANE   : 0) |
+	       (v.x < -v.w    ? LEFT_PLANE   : 0) | (v.x > v.w    ? RIGHT_PLANE : 0) |
+	       (v.y < -v.w    ? BOTTOM_PLANE : 0) | (v.y > v.w    ? TOP_PLANE   : 0) |
+	       (v.x < -guardW ? GUARD_LEFT   : 0) | (v.x > guardW ? GUARD_RIGHT : 0) |
+	       (v.y < -guardW ? GUARD_BOTTOM : 0) | (v.y > guardW ? GUARD_TOP   : 0);
+}
+
+
+// Pixel coordinates (y downwards) and depth of a vertex that needs no clipping
+OcclusionCuller::ScreenVertex OcclusionCuller::Project(const ClipVertex& v) const
+{
+	float invW = 1.0f / v.w;
+	return { ( v.x * invW * 0.5f + 0.5f) * Width(), (-v.y * invW * 0.5f + 0.5f) * Height(), v.z * invW };
+}
+
+
+// Clip a triangle to the given clipping planes (outcode bits), then set up what is left for rasterising
+void OcclusionCuller::ClipTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, unsigned int clipPlanes)
+{
+	// Distance of a vertex inside a clipping plane
+	auto clipDistance = [](const ClipVertex& v, unsigned int plane)
+	{
+		switch (plane)
+		{
+			case NEAR_PLANE:   return v.z;
+			case GUARD_LEFT:   return GUARD_BAND * v.w + v.x;
+			case GUARD_RIGHT:  return GUARD_BAND * v.w - v.x;
+			case GUARD_BOTTOM: return GUARD_BAND * v.w + v.y;
+			default:           return GUARD_BAND * v.w - v.y;
+		}
+	};
+
+	// Clip the triangle to each plane in turn (Sutherland-Hodgman), then split the polygon left into triangles. Each plane
+	// can add one vertex
+	const unsigned int planes[5] = { NEAR_PLANE, GUARD_LEFT, GUARD_RIGHT, GUARD_BOTTOM, GUARD_TOP };
+	ClipVertex polygon[2][3 + 5] = { { v0, v1, v2 } };
+	int numVertices = 3, current = 0;
+	for (unsigned int plane : planes)
+	{
+		if ((clipPlanes & plane) == 0)  continue;
+
+		const ClipVertex* in  = polygon[current];
+		ClipVertex*       out = polygon[1 - current];
+		int numOut = 0;
+		for (int i = 0; i < numVertices; ++i)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % numVertices];
+			float distanceA = clipDistance(a, plane), distanceB = clipDistance(b, plane);
+			if (distanceA >= 0)  out[numOut++] = a;
+			if ((distanceA >= 0) != (distanceB >= 0))
+			{
+				float t = distanceA / (distanceA - distanceB);
+				out[numOut++] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+			}
+		}
+		numVertices = numOut;
+		current = 1 - current;
+		if (numVertices < 3)  return;
+	}
+
+	ScreenVertex first = Project(polygon[current][0]);
+	ScreenVertex previous = Project(polygon[current][1]);
+	for (int i = 2; i < numVertices; ++i)
+	{
+		ScreenVertex next = Project(polygon[current][i]);
+		SetupTriangle(first, previous, next);
+		previous = next;
+	}
+}
+
+
+// Set up a triangle that needs no more clipping for rasterising
+void OcclusionCuller::SetupTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2)
+{
+	float x[3] = { v0.x, v1.x, v2.x };
+	float y[3] = { v0.y, v1.y, v2.y };
+	float z[3] = { v0.z, v1.z, v2.z };
+
+	// Twice the area, negative if the triangle is wound the other way on screen. Both ways are used, made the same by
+	// swapping two vertices. Skip triangles seen edge on
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area < 0)
+	{
+		std::swap(x[1], x[2]);  std::swap(y[1], y[2]);  std::swap(z[1], z[2]);
+		area = -area;
+	}
+	if (!(area > 0))  return;
+
+	// Pixels whose centres may be inside the triangle, skip triangles entirely off screen
+	float minX = std::min({ x[0], x[1], x[2] }), maxX = std::max({ x[0], x[1], x[2] });
+	float minY = std::min({ y[0], y[1], y[2] }), maxY = std::max({ y[0], y[1], y[2] });
+	if (maxX < 0.5f || maxY < 0.5f || minX > Width() - 0.5f || minY > Height() - 0.5f)  return;
+	unsigned int firstX = static_cast<unsigned int>(std::max(minX - 0.5f, 0.0f));
+	unsigned int firstY = static_cast<unsigned int>(std::max(minY - 0.5f, 0.0f));
+	unsigned int lastX  = static_cast<unsigned int>(std::min(maxX - 0.5f, Width()  - 1.0f));
+	unsigned int lastY  = static_cast<unsigned int>(std::min(maxY - 0.5f, Height() - 1.0f));
+
+	Triangle triangle;
+	for (int i = 0; i < 3; ++i)
+	{
+		int j = (i + 1) % 3;
+		triangle.edgeA[i] = y[i] - y[j];
+		triangle.edgeB[i] = x[j] - x[i];
+		triangle.edgeC[i] = x[i] * y[j] - x[j] * y[i] - EDGE_MARGIN * (std::abs(triangle.edgeA[i]) + std::abs(triangle.edgeB[i]));
+	}
+
+	// Depth is linear in screen space
+	triangle.dzdx  = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	triangle.dzdy  = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	triangle.depth = z[0] - triangle.dzdx * x[0] - triangle.dzdy * y[0];
+	triangle.maxDepth = std::max({ z[0], z[1], z[2] });
+	triangle.firstTileX = static_cast<uint16_t>(firstX / TILE_SIZE);
+	triangle.lastTileX  = static_cast<uint16_t>(lastX  / TILE_SIZE);
+
+	uint32_t index = static_cast<uint32_t>(mTriangles.size());
+	mTriangles.push_back(triangle);
+	for (unsigned int row = firstY / TILE_SIZE; row <= lastY / TILE_SIZE; ++row)  mRowTriangles[row].push_back(index);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Rasterising
+//--------------------------------------------------------------------------------------
+
+// Worker threads wait here for each Rasterise, then help rasterise rows
+void OcclusionCuller::WorkerThread()
+{
+	unsigned int lastJob = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mStartWork.wait(lock, [&] { return mQuit || mJob != lastJob; });
+			if (mQuit)  return;
+			lastJob = mJob;
+		}
+
+		RasteriseRows();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (--mNumWorking == 0)  mWorkDone.notify_one();
+		}
+	}
+}
+
+
+// Rasterise rows until there are none left, called by the worker threads and Rasterise
+void OcclusionCuller::RasteriseRows()
+{
+	unsigned int row;
+	while ((row = mNextRow++) < mNumTilesY)
+	{
+		RasteriseRow(row);
+	}
+}
+
+
+// Rasterise the triangles overlapping one row of tiles
+void OcclusionCuller::RasteriseRow(unsigned int tileY)
+{
+	Tile* tiles = &mTiles[tileY * mNumTilesX];
+	const float top = static_cast<float>(tileY * TILE_SIZE);
+	const __m128 columnOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	for (uint32_t index : mRowTriangles[tileY])
+	{
+		const Triangle& triangle = mTriangles[index];
+
+		// Furthest depth of the triangle over the row's pixel centres in y, the x part is added for each tile
+		float rowDepth = triangle.depth + triangle.dzdy * (top + (triangle.dzdy > 0 ? TILE_SIZE - 0.5f : 0.5f));
+		float columnOffset = triangle.dzdx > 0 ? TILE_SIZE - 0.5f : 0.5f;
+
+		for (unsigned int tileX = triangle.firstTileX; tileX <= triangle.lastTileX; ++tileX)
+		{
+			Tile& tile = tiles[tileX];
+			const float left = static_cast<float>(tileX * TILE_SIZE);
+
+			// The triangle's depth can't be further than its plane at the tile's furthest pixel centre, or its furthest
+			// vertex. Nothing to do if that isn't nearer than the tile already is
+			float depth = std::min(rowDepth + triangle.dzdx * (left + columnOffset), triangle.maxDepth);
+			if (depth >= tile.referenceDepth)  continue;
+
+			// Edge functions at the tile's first pixel centre. Skip the tile if any edge is outside all its pixel centres, and
+			// it is entirely covered if every edge is inside all of them
+			float edgeStart[3];
+			bool inside = true;
+			bool outside = false;
+			for (int i = 0; i < 3; ++i)
+			{
+				edgeStart[i] = triangle.edgeA[i] * (left + 0.5f) + triangle.edgeB[i] * (top + 0.5f) + triangle.edgeC[i];
+				float spanA = triangle.edgeA[i] * (TILE_SIZE - 1), spanB = triangle.edgeB[i] * (TILE_SIZE - 1);
+				outside = outside || edgeStart[i] + std::max(spanA, 0.0f) + std::max(spanB, 0.0f) < 0;
+				inside  = inside  && edgeStart[i] + std::min(spanA, 0.0f) + std::min(spanB, 0.0f) >= 0;
+			}
+			if (outside)  continue;
+
+			uint64_t coverage = ~0ull;
+			if (!inside)
+			{
+				// Edge functions along the tile's first row, four pixels at a time. A pixel is covered if all three are >= 0,
+				// so the sign bit of the smallest is clear
+				__m128 edgeLeft[3], edgeRight[3], edgeStepY[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					__m128 a = _mm_set1_ps(triangle.edgeA[i]);
+					edgeLeft[i]  = _mm_add_ps(_mm_set1_ps(edgeStart[i]), _mm_mul_ps(a, columnOffsets));
+					edgeRight[i] = _mm_add_ps(edgeLeft[i], _mm_mul_ps(a, _mm_set1_ps(4.0f)));
+					edgeStepY[i] = _mm_set1_ps(triangle.edgeB[i]);
+				}
+
+				coverage = 0;
+				for (unsigned int row = 0; row < TILE_SIZE; ++row)
+				{
+					__m128 smallestLeft  = _mm_min_ps(_mm_min_ps(edgeLeft[0],  edgeLeft[1]),  edgeLeft[2]);
+					__m128 smallestRight = _mm_min_ps(_mm_min_ps(edgeRight[0], edgeRight[1]), edgeRight[2]);
+					unsigned int outsideBits = _mm_movemask_ps(smallestLeft) | (_mm_movemask_ps(smallestRight) << 4);
+					coverage |= static_cast<uint64_t>(~outsideBits & 0xff) << (row * TILE_SIZE);
+					for (int i = 0; i < 3; ++i)
+					{
+						edgeLeft[i]  = _mm_add_ps(edgeLeft[i],  edgeStepY[i]);
+						edgeRight[i] = _mm_add_ps(edgeRight[i], edgeStepY[i]);
+					}
+				}
+				if (coverage == 0)  continue;
+			}
+
+			// Merge the triangle into the working layer. If the triangle is much nearer than the working layer, start a new
+			// working layer with it instead, so a far away layer doesn't hold back nearer ones (heuristic from the paper)
+			if (tile.mask != 0 && tile.workingDepth - depth > tile.referenceDepth - tile.workingDepth)
+			{
+				tile.mask = 0;
+			}
+			tile.workingDepth = (tile.mask == 0) ? depth : std::max(tile.workingDepth, depth);
+			tile.mask |= coverage;
+
+			// When the working layer covers the tile it becomes the reference
+			if (tile.mask == ~0ull)
+			{
+				tile.referenceDepth = std::min(tile.referenceDepth, tile.workingDepth);
+				tile.mask = 0;
+				tile.workingDepth = 0;
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// A perspective projection like the camera's (see MakeProjectionMatrix), kept here so this file needs no graphics headers
+	CMatrix4x4 PerspectiveMatrix(float aspectRatio, float FOVx, float nearClip, float farClip)
+	{
+		float scaleX  = 1.0f / std::tan(FOVx * 0.5f);
+		float scaleZa = farClip / (farClip - nearClip);
+		CMatrix4x4 m = MatrixIdentity();
+		m.e00 = scaleX;
+		m.e11 = scaleX * aspectRatio;
+		m.e22 = scaleZa;  m.e23 = 1.0f;
+		m.e32 = -nearClip * scaleZa;  m.e33 = 0.0f;
+		return m;
+	}
+
+	// Test scene geometry in world space, three indices per triangle
+	struct TestMesh
+	{
+		std::vector<CVector3> positions;
+		std::vector<uint32_t> indices;
+
+		// Add a box as 12 triangles
+		void AddBox(const CVector3& minimum, const CVector3& maximum)
+		{
+			uint32_t first = static_cast<uint32_t>(positions.size());
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				positions.push_back({ (corner & 1) ? maximum.x : minimum.x, (corner & 2) ? maximum.y : minimum.y,
+				                      (corner & 4) ? maximum.z : minimum.z });
+			}
+			const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 } };
+			for (auto& face : faces)
+			{
+				for (uint32_t corner : { face[0], face[1], face[2], face[0], face[2], face[3] })  indices.push_back(first + corner);
+			}
+		}
+	};
+
+	// The nearest depth at each pixel centre of the test scene, rasterised a pixel at a time in double precision. All the
+	// scene's vertices must be beyond the near clip
+	std::vector<float> ReferenceDepths(const TestMesh& mesh, const CMatrix4x4& m, unsigned int width, unsigned int height)
+	{
+		std::vector<double> x(mesh.positions.size()), y(mesh.positions.size()), z(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); ++i)
+		{
+			const CVector3& p = mesh.positions[i];
+			double w = static_cast<double>(p.x) * m.e03 + static_cast<double>(p.y) * m.e13 + static_cast<double>(p.z) * m.e23 + m.e33;
+			x[i] = ( (static_cast<double>(p.x) * m.e00 + static_cast<double>(p.y) * m.e10 + static_cast<double>(p.z) * m.e20 + m.e30) / w * 0.5 + 0.5) * width;
+			y[i] = (-(static_cast<double>(p.x) * m.e01 + static_cast<double>(p.y) * m.e11 + static_cast<double>(p.z) * m.e21 + m.e31) / w * 0.5 + 0.5) * height;
+			z[i] =    (static_cast<double>(p.x) * m.e02 + static_cast<double>(p.y) * m.e12 + static_cast<double>(p.z) * m.e22 + m.e32) / w;
+		}
+
+		std::vector<float> depths(width * height, 1.0f);
+		for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+		{
+			uint32_t i0 = mesh.indices[t], i1 = mesh.indices[t + 1], i2 = mesh.indices[t + 2];
+			double area = (x[i1] - x[i0]) * (y[i2] - y[i0]) - (x[i2] - x[i0]) * (y[i1] - y[i0]);
+			if (area == 0)  continue;
+			for (unsigned int py = 0; py < height; ++py)
+			{
+				for (unsigned int px = 0; px < width; ++px)
+				{
+					// Barycentric coordinates of the pixel centre, all the same sign as the area inside the triangle
+					double cx = px + 0.5, cy = py + 0.5;
+					double b0 = ((x[i1] - cx) * (y[i2] - cy) - (x[i2] - cx) * (y[i1] - cy)) / area;
+					double b1 = ((x[i2] - cx) * (y[i0] - cy) - (x[i0] - cx) * (y[i2] - cy)) / area;
+					double b2 = 1.0 - b0 - b1;
+					if (b0 < 0 || b1 < 0 || b2 < 0)  continue;
+					float depth = static_cast<float>(b0 * z[i0] + b1 * z[i1] + b2 * z[i2]);
+					depths[py * width + px] = std::min(depths[py * width + px], depth);
+				}
+			}
+		}
+		return depths;
+	}
+}
+
+
+// Rasterise a test scene of terrain and walls, then test random boxes against it, with one thread and with all threads.
+// Checks that no box is reported as occluded that a simple per-pixel depth buffer of the same occluders shows to be
+// visible, and that both thread counts give the same results. Writes a report of the percentage of boxes occluded and the
+// time per frame in microseconds to the given stream. Returns the number of checks failed (see Tests.cpp)
+unsigned int RunOcclusionBenchmark(std::ostream& report, unsigned int numBoxes /*= 1000*/, unsigned int numRepeats /*= 100*/)
+{
+	OcclusionCuller singleThreaded(256, 144, 0);
+	OcclusionCuller multiThreaded(256, 144);
+	const unsigned int width = singleThreaded.Width(), height = singleThreaded.Height();
+
+	// Camera above rolling hills looking slightly down, with walls and a container-like box in front of it
+	CMatrix4x4 cameraMatrix = MatrixRotationX(ToRadians(5)) * MatrixTranslation({ 0, 25, 0 });
+	CMatrix4x4 viewProjectionMatrix = InverseAffine(cameraMatrix) * PerspectiveMatrix(16.0f / 9.0f, ToRadians(90), 1, 2000);
+
+	TestMesh scene;
+	const unsigned int GRID = 64;
+	for (unsigned int z = 0; z <= GRID; ++z)
+	{
+		for (unsigned int x = 0; x <= GRID; ++x)
+		{
+			float worldX = -800.0f + 1600.0f * x / GRID, worldZ = 40.0f + 1200.0f * z / GRID;
+			scene.positions.push_back({ worldX, 12.0f * std::sin(worldX / 60.0f) * std::cos(worldZ / 90.0f) + worldZ * 0.02f, worldZ });
+		}
+	}
+	for (unsigned int z = 0; z < GRID; ++z)
+	{
+		for (unsigned int x = 0; x < GRID; ++x)
+		{
+			uint32_t i = z * (GRID + 1) + x;
+			for (uint32_t corner : { i, i + GRID + 1, i + 1, i + 1, i + GRID + 1, i + GRID + 2 })  scene.indices.push_back(corner);
+		}
+	}
+	scene.AddBox({ -120, -5,  90 }, { -20, 45,  95 });
+	scene.AddBox({   30, -5, 150 }, { 140, 35, 160 });
+	scene.AddBox({  -25, -5,  60 }, {   5, 25,  85 });
+
+	// Random boxes of different sizes, some above the hills and some partly or entirely below them
+	std::vector<CAABB> boxes(numBoxes);
+	for (auto& box : boxes)
+	{
+		CVector3 centre = { Random(-400, 400), Random(-15, 30), Random(50, 900) };
+		CVector3 halfSize = { Random(0.5f, 8), Random(0.5f, 8), Random(0.5f, 8) };
+		box = { centre - halfSize, centre + halfSize };
+	}
+
+	report.precision(3);
+	report << std::fixed;
+	report << "Occlusion culling benchmark: " << width << "x" << height << " depth buffer, " << scene.indices.size() / 3
+	       << " occluder triangles, " << numBoxes << " boxes, " << numRepeats << " repeats, " << multiThreaded.NumThreads() << " threads\n";
+
+	// Time whole frames: clearing, adding the occluders and rasterising, then testing every box
+	Timer timer;
+	std::vector<uint8_t> singleOccluded(numBoxes), multiOccluded(numBoxes);
+	auto runFrames = [&](OcclusionCuller& culler, std::vector<uint8_t>& occluded, float& rasteriseTime, float& testTime)
+	{
+		rasteriseTime = testTime = 0;
+		timer.GetLapTime();
+		for (unsigned int r = 0; r < numRepeats; ++r)
+		{
+			culler.Clear(viewProjectionMatrix);
+			culler.AddOccluder(scene.positions.data(), scene.indices.data(), static_cast<unsigned int>(scene.indices.size()), MatrixIdentity());
+			culler.Rasterise();
+			rasteriseTime += timer.GetLapTime();
+
+			for (unsigned int b = 0; b < numBoxes; ++b)  occluded[b] = culler.IsOccluded(boxes[b]) ? 1 : 0;
+			testTime += timer.GetLapTime();
+		}
+	};
+	float singleRasterise, singleTest, multiRasterise, multiTest;
+	runFrames(singleThreaded, singleOccluded, singleRasterise, singleTest);
+	runFrames(multiThreaded,  multiOccluded,  multiRasterise,  multiTest);
+
+	// Compare with a per-pixel depth buffer. A box the culler reports as occluded must be behind the nearest occluder at
+	// every pixel centre it touches (with a little tolerance for the single precision maths)
+	std::vector<float> depths = ReferenceDepths(scene, viewProjectionMatrix, width, height);
+	unsigned int numOccluded = 0, numReferenceOccluded = 0, numErrors = 0;
+	for (unsigned int b = 0; b < numBoxes; ++b)
+	{
+		const CAABB& box = boxes[b];
+		bool inFront = false;
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minDepth = FLT_MAX;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			CVector3 p = { (corner & 1) ? box.maximum.x : box.minimum.x, (corner & 2) ? box.maximum.y : box.minimum.y,
+			               (corner & 4) ? box.maximum.z : box.minimum.z };
+			const CMatrix4x4& m = viewProjectionMatrix;
+			float w = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+			float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+			inFront = inFront || z < 0;
+			minX = std::min(minX, ( (p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) / w * 0.5f + 0.5f) * width);
+			maxX = std::max(maxX, ( (p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) / w * 0.5f + 0.5f) * width);
+			minY = std::min(minY, (-(p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) / w * 0.5f + 0.5f) * height);
+			maxY = std::max(maxY, (-(p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) / w * 0.5f + 0.5f) * height);
+			minDepth = std::min(minDepth, z / w);
+		}
+
+		bool referenceOccluded = !inFront && maxX >= 0 && maxY >= 0 && minX < width && minY < height;
+		bool referenceVisible  = false; // Clearly visible somewhere, beyond the tolerance
+		for (int py = static_cast<int>(std::max(minY, 0.0f)); referenceOccluded && py <= static_cast<int>(std::min(maxY, height - 1.0f)); ++py)
+		{
+			for (int px = static_cast<int>(std::max(minX, 0.0f)); px <= static_cast<int>(std::min(maxX, width - 1.0f)); ++px)
+			{
+				float depth = depths[py * width + px];
+				if (depth >= minDepth)           referenceOccluded = false;
+				if (depth >= minDepth + 1e-5f)   referenceVisible = true;
+			}
+		}
+		numOccluded          += multiOccluded[b];
+		numReferenceOccluded += referenceOccluded ? 1 : 0;
+		if (multiOccluded[b] && referenceVisible)  ++numErrors;
+	}
+
+	// Report times in microseconds per frame
+	float scale = 1000000.0f / numRepeats;
+	report << "  1 thread: " << (singleRasterise + singleTest) * scale << "us per frame (rasterise " << singleRasterise * scale
+	       << "us, test boxes " << singleTest * scale << "us)\n"
+	       << "  " << multiThreaded.NumThreads() << " threads: " << (multiRasterise + multiTest) * scale << "us per frame (rasterise "
+	       << multiRasterise * scale << "us, test boxes " << multiTest * scale << "us)\n"
+	       << "  Boxes occluded: " << 100.0f * numOccluded / numBoxes << "%, per-pixel depth buffer would occlude "
+	       << 100.0f * numReferenceOccluded / numBoxes << "%\n"
+	       << "  Checks: " << (singleOccluded == multiOccluded ? "thread counts agree" : "THREAD COUNTS DIFFER") << ", "
+	       << (numErrors == 0 ? "no visible boxes occluded" : std::to_string(numErrors) + " VISIBLE BOXES OCCLUDED") << "\n";
+	return (singleOccluded == multiOccluded ? 0 : 1) + numErrors;
+}
@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - finds the models hidden behind large occluders before they are drawn
+//--------------------------------------------------------------------------------------
+// Each frame a few large, simple occluders (terrain, walls, floors) are rasterised on the CPU into a small depth buffer
+// seen from the camera, then the bounding boxes of the models in view are tested against it. A model whose box is behind
+// the occluders at every pixel it touches can't be seen and needn't be drawn.
+//
+// The buffer doesn't hold a depth for each pixel. Following Hasselgren, Andersson and Akenine-Moller, "Masked Software
+// Occlusion Culling" (2016), it is split into 8x8 pixel tiles and each tile holds a coverage mask (a bit per pixel) and
+// two depths:
+//   - the reference depth: every pixel in the tile has an occluder no further away than this
+//   - the working depth:   every pixel whose mask bit is set has an occluder no further away than this
+// Triangles are merged into the working layer, and when its mask covers the whole tile it becomes the new reference. So
+// rasterising a triangle costs a few SSE compares per tile rather than a depth write per pixel, and testing a box is a
+// compare per tile - the tiles are the coarse level of a hierarchical depth buffer and the masks are the fine level.
+//
+// Depths are post-projection z / w, 0 at the near clip and 1 at the far clip. Occluders are sampled at pixel centres, so at
+// this low resolution a model seen only through a gap narrower than a pixel may be culled. Occluders must be opaque, and
+// their triangles are used whichever way they face.
+//
+// Rasterising is split into rows of tiles, spread across worker threads that are kept waiting between frames. Each row
+// takes its triangles in the order they were added, so results don't depend on the number of threads.
+//
+// Uses only the maths classes and the standard library, so it can be built and tested without a window or GPU
+
+#ifndef _OCCLUSION_CULLER_H_INCLUDED_
+#define _OCCLUSION_CULLER_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CBoundingVolumes.h"
+
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+class OcclusionCuller
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// A depth buffer of the given size in pixels, rounded up to whole tiles. Rasterising is shared between the calling
+	// thread and the given number of worker threads, -1 for one less than the number of CPU cores
+	OcclusionCuller(unsigned int width = 256, unsigned int height = 144, int numWorkerThreads = -1);
+	~OcclusionCuller();
+
+	// Start a new frame seen with the given view-projection matrix, removing the occluders of the last frame
+	void Clear(const CMatrix4x4& viewProjectionMatrix);
+
+	// Add occluder triangles: vertex positions in model space, three indices into them per triangle and the model's world
+	// matrix. The triangles are transformed, clipped and sorted into rows of tiles straight away
+	void AddOccluder(const CVector3* positions, const uint32_t* indices, unsigned int numIndices, const CMatrix4x4& worldMatrix);
+
+	// Rasterise the occluders added since Clear into the depth buffer
+	void Rasterise();
+
+	// Whether a box in world space is certainly hidden by the occluders, call after Rasterise. Boxes crossing the near clip
+	// plane or entirely off screen are never reported as occluded (frustum culling deals with those)
+	bool IsOccluded(const CAABB& box) const;
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	unsigned int Width() const  { return mNumTilesX * TILE_SIZE; }
+	unsigned int Height() const { return mNumTilesY * TILE_SIZE; }
+	unsigned int NumTriangles()  { return static_cast<unsigned int>(mTriangles.size()); } // After clipping, since Clear
+	unsigned int NumThreads()    { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+	// Reference depth of a tile, i.e. the furthest an occluder can be at any pixel in it. 1 where there are no occluders
+	float TileDepth(unsigned int tileX, unsigned int tileY)  { return mTiles[tileY * mNumTilesX + tileX].referenceDepth; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Not copyable, the worker threads refer to this object
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	// A vertex after the view-projection matrix, before dividing by w, and after: in pixels (y downwards) with its depth
+	struct ClipVertex   { float x, y, z, w; };
+	struct ScreenVertex { float x, y, z; };
+
+	// Bits of a vertex's outcode, set for each plane of the view it is outside and for each plane triangles are clipped to.
+	// Triangles are clipped to the near plane and a guard band around the screen (see GUARD_BAND in the .cpp file)
+	static const unsigned int NEAR_PLANE = 1,  FAR_PLANE   = 2,   LEFT_PLANE   = 4,   RIGHT_PLANE = 8, BOTTOM_PLANE = 16, TOP_PLANE = 32;
+	static const unsigned int GUARD_LEFT = 64, GUARD_RIGHT = 128, GUARD_BOTTOM = 256, GUARD_TOP   = 512;
+	static const unsigned int CLIP_PLANES = NEAR_PLANE | GUARD_LEFT | GUARD_RIGHT | GUARD_BOTTOM | GUARD_TOP;
+	static unsigned int Outcode(const ClipVertex& v);
+
+	// Pixel coordinates and depth of a vertex that needs no clipping
+	ScreenVertex Project(const ClipVertex& v) const;
+
+	// Clip a triangle to the given clipping planes (outcode bits), then set up what is left for rasterising
+	void ClipTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, unsigned int clipPlanes);
+
+	// Set up a triangle that needs no more clipping for rasterising
+	void SetupTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2);
+
+	// Worker threads wait here for each Rasterise, then help rasterise rows
+	void WorkerThread();
+
+	// Rasterise rows until there are none left, called by the worker threads and Rasterise
+	void RasteriseRows();
+
+	// Rasterise the triangles overlapping one row of tiles
+	void RasteriseRow(unsigned int tileY);
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	static const unsigned int TILE_SIZE = 8; // Pixels across and down a tile, one bit each in a 64-bit mask
+
+	unsigned int mNumTilesX, mNumTilesY;
+	CMatrix4x4   mViewProjectionMatrix;
+
+	// A tile of the depth buffer, see the top of this file. Bit y * 8 + x of the mask is pixel (x, y) in the tile
+	struct Tile
+	{
+		uint64_t mask;
+		float    workingDepth;
+		float    referenceDepth;
+	};
+	std::vector<Tile> mTiles; // Ordered across then down
+
+	// A triangle ready to rasterise, in pixels with y downwards. Edge function i is A * x + B * y + C, which is >= 0 on the
+	// inside of edge i. Depth at (x, y) is the plane depth + dzdx * x + dzdy * y
+	struct Triangle
+	{
+		float    edgeA[3], edgeB[3], edgeC[3];
+		float    depth, dzdx, dzdy;
+		float    maxDepth;             // Furthest vertex
+		uint16_t firstTileX, lastTileX;
+	};
+	std::vector<Triangle> mTriangles;
+	std::vector<std::vector<uint32_t>> mRowTriangles; // The triangles overlapping each row of tiles, in the order added
+
+	// Vertices of the occluder being added, kept to save reallocating them
+	std::vector<ClipVertex>   mClipVertices;
+	std::vector<ScreenVertex> mScreenVertices;
+	std::vector<unsigned int> mOutcodes;
+
+	// Worker threads. Each Rasterise increases the job number to wake them, rows are taken in turn using mNextRow
+	std::vector<std::thread>  mThreads;
+	std::mutex                mMutex;
+	std::condition_variable   mStartWork;
+	std::condition_variable   mWorkDone;
+	unsigned int              mJob = 0;
+	unsigned int              mNumWorking = 0;
+	bool                      mQuit = false;
+	std::atomic<unsigned int> mNextRow;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Rasterise a test scene of terrain and walls, then test random boxes against it, with one thread and with all threads.
+// Checks that no box is reported as occluded that a simple per-pixel depth buffer of the same occluders shows to be
+// visible, and that both thread counts give the same results. Writes a report of the percentage of boxes occluded and the
+// time per frame in microseconds to the given stream. Returns the number of checks failed (see Tests.cpp)
+unsigned int RunOcclusionBenchmark(std::ostream& report, unsigned int numBoxes = 1000, unsigned int numRepeats = 100);
+
+
+#endif //_OCCLUSION_CULLER_H_INCLUDED_
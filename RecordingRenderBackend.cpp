@@ -0,0 +1,370 @@
+//--------------------------------------------------------------------------------------
+// Render backend that records and counts the calls made to it, for measuring the CPU cost of rendering
+//--------------------------------------------------------------------------------------
+
+#include "RecordingRenderBackend.h"
+#ifdef _WIN32
+#include "D3D11RenderBackend.h"
+#endif
+
+#include <unordered_map>
+#include <sstream>
+#include <cstring>
+
+
+//-------------------------------------
+// CPU-side buffers
+//-------------------------------------
+
+#ifdef _WIN32
+
+// A buffer held in CPU memory, created when there is no GPU. It is a complete ID3D11Buffer so the rest of the app can
+// use and release it as normal. Nothing can be bound to a device with it
+class RecordedBuffer : public ID3D11Buffer
+{
+public:
+	RecordedBuffer(const RenderBufferDesc& desc, const void* initialData)
+		: mDesc(desc), mData(desc.size)
+	{
+		if (initialData != nullptr)  std::memcpy(mData.data(), initialData, desc.size);
+	}
+
+	// IUnknown
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** object) override  { *object = nullptr; return E_NOINTERFACE; }
+	ULONG STDMETHODCALLTYPE AddRef() override  { return ++mRefCount; }
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG refCount = --mRefCount;
+		if (refCount == 0)  delete this;
+		return refCount;
+	}
+
+	// ID3D11DeviceChild - there is no device and private data is not supported
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device** device) override  { *device = nullptr; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT* dataSize, void*) override  { *dataSize = 0; return DXGI_ERROR_NOT_FOUND; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) override  { return S_OK; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override  { return S_OK; }
+
+	// ID3D11Resource
+	void STDMETHODCALLTYPE GetType(D3D11_RESOURCE_DIMENSION* type) override  { *type = D3D11_RESOURCE_DIMENSION_BUFFER; }
+	void STDMETHODCALLTYPE SetEvictionPriority(UINT priority) override  { mEvictionPriority = priority; }
+	UINT STDMETHODCALLTYPE GetEvictionPriority() override  { return mEvictionPriority; }
+
+	// ID3D11Buffer
+	void STDMETHODCALLTYPE GetDesc(D3D11_BUFFER_DESC* desc) override  { *desc = D3D11RenderBackend::BufferDesc(mDesc); }
+
+private:
+	RenderBufferDesc  mDesc;
+	std::vector<char> mData;
+	ULONG mRefCount = 1;
+	UINT  mEvictionPriority = 0;
+};
+
+static RenderBuffer* NewRecordedBuffer(const RenderBufferDesc& desc, const void* initialData)  { return new RecordedBuffer(desc, initialData); }
+static void DeleteRecordedBuffer(RenderBuffer* buffer)  { buffer->Release(); }
+
+#else
+
+// A buffer held in CPU memory, created when there is no GPU. Without Windows the buffer handle type is never defined,
+// so the handle given out points to one of these instead, and it is deleted by ReleaseBuffer
+class RecordedBuffer
+{
+public:
+	RecordedBuffer(const RenderBufferDesc& desc, const void* initialData)
+		: mDesc(desc), mData(desc.size)
+	{
+		if (initialData != nullptr)  std::memcpy(mData.data(), initialData, desc.size);
+	}
+
+private:
+	RenderBufferDesc  mDesc;
+	std::vector<char> mData;
+};
+
+static RenderBuffer* NewRecordedBuffer(const RenderBufferDesc& desc, const void* initialData)
+{
+	return reinterpret_cast<RenderBuffer*>(new RecordedBuffer(desc, initialData));
+}
+static void DeleteRecordedBuffer(RenderBuffer* buffer)  { delete reinterpret_cast<RecordedBuffer*>(buffer); }
+
+#endif
+
+
+//-------------------------------------
+// Construction and Usage
+//-------------------------------------
+
+// Return the commands recorded as text, one line per command. Objects are shown as numbers in the order they were
+// first used rather than addresses, so logs from different runs can be compared
+std::string RecordingRenderBackend::CommandLog()
+{
+	static const char* const commandNames[] =
+	{
+		"CreateBuffer", "UpdateBuffer", "WriteBuffer", "UpdateBufferRegion", "VSSetShader", "GSSetShader", "PSSetShader",
+		"VSSetConstantBuffers", "GSSetConstantBuffers", "PSSetConstantBuffers", "VSSetConstantBuffers1", "PSSetConstantBuffers1",
+		"PSSetShaderResources", "PSSetSamplers", "OMSetBlendState", "OMSetDepthStencilState", "RSSetState", "RSSetViewports",
+		"IASetInputLayout", "IASetPrimitiveTopology", "IASetVertexBuffers", "IASetIndexBuffer", "Draw", "DrawIndexed",
+		"OMSetRenderTargets", "ClearRenderTargetView", "ClearDepthStencilView", "Present",
+	};
+
+	std::unordered_map<const void*, unsigned int> objectNumbers;
+	objectNumbers[nullptr] = 0;
+
+	std::ostringstream log;
+	for (auto& command : mCommands)
+	{
+		log << commandNames[static_cast<int>(command.type) - 1];
+		if (command.slot != 0 || command.count != 1)  log << " [" << int(command.slot) << ":" << command.count << "]";
+		bool hasObject = command.type != ERenderCommand::Draw && command.type != ERenderCommand::DrawIndexed &&
+		                 command.type != ERenderCommand::IASetPrimitiveTopology && command.type != ERenderCommand::RSSetViewports &&
+		                 command.type != ERenderCommand::Present;
+		if (hasObject) // Unbinding (nullptr) is shown as #0
+		{
+			auto found = objectNumbers.insert({ command.object, static_cast<unsigned int>(objectNumbers.size()) });
+			log << " #" << found.first->second;
+		}
+		if (command.value != 0)  log << " " << command.value;
+		log << "\n";
+	}
+	return log.str();
+}
+
+
+//-------------------------------------
+// Backend functions
+//-------------------------------------
+
+bool RecordingRenderBackend::CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer)
+{
+	if (mForwardTo != nullptr)
+	{
+		if (!mForwardTo->CreateBuffer(desc, initialData, buffer))  return false;
+	}
+	else
+	{
+		*buffer = NewRecordedBuffer(desc, initialData);
+	}
+
+	if (initialData != nullptr)  mNumBytesUploaded += desc.size;
+	Record(ERenderCommand::CreateBuffer, *buffer, desc.size);
+	return true;
+}
+
+// Not recorded, releasing is not part of rendering a frame
+void RecordingRenderBackend::ReleaseBuffer(RenderBuffer* buffer)
+{
+	if (buffer == nullptr)  return;
+	if (mForwardTo != nullptr)  mForwardTo->ReleaseBuffer(buffer);
+	else                        DeleteRecordedBuffer(buffer);
+}
+
+void RecordingRenderBackend::UpdateBuffer(RenderBuffer* buffer, const void* data, size_t size)
+{
+	if (mForwardTo != nullptr)
+	{
+		mForwardTo->UpdateBuffer(buffer, data, size);
+	}
+	else
+	{
+		if (mUploadScratch.size() < size)  mUploadScratch.resize(size);
+		std::memcpy(mUploadScratch.data(), data, size);
+	}
+	mNumBytesUploaded += size;
+	Record(ERenderCommand::UpdateBuffer, buffer, static_cast<uint32_t>(size));
+}
+
+void RecordingRenderBackend::WriteBuffer(RenderBuffer* buffer, size_t offset, const void* data, size_t size, bool discard)
+{
+	if (mForwardTo != nullptr)
+	{
+		mForwardTo->WriteBuffer(buffer, offset, data, size, discard);
+	}
+	else
+	{
+		if (mUploadScratch.size() < size)  mUploadScratch.resize(size);
+		std::memcpy(mUploadScratch.data(), data, size);
+	}
+	mNumBytesUploaded += size;
+	Record(ERenderCommand::WriteBuffer, buffer, static_cast<uint32_t>(size));
+}
+
+void RecordingRenderBackend::UpdateBufferRegion(RenderBuffer* buffer, size_t offset, const void* data, size_t size)
+{
+	if (mForwardTo != nullptr)
+	{
+		mForwardTo->UpdateBufferRegion(buffer, offset, data, size);
+	}
+	else
+	{
+		if (mUploadScratch.size() < size)  mUploadScratch.resize(size);
+		std::memcpy(mUploadScratch.data(), data, size);
+	}
+	mNumBytesUploaded += size;
+	Record(ERenderCommand::UpdateBufferRegion, buffer, static_cast<uint32_t>(size));
+}
+
+// With no GPU, offsets are supported so the same code is timed as on a Direct3D 11.1 device
+bool RecordingRenderBackend::SupportsConstantBufferOffsets()
+{
+	return mForwardTo != nullptr ? mForwardTo->SupportsConstantBufferOffsets() : true;
+}
+
+
+void RecordingRenderBackend::VSSetShader(RenderVertexShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	if (mForwardTo != nullptr)  mForwardTo->VSSetShader(shader, classInstances, numClassInstances);
+	RecordBind(ERenderCommand::VSSetShader, 0, 1, &shader);
+}
+void RecordingRenderBackend::GSSetShader(RenderGeometryShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	if (mForwardTo != nullptr)  mForwardTo->GSSetShader(shader, classInstances, numClassInstances);
+	RecordBind(ERenderCommand::GSSetShader, 0, 1, &shader);
+}
+void RecordingRenderBackend::PSSetShader(RenderPixelShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances)
+{
+	if (mForwardTo != nullptr)  mForwardTo->PSSetShader(shader, classInstances, numClassInstances);
+	RecordBind(ERenderCommand::PSSetShader, 0, 1, &shader);
+}
+
+void RecordingRenderBackend::VSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	if (mForwardTo != nullptr)  mForwardTo->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+	RecordBind(ERenderCommand::VSSetConstantBuffers, startSlot, numBuffers, buffers);
+}
+void RecordingRenderBackend::GSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	if (mForwardTo != nullptr)  mForwardTo->GSSetConstantBuffers(startSlot, numBuffers, buffers);
+	RecordBind(ERenderCommand::GSSetConstantBuffers, startSlot, numBuffers, buffers);
+}
+void RecordingRenderBackend::PSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers)
+{
+	if (mForwardTo != nullptr)  mForwardTo->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+	RecordBind(ERenderCommand::PSSetConstantBuffers, startSlot, numBuffers, buffers);
+}
+
+void RecordingRenderBackend::VSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+                                                   const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	if (mForwardTo != nullptr)  mForwardTo->VSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+	Record(ERenderCommand::VSSetConstantBuffers1, numBuffers > 0 ? buffers[0] : nullptr, numBuffers > 0 ? firstConstants[0] : 0, startSlot, numBuffers);
+	++mNumBinds;
+}
+void RecordingRenderBackend::PSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+                                                   const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	if (mForwardTo != nullptr)  mForwardTo->PSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+	Record(ERenderCommand::PSSetConstantBuffers1, numBuffers > 0 ? buffers[0] : nullptr, numBuffers > 0 ? firstConstants[0] : 0, startSlot, numBuffers);
+	++mNumBinds;
+}
+
+void RecordingRenderBackend::PSSetShaderResources(unsigned int startSlot, unsigned int numViews, RenderShaderResourceView* const* views)
+{
+	if (mForwardTo != nullptr)  mForwardTo->PSSetShaderResources(startSlot, numViews, views);
+	RecordBind(ERenderCommand::PSSetShaderResources, startSlot, numViews, views);
+}
+void RecordingRenderBackend::PSSetSamplers(unsigned int startSlot, unsigned int numSamplers, RenderSamplerState* const* samplers)
+{
+	if (mForwardTo != nullptr)  mForwardTo->PSSetSamplers(startSlot, numSamplers, samplers);
+	RecordBind(ERenderCommand::PSSetSamplers, startSlot, numSamplers, samplers);
+}
+
+void RecordingRenderBackend::OMSetBlendState(RenderBlendState* state, const float blendFactor[4], unsigned int sampleMask)
+{
+	if (mForwardTo != nullptr)  mForwardTo->OMSetBlendState(state, blendFactor, sampleMask);
+	RecordBind(ERenderCommand::OMSetBlendState, 0, 1, &state);
+}
+void RecordingRenderBackend::OMSetDepthStencilState(RenderDepthStencilState* state, unsigned int stencilRef)
+{
+	if (mForwardTo != nullptr)  mForwardTo->OMSetDepthStencilState(state, stencilRef);
+	Record(ERenderCommand::OMSetDepthStencilState, state, stencilRef);
+	++mNumBinds;
+}
+void RecordingRenderBackend::RSSetState(RenderRasterizerState* state)
+{
+	if (mForwardTo != nullptr)  mForwardTo->RSSetState(state);
+	RecordBind(ERenderCommand::RSSetState, 0, 1, &state);
+}
+void RecordingRenderBackend::RSSetViewports(unsigned int numViewports, const RenderViewport* viewports)
+{
+	if (mForwardTo != nullptr)  mForwardTo->RSSetViewports(numViewports, viewports);
+	Record(ERenderCommand::RSSetViewports, nullptr, 0, 0, numViewports);
+	++mNumBinds;
+}
+
+
+void RecordingRenderBackend::IASetInputLayout(RenderInputLayout* layout)
+{
+	if (mForwardTo != nullptr)  mForwardTo->IASetInputLayout(layout);
+	RecordBind(ERenderCommand::IASetInputLayout, 0, 1, &layout);
+}
+void RecordingRenderBackend::IASetPrimitiveTopology(ERenderTopology topology)
+{
+	if (mForwardTo != nullptr)  mForwardTo->IASetPrimitiveTopology(topology);
+	Record(ERenderCommand::IASetPrimitiveTopology, nullptr, static_cast<uint32_t>(topology));
+	++mNumBinds;
+}
+void RecordingRenderBackend::IASetVertexBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	if (mForwardTo != nullptr)  mForwardTo->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+	RecordBind(ERenderCommand::IASetVertexBuffers, startSlot, numBuffers, buffers);
+}
+void RecordingRenderBackend::IASetIndexBuffer(RenderBuffer* buffer, ERenderIndexFormat format, unsigned int offset)
+{
+	if (mForwardTo != nullptr)  mForwardTo->IASetIndexBuffer(buffer, format, offset);
+	RecordBind(ERenderCommand::IASetIndexBuffer, 0, 1, &buffer);
+}
+
+void RecordingRenderBackend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	if (mForwardTo != nullptr)  mForwardTo->Draw(vertexCount, startVertex);
+	Record(ERenderCommand::Draw, nullptr, vertexCount);
+	++mNumDraws;
+}
+void RecordingRenderBackend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	if (mForwardTo != nullptr)  mForwardTo->DrawIndexed(indexCount, startIndex, baseVertex);
+	Record(ERenderCommand::DrawIndexed, nullptr, indexCount);
+	++mNumDraws;
+}
+
+
+void RecordingRenderBackend::OMSetRenderTargets(unsigned int numViews, RenderTargetView* const* renderTargets, RenderDepthStencilView* depthStencil)
+{
+	if (mForwardTo != nullptr)  mForwardTo->OMSetRenderTargets(numViews, renderTargets, depthStencil);
+	// Shadow map passes set only a depth buffer, record that instead of an empty list of render targets
+	Record(ERenderCommand::OMSetRenderTargets, numViews > 0 ? static_cast<const void*>(renderTargets[0]) : depthStencil, 0, 0, numViews);
+	++mNumBinds;
+}
+void RecordingRenderBackend::ClearRenderTargetView(RenderTargetView* renderTarget, const float colour[4])
+{
+	if (mForwardTo != nullptr)  mForwardTo->ClearRenderTargetView(renderTarget, colour);
+	Record(ERenderCommand::ClearRenderTargetView, renderTarget);
+}
+void RecordingRenderBackend::ClearDepthStencilView(RenderDepthStencilView* depthStencil, unsigned int clearFlags, float depth, uint8_t stencil)
+{
+	if (mForwardTo != nullptr)  mForwardTo->ClearDepthStencilView(depthStencil, clearFlags, depth, stencil);
+	Record(ERenderCommand::ClearDepthStencilView, depthStencil, clearFlags);
+}
+
+void RecordingRenderBackend::Present(unsigned int syncInterval, unsigned int flags)
+{
+	if (mForwardTo != nullptr)  mForwardTo->Present(syncInterval, flags);
+	Record(ERenderCommand::Present, nullptr, syncInterval);
+}
+
+
+//-------------------------------------
+// Private support functions
+//-------------------------------------
+
+// Add a command to the list. Binds that set more than one object record the first of them
+void RecordingRenderBackend::Record(ERenderCommand type, const void* object, uint32_t value /*= 0*/, unsigned int slot /*= 0*/, unsigned int count /*= 1*/)
+{
+	RenderCommand command;
+	command.type   = type;
+	command.slot   = static_cast<uint8_t>(slot);
+	command.count  = static_cast<uint16_t>(count);
+	command.value  = value;
+	command.object = object;
+	mCommands.push_back(command);
+}
@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------------
+// Render backend that records and counts the calls made to it, for measuring the CPU cost of rendering
+//--------------------------------------------------------------------------------------
+// Each call is stored as a small fixed-size command (see RenderCommand), and draws, binds and bytes uploaded are counted.
+// Calls can also be passed on to another backend, so a real frame can be captured while it is rendered.
+//
+// With nothing to pass calls on to, no GPU is used: buffers are created in CPU memory and uploads are copied to a scratch
+// area, so the CPU work is similar to real rendering. Swap one in for gRenderBackend to time the rendering code alone.
+// It needs no graphics API, so it also builds and runs without Windows (see Tests.cpp)
+
+#ifndef _RECORDING_RENDER_BACKEND_H_INCLUDED_
+#define _RECORDING_RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderBackend.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+
+// The type of a recorded command, one for each backend function
+enum class ERenderCommand : uint8_t
+{
+	CreateBuffer = 1,
+	UpdateBuffer,
+	WriteBuffer,
+	UpdateBufferRegion,
+	VSSetShader,
+	GSSetShader,
+	PSSetShader,
+	VSSetConstantBuffers,
+	GSSetConstantBuffers,
+	PSSetConstantBuffers,
+	VSSetConstantBuffers1,
+	PSSetConstantBuffers1,
+	PSSetShaderResources,
+	PSSetSamplers,
+	OMSetBlendState,
+	OMSetDepthStencilState,
+	RSSetState,
+	RSSetViewports,
+	IASetInputLayout,
+	IASetPrimitiveTopology,
+	IASetVertexBuffers,
+	IASetIndexBuffer,
+	Draw,
+	DrawIndexed,
+	OMSetRenderTargets,
+	ClearRenderTargetView,
+	ClearDepthStencilView,
+	Present,
+};
+
+// A recorded call. Calls that bind several objects record the first slot, the number of objects and the first object
+struct RenderCommand
+{
+	ERenderCommand type;
+	uint8_t        slot;   // First slot bound
+	uint16_t       count;  // Number of objects bound
+	uint32_t       value;  // Bytes for buffers, first constant for constant buffer ranges, vertex/index count for draws,
+	                       // topology, stencil ref or sync interval
+	const void*    object; // Shader, state, buffer, view etc. - nullptr if none
+};
+
+
+class RecordingRenderBackend : public RenderBackend
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Pass the backend to pass calls on to, or nullptr to use no GPU
+	RecordingRenderBackend(RenderBackend* forwardTo = nullptr)  : mForwardTo(forwardTo) {}
+
+	// The commands recorded so far, and clearing them (e.g. at the start of each frame)
+	const std::vector<RenderCommand>& Commands()  { return mCommands; }
+	void ClearCommands()  { mCommands.clear(); }
+
+	// Return the commands recorded as text, one line per command. Objects are shown as numbers in the order they were
+	// first used rather than addresses, so logs from different runs can be compared
+	std::string CommandLog();
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Totals since the statistics were last reset
+	unsigned int NumDraws()          { return mNumDraws; }
+	unsigned int NumBinds()          { return mNumBinds; }          // Calls setting shaders, states, resources or targets
+	size_t       NumBytesUploaded()  { return mNumBytesUploaded; } // Buffer creation and update data
+	void ResetStatistics()  { mNumDraws = mNumBinds = 0; mNumBytesUploaded = 0; }
+
+
+	//-------------------------------------
+	// Backend functions
+	//-------------------------------------
+
+	bool CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) override;
+	void ReleaseBuffer(RenderBuffer* buffer) override;
+	void UpdateBuffer(RenderBuffer* buffer, const void* data, size_t size) override;
+	void WriteBuffer(RenderBuffer* buffer, size_t offset, const void* data, size_t size, bool discard) override;
+	void UpdateBufferRegion(RenderBuffer* buffer, size_t offset, const void* data, size_t size) override;
+	bool SupportsConstantBufferOffsets() override;
+
+	void VSSetShader(RenderVertexShader*   shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+	void GSSetShader(RenderGeometryShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+	void PSSetShader(RenderPixelShader*    shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) override;
+
+	void VSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+	void GSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+	void PSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) override;
+
+	void VSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                           const unsigned int* firstConstants, const unsigned int* numConstants) override;
+	void PSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                           const unsigned int* firstConstants, const unsigned int* numConstants) override;
+
+	void PSSetShaderResources(unsigned int startSlot, unsigned int numViews, RenderShaderResourceView* const* views) override;
+	void PSSetSamplers(unsigned int startSlot, unsigned int numSamplers, RenderSamplerState* const* samplers) override;
+
+	void OMSetBlendState(RenderBlendState* state, const float blendFactor[4], unsigned int sampleMask) override;
+	void OMSetDepthStencilState(RenderDepthStencilState* state, unsigned int stencilRef) override;
+	void RSSetState(RenderRasterizerState* state) override;
+	void RSSetViewports(unsigned int numViewports, const RenderViewport* viewports) override;
+
+	void IASetInputLayout(RenderInputLayout* layout) override;
+	void IASetPrimitiveTopology(ERenderTopology topology) override;
+	void IASetVertexBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers, const unsigned int* strides, const unsigned int* offsets) override;
+	void IASetIndexBuffer(RenderBuffer* buffer, ERenderIndexFormat format, unsigned int offset) override;
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+
+	void OMSetRenderTargets(unsigned int numViews, RenderTargetView* const* renderTargets, RenderDepthStencilView* depthStencil) override;
+	void ClearRenderTargetView(RenderTargetView* renderTarget, const float colour[4]) override;
+	void ClearDepthStencilView(RenderDepthStencilView* depthStencil, unsigned int clearFlags, float depth, uint8_t stencil) override;
+
+	void Present(unsigned int syncInterval, unsigned int flags) override;
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Add a command to the list. Binds that set more than one object record the first of them
+	void Record(ERenderCommand type, const void* object, uint32_t value = 0, unsigned int slot = 0, unsigned int count = 1);
+
+	// Record a bind of a list of objects to consecutive slots
+	template <class T>
+	void RecordBind(ERenderCommand type, unsigned int startSlot, unsigned int count, T* const* objects)
+	{
+		Record(type, count > 0 ? objects[0] : nullptr, 0, startSlot, count);
+		++mNumBinds;
+	}
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	RenderBackend* mForwardTo;
+
+	std::vector<RenderCommand> mCommands;
+
+	// Uploads are copied here when there is no GPU
+	std::vector<char> mUploadScratch;
+
+	unsigned int mNumDraws = 0;
+	unsigned int mNumBinds = 0;
+	size_t       mNumBytesUploaded = 0;
+};
+
+
+#endif //_RECORDING_RENDER_BACKEND_H_INCLUDED_
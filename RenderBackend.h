@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// Interface to the rendering calls made by the app, so they can go to Direct3D or elsewhere (e.g. be recorded)
+//--------------------------------------------------------------------------------------
+// Scene, model, mesh and light rendering make their calls through gRenderBackend rather than gD3DContext. Normally it is
+// a D3D11RenderBackend (see D3D11RenderBackend.h), which passes calls on to the device and context. A
+// RecordingRenderBackend (see RecordingRenderBackend.h) can be swapped in to record and count calls, optionally without
+// sending them to the GPU.
+//
+// The functions have the same names and parameters as the device / context functions, so classes written for a context
+// can use a backend instead (see StateCache). The parameters use the handle and description types in RenderTypes.h
+// rather than Direct3D ones, so this header needs no graphics API headers and a backend can be used without Windows
+// (e.g. the recorder in Tests.cpp). Only the calls the app uses are here, add more as needed. Creating shaders, states,
+// textures and render targets is not covered - they are created once at startup on gD3DDevice
+
+#ifndef _RENDER_BACKEND_H_INCLUDED_
+#define _RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderTypes.h"
+
+
+class RenderBackend
+{
+public:
+	virtual ~RenderBackend() {}
+
+
+	//-------------------------------------
+	// Resources
+	//-------------------------------------
+
+	// Create a buffer, with its content copied from initialData if it isn't nullptr. Returns false on failure
+	virtual bool CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) = 0;
+
+	// Release a buffer created by CreateBuffer. With Direct3D buffers are Direct3D objects, so calling their Release does
+	// the same - code that only runs on Windows still does that
+	virtual void ReleaseBuffer(RenderBuffer* buffer) = 0;
+
+	// Replace the content of a dynamic buffer (Map with discard, copy, Unmap). Only the first "size" bytes are written
+	virtual void UpdateBuffer(RenderBuffer* buffer, const void* data, size_t size) = 0;
+
+	// Write to part of a dynamic buffer. Without discard the rest of the buffer is kept (Map with no-overwrite), so the part
+	// written must not be in use by the GPU. With discard the rest of the buffer is lost
+	virtual void WriteBuffer(RenderBuffer* buffer, size_t offset, const void* data, size_t size, bool discard) = 0;
+
+	// Copy data into part of a default usage buffer (UpdateSubresource). The copy is queued, so the GPU can still be using
+	// the old content while this is called
+	virtual void UpdateBufferRegion(RenderBuffer* buffer, size_t offset, const void* data, size_t size) = 0;
+
+	// True if constant buffers can be bound from an offset with *SetConstantBuffers1 and written with WriteBuffer without
+	// discard (needs Direct3D 11.1)
+	virtual bool SupportsConstantBufferOffsets() = 0;
+
+
+	//-------------------------------------
+	// Pipeline state
+	//-------------------------------------
+
+	virtual void VSSetShader(RenderVertexShader*   shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) = 0;
+	virtual void GSSetShader(RenderGeometryShader* shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) = 0;
+	virtual void PSSetShader(RenderPixelShader*    shader, RenderClassInstance* const* classInstances, unsigned int numClassInstances) = 0;
+
+	virtual void VSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) = 0;
+	virtual void GSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) = 0;
+	virtual void PSSetConstantBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers) = 0;
+
+	// Bind ranges of constant buffers. Offsets and sizes are in constants (16 bytes), offsets must be multiples of 16 constants
+	virtual void VSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                                   const unsigned int* firstConstants, const unsigned int* numConstants) = 0;
+	virtual void PSSetConstantBuffers1(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers,
+	                                   const unsigned int* firstConstants, const unsigned int* numConstants) = 0;
+
+	virtual void PSSetShaderResources(unsigned int startSlot, unsigned int numViews, RenderShaderResourceView* const* views) = 0;
+	virtual void PSSetSamplers(unsigned int startSlot, unsigned int numSamplers, RenderSamplerState* const* samplers) = 0;
+
+	virtual void OMSetBlendState(RenderBlendState* state, const float blendFactor[4], unsigned int sampleMask) = 0;
+	virtual void OMSetDepthStencilState(RenderDepthStencilState* state, unsigned int stencilRef) = 0;
+	virtual void RSSetState(RenderRasterizerState* state) = 0;
+	virtual void RSSetViewports(unsigned int numViewports, const RenderViewport* viewports) = 0;
+
+
+	//-------------------------------------
+	// Geometry and drawing
+	//-------------------------------------
+
+	virtual void IASetInputLayout(RenderInputLayout* layout) = 0;
+	virtual void IASetPrimitiveTopology(ERenderTopology topology) = 0;
+	virtual void IASetVertexBuffers(unsigned int startSlot, unsigned int numBuffers, RenderBuffer* const* buffers, const unsigned int* strides, const unsigned int* offsets) = 0;
+	virtual void IASetIndexBuffer(RenderBuffer* buffer, ERenderIndexFormat format, unsigned int offset) = 0;
+
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+
+
+	//-------------------------------------
+	// Render targets
+	//-------------------------------------
+
+	virtual void OMSetRenderTargets(unsigned int numViews, RenderTargetView* const* renderTargets, RenderDepthStencilView* depthStencil) = 0;
+	virtual void ClearRenderTargetView(RenderTargetView* renderTarget, const float colour[4]) = 0;
+	// Clear flags are RENDER_CLEAR_DEPTH and/or RENDER_CLEAR_STENCIL
+	virtual void ClearDepthStencilView(RenderDepthStencilView* depthStencil, unsigned int clearFlags, float depth, uint8_t stencil) = 0;
+
+	// Show the back buffer, syncInterval 1 locks to vsync
+	virtual void Present(unsigned int syncInterval, unsigned int flags) = 0;
+};
+
+
+// The backend used for rendering, set up in Direct3DSetup.cpp. Can be swapped for another backend between frames, call
+// gStateCache.SetContext with the new backend at the same time
+extern RenderBackend* gRenderBackend;
+
+
+#endif //_RENDER_BACKEND_H_INCLUDED_
@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// Class that collects the draws for a frame and submits them in an order that minimises state changes
+//--------------------------------------------------------------------------------------
+
+#include "RenderQueue.h"
+#include "CModel.h"
+
+#include <cstring>
+
+
+// Sizes of the fields in the sort keys (see RenderQueue.h)
+static const unsigned int PASS_BITS     = 2;
+static const unsigned int SHADER_BITS   = 8;
+static const unsigned int MATERIAL_BITS = 16;
+static const unsigned int DEPTH_BITS    = 24;
+static const unsigned int MATERIAL_PART_BITS = 12; // Texture and each state within a material
+
+
+//-------------------------------------
+// Construction and Usage
+//-------------------------------------
+
+// Call at the start of each frame, before adding the frame's draws
+void RenderQueue::Clear()
+{
+	mDraws.clear();
+	mKeys.clear();
+	mOrder.clear();
+}
+
+
+// Add a draw of the given model, depth sorted using its distance from the given camera position. Set the model's shaders
+// and states beforehand. Draws for earlier passes are submitted first (pass 0 to 3). The current object colour in the
+// per-model constants is recorded with the draw and restored when it is submitted
+void RenderQueue::Add(CModel* model, const CVector3& cameraPosition, unsigned int pass /*= 0*/)
+{
+	uint64_t vertexShader = Id(model->GetVSShader(), mVertexShaderIds, (1 << SHADER_BITS) - 1);
+	uint64_t pixelShader  = Id(model->GetPSShader(), mPixelShaderIds,  (1 << SHADER_BITS) - 1);
+
+	// Identify the material from its texture and states
+	const unsigned int maxPartId = (1 << MATERIAL_PART_BITS) - 1;
+	uint64_t materialParts = Id(model->GetDiffuseMapSRV(), mMaterialPartIds, maxPartId);
+	materialParts = (materialParts << MATERIAL_PART_BITS) | Id(model->GetBlendState(),        mMaterialPartIds, maxPartId);
+	materialParts = (materialParts << MATERIAL_PART_BITS) | Id(model->GetDepthStencilState(), mMaterialPartIds, maxPartId);
+	materialParts = (materialParts << MATERIAL_PART_BITS) | Id(model->GetRasterizerState(),   mMaterialPartIds, maxPartId);
+	materialParts = (materialParts << MATERIAL_PART_BITS) | Id(model->GetSamplerState(),      mMaterialPartIds, maxPartId);
+	uint64_t material;
+	for (material = 0; material < mMaterialIds.size(); ++material)
+	{
+		if (mMaterialIds[material] == materialParts)  break;
+	}
+	if (material == mMaterialIds.size())
+	{
+		if (material < (1 << MATERIAL_BITS) - 1)  mMaterialIds.push_back(materialParts);
+		else                                      material = (1 << MATERIAL_BITS) - 1;
+	}
+
+	// The bits of a positive float increase as its value does, so the top bits of the distance give a depth that sorts
+	// correctly with no need to know the range of distances in the scene
+	float distance = Length(model->GetPosition() - cameraPosition);
+	uint32_t distanceBits;
+	std::memcpy(&distanceBits, &distance, sizeof(distanceBits));
+	uint64_t depth = distanceBits >> (32 - DEPTH_BITS);
+
+	uint64_t key = static_cast<uint64_t>(pass & ((1 << PASS_BITS) - 1)) << (64 - PASS_BITS);
+	if (model->IsTransparent())
+	{
+		depth = ((1 << DEPTH_BITS) - 1) - depth; // Back-to-front
+		key |= 1ull << (63 - PASS_BITS);
+		key |= depth        << (2 * SHADER_BITS + MATERIAL_BITS);
+		key |= vertexShader << (SHADER_BITS + MATERIAL_BITS);
+		key |= pixelShader  << MATERIAL_BITS;
+		key |= material;
+	}
+	else
+	{
+		key |= vertexShader << (SHADER_BITS + MATERIAL_BITS + DEPTH_BITS);
+		key |= pixelShader  << (MATERIAL_BITS + DEPTH_BITS);
+		key |= material     << DEPTH_BITS;
+		key |= depth;
+	}
+
+	mKeys.push_back(key);
+	mOrder.push_back(static_cast<uint32_t>(mDraws.size()));
+	mDraws.push_back({ model, gPerModelConstants.objectColour });
+}
+
+
+// Sort the draws and render them. The first draw sets all its states, as other code may have changed them
+void RenderQueue::Submit()
+{
+	RadixSort();
+
+	CModel* previousModel = nullptr;
+	for (auto drawIndex : mOrder)
+	{
+		const Draw& draw = mDraws[drawIndex];
+		gPerModelConstants.objectColour = draw.objectColour;
+
+		unsigned int numSaved = draw.model->Render(previousModel);
+		mNumStateChangesSaved += numSaved;
+		mNumStateChanges      += CModel::NUM_RENDER_STATES - numSaved;
+		++mNumDraws;
+		previousModel = draw.model;
+	}
+}
+
+
+//-------------------------------------
+// Private support functions
+//-------------------------------------
+
+// Return a small number identifying the given pointer, the same number each time it is passed. Values past the given
+// maximum share the maximum (they still render correctly, they are just not sorted apart)
+unsigned int RenderQueue::Id(const void* pointer, std::vector<const void*>& ids, unsigned int maxId)
+{
+	unsigned int id;
+	for (id = 0; id < ids.size(); ++id)
+	{
+		if (ids[id] == pointer)  return id;
+	}
+	if (id >= maxId)  return maxId;
+	ids.push_back(pointer);
+	return id;
+}
+
+
+// Sort mKeys and mOrder together by key using a least significant digit first radix sort, 8 bits at a time
+// Each pass is stable so the order from earlier (less significant) digits is kept for equal digits. Passes where every key
+// has the same digit are skipped - common as many key fields only use their lowest few bits
+void RenderQueue::RadixSort()
+{
+	size_t numKeys = mKeys.size();
+	mSortKeys.resize(numKeys);
+	mSortOrder.resize(numKeys);
+
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		// Count the keys with each value of this digit
+		unsigned int counts[256] = {};
+		for (auto key : mKeys)
+		{
+			++counts[(key >> shift) & 0xff];
+		}
+		if (numKeys == 0 || counts[(mKeys[0] >> shift) & 0xff] == numKeys)  continue;
+
+		// Turn the counts into the position of the first key with each digit value, then place each key in order
+		unsigned int position = 0;
+		for (auto& count : counts)
+		{
+			unsigned int digitCount = count;
+			count = position;
+			position += digitCount;
+		}
+		for (size_t i = 0; i < numKeys; ++i)
+		{
+			unsigned int destination = counts[(mKeys[i] >> shift) & 0xff]++;
+			mSortKeys[destination]  = mKeys[i];
+			mSortOrder[destination] = mOrder[i];
+		}
+		mKeys.swap(mSortKeys);
+		mOrder.swap(mSortOrder);
+	}
+}
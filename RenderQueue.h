@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// Class that collects the draws for a frame and submits them in an order that minimises state changes
+//--------------------------------------------------------------------------------------
+// Each draw is recorded as a 64-bit sort key and the model to draw. The key holds, from the most significant bits down:
+//   pass (2 bits) | transparent (1 bit) | for opaque draws:      vertex shader (8) | pixel shader (8) | material (16) | depth (24)
+//                                       | for transparent draws: inverted depth (24) | vertex shader (8) | pixel shader (8) | material (16)
+// So each pass is drawn in turn, opaque draws before transparent ones. Opaque draws are grouped by shaders then material
+// (texture and states) and drawn front-to-back within a group, which helps early depth rejection. Transparent draws must
+// be drawn back-to-front to blend correctly so depth comes first for them. The keys are sorted with a radix sort.
+// When submitting, each model only sets the states that differ from the previous model drawn (see CModel::Render)
+
+#include "Common.h"
+#include "CVector3.h"
+
+#include <vector>
+#include <cstdint>
+
+#ifndef _RENDER_QUEUE_H_INCLUDED_
+#define _RENDER_QUEUE_H_INCLUDED_
+
+class CModel;
+
+
+class RenderQueue
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Call at the start of each frame, before adding the frame's draws
+	void Clear();
+
+	// Add a draw of the given model, depth sorted using its distance from the given camera position. Set the model's shaders
+	// and states beforehand. Draws for earlier passes are submitted first (pass 0 to 3). The current object colour in the
+	// per-model constants is recorded with the draw and restored when it is submitted
+	void Add(CModel* model, const CVector3& cameraPosition, unsigned int pass = 0);
+
+	// Sort the draws and render them. The first draw sets all its states, as other code may have changed them
+	void Submit();
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Totals since the statistics were last reset
+	unsigned int NumDraws()              { return mNumDraws; }
+	unsigned int NumStateChanges()       { return mNumStateChanges; }       // State changes made
+	unsigned int NumStateChangesSaved()  { return mNumStateChangesSaved; }  // Redundant state changes skipped
+	void ResetStatistics()  { mNumDraws = mNumStateChanges = mNumStateChangesSaved = 0; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Return a small number identifying the given pointer, the same number each time it is passed. Values past the given
+	// maximum share the maximum (they still render correctly, they are just not sorted apart)
+	static unsigned int Id(const void* pointer, std::vector<const void*>& ids, unsigned int maxId);
+
+	// Sort mKeys and mOrder together by key using a least significant digit first radix sort, 8 bits at a time
+	void RadixSort();
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	struct Draw
+	{
+		CModel*  model;
+		CVector3 objectColour;
+	};
+	std::vector<Draw> mDraws;
+
+	// Sort key of each draw, and the position of each key's draw in mDraws. Sorted together
+	std::vector<uint64_t> mKeys;
+	std::vector<uint32_t> mOrder;
+
+	// Buffers used while sorting (kept to avoid allocations each frame)
+	std::vector<uint64_t> mSortKeys;
+	std::vector<uint32_t> mSortOrder;
+
+	// Pointers seen so far for shaders and materials, the position in each list is the value used in the sort keys. A material
+	// is a combination of texture and states, the states are given the ids in the first list then combined
+	std::vector<const void*> mVertexShaderIds;
+	std::vector<const void*> mPixelShaderIds;
+	std::vector<const void*> mMaterialPartIds;
+	std::vector<uint64_t>    mMaterialIds;
+
+	unsigned int mNumDraws = 0;
+	unsigned int mNumStateChanges = 0;
+	unsigned int mNumStateChangesSaved = 0;
+};
+
+
+#endif //_RENDER_QUEUE_H_INCLUDED_
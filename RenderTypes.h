@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// Handle and description types used by the render backends, without any graphics API headers
+//--------------------------------------------------------------------------------------
+// The handles are pointers to objects that are never defined here, so code using a backend can pass them around without
+// knowing what they are. With Direct3D they are the Direct3D objects themselves (the forward declarations below are of
+// the Direct3D interfaces), so the app's objects are passed to a backend unchanged. Elsewhere they are only ever used
+// through pointers (e.g. the buffers created by a RecordingRenderBackend with no GPU).
+//
+// Descriptions and values (buffers, viewports, topology, index format) are the app's own types, which D3D11RenderBackend
+// converts to Direct3D ones. Only what the app uses is here, add more as needed
+
+#ifndef _RENDER_TYPES_H_INCLUDED_
+#define _RENDER_TYPES_H_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+
+
+//-------------------------------------
+// Handles
+//-------------------------------------
+
+struct ID3D11Buffer;
+struct ID3D11VertexShader;
+struct ID3D11GeometryShader;
+struct ID3D11PixelShader;
+struct ID3D11ClassInstance;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11BlendState;
+struct ID3D11DepthStencilState;
+struct ID3D11RasterizerState;
+struct ID3D11InputLayout;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+
+typedef ID3D11Buffer             RenderBuffer;
+typedef ID3D11VertexShader       RenderVertexShader;
+typedef ID3D11GeometryShader     RenderGeometryShader;
+typedef ID3D11PixelShader        RenderPixelShader;
+typedef ID3D11ClassInstance      RenderClassInstance;
+typedef ID3D11ShaderResourceView RenderShaderResourceView;
+typedef ID3D11SamplerState       RenderSamplerState;
+typedef ID3D11BlendState         RenderBlendState;
+typedef ID3D11DepthStencilState  RenderDepthStencilState;
+typedef ID3D11RasterizerState    RenderRasterizerState;
+typedef ID3D11InputLayout        RenderInputLayout;
+typedef ID3D11RenderTargetView   RenderTargetView;
+typedef ID3D11DepthStencilView   RenderDepthStencilView;
+
+
+//-------------------------------------
+// Descriptions and values
+//-------------------------------------
+
+// What a buffer is bound as. Structured buffers are read by shaders through a shader resource view
+enum class ERenderBufferType
+{
+	Vertex,
+	Index,
+	Constant,
+	Structured,
+};
+
+// How a buffer is written: default buffers with UpdateBufferRegion (or never if given initial data), dynamic buffers by
+// the CPU with UpdateBuffer or WriteBuffer
+enum class ERenderBufferUsage
+{
+	Default,
+	Dynamic,
+};
+
+struct RenderBufferDesc
+{
+	ERenderBufferType  type;
+	ERenderBufferUsage usage;
+	unsigned int       size;            // Bytes
+	unsigned int       elementSize = 0; // Bytes in each element of a structured buffer, otherwise unused
+};
+
+struct RenderViewport
+{
+	float x = 0, y = 0;
+	float width = 0, height = 0;
+	float minDepth = 0, maxDepth = 1;
+};
+
+enum class ERenderTopology
+{
+	PointList,
+	LineList,
+	TriangleList,
+	TriangleStrip,
+};
+
+enum class ERenderIndexFormat
+{
+	UInt16,
+	UInt32,
+};
+
+// Flags for ClearDepthStencilView
+static const unsigned int RENDER_CLEAR_DEPTH   = 1;
+static const unsigned int RENDER_CLEAR_STENCIL = 2;
+
+// Largest range of a constant buffer that can be bound to a shader, in bytes
+static const size_t RENDER_MAX_CONSTANT_BUFFER_RANGE = 4096 * 16;
+
+
+#endif //_RENDER_TYPES_H_INCLUDED_
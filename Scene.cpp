@@ -21,12 +21,25 @@
 #include "ColourRGBA.h" 
 
 #include "Light.h"
+#include "LightManager.h"
 #include "CModel.h"
 #include "CTexture.h"
 #include "Timer.h"
+#include "AnimationScheduler.h"
+#include "RenderQueue.h"
+#include "RecordingRenderBackend.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "LightClusters.h"
+#include "LightSelector.h"
+#include "SceneBVH.h"
+#include "OcclusionCuller.h"
+#include "ShadowAtlas.h"
+#include "ShadowCascades.h"
 
 #include <sstream>
 #include <memory>
+#include <algorithm>
 
 
 //--------------------------------------------------------------------------------------
@@ -63,6 +76,34 @@ const int NUM_CUBES = 5;
 CModel* gCharacters[NUM_CHARACTERS]; // An arry of characters
 CModel* gCubes[NUM_CUBES]; // An array of cubes (demostrating different effects and graphic techniques)
 
+// Distant characters are animated less often (see AnimationScheduler.h). Characters are added in the same order as the array
+AnimationScheduler gAnimationScheduler;
+
+// Characters use a simpler skeleton for each multiple of this distance from the camera (see Mesh.h)
+float gSkeletonLODDistance = 150.0f;
+
+// Character nodes posed / animated by the scene. Looked up by name in InitScene, node numbers change if the mesh is re-exported
+unsigned int gTorsoUpperNode, gHeadNode;
+unsigned int gRightUpperArmNode, gRightLowerArmNode, gRightHandNode, gLeftUpperArmNode, gLeftLowerArmNode;
+unsigned int gRightUpperLegNode, gRightLowerLegNode, gLeftUpperLegNode, gLeftLowerLegNode;
+
+// Draws of the models using my class are collected here each frame and submitted in sorted order
+RenderQueue gRenderQueue;
+
+// Bounding volume hierarchy over the models using my class, so only those in view are queued (see SceneBVH.h)
+SceneBVH gSceneBVH;
+std::vector<CModel*> gBVHModels; // The model for each id in the BVH
+
+// Box around a model's bounding sphere, which is what the BVH holds for it (see Model::BoundingSphere)
+CAABB BVHBounds(CModel* model)
+{
+    CVector3 centre;
+    float radius;
+    model->GetModel()->BoundingSphere(centre, radius);
+    CVector3 extents = { radius, radius, radius };
+    return { centre - extents, centre + extents };
+}
+
 // Individual models
 CModel* gCrate;
 CModel* gGround;
@@ -91,6 +132,27 @@ Model* gMySkyBox;
 // Store lights in an array in this exercise
 const int NUM_LIGHTS = 5;
 Light* gLight[NUM_LIGHTS];
+LightManager gLightManager; // Light properties for the shaders, the lights above add themselves to this
+LightClusters* gLightClusters = nullptr; // Lists of the lights reaching each part of the camera's view, rebuilt each frame
+
+// When enabled each model is lit by only the few lights that affect it most instead of using the clusters above. F5 toggles
+LightSelector gLightSelector;
+bool gPerObjectLights = false;
+
+// The camera's view and the lights' shadow views are culled together in one pass down the BVH each frame. Each model gets
+// a mask of the views it is in: bit 0 for the camera, then a bit for each shadow view. A shadow view only holds the models
+// that are in the light's frustum and can cast a shadow the camera sees
+const uint32_t CAMERA_VIEW = 1;
+CConvexVolume gViewVolumes[SceneBVH::MAX_VOLUMES];
+std::vector<uint32_t> gViewMasks;       // By model id in the BVH
+uint32_t gShadowViews[NUM_LIGHTS] = {}; // The view bits for each light's shadow maps, a directional light's are its cascades
+                                        // Lights without shadow maps (point lights) have none
+
+// Models in the camera's view hidden behind the terrain, the container or the floor are then removed from it. Those three
+// are rasterised into a small depth buffer on the CPU each frame and the other models' boxes tested against it
+OcclusionCuller* gOcclusionCuller = nullptr;
+std::vector<unsigned int> gOccluderIds; // BVH ids of the occluding models
+unsigned int gNumOccludedModels = 0;    // Removed from the camera's view in the last frame
 
 // Additional light information
 CVector3 gAmbientColour = { 0.2f, 0.2f, 0.3f }; // Background level of light (slightly bluish to match the far background, which is dark blue)
@@ -113,12 +175,27 @@ Timer gBurnTimer;
 int timerTracker = 0;
 bool canChangePostProcess = false;
 
-// Shadow Texture
-int gShadowMapSize = 2048;  // Quality of shadow map
-
-ID3D11Texture2D*          gShadowMap1Texture      = nullptr;
-ID3D11DepthStencilView*   gShadowMap1DepthStencil = nullptr;
-ID3D11ShaderResourceView* gShadowMap1SRV          = nullptr;
+// Shadow Textures
+// Each spotlight's shadow map and each shadow cascade is a tile of one atlas texture, sized by how much of the screen it
+// covers. The depth of casters that don't move is kept in a cache texture of the same size, so each frame only tiles with
+// moving casters are redrawn, and only the moving casters in them (see ShadowAtlas.h)
+const unsigned int SHADOW_ATLAS_SIZE = 4096; // Quality of shadow maps, the largest tile is half this
+ShadowAtlas gShadowAtlas(SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE / 2, SHADOW_ATLAS_SIZE / 32);
+
+// The first directional light's shadows are cascades fitted to the camera's view each frame, each with its own atlas tile
+// (see ShadowCascades.h). They are snapped to 1/(smallest tile size) of their width, which is whole texels in any tile
+const float SHADOW_DISTANCE = 400.0f; // How far from the camera directional light shadows reach
+const uint32_t CASCADE_VIEW_KEY = 256; // Atlas view key of the first cascade, spotlights use their light index
+ShadowCascades gShadowCascades(ShadowCascades::MAX_CASCADES, 0.75f, SHADOW_ATLAS_SIZE / 32);
+int gCascadeLight = -1; // Index in gLight of the directional light using the cascades, -1 if none
+uint32_t gCascadeViews[ShadowCascades::MAX_CASCADES] = {}; // The view bit of each cascade, 0 if it couldn't be culled
+
+ID3D11Texture2D*          gShadowAtlasTexture      = nullptr;
+ID3D11DepthStencilView*   gShadowAtlasDepthStencil = nullptr;
+ID3D11ShaderResourceView* gShadowAtlasSRV          = nullptr;
+ID3D11Texture2D*          gShadowCacheTexture      = nullptr;
+ID3D11DepthStencilView*   gShadowCacheDepthStencil = nullptr;
+ID3D11ShaderResourceView* gShadowCacheSRV          = nullptr;
 
 //--------------------------------------------------------------------------------------
 // Constant Buffers
@@ -134,6 +211,16 @@ ID3D11Buffer*     gPerFrameConstantBuffer; // The GPU buffer that will recieve t
 PerModelConstants gPerModelConstants;      // As above, but constant that change per-model (e.g. world matrix)
 ID3D11Buffer*     gPerModelConstantBuffer; // --"--
 
+PerSkeletonConstants gPerSkeletonConstants;      // Bone palette for skinned meshes
+ID3D11Buffer*        gPerSkeletonConstantBuffer;
+
+PerMaterialConstants   gPerMaterialConstants;    // Surface settings, only sent when they change
+ID3D11Buffer*          gPerMaterialConstantBuffer;
+MaterialConstantsCache gMaterialConstantsCache;  // The surface settings last sent
+
+// Per-draw model and skeleton constants are written to this ring rather than the buffers above when Direct3D 11.1 is available
+ConstantBufferRing gConstantBufferRing(1024 * 1024);
+
 // Post processing constants
 PostProcessingConstants gPostProcessingConstants;
 ID3D11Buffer* gPostProcessingConstantBuffer;
@@ -180,7 +267,7 @@ bool InitGeometry()
     // Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
     try 
     {
-        gMySkyBoxMesh = new Mesh("MySkyBox.fbx");
+        gMySkyBoxMesh = new Mesh("MySkyBox.fbx", false, MAX_BONES, ENodeImport::PreTransformed); // Static, so baked to a single node
         gSphereMesh = new Mesh("Sphere.x");
         gCubeMesh = new Mesh("cube.x", true);
         gTeapotMesh = new Mesh("teapot.x", true);
@@ -226,13 +313,24 @@ bool InitGeometry()
     // See the comments above where these variable are declared and also the UpdateScene function
     gPerFrameConstantBuffer = CreateConstantBuffer(sizeof(gPerFrameConstants));
     gPerModelConstantBuffer = CreateConstantBuffer(sizeof(gPerModelConstants));
+    gPerSkeletonConstantBuffer = CreateConstantBuffer(sizeof(gPerSkeletonConstants));
+    gPerMaterialConstantBuffer = CreateConstantBuffer(sizeof(gPerMaterialConstants));
     gPostProcessingConstantBuffer = CreateConstantBuffer(sizeof(gPostProcessingConstants));
-    if (gPerFrameConstantBuffer       == nullptr || gPerModelConstantBuffer == nullptr ||
+    if (gPerFrameConstantBuffer       == nullptr || gPerModelConstantBuffer    == nullptr ||
+        gPerSkeletonConstantBuffer    == nullptr || gPerMaterialConstantBuffer == nullptr ||
         gPostProcessingConstantBuffer == nullptr)
     {
         gLastError = "Error creating constant buffers";
         return false;
     }
+    if (!gConstantBufferRing.Init())
+    {
+        gLastError = "Error creating constant buffer ring";
+        return false;
+    }
+
+    gLightClusters = new LightClusters;
+    gOcclusionCuller = new OcclusionCuller;
 
     // Create Scene Texture
     D3D11_TEXTURE2D_DESC sceneTextureDesc = {};
@@ -270,51 +368,57 @@ bool InitGeometry()
         return false;
     }
 
-    //**** Create Shadow Map texture ****//
-
-    // We also need a depth buffer to go with our portal
-    D3D11_TEXTURE2D_DESC textureDesc = {};
-    textureDesc.Width = gShadowMapSize; // Size of the shadow map determines quality / resolution of shadows
-    textureDesc.Height = gShadowMapSize;
-    textureDesc.MipLevels = 1; // 1 level, means just the main texture, no additional mip-maps. Usually don't use mip-maps when rendering to textures (or we would have to render every level)
-    textureDesc.ArraySize = 1;
-    textureDesc.Format = DXGI_FORMAT_R32_TYPELESS; // The shadow map contains a single 32-bit value [tech gotcha: have to say typeless because depth buffer and shaders see things slightly differently]
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.SampleDesc.Quality = 0;
-    textureDesc.Usage = D3D11_USAGE_DEFAULT;
-    textureDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as a depth buffer and also pass it to shaders
-    textureDesc.CPUAccessFlags = 0;
-    textureDesc.MiscFlags = 0;
-    if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, NULL, &gShadowMap1Texture)))
-    {
-        gLastError = "Error creating shadow map texture";
-        return false;
-    }
+    //**** Create Shadow Map textures ****//
+    // The shadow atlas and the cache of static caster depths (see above) are made the same way
 
-    // Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
-    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-    dsvDesc.Format = DXGI_FORMAT_D32_FLOAT; // See "tech gotcha" above. The depth buffer sees each pixel as a "depth" float
-    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-    dsvDesc.Texture2D.MipSlice = 0;
-    dsvDesc.Flags = 0;
-    if (FAILED(gD3DDevice->CreateDepthStencilView(gShadowMap1Texture, &dsvDesc, &gShadowMap1DepthStencil)))
+    ID3D11Texture2D**          shadowTextures[]      = { &gShadowAtlasTexture,      &gShadowCacheTexture };
+    ID3D11DepthStencilView**   shadowDepthStencils[] = { &gShadowAtlasDepthStencil, &gShadowCacheDepthStencil };
+    ID3D11ShaderResourceView** shadowSRVs[]          = { &gShadowAtlasSRV,          &gShadowCacheSRV };
+    for (int i = 0; i < 2; ++i)
     {
-        gLastError = "Error creating shadow map depth stencil view";
-        return false;
-    }
+        D3D11_TEXTURE2D_DESC textureDesc = {};
+        textureDesc.Width = SHADOW_ATLAS_SIZE; // Size of the shadow map determines quality / resolution of shadows
+        textureDesc.Height = SHADOW_ATLAS_SIZE;
+        textureDesc.MipLevels = 1; // 1 level, means just the main texture, no additional mip-maps. Usually don't use mip-maps when rendering to textures (or we would have to render every level)
+        textureDesc.ArraySize = 1;
+        textureDesc.Format = DXGI_FORMAT_R32_TYPELESS; // The shadow map contains a single 32-bit value [tech gotcha: have to say typeless because depth buffer and shaders see things slightly differently]
+        textureDesc.SampleDesc.Count = 1;
+        textureDesc.SampleDesc.Quality = 0;
+        textureDesc.Usage = D3D11_USAGE_DEFAULT;
+        textureDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as a depth buffer and also pass it to shaders
+        textureDesc.CPUAccessFlags = 0;
+        textureDesc.MiscFlags = 0;
+        if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, NULL, shadowTextures[i])))
+        {
+            gLastError = "Error creating shadow map texture";
+            return false;
+        }
+
+        // Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+        dsvDesc.Format = DXGI_FORMAT_D32_FLOAT; // See "tech gotcha" above. The depth buffer sees each pixel as a "depth" float
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+        dsvDesc.Texture2D.MipSlice = 0;
+        dsvDesc.Flags = 0;
+        if (FAILED(gD3DDevice->CreateDepthStencilView(*shadowTextures[i], &dsvDesc, shadowDepthStencils[i])))
+        {
+            gLastError = "Error creating shadow map depth stencil view";
+            return false;
+        }
 
 
-    // We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view"
-    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.Format = DXGI_FORMAT_R32_FLOAT; // See "tech gotcha" above. The shaders see textures as colours, so shadow map pixels are not seen as depths
-                                           // but rather as "red" floats (one float taken from RGB). Although the shader code will use the value as a depth
-    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MostDetailedMip = 0;
-    srvDesc.Texture2D.MipLevels = 1;
-    if (FAILED(gD3DDevice->CreateShaderResourceView(gShadowMap1Texture, &srvDesc, &gShadowMap1SRV)))
-    {
-        gLastError = "Error creating shadow map shader resource view";
-        return false;
+        // We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view"
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT; // See "tech gotcha" above. The shaders see textures as colours, so shadow map pixels are not seen as depths
+                                               // but rather as "red" floats (one float taken from RGB). Although the shader code will use the value as a depth
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+        srvDesc.Texture2D.MipLevels = 1;
+        if (FAILED(gD3DDevice->CreateShaderResourceView(*shadowTextures[i], &srvDesc, shadowSRVs[i])))
+        {
+            gLastError = "Error creating shadow map shader resource view";
+            return false;
+        }
     }
 
     //*****************************//
@@ -342,27 +446,54 @@ bool InitScene()
         gCharacters[i]->SetScale(0.06f);
         gCharacters[i]->SetName("Character" + i);
     }
+
+    // Find the character nodes used by the scene. The table is constexpr so the names are hashed at compile time (see NameHash.h)
+    static constexpr struct { uint32_t nameHash; unsigned int* node; } characterNodes[] =
+    {
+        { HashName("TorsoUpper"),    &gTorsoUpperNode    }, { HashName("Head"),          &gHeadNode          },
+        { HashName("RightUpperArm"), &gRightUpperArmNode }, { HashName("RightLowerArm"), &gRightLowerArmNode },
+        { HashName("RightHand"),     &gRightHandNode     }, { HashName("LeftUpperArm"),  &gLeftUpperArmNode  },
+        { HashName("LeftLowerArm"),  &gLeftLowerArmNode  }, { HashName("RightUpperLeg"), &gRightUpperLegNode },
+        { HashName("RightLowerLeg"), &gRightLowerLegNode }, { HashName("LeftUpperLeg"),  &gLeftUpperLegNode  },
+        { HashName("LeftLowerLeg"),  &gLeftLowerLegNode  },
+    };
+    for (auto& characterNode : characterNodes)
+    {
+        *characterNode.node = gCharacters[0]->GetMesh()->FindNode(characterNode.nameHash);
+        if (*characterNode.node == NODE_NOT_FOUND)
+        {
+            gLastError = "Character mesh is missing a node used by the scene";
+            return false;
+        }
+    }
+
     gCharacters[0]->SetPosition({ 45, 16, 45 });
     gCharacters[0]->SetRotation({ ToRadians(0.0f), ToRadians(220.0f), ToRadians(90.0f) });
-    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(-90), ToRadians(90) }, 6); // Right Lower Arm
-    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(0), ToRadians(30) }, 5); // Right Upper Arm
-    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(5), ToRadians(0) }, 40); // Right Upper Leg
-    gCharacters[0]->SetRotation({ ToRadians(107374176.), ToRadians(-185), ToRadians(0) }, 36); // Right Lower Leg
-    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(30), ToRadians(0) }, 3);  // Upper Torso
-    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(-50), ToRadians(70) }, 7); // Right Hand
-    gCharacters[0]->SetRotation({ ToRadians(-90), ToRadians(0), ToRadians(0) }, 19); // Left Upper Arm
+    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(-90), ToRadians(90) }, gRightLowerArmNode);
+    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(0), ToRadians(30) }, gRightUpperArmNode);
+    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(5), ToRadians(0) }, gRightUpperLegNode);
+    gCharacters[0]->SetRotation({ ToRadians(107374176.), ToRadians(-185), ToRadians(0) }, gLeftUpperLegNode);
+    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(30), ToRadians(0) }, gTorsoUpperNode);
+    gCharacters[0]->SetRotation({ ToRadians(0), ToRadians(-50), ToRadians(70) }, gRightHandNode);
+    gCharacters[0]->SetRotation({ ToRadians(-90), ToRadians(0), ToRadians(0) }, gLeftUpperArmNode);
+
+    // Schedule character animation once their starting poses are set
+    for (int i = 0; i < NUM_CHARACTERS; ++i)
+    {
+        gAnimationScheduler.Add(gCharacters[i]->GetModel());
+    }
 
     // Create model using my class
     gGround = new CModel("GrassDiffuseSpecular.dds");
-    gGround->SetMesh("Hills.x");
+    gGround->SetMesh("Hills.x", false, ENodeImport::PreTransformed);
     gCrate = new CModel("CargoA.dds");
-    gCrate->SetMesh("CargoContainer.x");
+    gCrate->SetMesh("CargoContainer.x", false, ENodeImport::PreTransformed);
     gCrate->SetPosition({ 45, 0, 45 });
     gCrate->SetScale(6.0f);
     gCrate->SetRotation({ 0.0f, ToRadians(-50.0f), 0.0f });
 
     gFloor = new CModel("Wood2.jpg");
-    gFloor->SetMesh("Floor.x");
+    gFloor->SetMesh("Floor.x", false, ENodeImport::PreTransformed);
     gFloor->SetPosition({ -320, 0, 0 });
 
     gTeapot = new CModel("tech02.jpg");
@@ -417,7 +548,8 @@ bool InitScene()
     gTroll->SetScale(4.0f);
 
     gMyCar = new CModel("CarTexture.png"); // Creates a model that I made myself
-    gMyCar->SetMesh("MyCar.fbx");
+    gMyCar->SetMesh("MyCar.fbx", false, ENodeImport::BatchedNodes); // Car parts are drawn together, each vertex knows its part
+    if (gMyCar->GetMesh()->HasBones())  gMyCar->SetVSShader(gSkinningVertexShader); // Only batched if it has several parts
     gMyCar->SetPosition({ -320, 0, 200 });
     gMyCar->SetRotation({ 0, 200, 0 });
     gMyCar->SetScale(.2f);
@@ -430,6 +562,18 @@ bool InitScene()
     //gMySkyBox->SetScale(10.0f); // For use as a skybox
     gMySkyBox->SetPosition({ -320, 10, -60 });
     //gMySkyBox->SetPosition({ 0, 0, 0 }); // For use as a skybox
+
+    // Put the models using my class in the BVH, rendering only queues the ones it finds in view
+    std::vector<CModel*> bvhModels = { gGround, gCrate, gFloor, gTeapot, gSphere, gMyCar };
+    bvhModels.insert(bvhModels.end(), gCharacters, gCharacters + NUM_CHARACTERS);
+    bvhModels.insert(bvhModels.end(), gCubes, gCubes + NUM_CUBES);
+    for (CModel* model : bvhModels)
+    {
+        unsigned int id = gSceneBVH.Add(BVHBounds(model));
+        if (id >= gBVHModels.size())  gBVHModels.resize(id + 1);
+        gBVHModels[id] = model;
+        if (model == gGround || model == gCrate || model == gFloor)  gOccluderIds.push_back(id);
+    }
     
     // Light set-up - using an array this time
     for (int i = 0; i < NUM_LIGHTS; ++i)
@@ -459,6 +603,7 @@ bool InitScene()
     gLight[4]->SetLightColour({ 0.75f, 0.75f, 0.75f });
     gLight[4]->SetStrength(40);
     gLight[4]->SetPosition({ -20, 40, -50 });
+    gLight[4]->SetFacing({ 20, -40, 50 }); // Shining from its model towards the middle of the scene
     gLight[4]->SetType(2);
 
     srand(static_cast <unsigned> (time(0))); // Used for seeding the random number generator
@@ -477,13 +622,19 @@ void ReleaseResources()
 {
     ReleaseStates();
 
-    if (gShadowMap1DepthStencil)        gShadowMap1DepthStencil->Release();
-    if (gShadowMap1SRV)                 gShadowMap1SRV->Release();
-    if (gShadowMap1Texture)             gShadowMap1Texture->Release();
+    if (gShadowAtlasDepthStencil)       gShadowAtlasDepthStencil->Release();
+    if (gShadowAtlasSRV)                gShadowAtlasSRV->Release();
+    if (gShadowAtlasTexture)            gShadowAtlasTexture->Release();
+    if (gShadowCacheDepthStencil)       gShadowCacheDepthStencil->Release();
+    if (gShadowCacheSRV)                gShadowCacheSRV->Release();
+    if (gShadowCacheTexture)            gShadowCacheTexture->Release();
 
     if (gPerModelConstantBuffer)        gPerModelConstantBuffer->Release();
+    if (gPerSkeletonConstantBuffer)     gPerSkeletonConstantBuffer->Release();
+    if (gPerMaterialConstantBuffer)     gPerMaterialConstantBuffer->Release();
     if (gPerFrameConstantBuffer)        gPerFrameConstantBuffer->Release();
     if (gPostProcessingConstantBuffer)  gPostProcessingConstantBuffer->Release();
+    gConstantBufferRing.Release();
 
     if (gSceneTextureSRV)               gSceneTextureSRV->Release();
     if (gSceneRenderTarget)             gSceneRenderTarget->Release();
@@ -496,6 +647,9 @@ void ReleaseResources()
     {
         delete gLight[i];  gLight[i] = nullptr;
     }
+    gLightManager.Release();
+    delete gLightClusters;          gLightClusters    = nullptr;
+    delete gOcclusionCuller;        gOcclusionCuller  = nullptr;
     delete gCamera;                 gCamera           = nullptr;
     delete gNormalMapCube;          gNormalMapCube    = nullptr;
     delete gParallaxTeapot;         gParallaxTeapot   = nullptr;
@@ -526,46 +680,90 @@ void RenderSceneFromCamera(Camera* camera)
     UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
     // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader
-    gD3DContext->GSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
-    gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+    gRenderBackend->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader
+    gRenderBackend->GSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+    gRenderBackend->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
     
-    gD3DContext->GSSetShader(nullptr, nullptr, 0); // Turns off the geometry shader
-    //// Render skinned models ////
-    for (int i = 0; i < NUM_CHARACTERS; ++i)
-    {
-        gCharacters[i]->SetVSShader(gSkinningVertexShader);
-        gCharacters[i]->Render();
-    }
+    gStateCache.GSSetShader(nullptr); // Turns off the geometry shader
 
-    //// Render non-skinned models ////
-    gGround->Render();
-    
-    gCrate->Render();
+    // All models in this app share the same material settings
+    gPerMaterialConstants.specularPower = gSpecularPower;
+    gPerMaterialConstants.parallaxDepth = gParallaxDepth;
+
+    //// Render models that set their own states ////
+    // These are drawn first, then the models using my class are queued and drawn in sorted order (see RenderQueue.h)
+
+    // Normal Mapped cube
+    gStateCache.VSSetShader(gNormalMapVertexShader);
+    gStateCache.PSSetShader(gNormalMapPixelShader);
+
+    gStateCache.OMSetBlendState(gNoBlendingState);
+    gStateCache.OMSetDepthStencilState(gUseDepthBufferState);
+    gStateCache.RSSetState(gCullBackState);
     
-    gFloor->Render();
+    gRenderBackend->PSSetShaderResources(0, 1, gPatternTexture->GetTexture()); // First parameter must match texture slot number in the shaer
+    gRenderBackend->PSSetShaderResources(2, 1, gPatternNormalTexture->GetTexture());
+    gStateCache.PSSetSampler(0, gAnisotropic4xSampler);
+    gNormalMapCube->Render();
 
-    gTeapot->Render();
+    // Parallax Mapped teapot
+    gStateCache.VSSetShader(gNormalMapVertexShader);
+    gStateCache.PSSetShader(gParallaxMapPixelShader);
+    gRenderBackend->PSSetShaderResources(2, 1, gPatternHeightTexture->GetTexture());
+    gParallaxTeapot->Render();
+
+    // Render Troll Outline
+    gStateCache.VSSetShader(gCellShadingOutlineVertexShader);
+    gStateCache.PSSetShader(gCellShadingOutlinePixelShader);
+    gStateCache.RSSetState(gCullFrontState);
+    gTroll->Render();
+
+    // Render Main Troll
+    gStateCache.VSSetShader(gPixelLightingVertexShader);
+    gStateCache.PSSetShader(gCellShadingPixelShader);
+    gStateCache.RSSetState(gCullBackState);
+    gRenderBackend->PSSetShaderResources(0, 1, gTrollTexture->GetTexture());
+    gRenderBackend->PSSetShaderResources(2, 1, gTrollTexture->GetTexture2());
+    gStateCache.PSSetSampler(2, gPointSampler);
+    gTroll->Render();
+
+    // Render sky box as a mesh
+    gStateCache.VSSetShader(gBasicTransformVertexShader);
+    gStateCache.PSSetShader(gLightModelPixelShader);
+    gStateCache.RSSetState(gCullNoneState);
+    gRenderBackend->PSSetShaderResources(0, 1, gSkyBoxTexture->GetTexture());
+    gMySkyBox->Render();
+
+
+    //// Queue models using my class ////
+    // Their shaders and states are set first, then only the models in the camera's view are queued
+
+    // Skinned models
+    for (int i = 0; i < NUM_CHARACTERS; ++i)
+    {
+        // The vertex shader must match the bone palette the mesh sends over
+        bool dualQuaternion = gCharacters[i]->GetMesh()->GetSkinningMode() == ESkinningMode::DualQuaternion;
+        gCharacters[i]->SetVSShader(dualQuaternion ? gSkinningDQVertexShader : gSkinningVertexShader);
+    }
 
     gMyCar->SetCull(ECullType::None);
-    gMyCar->Render();
 
     // Set cubes up
     gCubes[0]->SetPSShader(gTextureFadePixelShader); 
 
-    // Render Additive cube
+    // Additive cube
     gCubes[1]->SetVSShader(gBasicTransformVertexShader);
     gCubes[1]->SetPSShader(gLightModelPixelShader);
     gCubes[1]->SetBlendType(EBlendType::Additive);
     gCubes[1]->SetCull(ECullType::None);
 
-    // Render Multiplicative cube
+    // Multiplicative cube
     gCubes[2]->SetVSShader(gBasicTransformVertexShader);
     gCubes[2]->SetPSShader(gSimplePixelShader);
     gCubes[2]->SetBlendType(EBlendType::Multiplicative);
     gCubes[2]->SetCull(ECullType::None);
 
-    // Render Alpha Cubes
+    // Alpha Cubes
     gCubes[3]->SetVSShader(gBasicTransformVertexShader);
     gCubes[3]->SetPSShader(gSimplePixelShader);
     gCubes[3]->SetBlendType(EBlendType::Alpha);
@@ -576,57 +774,21 @@ void RenderSceneFromCamera(Camera* camera)
     gCubes[4]->SetBlendType(EBlendType::Alpha);
     gCubes[4]->SetCull(ECullType::None);
 
-    for (int i = 0; i < NUM_CUBES; ++i) // Render all cubes
-    {
-        gCubes[i]->Render();
-    }
-
-    // Normal Mapped cube
-    gD3DContext->VSSetShader(gNormalMapVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gNormalMapPixelShader, nullptr, 0);
-
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullBackState);
-    
-    gD3DContext->PSSetShaderResources(0, 1, gPatternTexture->GetTexture()); // First parameter must match texture slot number in the shaer
-    gD3DContext->PSSetShaderResources(2, 1, gPatternNormalTexture->GetTexture());
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
-    gNormalMapCube->Render();
-
-    // Parallax Mapped teapot
-    gD3DContext->VSSetShader(gNormalMapVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gParallaxMapPixelShader, nullptr, 0);
-    gD3DContext->PSSetShaderResources(2, 1, gPatternHeightTexture->GetTexture());
-    gParallaxTeapot->Render();
-
-    // Render Troll Outline
-    gD3DContext->VSSetShader(gCellShadingOutlineVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCellShadingOutlinePixelShader, nullptr, 0);
-    gD3DContext->RSSetState(gCullFrontState);
-    gTroll->Render();
-
-    // Render Main Troll
-    gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCellShadingPixelShader, nullptr, 0);
-    gD3DContext->RSSetState(gCullBackState);
-    gD3DContext->PSSetShaderResources(0, 1, gTrollTexture->GetTexture());
-    gD3DContext->PSSetShaderResources(2, 1, gTrollTexture->GetTexture2());
-    gD3DContext->PSSetSamplers(2, 1, &gPointSampler);
-    gTroll->Render();
-
-    // Render sky box as a mesh
-    gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gLightModelPixelShader, nullptr, 0);
-    gD3DContext->RSSetState(gCullNoneState);
-    gD3DContext->PSSetShaderResources(0, 1, gSkyBoxTexture->GetTexture());
-    gMySkyBox->Render();
-
-    // Render wigghle sphere
+    // Wiggle sphere, the object colour is recorded with each draw (only the sphere's shader uses it)
     gPerModelConstants.objectColour = { 1, 1, 0 };
     gSphere->SetPSShader(gTintPixelShader);
     gSphere->SetVSShader(gWiggleVertexShader);
-    gSphere->Render();
+
+    // Queue the models in view, the blended ones are drawn after all opaque models, furthest first
+    gRenderQueue.Clear();
+    CVector3 cameraPosition = camera->Position();
+    for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+    {
+        if (gViewMasks[id] & CAMERA_VIEW)  gRenderQueue.Add(gBVHModels[id], cameraPosition);
+    }
+
+    // Render the queued models in sorted order
+    gRenderQueue.Submit();
 
     //// Render lights ////
     // Render all the lights in the array
@@ -643,34 +805,34 @@ void PostProcessing(float frameTime)
 {
 
     // Select the back buffer to use for rendering. Not going to clear the back-buffer because we're going to overwrite it all
-    gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget /*MISSING, 2nd pass specify back buffer as render target (note: needs an &)*/, gDepthStencil);
+    gRenderBackend->OMSetRenderTargets(1, &gBackBufferRenderTarget /*MISSING, 2nd pass specify back buffer as render target (note: needs an &)*/, gDepthStencil);
 
 
     // Give the pixel shader (post-processing shader) access to the scene texture 
-    gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV/* MISSING select the scene texture shader resource view (note: needs an &)*/);
-    gD3DContext->PSSetSamplers(0, 1, &gPointSampler); // Use point sampling (no bilinear, trilinear, mip-mapping etc. for most post-processes)
+    gRenderBackend->PSSetShaderResources(0, 1, &gSceneTextureSRV/* MISSING select the scene texture shader resource view (note: needs an &)*/);
+    gStateCache.PSSetSampler(0, gPointSampler); // Use point sampling (no bilinear, trilinear, mip-mapping etc. for most post-processes)
 
 
     // Using special vertex shader than creates its own data for a full screen quad
-    gD3DContext->VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
-    gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+    gStateCache.VSSetShader(gFullScreenQuadVertexShader);
+    gStateCache.GSSetShader(nullptr);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
 
 
     // States - no blending, ignore depth buffer and culling
-    gD3DContext->OMSetBlendState(gAlphaBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-    gD3DContext->RSSetState(gCullNoneState);
+    gStateCache.OMSetBlendState(gAlphaBlendingState);
+    gStateCache.OMSetDepthStencilState(gDepthReadOnlyState);
+    gStateCache.RSSetState(gCullNoneState);
 
 
     // No need to set vertex/index buffer (see fullscreen quad vertex shader), just indicate that the quad will be created as a triangle strip
-    gD3DContext->IASetInputLayout(NULL); // No vertex data
-    gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    gStateCache.IASetInputLayout(NULL); // No vertex data
+    gStateCache.IASetPrimitiveTopology(ERenderTopology::TriangleStrip);
 
 
     // Prepare custom settings for current post-process
     if (gCurrentPostProcess == PostProcess::Tint)
     {
-        gD3DContext->PSSetShader(gTintPostProcess, nullptr, 0);
+        gStateCache.PSSetShader(gTintPostProcess);
         //gPostProcessingConstants.tintColour = { 1, 0, 0 };
         gPostProcessingConstants.tintColour = { 1, 1, 0 };//?? FILTER - Make a nice colour*/;
     }
@@ -678,7 +840,7 @@ void PostProcessing(float frameTime)
 
     else if (gCurrentPostProcess == PostProcess::GreyNoise)
     {
-        gD3DContext->PSSetShader(gGreyNoisePostProcess, nullptr, 0);
+        gStateCache.PSSetShader(gGreyNoisePostProcess);
 
         // Noise scaling adjusts how fine the noise is.
         const float grainSize = 140; // Fineness of the noise grain
@@ -689,41 +851,41 @@ void PostProcessing(float frameTime)
         gPostProcessingConstants.noiseOffset = { Random(2.0f, 10.0f), Random(2.0f, 10.0f)/*FILTER - 2 random UVs please*/ };
 
         // Give pixel shader access to the noise texture
-        gD3DContext->PSSetShaderResources(1, 1, &gNoiseMapSRV);
-        gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
+        gRenderBackend->PSSetShaderResources(1, 1, &gNoiseMapSRV);
+        gStateCache.PSSetSampler(1, gTrilinearSampler);
     }
 
 
     else if (gCurrentPostProcess == PostProcess::Burn)
     {
-        gD3DContext->PSSetShader(gBurnPostProcess, nullptr, 0);
+        gStateCache.PSSetShader(gBurnPostProcess);
 
         // Set and increase the burn level (cycling back to 0 when it reaches 1.0f)
         const float burnSpeed = 0.2f;
         gPostProcessingConstants.burnHeight = fmod(gPostProcessingConstants.burnHeight + burnSpeed * frameTime, 1.0f);
 
         // Give pixel shader access to the burn texture (basically a height map that the burn level ascends)
-        gD3DContext->PSSetShaderResources(1, 1, &gBurnMapSRV);
-        gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
+        gRenderBackend->PSSetShaderResources(1, 1, &gBurnMapSRV);
+        gStateCache.PSSetSampler(1, gTrilinearSampler);
     }
 
 
     else if (gCurrentPostProcess == PostProcess::Distort)
     {
-        gD3DContext->PSSetShader(gDistortPostProcess, nullptr, 0);
+        gStateCache.PSSetShader(gDistortPostProcess);
 
         // Set the level of distortion
         gPostProcessingConstants.distortLevel = 0.03f;
 
         // Give pixel shader access to the distortion texture (containts 2D vectors (in R & G) to shift the texture UVs to give a cut-glass impression)
-        gD3DContext->PSSetShaderResources(1, 1, &gDistortMapSRV);
-        gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
+        gRenderBackend->PSSetShaderResources(1, 1, &gDistortMapSRV);
+        gStateCache.PSSetSampler(1, gTrilinearSampler);
     }
 
 
     else if (gCurrentPostProcess == PostProcess::Spiral)
     {
-        gD3DContext->PSSetShader(gSpiralPostProcess, nullptr, 0);
+        gStateCache.PSSetShader(gSpiralPostProcess);
 
         static float wiggle = 0.0f;
         const float wiggleSpeed = 1.0f;
@@ -734,124 +896,348 @@ void PostProcessing(float frameTime)
     }
 
     UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-    gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
+    gRenderBackend->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
 
     // Draw a quad
-    gD3DContext->Draw(4/*MISSING - Post-process pass renderes a quad*/, 0);
+    gRenderBackend->Draw(4/*MISSING - Post-process pass renderes a quad*/, 0);
 
 
     // These lines unbind the scene texture from the pixel shader to stop DirectX issuing a warning when we try to render to it again next frame
     ID3D11ShaderResourceView* nullSRV = nullptr;
-    gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
+    gRenderBackend->PSSetShaderResources(0, 1, &nullSRV);
+}
+
+// Choose the shadow atlas tile for each spotlight and shadow cascade this frame and what must be redrawn in it (see
+// ShadowAtlas.h). Their casters are the models culled into their shadow views. Call after culling
+void AllocateShadowAtlas()
+{
+    gShadowAtlas.BeginFrame();
+
+    // Skinned models and the wiggling sphere change shape in the vertex shader, so they are never cached. Blended models
+    // don't cast shadows
+    for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+    {
+        ID3D11VertexShader* vertexShader = gBVHModels[id]->GetVSShader();
+        bool animated = vertexShader == gSkinningVertexShader || vertexShader == gSkinningDQVertexShader || vertexShader == gWiggleVertexShader;
+        gShadowAtlas.UpdateCaster(id, gBVHModels[id]->GetModel()->WorldMatrix(), animated);
+    }
+
+    static std::vector<unsigned int> casters; // Kept to save reallocating
+    auto findCasters = [](uint32_t views)
+    {
+        casters.clear();
+        for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+        {
+            if ((gViewMasks[id] & views) && !gBVHModels[id]->IsTransparent())  casters.push_back(id);
+        }
+    };
+    float tanHalfFOV = std::tan(gCamera->FOV() / 2);
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        if (gLight[i]->GetLightType() != static_cast<int>(ELightType::Spot) || gShadowViews[i] == 0)  continue;
+
+        findCasters(gShadowViews[i]);
+        float importance = ShadowImportance(gCamera->Position(), tanHalfFOV, gLight[i]->GetLightPosition(), gLight[i]->GetLightRange());
+        gShadowAtlas.AddView(i, importance, gLight[i]->GetLightViewMatrix(), gLight[i]->GetLightProjectionMatrix(),
+                             casters.data(), static_cast<unsigned int>(casters.size()));
+    }
+
+    // The directional light covers the whole screen and each cascade takes a similar share of it
+    unsigned int numCascades = (gCascadeLight >= 0) ? gShadowCascades.NumCascades() : 0;
+    for (unsigned int c = 0; c < numCascades; ++c)
+    {
+        if (gCascadeViews[c] == 0)  continue;
+
+        findCasters(gCascadeViews[c]);
+        const ShadowCascades::Cascade& cascade = gShadowCascades.GetCascade(c);
+        gShadowAtlas.AddView(CASCADE_VIEW_KEY + c, 1.0f / numCascades, cascade.viewMatrix, cascade.projectionMatrix,
+                             casters.data(), static_cast<unsigned int>(casters.size()));
+    }
+    gShadowAtlas.Allocate();
+
+    // Tell the shaders where each light's and cascade's tile is, those without one have no shadows
+    bool hasTile[NUM_LIGHTS] = {};
+    gPerFrameConstants.numShadowCascades = numCascades;
+    gPerFrameConstants.shadowCascadeLight = (numCascades > 0) ? static_cast<int>(gLight[gCascadeLight]->GetLightIndex()) : -1;
+    for (unsigned int c = 0; c < numCascades; ++c)
+    {
+        gPerFrameConstants.shadowCascadeMatrices[c] = gShadowCascades.GetCascade(c).viewProjectionMatrix;
+        std::fill(gPerFrameConstants.shadowCascadeUVRects[c], gPerFrameConstants.shadowCascadeUVRects[c] + 4, 0.0f);
+    }
+    for (unsigned int v = 0; v < gShadowAtlas.NumViews(); ++v)
+    {
+        const ShadowAtlas::View& view = gShadowAtlas.GetView(v);
+        if (view.size == 0)  continue;
+        float atlasSize = static_cast<float>(SHADOW_ATLAS_SIZE);
+        if (view.key >= CASCADE_VIEW_KEY)
+        {
+            float* uvRect = gPerFrameConstants.shadowCascadeUVRects[view.key - CASCADE_VIEW_KEY];
+            uvRect[0] = view.x / atlasSize;
+            uvRect[1] = view.y / atlasSize;
+            uvRect[2] = uvRect[3] = view.size / atlasSize;
+            continue;
+        }
+        gLight[view.key]->SetShadowTile({ view.x / atlasSize, view.y / atlasSize }, { view.size / atlasSize, view.size / atlasSize });
+        hasTile[view.key] = true;
+    }
+
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        if (!hasTile[i])  gLight[i]->SetShadowTile({ 0, 0 }, { 0, 0 });
+    }
 }
 
+
+// Render the depth of the given models from a shadow view, into the current depth buffer and viewport
+void RenderShadowCasters(const ShadowAtlas::View& view, const std::vector<unsigned int>& casters)
+{
+    if (casters.empty())  return;
+
+    // Get camera-like matrices from the light, set in the constant buffer and send over to GPU
+    gPerFrameConstants.viewMatrix = view.viewMatrix;
+    gPerFrameConstants.projectionMatrix = view.projectionMatrix;
+    gPerFrameConstants.viewProjectionMatrix = view.viewMatrix * view.projectionMatrix;
+    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+    gRenderBackend->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+
+    // Only depth is written so no pixel shader is needed. Each model keeps its own vertex shader, which matches its
+    // vertex data and does any skinning or deforming
+    gStateCache.PSSetShader(nullptr);
+    gStateCache.OMSetBlendState(gNoBlendingState);
+    gStateCache.OMSetDepthStencilState(gUseDepthBufferState);
+    gStateCache.RSSetState(gCullFrontState);
+    for (unsigned int id : casters)
+    {
+        gStateCache.VSSetShader(gBVHModels[id]->GetVSShader());
+        gBVHModels[id]->GetModel()->Render();
+    }
+}
+
+
+// Fill a viewport of the current depth buffer using the full screen quad, with the given pixel shader. With no pixel
+// shader the depth is the viewport's minDepth
+void DrawShadowQuad(const RenderViewport& viewport, ID3D11PixelShader* pixelShader)
+{
+    gRenderBackend->RSSetViewports(1, &viewport);
+    gStateCache.VSSetShader(gFullScreenQuadVertexShader);
+    gStateCache.PSSetShader(pixelShader);
+    gStateCache.OMSetBlendState(gNoBlendingState);
+    gStateCache.OMSetDepthStencilState(gOverwriteDepthState);
+    gStateCache.RSSetState(gCullNoneState);
+    gStateCache.IASetInputLayout(NULL);
+    gStateCache.IASetPrimitiveTopology(ERenderTopology::TriangleStrip);
+    gRenderBackend->Draw(4, 0);
+}
+
+
+// Update the tiles of the shadow atlas chosen by AllocateShadowAtlas. Depth buffers can only be cleared or copied whole, so
+// tiles are cleared and copied by drawing quads over them
+void RenderShadowAtlas()
+{
+    gStateCache.GSSetShader(nullptr);
+    for (unsigned int v = 0; v < gShadowAtlas.NumViews(); ++v)
+    {
+        const ShadowAtlas::View& view = gShadowAtlas.GetView(v);
+        if (view.size == 0 || view.update == EShadowUpdate::None)  continue;
+
+        RenderViewport vp;
+        vp.width  = static_cast<float>(view.size);
+        vp.height = static_cast<float>(view.size);
+        vp.x = static_cast<float>(view.x);
+        vp.y = static_cast<float>(view.y);
+
+        // Redraw the cached tile: clear it to the far distance then draw the static casters
+        if (view.update == EShadowUpdate::Full)
+        {
+            gRenderBackend->OMSetRenderTargets(0, nullptr, gShadowCacheDepthStencil);
+            vp.minDepth = vp.maxDepth = 1.0f;
+            DrawShadowQuad(vp, nullptr);
+            vp.minDepth = 0.0f;
+            gRenderBackend->RSSetViewports(1, &vp);
+            RenderShadowCasters(view, view.staticCasters);
+        }
+
+        // Copy the cached tile into the atlas, then draw the moving casters over it
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+        gRenderBackend->OMSetRenderTargets(0, nullptr, gShadowAtlasDepthStencil);
+        gRenderBackend->PSSetShaderResources(0, 1, &gShadowCacheSRV);
+        DrawShadowQuad(vp, gShadowCacheCopyPixelShader);
+        ID3D11ShaderResourceView* nullSRV = nullptr;
+        gRenderBackend->PSSetShaderResources(0, 1, &nullSRV);
+        RenderShadowCasters(view, view.dynamicCasters);
+    }
+}
+
+
 // Rendering the scene
 void RenderScene(float frameTime)
 {
     //// Common settings ////
 
-    // Set up the light information in the constant buffer
-    // Don't send to the GPU yet, the function RenderSceneFromCamera will do that
-
-    // Setup lights
-    gPerFrameConstants.light1Colour           = gLight[0]->GetLightColour();
-    gPerFrameConstants.light1Position         = gLight[0]->GetLightPosition();
-    gPerFrameConstants.light1Facing           = gLight[0]->GetLightFacing();
-    gPerFrameConstants.light1CosHalfAngle     = gLight[0]->GetLightCosHalfAngle();
-    gPerFrameConstants.light1ViewMatrix       = gLight[0]->GetLightViewMatrix();
-    gPerFrameConstants.light1ProjectionMatrix = gLight[0]->GetLightProjectionMatrix();
-    gPerFrameConstants.light1Type             = gLight[0]->GetLightType();
-
-    gPerFrameConstants.light2Colour           = gLight[1]->GetLightColour();
-    gPerFrameConstants.light2Position         = gLight[1]->GetLightPosition();
-    gPerFrameConstants.light2Facing           = gLight[1]->GetLightFacing();
-    gPerFrameConstants.light2CosHalfAngle     = gLight[1]->GetLightCosHalfAngle();
-    gPerFrameConstants.light2ViewMatrix       = gLight[1]->GetLightViewMatrix();
-    gPerFrameConstants.light2ProjectionMatrix = gLight[1]->GetLightProjectionMatrix();
-    gPerFrameConstants.light2Type             = gLight[1]->GetLightType();
-
-    gPerFrameConstants.light3Colour           = gLight[2]->GetLightColour();
-    gPerFrameConstants.light3Position         = gLight[2]->GetLightPosition();
-    gPerFrameConstants.light3Facing           = gLight[2]->GetLightFacing();
-    gPerFrameConstants.light3CosHalfAngle     = gLight[2]->GetLightCosHalfAngle();
-    gPerFrameConstants.light3ViewMatrix       = gLight[2]->GetLightViewMatrix();
-    gPerFrameConstants.light3ProjectionMatrix = gLight[2]->GetLightProjectionMatrix();
-    gPerFrameConstants.light3Type             = gLight[2]->GetLightType();
-
-    gPerFrameConstants.light4Colour           = gLight[3]->GetLightColour();
-    gPerFrameConstants.light4Position         = gLight[3]->GetLightPosition();
-    gPerFrameConstants.light4Facing           = gLight[3]->GetLightFacing();
-    gPerFrameConstants.light4CosHalfAngle     = gLight[3]->GetLightCosHalfAngle();
-    gPerFrameConstants.light4ViewMatrix       = gLight[3]->GetLightViewMatrix();
-    gPerFrameConstants.light4ProjectionMatrix = gLight[3]->GetLightProjectionMatrix();
-    gPerFrameConstants.light4Type             = gLight[3]->GetLightType();
-
-    gPerFrameConstants.light5Colour           = gLight[4]->GetLightColour();
-    gPerFrameConstants.light5Position         = gLight[4]->GetLightPosition();
-    gPerFrameConstants.light5Facing           = gLight[4]->GetLightFacing();
-    gPerFrameConstants.light5CosHalfAngle     = gLight[4]->GetLightCosHalfAngle();
-    gPerFrameConstants.light5ViewMatrix       = gLight[4]->GetLightViewMatrix();
-    gPerFrameConstants.light5ProjectionMatrix = gLight[4]->GetLightProjectionMatrix();
-    gPerFrameConstants.light5Type             = gLight[4]->GetLightType();
+    // Fit the BVH to where the models have moved this frame
+    for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+    {
+        gSceneBVH.SetBounds(id, BVHBounds(gBVHModels[id]));
+    }
+    gSceneBVH.Update();
+
+    // Cull the camera's view and every shadow view together. Only the views that get a shadow map have a volume: a
+    // spotlight's frustum (see Light::GetShadowFrustums) cut down to where casters can reach the camera's view, and the
+    // first directional light's shadow cascades. A cascade's box is kept as it is, so its casters only change when it moves
+    // a snap step. Point lights have no shadow maps, so their six cube face views would be culled for nothing
+    CFrustum cameraFrustum = gCamera->Frustum();
+    unsigned int numViews = 0;
+    gViewVolumes[numViews++] = CConvexVolume(cameraFrustum);
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        gShadowViews[i] = 0;
+        if (gLight[i]->GetLightType() != static_cast<int>(ELightType::Spot))  continue;
+
+        CFrustum lightFrustums[6];
+        int numLightFrustums = gLight[i]->GetShadowFrustums(lightFrustums);
+        for (int f = 0; f < numLightFrustums && numViews < SceneBVH::MAX_VOLUMES; ++f)
+        {
+            gViewVolumes[numViews] = CConvexVolume(lightFrustums[f]);
+            gViewVolumes[numViews].AddShadowCasterPlanes(cameraFrustum, gLight[i]->GetLightPosition());
+            gShadowViews[i] |= 1u << numViews++;
+        }
+    }
+    gCascadeLight = -1;
+    for (int i = 0; i < NUM_LIGHTS && gCascadeLight < 0; ++i)
+    {
+        if (gLight[i]->GetLightType() == static_cast<int>(ELightType::Directional))  gCascadeLight = i;
+    }
+    if (gCascadeLight >= 0)
+    {
+        // The cascades reach back to every caster in the scene
+        CAABB casterBounds = CAABB::Empty();
+        for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+        {
+            if (!gBVHModels[id]->IsTransparent())  casterBounds.Expand(gSceneBVH.Bounds(id));
+        }
+        gShadowCascades.Fit(gCamera->WorldMatrix(), gCamera->FOV(), gCamera->AspectRatio(), gCamera->NearClip(),
+                            std::min(SHADOW_DISTANCE, gCamera->FarClip()), gLight[gCascadeLight]->GetLightFacing(), casterBounds);
+        for (unsigned int c = 0; c < gShadowCascades.NumCascades(); ++c)
+        {
+            gCascadeViews[c] = 0;
+            if (numViews == SceneBVH::MAX_VOLUMES)  continue;
+            gViewVolumes[numViews] = gShadowCascades.GetCascade(c).casterVolume;
+            gCascadeViews[c] = 1u << numViews++;
+            gShadowViews[gCascadeLight] |= gCascadeViews[c];
+        }
+    }
+    gSceneBVH.QueryVolumes(gViewVolumes, numViews, gViewMasks);
+
+    // Remove models hidden behind the occluders from the camera's view. Occluders outside the view can't hide anything
+    gOcclusionCuller->Clear(gCamera->ViewProjectionMatrix());
+    for (unsigned int id : gOccluderIds)
+    {
+        if ((gViewMasks[id] & CAMERA_VIEW) == 0)  continue;
+        Model* model = gBVHModels[id]->GetModel();
+        Mesh*  mesh  = model->GetMesh();
+        gOcclusionCuller->AddOccluder(mesh->Positions().data(), mesh->TriangleIndices().data(),
+                                      static_cast<unsigned int>(mesh->TriangleIndices().size()), model->WorldMatrix());
+    }
+    gOcclusionCuller->Rasterise();
+    gNumOccludedModels = 0;
+    for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+    {
+        bool isOccluder = std::find(gOccluderIds.begin(), gOccluderIds.end(), id) != gOccluderIds.end();
+        if ((gViewMasks[id] & CAMERA_VIEW) && !isOccluder && gOcclusionCuller->IsOccluded(gSceneBVH.Bounds(id)))
+        {
+            gViewMasks[id] &= ~CAMERA_VIEW;
+            ++gNumOccludedModels;
+        }
+    }
+
+    // Choose the shadow atlas tiles of the spotlights and shadow cascades, which the light buffer below holds
+    AllocateShadowAtlas();
+
+    // Send the lights that changed since last frame to the light buffer (see LightManager.h), the shaders loop over them
+    gPerFrameConstants.numLights = gLightManager.Update() ? gLightManager.NumLights() : 0;
+
+    // Bin the lights into clusters of the camera's view so each pixel only uses the lights that reach it. If the cluster
+    // buffers can't be made the shaders fall back to using every light
+    gLightClusters->Build(gLightManager, *gCamera);
+    if (gPerFrameConstants.numLights > 0 && gLightClusters->Upload())
+    {
+        gPerFrameConstants.clusterCountX     = gLightClusters->NumX();
+        gPerFrameConstants.clusterCountY     = gLightClusters->NumY();
+        gPerFrameConstants.clusterCountZ     = gLightClusters->NumZ();
+        gPerFrameConstants.clusterDepthScale = gLightClusters->DepthScale();
+        gPerFrameConstants.clusterDepthBias  = gLightClusters->DepthBias();
+    }
+    else
+    {
+        gPerFrameConstants.clusterCountZ = 0;
+    }
+
+    // Choose the lights for each lit model in view when using per-object light lists
+    gLightSelector.Clear();
+    for (unsigned int id = 0; id < gBVHModels.size(); ++id)
+    {
+        if (gViewMasks[id] & CAMERA_VIEW)  gLightSelector.Add(gBVHModels[id]->GetModel());
+    }
+    for (Model*  model : { gNormalMapCube, gParallaxTeapot, gTroll })  gLightSelector.Add(model);
+    if (gPerObjectLights)  gLightSelector.Select(gLightManager);
+    else                   gLightSelector.UseSceneLights();
 
     // Set other data to send to GPU
     gPerFrameConstants.ambientColour    = gAmbientColour; 
-    gPerFrameConstants.specularPower    = gSpecularPower;
     gPerFrameConstants.cameraPosition   = gCamera->Position();
-    gPerFrameConstants.parallaxDepth    = gParallaxDepth;
     gPerFrameConstants.outlineColour    = OutlineColour;       
     gPerFrameConstants.outlineThickness = OutlineThickness;    
     gPerFrameConstants.viewportWidth = static_cast<float>(gViewportWidth);
     gPerFrameConstants.viewportHeight = static_cast<float>(gViewportHeight);
     gPerFrameConstants.frameTime = frameTime;
 
-    // Select the shadow map texture as the current depth buffer. We will not be rendering any pixel colours
-    // Also clear the the shadow map depth buffer to the far distance
-    gD3DContext->OMSetRenderTargets(0, nullptr, gShadowMap1DepthStencil);
-    gD3DContext->ClearDepthStencilView(gShadowMap1DepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    // Render the shadow atlas tiles that changed, from the point of view of their lights (only depth values written). The
+    // atlas isn't cleared, unchanged tiles are kept from earlier frames
+    RenderShadowAtlas();
 
     if (gCurrentPostProcess != PostProcess::None)
     {
-        gD3DContext->OMSetRenderTargets(1, &gSceneRenderTarget/*MISSING select scene texture as render target (note: needs &)*/, gDepthStencil);
-        gD3DContext->ClearRenderTargetView(gSceneRenderTarget, &gBackgroundColor.r);
+        gRenderBackend->OMSetRenderTargets(1, &gSceneRenderTarget/*MISSING select scene texture as render target (note: needs &)*/, gDepthStencil);
+        gRenderBackend->ClearRenderTargetView(gSceneRenderTarget, &gBackgroundColor.r);
     }
     else
     {
-        gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
-        gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
+        gRenderBackend->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+        gRenderBackend->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
     }
-    gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-    // Render the scene from the point of view of light 1 (only depth values written)
+    gRenderBackend->ClearDepthStencilView(gDepthStencil, RENDER_CLEAR_DEPTH, 1.0f, 0);
 
-    for (int i = 0; i < NUM_LIGHTS; ++i)
-    {
-        gLight[i]->RenderDepthBufferFromLight();
-    }
-    // Main scene rendering ////
+    //// Main scene rendering ////
 
     // Setup the viewport to the size of the main window
-    D3D11_VIEWPORT vp;
-    vp.Width  = static_cast<FLOAT>(gViewportWidth);
-    vp.Height = static_cast<FLOAT>(gViewportHeight);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
-
-    // Set shadow map
-    gD3DContext->PSSetShaderResources(1, 1, &gShadowMap1SRV);
-    gD3DContext->PSSetSamplers(1, 1, &gPointSampler);
+    RenderViewport vp;
+    vp.width  = static_cast<float>(gViewportWidth);
+    vp.height = static_cast<float>(gViewportHeight);
+    vp.minDepth = 0.0f;
+    vp.maxDepth = 1.0f;
+    vp.x = 0;
+    vp.y = 0;
+    gRenderBackend->RSSetViewports(1, &vp);
+
+    // Set shadow atlas
+    gRenderBackend->PSSetShaderResources(1, 1, &gShadowAtlasSRV);
+
+    // Set light buffer, slot must match Lighting.hlsli
+    ID3D11ShaderResourceView* lightBufferSRV = gLightManager.LightBufferSRV();
+    gRenderBackend->PSSetShaderResources(8, 1, &lightBufferSRV);
+    ID3D11ShaderResourceView* lightClusterSRVs[] = { gLightClusters->ClusterSRV(), gLightClusters->LightIndexSRV() };
+    gRenderBackend->PSSetShaderResources(9, 2, lightClusterSRVs);
+    gStateCache.PSSetSampler(1, gPointSampler);
 
     // Set SkyBox Followed Introduction to 3D Game Programming With DirectX 11 but it doesn't work quite right
-    gD3DContext->VSSetShader(gCubeMapVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCubeMapPixelShader, nullptr, 0);
-    gD3DContext->PSSetShaderResources(0, 1, gCubeMapTexture->GetTexture());
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gLessEqualDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullNoneState);
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+    gStateCache.VSSetShader(gCubeMapVertexShader);
+    gStateCache.PSSetShader(gCubeMapPixelShader);
+    gRenderBackend->PSSetShaderResources(0, 1, gCubeMapTexture->GetTexture());
+    gStateCache.OMSetBlendState(gNoBlendingState);
+    gStateCache.OMSetDepthStencilState(gLessEqualDepthBufferState);
+    gStateCache.RSSetState(gCullNoneState);
+    gStateCache.PSSetSampler(0, gAnisotropic4xSampler);
     //gSkyBox->Render();
 
     // Render the scene from the main camera
@@ -859,7 +1245,7 @@ void RenderScene(float frameTime)
     
     // Unbind shadow maps
     ID3D11ShaderResourceView* nullView = nullptr;
-    gD3DContext->PSSetShaderResources(1, 1, &nullView);
+    gRenderBackend->PSSetShaderResources(1, 1, &nullView);
 
     //// Scene completion ////
 
@@ -868,7 +1254,65 @@ void RenderScene(float frameTime)
 
     // When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
     // Set first parameter to 1 to lock to vsync (typically 60fps)
-    gSwapChain->Present(lockFPS ? 1 : 0, 0);
+    gRenderBackend->Present(lockFPS ? 1 : 0, 0);
+
+    // Constants written this frame can be overwritten once the GPU has finished with them, a few frames from now
+    gConstantBufferRing.EndFrame();
+}
+
+
+// Time the CPU cost of rendering the scene: it is rendered the given number of times through a RecordingRenderBackend
+// that sends nothing to the GPU. Returns a report of the time and the draws, binds and bytes uploaded per frame,
+// followed by the commands of the last frame
+//
+// Nothing the recorder is sent reaches the GPU, so afterwards anything that remembers what the GPU was last given is
+// wrong. The real backend is restored and these are invalidated: the state cache (bound shaders and states), the constant
+// buffer ring (space written and frames in flight), the material constants sent by each mesh, the light manager's
+// uploaded lights and the shadow atlas's cached tiles. Add any new cache of GPU-side state to the list at the end
+std::string RunRenderBenchmark(unsigned int numFrames /*= 100*/)
+{
+    RecordingRenderBackend recorder;
+    RenderBackend* previousBackend = gRenderBackend;
+    gRenderBackend = &recorder;
+    gStateCache.SetContext(gRenderBackend);
+
+    Timer timer;
+    timer.GetLapTime();
+    for (unsigned int frame = 0; frame < numFrames; ++frame)
+    {
+        recorder.ClearCommands(); // Keep only the last frame
+        RenderScene(0);
+    }
+    float renderTime = timer.GetLapTime();
+
+    // Restore the real backend and invalidate what it was last sent (see above)
+    gRenderBackend = previousBackend;
+    gStateCache.SetContext(gRenderBackend);
+    gConstantBufferRing.Invalidate();
+    gMaterialConstantsCache.Invalidate();
+    gLightManager.Invalidate();
+    gShadowAtlas.Invalidate();
+
+    // Models in the camera's view and shadow casters, summed over the lights
+    unsigned int numInView = 0, numShadowCasters = 0;
+    for (unsigned int id = 0; id < gViewMasks.size(); ++id)
+    {
+        if (gViewMasks[id] & CAMERA_VIEW)  ++numInView;
+        for (int i = 0; i < NUM_LIGHTS; ++i)  numShadowCasters += (gViewMasks[id] & gShadowViews[i]) ? 1 : 0;
+    }
+
+    std::ostringstream report;
+    report.precision(3);
+    report << std::fixed << "Render benchmark, " << numFrames << " frames with no GPU:\n"
+           << "  CPU time per frame: " << renderTime * 1000 / numFrames << "ms\n"
+           << "  Draws: " << recorder.NumDraws() / numFrames << ", binds: " << recorder.NumBinds() / numFrames
+           << ", bytes uploaded: " << recorder.NumBytesUploaded() / numFrames << ", commands: " << recorder.Commands().size() << "\n"
+           << "  Models in view: " << numInView << " of " << gSceneBVH.NumModels() << ", hidden by occluders: " << gNumOccludedModels
+           << ", shadow casters: " << numShadowCasters << "\n"
+           << "  Shadow atlas tiles in the last frame: " << gShadowAtlas.NumViews() << ", redrawn in full: " << gShadowAtlas.NumFullUpdates()
+           << ", moving casters only: " << gShadowAtlas.NumDynamicUpdates() << "\n"
+           << "Commands of the last frame:\n" << recorder.CommandLog();
+    return report.str();
 }
 
 
@@ -908,14 +1352,28 @@ void UpdateScene(float frameTime)
 
     
 
-    gCharacters[0]->GetModel()->Control(20, frameTime, Key_0, Key_0, Key_0, Key_0, Key_U, Key_O, Key_I, Key_0); // Wave
+    // Characters are only animated on the frames the scheduler picks for them, using the time since they were last animated
+    gAnimationScheduler.BeginFrame(gCamera->Position(), frameTime);
+    if (gAnimationScheduler.IsUpdateFrame(0))
+    {
+        float animationTime = gAnimationScheduler.UpdateTime(0);
+        gCharacters[0]->GetModel()->Control(gLeftLowerArmNode, animationTime, Key_0, Key_0, Key_0, Key_0, Key_U, Key_O, Key_I, Key_0); // Wave
     
-	// Control character part. First parameter is node number - index from flattened depth-first array of model parts. 0 is root
-	gCharacters[0]->GetModel()->Control(33, frameTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_I, Key_0); // Head
-	gCharacters[0]->GetModel()->Control(37, frameTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_T, Key_0); // Left Lower Leg
-	gCharacters[0]->GetModel()->Control(41, frameTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_T, Key_0); // Right Lower Leg
-	gCharacters[0]->GetModel()->Control(6,  frameTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_Z, Key_0); // Right Lower Arm
-	gCharacters[0]->GetModel()->Control(20, frameTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_Z, Key_0); // Left Lower Arm
+	    // Control character part. First parameter is node number - found by name in InitScene. 0 is root
+	    gCharacters[0]->GetModel()->Control(gHeadNode,          animationTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_I, Key_0);
+	    gCharacters[0]->GetModel()->Control(gLeftLowerLegNode,  animationTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_T, Key_0);
+	    gCharacters[0]->GetModel()->Control(gRightLowerLegNode, animationTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_T, Key_0);
+	    gCharacters[0]->GetModel()->Control(gRightLowerArmNode, animationTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_Z, Key_0);
+	    gCharacters[0]->GetModel()->Control(gLeftLowerArmNode,  animationTime, Key_0, Key_0, Key_0, Key_0, Key_0, Key_0, Key_Z, Key_0);
+    }
+    gAnimationScheduler.EndFrame();
+
+    // Select skeleton LOD by distance, the mesh clamps it to the LODs available
+    for (int i = 0; i < NUM_CHARACTERS; ++i)
+    {
+        float distance = Length(gCharacters[i]->GetPosition() - gCamera->Position());
+        gCharacters[i]->GetModel()->SetSkeletonLOD(static_cast<unsigned int>(distance / gSkeletonLODDistance));
+    }
 
     gPerFrameConstants.wiggle += sin(gWiggle * 6);
 
@@ -930,6 +1388,22 @@ void UpdateScene(float frameTime)
     // Toggle FPS limiting
     if (KeyHit(Key_P))  lockFPS = !lockFPS;
 
+    // Toggle between linear blend and dual quaternion skinning on the characters
+    if (KeyHit(Key_F1))
+    {
+        for (int i = 0; i < NUM_CHARACTERS; ++i)
+        {
+            Mesh* mesh = gCharacters[i]->GetMesh();
+            mesh->SetSkinningMode(mesh->GetSkinningMode() == ESkinningMode::Linear ? ESkinningMode::DualQuaternion : ESkinningMode::Linear);
+        }
+    }
+
+    // Measure the CPU cost of rendering the scene with no GPU work, results are shown in the debugger output window
+    if (KeyHit(Key_F3))  OutputDebugStringA(RunRenderBenchmark().c_str());
+
+    // Toggle between clustered lighting and per-object light lists
+    if (KeyHit(Key_F5))  gPerObjectLights = !gPerObjectLights;
+
     // Show frame time / FPS in the window title //
     const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
     static float totalFrameTime = 0;
@@ -945,6 +1419,25 @@ void UpdateScene(float frameTime)
         frameTimeMs << std::fixed << avgFrameTime * 1000;
         std::string windowTitle = "Graphics Assignment - Frame Time: " + frameTimeMs.str() +
                                   "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
+
+        // Node matrices recalculated vs reused from last frame, per frame (see Model::Render)
+        windowTitle += ", Matrices recalculated: " + std::to_string(gNodeMatricesRecalculated / frameCount) +
+                       " reused: " + std::to_string(gNodeMatricesReused / frameCount) +
+                       " root only: " + std::to_string(gRootMatricesPlaced / frameCount);
+        gNodeMatricesRecalculated = 0;
+        gNodeMatricesReused = 0;
+        gRootMatricesPlaced = 0;
+
+        // State changes made vs skipped as redundant by the render queue, per frame
+        windowTitle += ", State changes: " + std::to_string(gRenderQueue.NumStateChanges() / frameCount) +
+                       " saved: " + std::to_string(gRenderQueue.NumStateChangesSaved() / frameCount);
+        gRenderQueue.ResetStatistics();
+
+        // Shader and state changes sent to the device vs dropped as redundant, per frame (see StateCache)
+        windowTitle += ", Device state calls: " + std::to_string(gStateCache.NumIssued() / frameCount) +
+                       " filtered: " + std::to_string(gStateCache.NumFiltered() / frameCount);
+        gStateCache.ResetStatistics();
+
         SetWindowTextA(gHWnd, windowTitle.c_str());
         totalFrameTime = 0;
         frameCount = 0;
@@ -0,0 +1,437 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy over the models in the scene, to find the models in a view, near a point or along a ray
+//--------------------------------------------------------------------------------------
+
+#include "SceneBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+
+
+namespace
+{
+	const uint32_t MAX_LEAF_MODELS = 4;   // Leaves hold at most this many models
+	const int      NUM_BINS = 16;         // Number of places considered for each split
+	const float    TRAVERSAL_COST = 1.0f; // Cost of visiting a node, relative to testing one model's bounds
+	const float    LOOSE_GROWTH = 2.0f;   // Parts of the tree are rebuilt when their surface area grows this many times
+
+	// A component of a vector: 0 for x, 1 for y, 2 for z
+	float Component(const CVector3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// Add a model with the given bounds. Returns an id for the model, used by queries
+unsigned int SceneBVH::Add(const CAABB& box)
+{
+	unsigned int id;
+	if (!mFreeIds.empty())
+	{
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<unsigned int>(mBounds.size());
+		mBounds.push_back(box);
+		mInUse.push_back(0);
+	}
+	mBounds[id] = box;
+	mInUse[id] = 1;
+	++mNumModels;
+	mNeedsRebuild = true;
+	return id;
+}
+
+// Give a model's new bounds after it has moved, before the next Update
+void SceneBVH::SetBounds(unsigned int id, const CAABB& box)
+{
+	mBounds[id] = box;
+}
+
+
+// Remove a model added above
+void SceneBVH::Remove(unsigned int id)
+{
+	if (id >= mInUse.size() || !mInUse[id])  return;
+
+	mInUse[id] = 0;
+	mFreeIds.push_back(id);
+	--mNumModels;
+	mNeedsRebuild = true;
+}
+
+
+// Call each frame after models have moved and before querying. Refits the tree to the new bounds and rebuilds any parts
+// that have become too loose, or the whole tree if anything was added or removed
+void SceneBVH::Update()
+{
+	mNumNodesRebuilt = 0;
+	if (mNeedsRebuild)
+	{
+		Rebuild();
+	}
+	else if (mRoot >= 0)
+	{
+		Refit(mRoot);
+		RebuildLoose(mRoot);
+	}
+}
+
+
+// Rebuild the whole tree from the current bounds
+void SceneBVH::Rebuild()
+{
+	mNodes.clear();
+	mFreeNodes.clear();
+	mOrder.clear();
+	mRoot = -1;
+	mNeedsRebuild = false;
+
+	for (uint32_t id = 0; id < mInUse.size(); ++id)
+	{
+		if (mInUse[id])  mOrder.push_back(id);
+	}
+	if (mOrder.empty())  return;
+
+	mRoot = NewNode();
+	Build(mRoot, 0, static_cast<uint32_t>(mOrder.size()));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------------------------------
+
+// Models whose bounds may be visible in a frustum
+void SceneBVH::QueryFrustum(const CFrustum& frustum, std::vector<unsigned int>& ids) const
+{
+	ids.clear();
+	if (mRoot >= 0)  QueryFrustum(mRoot, frustum, CFrustum::ALL_PLANES, ids);
+}
+
+// The plane mask holds the planes that the parent's box is not entirely inside, only those need testing here
+void SceneBVH::QueryFrustum(int32_t node, const CFrustum& frustum, unsigned int planeMask, std::vector<unsigned int>& ids) const
+{
+	const Node& n = mNodes[node];
+	if (!frustum.Intersects(n.box, planeMask))  return;
+
+	// Everything in a box entirely inside the frustum is visible, no need to test further down
+	if (planeMask == 0)
+	{
+		ids.insert(ids.end(), mOrder.begin() + n.first, mOrder.begin() + n.first + n.count);
+	}
+	else if (n.left < 0)
+	{
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			unsigned int modelMask = planeMask;
+			if (frustum.Intersects(mBounds[mOrder[i]], modelMask))  ids.push_back(mOrder[i]);
+		}
+	}
+	else
+	{
+		QueryFrustum(n.left,  frustum, planeMask, ids);
+		QueryFrustum(n.right, frustum, planeMask, ids);
+	}
+}
+
+
+// Test the models against several volumes in one pass down the tree. Fills masks, indexed by model id, with bit n set if
+// the model may be inside volume n
+void SceneBVH::QueryVolumes(const CConvexVolume* volumes, unsigned int numVolumes, std::vector<uint32_t>& masks) const
+{
+	masks.assign(mBounds.size(), 0);
+	numVolumes = std::min(numVolumes, MAX_VOLUMES);
+	if (mRoot < 0 || numVolumes == 0)  return;
+
+	uint32_t planeMasks[MAX_VOLUMES];
+	for (unsigned int v = 0; v < numVolumes; ++v)  planeMasks[v] = volumes[v].AllPlanes();
+	uint32_t allVolumes = numVolumes == 32 ? ~0u : (1u << numVolumes) - 1;
+	QueryVolumes(mRoot, volumes, numVolumes, allVolumes, planeMasks, masks);
+}
+
+// Each volume is tested as in the single frustum query. activeVolumes holds the volumes that the parent's box is partly
+// inside, only those are tested further down
+void SceneBVH::QueryVolumes(int32_t node, const CConvexVolume* volumes, unsigned int numVolumes, uint32_t activeVolumes,
+                            const uint32_t* parentPlaneMasks, std::vector<uint32_t>& masks) const
+{
+	const Node& n = mNodes[node];
+	uint32_t planeMasks[MAX_VOLUMES];
+	uint32_t insideVolumes = 0; // Volumes the box is entirely inside
+	for (unsigned int v = 0; v < numVolumes; ++v)
+	{
+		uint32_t bit = 1u << v;
+		if ((activeVolumes & bit) == 0)  continue;
+
+		planeMasks[v] = parentPlaneMasks[v];
+		if (!volumes[v].Intersects(n.box, planeMasks[v]))  activeVolumes &= ~bit;
+		else if (planeMasks[v] == 0)                       insideVolumes |= bit;
+	}
+	activeVolumes &= ~insideVolumes;
+
+	// Every model below is in the volumes that contain the whole box
+	if (insideVolumes != 0)
+	{
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)  masks[mOrder[i]] |= insideVolumes;
+	}
+	if (activeVolumes == 0)  return;
+
+	if (n.left < 0)
+	{
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			for (unsigned int v = 0; v < numVolumes; ++v)
+			{
+				uint32_t modelPlaneMask = planeMasks[v];
+				if ((activeVolumes & (1u << v)) != 0 && volumes[v].Intersects(mBounds[mOrder[i]], modelPlaneMask))
+				{
+					masks[mOrder[i]] |= 1u << v;
+				}
+			}
+		}
+	}
+	else
+	{
+		QueryVolumes(n.left,  volumes, numVolumes, activeVolumes, planeMasks, masks);
+		QueryVolumes(n.right, volumes, numVolumes, activeVolumes, planeMasks, masks);
+	}
+}
+
+
+// Models whose bounds overlap a sphere
+void SceneBVH::QuerySphere(const CSphere& sphere, std::vector<unsigned int>& ids) const
+{
+	ids.clear();
+	if (mRoot >= 0)  QuerySphere(mRoot, sphere, ids);
+}
+
+void SceneBVH::QuerySphere(int32_t node, const CSphere& sphere, std::vector<unsigned int>& ids) const
+{
+	const Node& n = mNodes[node];
+	if (!Intersects(sphere, n.box))  return;
+
+	if (n.left < 0)
+	{
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			if (Intersects(sphere, mBounds[mOrder[i]]))  ids.push_back(mOrder[i]);
+		}
+	}
+	else
+	{
+		QuerySphere(n.left,  sphere, ids);
+		QuerySphere(n.right, sphere, ids);
+	}
+}
+
+
+// Models whose bounds a ray hits before the given distance along it, nearest first
+void SceneBVH::QueryRay(const CVector3& origin, const CVector3& direction, float maxDistance, std::vector<unsigned int>& ids) const
+{
+	ids.clear();
+	if (mRoot < 0)  return;
+
+	// Collect the hits with their distances then sort them
+	std::vector<std::pair<float, unsigned int>> hits;
+	CVector3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+	QueryRay(mRoot, origin, inverseDirection, maxDistance, hits);
+	std::sort(hits.begin(), hits.end());
+	for (auto& hit : hits)  ids.push_back(hit.second);
+}
+
+void SceneBVH::QueryRay(int32_t node, const CVector3& origin, const CVector3& inverseDirection, float maxDistance,
+                        std::vector<std::pair<float, unsigned int>>& hits) const
+{
+	const Node& n = mNodes[node];
+	float distance;
+	if (!RayIntersects(origin, inverseDirection, maxDistance, n.box, distance))  return;
+
+	if (n.left < 0)
+	{
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)
+		{
+			if (RayIntersects(origin, inverseDirection, maxDistance, mBounds[mOrder[i]], distance))
+			{
+				hits.push_back({ distance, mOrder[i] });
+			}
+		}
+	}
+	else
+	{
+		QueryRay(n.left,  origin, inverseDirection, maxDistance, hits);
+		QueryRay(n.right, origin, inverseDirection, maxDistance, hits);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private support functions
+//--------------------------------------------------------------------------------------
+
+// Return the index of an unused node
+int32_t SceneBVH::NewNode()
+{
+	if (!mFreeNodes.empty())
+	{
+		int32_t node = mFreeNodes.back();
+		mFreeNodes.pop_back();
+		return node;
+	}
+	mNodes.push_back({});
+	return static_cast<int32_t>(mNodes.size() - 1);
+}
+
+
+// Return the nodes below the given node to the unused list, the node itself is kept
+void SceneBVH::FreeChildren(int32_t node)
+{
+	int32_t left  = mNodes[node].left;
+	int32_t right = mNodes[node].right;
+	if (left < 0)  return;
+
+	FreeChildren(left);
+	FreeChildren(right);
+	mFreeNodes.push_back(left);
+	mFreeNodes.push_back(right);
+	mNodes[node].left = mNodes[node].right = -1;
+}
+
+
+// Build the tree below a node from the models in the given range of mOrder, reordering that range
+void SceneBVH::Build(int32_t node, uint32_t first, uint32_t count)
+{
+	++mNumNodesRebuilt;
+
+	// Bounds of the models and of their centres
+	CAABB box = CAABB::Empty();
+	CAABB centres = CAABB::Empty();
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		box.Expand(mBounds[mOrder[i]]);
+		centres.Expand(mBounds[mOrder[i]].Centre());
+	}
+	float area = box.SurfaceArea();
+	mNodes[node] = { box, area, first, count, -1, -1 };
+	if (count == 1)  return;
+
+	// Split across the axis the centres are most spread along
+	CVector3 spread = centres.maximum - centres.minimum;
+	int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+	float axisStart = Component(centres.minimum, axis);
+	float axisSize  = Component(spread, axis);
+
+	uint32_t split = first + count / 2; // Models at the same place can't be separated, they are split in half
+	if (axisSize > 0)
+	{
+		// Sort the models into equal sized bins along the axis by their centres
+		float binScale = NUM_BINS / axisSize;
+		auto bin = [&](uint32_t id)
+		{
+			return std::min(static_cast<int>((Component(mBounds[id].Centre(), axis) - axisStart) * binScale), NUM_BINS - 1);
+		};
+		CAABB    binBoxes[NUM_BINS];
+		uint32_t binCounts[NUM_BINS] = {};
+		for (auto& binBox : binBoxes)  binBox = CAABB::Empty();
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			int b = bin(mOrder[i]);
+			binBoxes[b].Expand(mBounds[mOrder[i]]);
+			++binCounts[b];
+		}
+
+		// Find the cheapest split between bins. First sweep from the right to get the area and count right of each split
+		float    rightAreas[NUM_BINS];
+		uint32_t rightCounts[NUM_BINS];
+		CAABB    rightBox = CAABB::Empty();
+		uint32_t rightCount = 0;
+		for (int b = NUM_BINS - 1; b > 0; --b)
+		{
+			rightBox.Expand(binBoxes[b]);
+			rightCount += binCounts[b];
+			rightAreas[b]  = rightBox.SurfaceArea();
+			rightCounts[b] = rightCount;
+		}
+		CAABB    leftBox = CAABB::Empty();
+		uint32_t leftCount = 0;
+		float    bestCost = FLT_MAX;
+		int      bestSplit = 0;
+		for (int b = 1; b < NUM_BINS; ++b)
+		{
+			leftBox.Expand(binBoxes[b - 1]);
+			leftCount += binCounts[b - 1];
+			float cost = leftBox.SurfaceArea() * leftCount + rightAreas[b] * rightCounts[b];
+			if (leftCount > 0 && rightCounts[b] > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = b;
+			}
+		}
+
+		// Stop at a leaf if testing all its models is cheaper than splitting
+		if (count <= MAX_LEAF_MODELS && TRAVERSAL_COST * area + bestCost >= area * count)  return;
+
+		if (bestSplit > 0)
+		{
+			auto middle = std::partition(mOrder.begin() + first, mOrder.begin() + first + count,
+			                             [&](uint32_t id) { return bin(id) < bestSplit; });
+			split = static_cast<uint32_t>(middle - mOrder.begin());
+		}
+	}
+	else if (count <= MAX_LEAF_MODELS)
+	{
+		return;
+	}
+
+	// Nodes may move when new ones are made, so set the children afterwards
+	int32_t left  = NewNode();
+	int32_t right = NewNode();
+	mNodes[node].left  = left;
+	mNodes[node].right = right;
+	Build(left,  first, split - first);
+	Build(right, split, first + count - split);
+}
+
+
+// Recalculate the boxes below and including a node from the models' bounds, children first
+void SceneBVH::Refit(int32_t node)
+{
+	Node& n = mNodes[node];
+	if (n.left < 0)
+	{
+		n.box = CAABB::Empty();
+		for (uint32_t i = n.first; i < n.first + n.count; ++i)  n.box.Expand(mBounds[mOrder[i]]);
+	}
+	else
+	{
+		Refit(n.left);
+		Refit(n.right);
+		n.box = Merge(mNodes[n.left].box, mNodes[n.right].box);
+	}
+}
+
+
+// Rebuild the highest nodes that have grown too much since they were built
+void SceneBVH::RebuildLoose(int32_t node)
+{
+	// Copied as rebuilding can move the nodes
+	Node n = mNodes[node];
+	if (n.left < 0)  return;
+
+	if (n.box.SurfaceArea() > LOOSE_GROWTH * n.builtArea)
+	{
+		FreeChildren(node);
+		Build(node, n.first, n.count);
+	}
+	else
+	{
+		RebuildLoose(n.left);
+		RebuildLoose(n.right);
+	}
+}
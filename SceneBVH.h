@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy over the models in the scene, to find the models in a view, near a point or along a ray
+//--------------------------------------------------------------------------------------
+// A binary tree of boxes: each node's box encloses the boxes of the models below it, so a query can skip every model
+// under a node whose box it misses. Culling a view then costs roughly O(log n + visible) rather than testing all n models.
+// The same tree serves any view (camera or light), and picking with rays.
+//
+// The tree is built with the surface area heuristic (SAH): the models at each node are split where the two halves'
+// surface areas times their model counts is least, since the chance of a query reaching a box grows with its surface area
+// (Ingo Wald, "On Fast Construction of SAH-based Bounding Volume Hierarchies", 2007, binned version used here).
+//
+// Each frame the models' new bounds are given with SetBounds, then Update refits the boxes without changing the tree's
+// shape, which is cheap but makes the tree looser as models move apart. Any part of the tree whose box has grown well past its size when built is
+// rebuilt. Adding or removing models rebuilds the whole tree on the next Update.
+//
+// Models are referred to by the id returned when they are added. Queries fill a list of ids. The tree only holds boxes, so
+// it doesn't depend on the Model class and can be built and tested without a window or GPU
+
+#ifndef _SCENE_BVH_H_INCLUDED_
+#define _SCENE_BVH_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CBoundingVolumes.h"
+#include "CFrustum.h"
+#include "CConvexVolume.h"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+
+class SceneBVH
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Add a model with the given bounds. Returns an id for the model, used by queries. Ids of removed models are reused
+	unsigned int Add(const CAABB& box);
+
+	// Give a model's new bounds after it has moved, before the next Update
+	void SetBounds(unsigned int id, const CAABB& box);
+
+	// Remove a model added above
+	void Remove(unsigned int id);
+
+	// Call each frame after models have moved and before querying. Refits the tree to the new bounds and rebuilds any parts
+	// that have become too loose, or the whole tree if anything was added or removed
+	void Update();
+
+	// Rebuild the whole tree from the current bounds
+	void Rebuild();
+
+
+	//-------------------------------------
+	// Queries
+	//-------------------------------------
+	// Each clears the given list then fills it with the ids of the models found. Call Update first if models have moved
+
+	// Models whose bounds may be visible in a frustum (see CFrustum.h)
+	void QueryFrustum(const CFrustum& frustum, std::vector<unsigned int>& ids) const;
+
+	// Test the models against several volumes in one pass down the tree, e.g. the camera's view and each light's shadow
+	// views (see CConvexVolume.h). Up to MAX_VOLUMES volumes. Fills masks, indexed by model id, with bit n set if the model
+	// may be inside volume n. Unlike the other queries this doesn't give a list of ids
+	static const unsigned int MAX_VOLUMES = 32;
+	void QueryVolumes(const CConvexVolume* volumes, unsigned int numVolumes, std::vector<uint32_t>& masks) const;
+
+	// Models whose bounds overlap a sphere
+	void QuerySphere(const CSphere& sphere, std::vector<unsigned int>& ids) const;
+
+	// Models whose bounds a ray hits before the given distance along it, nearest first. Distances are in multiples of the
+	// direction's length
+	void QueryRay(const CVector3& origin, const CVector3& direction, float maxDistance, std::vector<unsigned int>& ids) const;
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	unsigned int NumModels()          { return mNumModels; }
+	unsigned int NumNodes()           { return static_cast<unsigned int>(mNodes.size() - mFreeNodes.size()); }
+	unsigned int NumNodesRebuilt()    { return mNumNodesRebuilt; } // Nodes rebuilt by the last Update, 0 if only refitted
+	const CAABB& Bounds(unsigned int id)  { return mBounds[id]; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Return the index of an unused node
+	int32_t NewNode();
+
+	// Return the nodes below the given node to the unused list, the node itself is kept
+	void FreeChildren(int32_t node);
+
+	// Build the tree below a node from the models in the given range of mOrder, reordering that range
+	void Build(int32_t node, uint32_t first, uint32_t count);
+
+	// Recalculate the boxes below and including a node from the models' bounds, children first
+	void Refit(int32_t node);
+
+	// Rebuild the highest nodes that have grown too much since they were built
+	void RebuildLoose(int32_t node);
+
+	// Recursive parts of the queries above
+	void QueryFrustum(int32_t node, const CFrustum& frustum, unsigned int planeMask, std::vector<unsigned int>& ids) const;
+	void QueryVolumes(int32_t node, const CConvexVolume* volumes, unsigned int numVolumes, uint32_t activeVolumes,
+	                  const uint32_t* planeMasks, std::vector<uint32_t>& masks) const;
+	void QuerySphere (int32_t node, const CSphere& sphere, std::vector<unsigned int>& ids) const;
+	void QueryRay    (int32_t node, const CVector3& origin, const CVector3& inverseDirection, float maxDistance,
+	                  std::vector<std::pair<float, unsigned int>>& hits) const;
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	// Each node's models are the range [first, first + count) of mOrder. Leaves have no children
+	struct Node
+	{
+		CAABB    box;
+		float    builtArea; // Surface area of the box when this part of the tree was last built
+		uint32_t first;
+		uint32_t count;
+		int32_t  left;      // -1 for a leaf
+		int32_t  right;
+	};
+	std::vector<Node>    mNodes;
+	std::vector<int32_t> mFreeNodes; // Unused entries in mNodes, left by partial rebuilds
+	int32_t              mRoot = -1;
+
+	// By id: the model's bounds and whether the id is in use
+	std::vector<CAABB>   mBounds;
+	std::vector<uint8_t> mInUse;
+	std::vector<unsigned int> mFreeIds;
+	unsigned int mNumModels = 0;
+
+	// Ids of the models in use ordered so the models below each node are together
+	std::vector<uint32_t> mOrder;
+
+	bool         mNeedsRebuild = false; // Models have been added or removed since the last build
+	unsigned int mNumNodesRebuilt = 0;
+};
+
+
+#endif //_SCENE_BVH_H_INCLUDED_
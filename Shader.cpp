@@ -4,6 +4,7 @@
 //--------------------------------------------------------------------------------------
 
 #include "Shader.h"
+#include "RenderBackend.h"
 #include <fstream>
 #include <vector>
 #include <d3dcompiler.h>
@@ -19,11 +20,13 @@ ID3D11VertexShader*   gPixelLightingVertexShader      = nullptr;
 ID3D11PixelShader*    gPixelLightingPixelShader       = nullptr;
 ID3D11VertexShader*   gBasicTransformVertexShader     = nullptr;
 ID3D11VertexShader*   gSkinningVertexShader           = nullptr; // Skinning is performed in the vertex shader (matrix work), we can use any pixel shader for lighting etc.
+ID3D11VertexShader*   gSkinningDQVertexShader         = nullptr; // Dual quaternion skinning, for meshes using ESkinningMode::DualQuaternion
 ID3D11PixelShader*    gLightModelPixelShader          = nullptr;
 ID3D11VertexShader*   gWiggleVertexShader             = nullptr;
 ID3D11PixelShader*    gTextureFadePixelShader         = nullptr;
 ID3D11PixelShader*    gSimplePixelShader              = nullptr;
 ID3D11PixelShader*    gDepthOnlyPixelShader           = nullptr;
+ID3D11PixelShader*    gShadowCacheCopyPixelShader     = nullptr; // Copies cached shadow depths into the shadow atlas (see ShadowAtlas.h)
 ID3D11VertexShader*   gNormalMapVertexShader          = nullptr;
 ID3D11PixelShader*    gNormalMapPixelShader           = nullptr;
 ID3D11PixelShader*    gParallaxMapPixelShader         = nullptr;
@@ -57,11 +60,13 @@ bool LoadShaders()
     gPixelLightingPixelShader       = LoadPixelShader ("PixelLighting_ps");
     gBasicTransformVertexShader     = LoadVertexShader("BasicTransform_vs");
     gSkinningVertexShader           = LoadVertexShader("Skinning_vs");
+    gSkinningDQVertexShader         = LoadVertexShader("SkinningDQ_vs");
     gLightModelPixelShader          = LoadPixelShader ("LightModel_ps");
     gWiggleVertexShader             = LoadVertexShader("WiggleShader_vs");
     gTextureFadePixelShader         = LoadPixelShader ("TextureFade_ps");
     gSimplePixelShader              = LoadPixelShader ("TextureAlpha_ps");
     gDepthOnlyPixelShader           = LoadPixelShader ("DepthOnly_ps");
+    gShadowCacheCopyPixelShader     = LoadPixelShader ("ShadowCacheCopy_ps");
     gNormalMapVertexShader          = LoadVertexShader("NormalMapping_vs");
     gNormalMapPixelShader           = LoadPixelShader ("NormalMap_ps");
     gParallaxMapPixelShader         = LoadPixelShader ("ParallaxMapping_ps");
@@ -89,7 +94,8 @@ bool LoadShaders()
         gCubeMapPixelShader             == nullptr || gTintPixelShader               == nullptr ||
         gFullScreenQuadVertexShader     == nullptr || gTintPostProcess               == nullptr ||
         gGreyNoisePostProcess           == nullptr || gBurnPostProcess               == nullptr ||
-        gDistortPostProcess             == nullptr || gSpiralPostProcess             == nullptr)
+        gDistortPostProcess             == nullptr || gSpiralPostProcess             == nullptr ||
+        gSkinningDQVertexShader         == nullptr || gShadowCacheCopyPixelShader    == nullptr)
     {
         gLastError = "Error loading shaders";
         return false;
@@ -103,6 +109,7 @@ void ReleaseShaders()
 {
     if (gLightModelPixelShader)             gLightModelPixelShader->Release();
     if (gSkinningVertexShader)              gSkinningVertexShader->Release();
+    if (gSkinningDQVertexShader)            gSkinningDQVertexShader->Release();
     if (gBasicTransformVertexShader)        gBasicTransformVertexShader->Release();
     if (gPixelLightingPixelShader)          gPixelLightingPixelShader->Release();
     if (gPixelLightingVertexShader)         gPixelLightingVertexShader->Release();
@@ -110,6 +117,7 @@ void ReleaseShaders()
     if (gTextureFadePixelShader)            gTextureFadePixelShader->Release();
     if (gSimplePixelShader)                 gSimplePixelShader->Release();
     if (gDepthOnlyPixelShader)              gDepthOnlyPixelShader->Release();
+    if (gShadowCacheCopyPixelShader)        gShadowCacheCopyPixelShader->Release();
     if (gNormalMapVertexShader)             gNormalMapVertexShader->Release();
     if (gNormalMapPixelShader)              gNormalMapPixelShader->Release();
     if (gParallaxMapPixelShader)            gParallaxMapPixelShader->Release();
@@ -314,15 +322,12 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
 // The returned pointer needs to be released before quitting. Returns nullptr on failure. 
 ID3D11Buffer* CreateConstantBuffer(int size)
 {
-    D3D11_BUFFER_DESC cbDesc;
-    cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    cbDesc.ByteWidth = 16 * ((size + 15) / 16);     // Constant buffer size must be a multiple of 16 - this maths rounds up to the nearest multiple
-    cbDesc.Usage = D3D11_USAGE_DYNAMIC;             // Indicates that the buffer is frequently updated
-    cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE; // CPU is only going to write to the constants (not read them)
-    cbDesc.MiscFlags = 0;
+    RenderBufferDesc cbDesc;
+    cbDesc.type = ERenderBufferType::Constant;
+    cbDesc.size = 16 * ((size + 15) / 16);        // Constant buffer size must be a multiple of 16 - this maths rounds up to the nearest multiple
+    cbDesc.usage = ERenderBufferUsage::Dynamic;   // Indicates that the buffer is frequently updated, the CPU only writes to it
     ID3D11Buffer* constantBuffer;
-    HRESULT hr = gD3DDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer);
-    if (FAILED(hr))
+    if (!gRenderBackend->CreateBuffer(cbDesc, nullptr, &constantBuffer))
     {
         return nullptr;
     }
@@ -19,11 +19,13 @@ extern ID3D11VertexShader*   gPixelLightingVertexShader;
 extern ID3D11PixelShader*    gPixelLightingPixelShader;
 extern ID3D11VertexShader*   gBasicTransformVertexShader;
 extern ID3D11VertexShader*   gSkinningVertexShader; // Skinning is performed in the vertex shader (matrix work), we can use any pixel shader for lighting etc.
+extern ID3D11VertexShader*   gSkinningDQVertexShader; // Dual quaternion skinning, for meshes using ESkinningMode::DualQuaternion
 extern ID3D11PixelShader*    gLightModelPixelShader;
 extern ID3D11VertexShader*   gWiggleVertexShader;
 extern ID3D11PixelShader*    gTextureFadePixelShader;
 extern ID3D11PixelShader*    gSimplePixelShader;
 extern ID3D11PixelShader*    gDepthOnlyPixelShader;
+extern ID3D11PixelShader*    gShadowCacheCopyPixelShader; // Copies cached shadow depths into the shadow atlas (see ShadowAtlas.h)
 extern ID3D11VertexShader*   gNormalMapVertexShader;
 extern ID3D11PixelShader*    gNormalMapPixelShader;
 extern ID3D11PixelShader*    gParallaxMapPixelShader;
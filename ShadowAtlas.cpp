@@ -0,0 +1,579 @@
+//--------------------------------------------------------------------------------------
+// Shadow atlas - shares one large shadow map between many shadow views and redraws only what changed
+//--------------------------------------------------------------------------------------
+
+#include "ShadowAtlas.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <algorithm>
+
+
+// A view's tile only changes size once its ideal size is this many octaves past the point between two sizes
+static const float SIZE_HYSTERESIS = 0.25f;
+
+// Whether two matrices are exactly the same, so anything drawn with them is too
+static bool SameMatrix(const CMatrix4x4& a, const CMatrix4x4& b)
+{
+	return std::memcmp(&a, &b, sizeof(CMatrix4x4)) == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// An atlas of the given size in texels, with tiles from the minimum to the maximum size. All sizes must be powers of two
+ShadowAtlas::ShadowAtlas(unsigned int size, unsigned int maxTileSize, unsigned int minTileSize)
+	: mSize(size), mMaxTileSize(std::min(maxTileSize, size)), mMinTileSize(std::min(minTileSize, maxTileSize))
+{
+	mFreeTiles.resize(Level(mMinTileSize) + 1);
+	mFreeTiles[0].push_back(0); // The whole atlas
+}
+
+
+// Record where a caster is this frame, call for every caster each frame after BeginFrame and before Allocate. Pass
+// animated = true for casters that change shape without their world matrix changing
+void ShadowAtlas::UpdateCaster(unsigned int id, const CMatrix4x4& worldMatrix, bool animated)
+{
+	if (id >= mCasters.size())  mCasters.resize(id + 1);
+	Caster& caster = mCasters[id];
+
+	bool unchanged = !animated && caster.lastFrame + 1 == mFrame && SameMatrix(caster.worldMatrix, worldMatrix);
+	caster.framesUnchanged = unchanged ? std::min(caster.framesUnchanged + 1, STATIC_FRAMES) : 0;
+	caster.worldMatrix = worldMatrix;
+	caster.lastFrame = mFrame;
+}
+
+
+// Start a new frame, removing the views of the last frame
+void ShadowAtlas::BeginFrame()
+{
+	++mFrame;
+	mNumViews = 0;
+}
+
+
+// Ask for a tile for a view this frame. Importance is from 0 to 1, the fraction of the screen the view affects (see
+// ShadowImportance below). Each view this frame needs a different key. The casters are those that may cast a shadow in
+// the view, they are copied
+void ShadowAtlas::AddView(uint32_t key, float importance, const CMatrix4x4& viewMatrix, const CMatrix4x4& projectionMatrix,
+                          const unsigned int* casterIds, unsigned int numCasters)
+{
+	if (mNumViews == mViews.size())  mViews.emplace_back();
+	View& view = mViews[mNumViews++];
+	view.key        = key;
+	view.importance = std::min(std::max(importance, 0.0f), 1.0f);
+	view.viewMatrix       = viewMatrix;
+	view.projectionMatrix = projectionMatrix;
+	view.casters.assign(casterIds, casterIds + numCasters);
+}
+
+
+// Give each view added since BeginFrame a tile and decide how each tile must be updated
+void ShadowAtlas::Allocate()
+{
+	mNumFullUpdates = mNumDynamicUpdates = mNumTilesMoved = 0;
+	mRepacked = false;
+
+	// Free the tiles of views not seen this frame
+	for (unsigned int i = 0; i < mNumViews; ++i)  mTiles[mViews[i].key].lastFrame = mFrame;
+	for (auto tile = mTiles.begin(); tile != mTiles.end(); )
+	{
+		if (tile->second.lastFrame == mFrame)  { ++tile;  continue; }
+		if (tile->second.size > 0)  FreeTile(tile->second.x, tile->second.y, tile->second.size);
+		tile = mTiles.erase(tile);
+	}
+
+	// Choose tile sizes, then while they don't fit halve the least important view that can be halved. If every view is at
+	// the minimum size drop the least important views instead
+	mOrder.resize(mNumViews);
+	uint64_t totalArea = 0;
+	for (unsigned int i = 0; i < mNumViews; ++i)
+	{
+		View& view = mViews[i];
+		view.size = ChooseTileSize(view.importance, mTiles[view.key].size);
+		totalArea += static_cast<uint64_t>(view.size) * view.size;
+		mOrder[i] = i;
+	}
+	std::stable_sort(mOrder.begin(), mOrder.end(), [&](unsigned int a, unsigned int b) { return mViews[a].importance > mViews[b].importance; });
+	const uint64_t atlasArea = static_cast<uint64_t>(mSize) * mSize;
+	while (totalArea > atlasArea)
+	{
+		View* shrink = nullptr;
+		for (auto i = mOrder.rbegin(); i != mOrder.rend() && !shrink; ++i)  if (mViews[*i].size > mMinTileSize)  shrink = &mViews[*i];
+		for (auto i = mOrder.rbegin(); i != mOrder.rend() && !shrink; ++i)  if (mViews[*i].size > 0)             shrink = &mViews[*i];
+
+		totalArea -= static_cast<uint64_t>(shrink->size) * shrink->size;
+		shrink->size = (shrink->size > mMinTileSize) ? shrink->size / 2 : 0;
+		totalArea += static_cast<uint64_t>(shrink->size) * shrink->size;
+	}
+	mTexelsUsed = static_cast<unsigned int>(std::min<uint64_t>(totalArea, UINT32_MAX));
+
+	// Free the tiles that are changing size, then place the new tiles largest first. If one won't fit pack them all again
+	mMoved.assign(mNumViews, 0);
+	for (unsigned int i = 0; i < mNumViews; ++i)
+	{
+		Tile& tile = mTiles[mViews[i].key];
+		if (tile.size == mViews[i].size)  continue;
+		if (tile.size > 0)  FreeTile(tile.x, tile.y, tile.size);
+		tile.size = 0;
+		mMoved[i] = mViews[i].size > 0 ? 1 : 0;
+	}
+	std::stable_sort(mOrder.begin(), mOrder.end(), [&](unsigned int a, unsigned int b) { return mViews[a].size > mViews[b].size; });
+	for (unsigned int i : mOrder)
+	{
+		Tile& tile = mTiles[mViews[i].key];
+		if (!mMoved[i])  continue;
+		if (!AllocateTile(mViews[i].size, tile.x, tile.y))
+		{
+			Repack();
+			mRepacked = true;
+			break;
+		}
+		tile.size = mViews[i].size;
+	}
+
+	// Decide how to update each tile
+	for (unsigned int i = 0; i < mNumViews; ++i)
+	{
+		View& view = mViews[i];
+		Tile& tile = mTiles[view.key];
+		view.x = tile.x;
+		view.y = tile.y;
+		view.staticCasters.clear();
+		view.dynamicCasters.clear();
+		if (view.size == 0)
+		{
+			view.update = EShadowUpdate::None;
+			tile.cachedCasters.clear();
+			continue;
+		}
+		for (unsigned int id : view.casters)  (IsStatic(id) ? view.staticCasters : view.dynamicCasters).push_back(id);
+		std::sort(view.staticCasters.begin(), view.staticCasters.end());
+
+		// The cache must be redrawn if the tile was invalidated, the tile or view changed, a static caster isn't in it yet,
+		// or a cached caster has started moving. Casters that are cached but no longer in the view can stay
+		bool full = tile.invalid || mMoved[i] || !SameMatrix(tile.viewMatrix, view.viewMatrix) || !SameMatrix(tile.projectionMatrix, view.projectionMatrix);
+		for (auto id = view.staticCasters.begin(); id != view.staticCasters.end() && !full; ++id)
+		{
+			full = !std::binary_search(tile.cachedCasters.begin(), tile.cachedCasters.end(), *id);
+		}
+		for (auto id = tile.cachedCasters.begin(); id != tile.cachedCasters.end() && !full; ++id)
+		{
+			full = !IsStatic(*id);
+		}
+
+		if (full)
+		{
+			view.update = EShadowUpdate::Full;
+			tile.cachedCasters = view.staticCasters;
+			tile.invalid = false;
+			++mNumFullUpdates;
+		}
+		else if (!view.dynamicCasters.empty() || tile.hadDynamicCasters)
+		{
+			view.update = EShadowUpdate::Dynamic; // Also when dynamic casters have just left, to remove them
+			++mNumDynamicUpdates;
+		}
+		else
+		{
+			view.update = EShadowUpdate::None;
+		}
+		tile.viewMatrix       = view.viewMatrix;
+		tile.projectionMatrix = view.projectionMatrix;
+		tile.hadDynamicCasters = !view.dynamicCasters.empty();
+		mNumTilesMoved += mMoved[i];
+	}
+}
+
+
+// Forget what the tiles hold, so each view is updated in full the next time it is allocated
+void ShadowAtlas::Invalidate()
+{
+	for (auto& tile : mTiles)  tile.second.invalid = true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private support functions
+//--------------------------------------------------------------------------------------
+
+// Tile size for a view of the given importance that has the given tile size now (0 if none). Tile area follows
+// importance, so the ideal size follows its square root
+unsigned int ShadowAtlas::ChooseTileSize(float importance, unsigned int currentSize)
+{
+	float idealSize = std::max(mMaxTileSize * std::sqrt(importance), static_cast<float>(mMinTileSize));
+	if (currentSize > 0 && std::fabs(std::log2(idealSize / currentSize)) < 0.5f + SIZE_HYSTERESIS)  return currentSize;
+
+	unsigned int size = 1u << static_cast<unsigned int>(std::lround(std::log2(idealSize)));
+	return std::min(std::max(size, mMinTileSize), mMaxTileSize);
+}
+
+
+// Take a free tile of the given size, returning false if there is none. Uses the smallest free tile that is large
+// enough, splitting it into four until it is the right size. The free tile nearest the top-left is used, so packing is
+// the same each time
+bool ShadowAtlas::AllocateTile(unsigned int size, unsigned int& x, unsigned int& y)
+{
+	unsigned int level = Level(size);
+	int freeLevel = static_cast<int>(level);
+	while (freeLevel >= 0 && mFreeTiles[freeLevel].empty())  --freeLevel;
+	if (freeLevel < 0)  return false;
+
+	std::vector<uint32_t>& freeTiles = mFreeTiles[freeLevel];
+	auto nearest = std::min_element(freeTiles.begin(), freeTiles.end());
+	x = *nearest >> 16;
+	y = *nearest & 0xffff;
+	*nearest = freeTiles.back();
+	freeTiles.pop_back();
+
+	// Keep the top-left quarter and free the rest, down to the size needed
+	for (unsigned int l = freeLevel + 1; l <= level; ++l)
+	{
+		unsigned int half = mSize >> l;
+		mFreeTiles[l].push_back((x + half) << 16 | y);
+		mFreeTiles[l].push_back(x << 16 | (y + half));
+		mFreeTiles[l].push_back((x + half) << 16 | (y + half));
+	}
+	return true;
+}
+
+
+// Free a tile, joining it with its three neighbours into a larger free tile when all four are free
+void ShadowAtlas::FreeTile(unsigned int x, unsigned int y, unsigned int size)
+{
+	unsigned int level = Level(size);
+	while (level > 0)
+	{
+		// The tiles sharing this tile's parent, other than this one
+		unsigned int parentX = x & ~(2 * size - 1), parentY = y & ~(2 * size - 1);
+		uint32_t neighbours[3];
+		unsigned int numNeighbours = 0;
+		for (unsigned int corner = 0; corner < 4; ++corner)
+		{
+			unsigned int cornerX = parentX + (corner & 1) * size, cornerY = parentY + (corner >> 1) * size;
+			if (cornerX != x || cornerY != y)  neighbours[numNeighbours++] = cornerX << 16 | cornerY;
+		}
+
+		std::vector<uint32_t>& freeTiles = mFreeTiles[level];
+		bool allFree = true;
+		for (uint32_t neighbour : neighbours)
+		{
+			allFree = allFree && std::find(freeTiles.begin(), freeTiles.end(), neighbour) != freeTiles.end();
+		}
+		if (!allFree)  break;
+
+		for (uint32_t neighbour : neighbours)  freeTiles.erase(std::find(freeTiles.begin(), freeTiles.end(), neighbour));
+		x = parentX;
+		y = parentY;
+		size *= 2;
+		--level;
+	}
+	mFreeTiles[level].push_back(x << 16 | y);
+}
+
+
+// Level in the quadtree of tiles of the given size, 0 for the whole atlas
+unsigned int ShadowAtlas::Level(unsigned int size)
+{
+	unsigned int level = 0;
+	while ((mSize >> level) > size)  ++level;
+	return level;
+}
+
+
+// Free every tile and give each view with a size a new tile, largest first. Placing power of two tiles largest first
+// leaves no gaps, so this always succeeds when the total area fits. Expects mOrder sorted largest first
+void ShadowAtlas::Repack()
+{
+	for (auto& freeTiles : mFreeTiles)  freeTiles.clear();
+	mFreeTiles[0].push_back(0);
+
+	for (unsigned int i : mOrder)
+	{
+		Tile& tile = mTiles[mViews[i].key];
+		if (mViews[i].size == 0)  continue;
+
+		unsigned int x, y;
+		AllocateTile(mViews[i].size, x, y);
+		if (tile.size != mViews[i].size || tile.x != x || tile.y != y)  mMoved[i] = 1;
+		tile.x = x;
+		tile.y = y;
+		tile.size = mViews[i].size;
+	}
+}
+
+
+// Importance of the shadow view of a light reaching the given distance from its position: roughly the fraction of the
+// screen its light covers, seen from a camera at the given position with the given tan(half the field of view). From 0
+// to 1, 1 when the camera is within the light's reach
+float ShadowImportance(const CVector3& cameraPosition, float tanHalfFOV, const CVector3& lightPosition, float range)
+{
+	float distance = Length(lightPosition - cameraPosition);
+	if (distance <= range)  return 1.0f;
+
+	// Radius of the lit sphere on screen as a fraction of half the screen's width, squared for the area
+	float screenRadius = range / (distance * tanHalfFOV);
+	return std::min(screenRadius * screenRadius, 1.0f);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Count the problems with the tiles given by the last Allocate: tiles outside the atlas, overlapping, of a size that isn't
+// allowed or adding up to more than the atlas
+static unsigned int CheckTiles(ShadowAtlas& atlas, unsigned int minTileSize, unsigned int maxTileSize)
+{
+	unsigned int numErrors = 0;
+	uint64_t totalArea = 0;
+	for (unsigned int i = 0; i < atlas.NumViews(); ++i)
+	{
+		const ShadowAtlas::View& a = atlas.GetView(i);
+		if (a.size == 0)  continue;
+		totalArea += static_cast<uint64_t>(a.size) * a.size;
+		if (a.size < minTileSize || a.size > maxTileSize || (a.size & (a.size - 1)) != 0)  ++numErrors;
+		if (a.x % a.size != 0 || a.y % a.size != 0 || a.x + a.size > atlas.Size() || a.y + a.size > atlas.Size())  ++numErrors;
+		for (unsigned int j = 0; j < i; ++j)
+		{
+			const ShadowAtlas::View& b = atlas.GetView(j);
+			if (b.size > 0 && a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size)  ++numErrors;
+		}
+	}
+	if (totalArea > static_cast<uint64_t>(atlas.Size()) * atlas.Size())  ++numErrors;
+	return numErrors;
+}
+
+
+// Run the atlas through a scripted scene of moving lights and casters and check that:
+// - tiles are inside the atlas, don't overlap, are powers of two within the size limits and fit the atlas
+// - tiles stay put while importances don't change, and small changes in importance don't change tile sizes
+// - unchanged views are skipped, moving casters give dynamic updates, and moving lights, moved tiles and casters that
+//   start or stop moving give full updates
+// Then times Allocate for many views. Writes a report including the casters drawn per frame with and without the cache to
+// the given stream and returns the number of checks failed
+unsigned int RunShadowAtlasBenchmark(std::ostream& report, unsigned int numViews /*= 64*/, unsigned int numFrames /*= 200*/)
+{
+	const unsigned int ATLAS_SIZE = 4096, MAX_TILE_SIZE = 2048, MIN_TILE_SIZE = 128;
+	std::vector<std::string> failures;
+	auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+
+	//// Packing random views ////
+	// Importances change a lot between frames so tiles are freed and placed in many patterns
+	unsigned int numTileErrors = 0, numRepacks = 0;
+	{
+		ShadowAtlas atlas(ATLAS_SIZE, MAX_TILE_SIZE, MIN_TILE_SIZE);
+		std::vector<uint32_t> keys(2 * numViews);
+		for (unsigned int k = 0; k < keys.size(); ++k)  keys[k] = k;
+		for (unsigned int frame = 0; frame < 1000; ++frame)
+		{
+			// A random selection of the keys, so some views stay and some come and go
+			atlas.BeginFrame();
+			unsigned int frameViews = 1 + rand() % numViews;
+			for (unsigned int v = 0; v < frameViews; ++v)
+			{
+				std::swap(keys[v], keys[v + rand() % (keys.size() - v)]);
+				float importance = Random(0, 1);
+				atlas.AddView(keys[v], importance * importance, MatrixIdentity(), MatrixIdentity(), nullptr, 0);
+			}
+			atlas.Allocate();
+			numTileErrors += CheckTiles(atlas, MIN_TILE_SIZE, MAX_TILE_SIZE);
+			numRepacks += atlas.Repacked() ? 1 : 0;
+		}
+	}
+	check(numTileErrors == 0, "tiles overlap, are outside the atlas or are the wrong size");
+
+	//// Stable tiles ////
+	// Unchanged importances keep their tiles, and so do importances wobbling by a few percent (with views that fit in the
+	// atlas without halving any)
+	{
+		ShadowAtlas atlas(ATLAS_SIZE, MAX_TILE_SIZE, MIN_TILE_SIZE);
+		std::vector<float> importances(numViews);
+		for (auto& importance : importances)  importance = Random(0, 0.05f);
+		bool stable = true;
+		for (unsigned int frame = 0; frame < 20; ++frame)
+		{
+			atlas.BeginFrame();
+			for (unsigned int v = 0; v < numViews; ++v)
+			{
+				float wobble = (frame < 10) ? 1.0f : Random(0.95f, 1.05f);
+				atlas.AddView(v, importances[v] * wobble, MatrixIdentity(), MatrixIdentity(), nullptr, 0);
+			}
+			atlas.Allocate();
+			if (frame > 0)  stable = stable && atlas.NumTilesMoved() == 0 && atlas.NumFullUpdates() == 0;
+		}
+		check(stable, "tiles moved while importances were steady");
+	}
+
+	//// Invalidation ////
+	// View 0 sees casters 0-3, view 1 sees casters 0-1 and the animated caster 4
+	{
+		ShadowAtlas atlas(ATLAS_SIZE, MAX_TILE_SIZE, MIN_TILE_SIZE);
+		CMatrix4x4 casterMatrices[5] = { MatrixTranslation({ 0, 0, 0 }), MatrixTranslation({ 10, 0, 0 }), MatrixTranslation({ 20, 0, 0 }),
+		                                 MatrixTranslation({ 30, 0, 0 }), MatrixTranslation({ 40, 0, 0 }) };
+		CMatrix4x4 lightMatrix = MatrixTranslation({ 0, 50, 0 });
+		std::vector<unsigned int> casters0 = { 0, 1, 2, 3 }, casters1 = { 0, 1, 4 };
+		auto runFrame = [&]()
+		{
+			atlas.BeginFrame();
+			for (unsigned int id = 0; id < 5; ++id)  atlas.UpdateCaster(id, casterMatrices[id], id == 4);
+			atlas.AddView(100, 0.5f, lightMatrix,      MatrixIdentity(), casters0.data(), static_cast<unsigned int>(casters0.size()));
+			atlas.AddView(200, 0.2f, MatrixIdentity(), MatrixIdentity(), casters1.data(), static_cast<unsigned int>(casters1.size()));
+			atlas.Allocate();
+		};
+		auto updates = [&](EShadowUpdate update0, EShadowUpdate update1)
+		{
+			return atlas.GetView(0).update == update0 && atlas.GetView(1).update == update1;
+		};
+
+		// New views are drawn in full, then casters count as moving until they have been still for a while
+		runFrame();
+		check(updates(EShadowUpdate::Full, EShadowUpdate::Full), "new views not drawn in full");
+		runFrame();
+		check(updates(EShadowUpdate::Dynamic, EShadowUpdate::Dynamic), "casters not yet still aren't drawn each frame");
+		bool becameStatic = false;
+		for (unsigned int frame = 0; frame < 100 && !becameStatic; ++frame)
+		{
+			runFrame();
+			becameStatic = updates(EShadowUpdate::Full, EShadowUpdate::Full);
+		}
+		check(becameStatic && atlas.GetView(0).staticCasters.size() == 4 && atlas.GetView(1).dynamicCasters.size() == 1,
+		      "still casters never moved into the cache");
+
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::Dynamic), "unchanged view not skipped, or animated caster not drawn");
+
+		// A cached caster starts moving, so its view is redrawn without it. Once it stops it is drawn over the cache until
+		// it has been still long enough to go back in
+		casterMatrices[3] = MatrixTranslation({ 30, 5, 0 });
+		runFrame();
+		check(updates(EShadowUpdate::Full, EShadowUpdate::Dynamic) && atlas.GetView(0).dynamicCasters.size() == 1,
+		      "moving a cached caster didn't redraw its view");
+		runFrame();
+		check(updates(EShadowUpdate::Dynamic, EShadowUpdate::Dynamic), "recently moved caster not drawn over the cache");
+		unsigned int numDynamic = 0;
+		while (atlas.GetView(0).update == EShadowUpdate::Dynamic && numDynamic < 100)
+		{
+			runFrame();
+			++numDynamic;
+		}
+		check(atlas.GetView(0).update == EShadowUpdate::Full && atlas.GetView(0).staticCasters.size() == 4,
+		      "caster that stopped moving never went back in the cache");
+
+		// A caster leaving the view (e.g. culled) stays in the cache, but one joining the view must be drawn into it
+		casters0 = { 0, 1, 3 };
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::Dynamic), "caster leaving a view caused a redraw");
+		casters0 = { 0, 1, 2, 3 };
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::Dynamic), "cached caster rejoining a view caused a redraw");
+		casters1 = { 0, 1, 2, 4 };
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::Full), "caster joining a view wasn't drawn into the cache");
+
+		// Moving the light redraws only its own view, and the animated caster leaving needs one more update to remove it
+		lightMatrix = MatrixTranslation({ 0, 60, 0 });
+		casters1 = { 0, 1, 2 };
+		runFrame();
+		check(updates(EShadowUpdate::Full, EShadowUpdate::Dynamic), "moving a light didn't redraw its view");
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::None), "unchanged views not skipped");
+
+		// Invalidating the atlas redraws every view in full, once
+		atlas.Invalidate();
+		runFrame();
+		check(updates(EShadowUpdate::Full, EShadowUpdate::Full), "views not drawn in full after invalidating the atlas");
+		runFrame();
+		check(updates(EShadowUpdate::None, EShadowUpdate::None), "views not skipped after being redrawn");
+	}
+
+	//// Simulated scene ////
+	// Views with a few dozen casters each, one caster in fifty animated and a few others moving now and then. Each
+	// light moves occasionally and the importances drift as if the camera were moving
+	const unsigned int NUM_CASTERS = 500, CASTERS_PER_VIEW = 30;
+	ShadowAtlas atlas(ATLAS_SIZE, MAX_TILE_SIZE, MIN_TILE_SIZE);
+	std::vector<CMatrix4x4> casterMatrices(NUM_CASTERS);
+	std::vector<uint8_t>    animated(NUM_CASTERS);
+	for (unsigned int id = 0; id < NUM_CASTERS; ++id)
+	{
+		casterMatrices[id] = MatrixTranslation({ Random(-500, 500), 0, Random(-500, 500) });
+		animated[id] = (rand() % 50 == 0) ? 1 : 0;
+	}
+	std::vector<std::vector<unsigned int>> viewCasters(numViews);
+	std::vector<CMatrix4x4> lightMatrices(numViews);
+	std::vector<float>      importances(numViews);
+	for (unsigned int v = 0; v < numViews; ++v)
+	{
+		for (unsigned int c = 0; c < CASTERS_PER_VIEW; ++c)  viewCasters[v].push_back(rand() % NUM_CASTERS);
+		std::sort(viewCasters[v].begin(), viewCasters[v].end());
+		viewCasters[v].erase(std::unique(viewCasters[v].begin(), viewCasters[v].end()), viewCasters[v].end());
+		lightMatrices[v] = MatrixTranslation({ Random(-500, 500), 50, Random(-500, 500) });
+		float importance = Random(0, 0.5f);
+		importances[v] = importance * importance;
+	}
+
+	Timer timer;
+	timer.GetLapTime();
+	float allocateTime = 0;
+	uint64_t numCasterDraws = 0, numUncachedDraws = 0, numFull = 0, numDynamic = 0, numMoved = 0;
+	unsigned int numSimulationErrors = 0;
+	for (unsigned int frame = 0; frame < numFrames; ++frame)
+	{
+		for (unsigned int id = 0; id < NUM_CASTERS; ++id)
+		{
+			if (rand() % 200 == 0)  casterMatrices[id] = casterMatrices[id] * MatrixTranslation({ 1, 0, 0 });
+		}
+		for (unsigned int v = 0; v < numViews; ++v)
+		{
+			if (rand() % 100 == 0)  lightMatrices[v] = lightMatrices[v] * MatrixTranslation({ 0, 0, 1 });
+			importances[v] = std::min(std::max(importances[v] * Random(0.97f, 1.03f), 0.0f), 1.0f);
+		}
+
+		timer.GetLapTime();
+		atlas.BeginFrame();
+		for (unsigned int id = 0; id < NUM_CASTERS; ++id)  atlas.UpdateCaster(id, casterMatrices[id], animated[id] != 0);
+		for (unsigned int v = 0; v < numViews; ++v)
+		{
+			atlas.AddView(v, importances[v], lightMatrices[v], MatrixIdentity(),
+			              viewCasters[v].data(), static_cast<unsigned int>(viewCasters[v].size()));
+		}
+		atlas.Allocate();
+		allocateTime += timer.GetLapTime();
+
+		numSimulationErrors += CheckTiles(atlas, MIN_TILE_SIZE, MAX_TILE_SIZE);
+		for (unsigned int v = 0; v < atlas.NumViews(); ++v)
+		{
+			const ShadowAtlas::View& view = atlas.GetView(v);
+			if (view.size == 0)  continue;
+			if (view.update == EShadowUpdate::Full)     numCasterDraws += view.staticCasters.size();
+			if (view.update != EShadowUpdate::None)     numCasterDraws += view.dynamicCasters.size();
+			numUncachedDraws += view.casters.size();
+		}
+		numFull    += atlas.NumFullUpdates();
+		numDynamic += atlas.NumDynamicUpdates();
+		numMoved   += atlas.NumTilesMoved();
+	}
+	check(numSimulationErrors == 0, "tiles overlap in the simulated scene");
+
+	report.precision(3);
+	report << std::fixed;
+	report << "Shadow atlas benchmark: " << ATLAS_SIZE << "x" << ATLAS_SIZE << " atlas, tiles " << MIN_TILE_SIZE << " to "
+	       << MAX_TILE_SIZE << ", " << numViews << " views, " << NUM_CASTERS << " casters, " << numFrames << " frames\n"
+	       << "  Allocate: " << allocateTime * 1000000.0f / numFrames << "us per frame, atlas " << 100.0f * atlas.TexelsUsed() / (ATLAS_SIZE * ATLAS_SIZE)
+	       << "% used in the last frame\n"
+	       << "  Views per frame updated in full: " << static_cast<float>(numFull) / numFrames << ", dynamic only: "
+	       << static_cast<float>(numDynamic) / numFrames << ", skipped: " << numViews - static_cast<float>(numFull + numDynamic) / numFrames
+	       << ", tiles moved: " << static_cast<float>(numMoved) / numFrames << "\n"
+	       << "  Casters drawn per frame: " << static_cast<float>(numCasterDraws) / numFrames << ", without the cache: "
+	       << static_cast<float>(numUncachedDraws) / numFrames << "\n"
+	       << "  Repacks in 1000 frames of random views: " << numRepacks << "\n"
+	       << "  Checks: " << (failures.empty() ? "all passed" : std::to_string(failures.size()) + " FAILED") << "\n";
+	for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+	return static_cast<unsigned int>(failures.size());
+}
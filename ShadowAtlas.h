@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------------------------
+// Shadow atlas - shares one large shadow map between many shadow views and redraws only what changed
+//--------------------------------------------------------------------------------------
+// Every shadow view (e.g. a spotlight) is given a square tile of one large depth texture, sized by how much of the screen
+// it affects: tiles are powers of two and the most important views get the largest. Tiles are handed out by a quadtree
+// (buddy) allocator, so a tile can be freed and its space reused without moving the others. A view keeps its tile from
+// frame to frame unless its importance changes enough to need a different size, and when the tiles won't all fit the least
+// important are halved. If the free space becomes too broken up to place a tile, every tile is packed again.
+//
+// Most shadow casters don't move, so their depth is drawn once into a cache texture of the same size as the atlas and kept.
+// Each frame a view's tile is then updated in one of three ways (see EShadowUpdate):
+//   - Full:    the view, its tile or its cached casters changed - draw the static casters into the cache, then update as below
+//   - Dynamic: copy the cached tile into the atlas, then draw the moving casters over it
+//   - None:    nothing the tile shows has changed, leave it as it is
+// A caster counts as static once its world matrix has stayed the same for a few frames (STATIC_FRAMES) and it isn't marked
+// as animated (skinned or deformed in the vertex shader, which the world matrix doesn't show).
+//
+// The cache may hold casters that are no longer in a view's caster list, e.g. culled because the camera turned away. Their
+// depth is still correct, so they are only removed on the next full update. Casters are referred to by ids chosen by the
+// caller (the scene uses BVH ids), views by a key that stays the same from frame to frame.
+//
+// Uses only the maths classes and the standard library - this class decides what to draw, the caller draws it - so it can
+// be built and tested without a window or GPU
+
+#ifndef _SHADOW_ATLAS_H_INCLUDED_
+#define _SHADOW_ATLAS_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+#include <cstdint>
+
+
+// How a view's tile must be updated this frame, see the top of this file
+enum class EShadowUpdate
+{
+	None,
+	Dynamic,
+	Full,
+};
+
+
+class ShadowAtlas
+{
+public:
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// An atlas of the given size in texels, with tiles from the minimum to the maximum size. All sizes must be powers of two
+	ShadowAtlas(unsigned int size = 4096, unsigned int maxTileSize = 2048, unsigned int minTileSize = 128);
+
+	// Record where a caster is this frame, call for every caster each frame after BeginFrame and before Allocate. Pass
+	// animated = true for casters that change shape without their world matrix changing
+	void UpdateCaster(unsigned int id, const CMatrix4x4& worldMatrix, bool animated);
+
+	// Start a new frame, removing the views of the last frame
+	void BeginFrame();
+
+	// Ask for a tile for a view this frame. Importance is from 0 to 1, the fraction of the screen the view affects (see
+	// ShadowImportance below). Each view this frame needs a different key. The casters are those that may cast a shadow in
+	// the view, they are copied
+	void AddView(uint32_t key, float importance, const CMatrix4x4& viewMatrix, const CMatrix4x4& projectionMatrix,
+	             const unsigned int* casterIds, unsigned int numCasters);
+
+	// Give each view added since BeginFrame a tile and decide how each tile must be updated
+	void Allocate();
+
+	// Forget what the tiles hold, so each view is updated in full the next time it is allocated. Call when the atlas and
+	// cache textures may not hold what was decided, e.g. after rendering through a backend that draws nothing
+	void Invalidate();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// A view's tile and what to draw in it, after Allocate
+	struct View
+	{
+		uint32_t      key;
+		float         importance;
+		CMatrix4x4    viewMatrix;
+		CMatrix4x4    projectionMatrix;
+		unsigned int  x, y, size; // Tile position and size in texels, size is 0 if there was no room for the view
+		EShadowUpdate update;
+
+		std::vector<unsigned int> casters;        // As passed to AddView
+		std::vector<unsigned int> staticCasters;  // To draw into the cache on a full update
+		std::vector<unsigned int> dynamicCasters; // To draw over the cached depth on a full or dynamic update
+	};
+
+	unsigned int NumViews()                  { return mNumViews; }
+	const View&  GetView(unsigned int index) { return mViews[index]; } // In the order they were added
+
+	unsigned int Size()  { return mSize; }
+
+	// Whether a caster counts as static, i.e. can be drawn into the cache. Casters not updated this frame don't
+	bool IsStatic(unsigned int id)
+	{
+		return id < mCasters.size() && mCasters[id].lastFrame == mFrame && mCasters[id].framesUnchanged >= STATIC_FRAMES;
+	}
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// From the last Allocate
+	unsigned int NumFullUpdates()     { return mNumFullUpdates; }
+	unsigned int NumDynamicUpdates()  { return mNumDynamicUpdates; }
+	unsigned int NumTilesMoved()      { return mNumTilesMoved; } // Views given a new tile, including new views
+	bool         Repacked()           { return mRepacked; }       // All tiles were packed again
+	unsigned int TexelsUsed()         { return mTexelsUsed; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Tile size for a view of the given importance that has the given tile size now (0 if none). Sizes only change when
+	// the importance has moved well past the point between two sizes, so views near that point don't switch back and forth
+	unsigned int ChooseTileSize(float importance, unsigned int currentSize);
+
+	// Quadtree allocator: take a free tile of the given size, returning false if there is none, or free a tile. Freed tiles
+	// are joined with their three neighbours into a larger free tile when all four are free
+	bool AllocateTile(unsigned int size, unsigned int& x, unsigned int& y);
+	void FreeTile(unsigned int x, unsigned int y, unsigned int size);
+
+	// Level in the quadtree of tiles of the given size, 0 for the whole atlas
+	unsigned int Level(unsigned int size);
+
+	// Free every tile and give each view with a size a new tile, largest first. Always succeeds if the sizes fit the atlas
+	void Repack();
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	// Frames a caster must stay still before it counts as static
+	static const unsigned int STATIC_FRAMES = 16;
+
+	unsigned int mSize, mMaxTileSize, mMinTileSize;
+	unsigned int mFrame = 0;
+
+	// Free tiles at each level of the quadtree, position packed as x << 16 | y
+	std::vector<std::vector<uint32_t>> mFreeTiles;
+
+	// Casters by id
+	struct Caster
+	{
+		CMatrix4x4   worldMatrix;
+		unsigned int framesUnchanged = 0; // Saturates at STATIC_FRAMES, always 0 for animated casters
+		unsigned int lastFrame = 0;       // Frame of the last UpdateCaster, 0 if never updated
+	};
+	std::vector<Caster> mCasters;
+
+	// What each view's tile held at the end of the last frame it was used, by view key
+	struct Tile
+	{
+		unsigned int x = 0, y = 0, size = 0;
+		CMatrix4x4   viewMatrix;
+		CMatrix4x4   projectionMatrix;
+		std::vector<unsigned int> cachedCasters; // Static casters in the cache, sorted
+		bool         hadDynamicCasters = false;  // Dynamic casters were drawn over the cache, so it must be copied again
+		bool         invalid = false;            // Invalidate was called since the tile was last updated in full
+		unsigned int lastFrame = 0;
+	};
+	std::unordered_map<uint32_t, Tile> mTiles;
+
+	// This frame's views. Kept between frames to save reallocating their caster lists
+	std::vector<View> mViews;
+	unsigned int      mNumViews = 0;
+
+	// Whether each view got a new tile this frame, and view indexes sorted largest tile first
+	std::vector<uint8_t>      mMoved;
+	std::vector<unsigned int> mOrder;
+
+	unsigned int mNumFullUpdates = 0, mNumDynamicUpdates = 0, mNumTilesMoved = 0, mTexelsUsed = 0;
+	bool         mRepacked = false;
+};
+
+
+// Importance of the shadow view of a light reaching the given distance from its position: roughly the fraction of the
+// screen its light covers, seen from a camera at the given position with the given tan(half the field of view). From 0
+// to 1, 1 when the camera is within the light's reach
+float ShadowImportance(const CVector3& cameraPosition, float tanHalfFOV, const CVector3& lightPosition, float range);
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Run the atlas through a scripted scene of moving lights and casters and check that:
+// - tiles are inside the atlas, don't overlap, are powers of two within the size limits and fit the atlas
+// - tiles stay put while importances don't change, and small changes in importance don't change tile sizes
+// - unchanged views are skipped, moving casters give dynamic updates, and moving lights, moved tiles and casters that
+//   start or stop moving give full updates, as does invalidating the atlas
+// Then times Allocate for many views. Writes a report including the casters drawn per frame with and without the cache to
+// the given stream and returns the number of checks failed (see Tests.cpp)
+unsigned int RunShadowAtlasBenchmark(std::ostream& report, unsigned int numViews = 64, unsigned int numFrames = 200);
+
+
+#endif //_SHADOW_ATLAS_H_INCLUDED_
@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Shadow cache copy pixel shader
+//--------------------------------------------------------------------------------------
+// Copies a tile of the static shadow caster cache into the shadow atlas (see ShadowAtlas.h). Used with the full screen
+// quad vertex shader and a viewport covering the tile. Depth buffers can only be copied whole, so each depth is read from
+// the cache and written as the pixel's depth instead
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D ShadowCache : register(t0); // Same size as the atlas, so pixels are read from the same position
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float main(PostProcessingInput input) : SV_Depth
+{
+    return ShadowCache.Load(int3(input.projectedPosition.xy, 0)).r;
+}
@@ -0,0 +1,286 @@
+//--------------------------------------------------------------------------------------
+// Shadow cascades - fits a directional light's shadow maps to the camera's view
+//--------------------------------------------------------------------------------------
+
+#include "ShadowCascades.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+// An orthographic projection of the given width, height and depth range
+static CMatrix4x4 OrthographicMatrix(float width, float height, float nearClip, float farClip)
+{
+	CMatrix4x4 m = MatrixIdentity();
+	m.e00 = 2.0f / width;
+	m.e11 = 2.0f / height;
+	m.e22 = 1.0f / (farClip - nearClip);
+	m.e32 = -nearClip / (farClip - nearClip);
+	return m;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction and Usage
+//--------------------------------------------------------------------------------------
+
+// The given number of cascades, kept within MIN_CASCADES and MAX_CASCADES. The split lambda blends from even splits (0)
+// to logarithmic splits (1). Cascades move in steps of 1/snapResolution of their width
+ShadowCascades::ShadowCascades(unsigned int numCascades, float splitLambda, unsigned int snapResolution)
+	: mSplitLambda(splitLambda), mSnapResolution(std::max(snapResolution, 2u))
+{
+	SetNumCascades(numCascades);
+	for (auto& cascade : mCascades)
+	{
+		cascade.nearDistance = cascade.farDistance = 0;
+		cascade.bounds = CSphere({ 0, 0, 0 }, 0);
+		cascade.viewMatrix = cascade.projectionMatrix = cascade.viewProjectionMatrix = MatrixIdentity();
+	}
+}
+
+void ShadowCascades::SetNumCascades(unsigned int numCascades)
+{
+	mNumCascades = std::min(std::max(numCascades, MIN_CASCADES), MAX_CASCADES);
+}
+
+
+// Fit the cascades to a camera with the given world matrix, horizontal field of view (radians), aspect ratio and near
+// clip distance, shadowed out to the given distance. The light travels in the given direction. Casters are anywhere
+// within the given box
+void ShadowCascades::Fit(const CMatrix4x4& cameraMatrix, float fovX, float aspectRatio, float nearClip, float shadowDistance,
+                         const CVector3& lightDirection, const CAABB& casterBounds)
+{
+	// Squared distance of a slice's corners from the camera's facing axis, per unit of distance along it squared
+	float tanX = std::tan(fovX / 2);
+	float tanY = tanX / aspectRatio;
+	float cornerSlope2 = tanX * tanX + tanY * tanY;
+
+	CVector3 cameraPosition = cameraMatrix.GetPosition();
+	CVector3 cameraFacing   = Normalise(cameraMatrix.GetZAxis());
+
+	// The light's axes depend only on its direction, so the cascades don't turn with the camera
+	CVector3 lightFacing = Normalise(lightDirection);
+	CVector3 worldUp     = (std::abs(lightFacing.y) > 0.99f) ? CVector3{ 0, 0, 1 } : CVector3{ 0, 1, 0 };
+	CVector3 lightRight  = Normalise(Cross(worldUp, lightFacing));
+	CVector3 lightUp     = Cross(lightFacing, lightRight);
+
+	// Depth range of the casters along the light's facing
+	float casterNear = FLT_MAX, casterFar = -FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		CVector3 point = { (corner & 1) ? casterBounds.maximum.x : casterBounds.minimum.x,
+		                   (corner & 2) ? casterBounds.maximum.y : casterBounds.minimum.y,
+		                   (corner & 4) ? casterBounds.maximum.z : casterBounds.minimum.z };
+		float depth = Dot(point, lightFacing);
+		casterNear = std::min(casterNear, depth);
+		casterFar  = std::max(casterFar,  depth);
+	}
+
+	float nearDistance = nearClip;
+	for (unsigned int c = 0; c < mNumCascades; ++c)
+	{
+		Cascade& cascade = mCascades[c];
+
+		// Practical split scheme, a blend of logarithmic and even splits
+		float fraction    = static_cast<float>(c + 1) / mNumCascades;
+		float logSplit    = nearClip * std::pow(shadowDistance / nearClip, fraction);
+		float evenSplit   = nearClip + (shadowDistance - nearClip) * fraction;
+		float farDistance = (c + 1 == mNumCascades) ? shadowDistance : mSplitLambda * logSplit + (1 - mSplitLambda) * evenSplit;
+		cascade.nearDistance = nearDistance;
+		cascade.farDistance  = farDistance;
+
+		// Smallest sphere around the slice: centred on the facing axis where the near and far corners are the same distance
+		// away, or on the far face if that is nearer. Its radius depends only on the distances and field of view, so it stays
+		// the same as the camera moves and turns
+		float centreDistance = std::min(0.5f * (nearDistance + farDistance) * (1 + cornerSlope2), farDistance);
+		float radius = std::sqrt((farDistance - centreDistance) * (farDistance - centreDistance) + cornerSlope2 * farDistance * farDistance);
+		cascade.bounds = CSphere(cameraPosition + cameraFacing * centreDistance, radius);
+
+		// Snap the centre to the grid across the light's view. The width leaves room for the sphere to be up to half a step
+		// away from its snapped position
+		float width = 2 * radius * mSnapResolution / (mSnapResolution - 1);
+		float step  = width / mSnapResolution;
+		float x = std::floor(Dot(cascade.bounds.centre, lightRight) / step + 0.5f) * step;
+		float y = std::floor(Dot(cascade.bounds.centre, lightUp)    / step + 0.5f) * step;
+
+		// Depth range of the casters, rounded out to whole widths so it only changes when their bounds change a lot. The slice
+		// may reach outside it: a point nearer the light than every caster is always lit, and one beyond every caster has its
+		// depth clamped to the far plane by the shader so it is still shadowed by the casters (see the top of ShadowCascades.h)
+		float depthNear = std::floor(casterNear / width) * width;
+		float depthFar  = std::ceil (casterFar  / width) * width;
+
+		CMatrix4x4 lightMatrix = MatrixIdentity();
+		lightMatrix.SetRow(0, lightRight);
+		lightMatrix.SetRow(1, lightUp);
+		lightMatrix.SetRow(2, lightFacing);
+		lightMatrix.SetRow(3, lightRight * x + lightUp * y + lightFacing * depthNear);
+		cascade.viewMatrix = InverseAffine(lightMatrix);
+		cascade.projectionMatrix = OrthographicMatrix(width, width, 0, depthFar - depthNear);
+		cascade.viewProjectionMatrix = cascade.viewMatrix * cascade.projectionMatrix;
+		cascade.casterVolume = CConvexVolume(CFrustum(cascade.viewProjectionMatrix));
+
+		nearDistance = farDistance;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Whether a point is across a cascade's shadow map, allowing for rounding. Its depth may be outside the map's depth range
+static bool InCascade(const ShadowCascades::Cascade& cascade, const CVector3& point)
+{
+	const float Tolerance = 0.0001f;
+	CVector3 p = cascade.viewProjectionMatrix.TransformPoint(point);
+	return std::abs(p.x) <= 1 + Tolerance && std::abs(p.y) <= 1 + Tolerance;
+}
+
+// World matrix of a camera at the given position turned by the given angles, built the same way as in the Camera class
+static CMatrix4x4 CameraMatrix(const CVector3& position, float pitch, float yaw)
+{
+	return MatrixRotationX(pitch) * MatrixRotationY(yaw) * MatrixTranslation(position);
+}
+
+
+// Fit cascades to many random cameras and light directions and check that:
+// - each cascade is across its whole slice of the camera's view, and contains every caster between the slice and the
+//   light that is within the caster bounds
+// - moving or turning the camera never changes a cascade's size, and moves each cascade by a whole number of snap steps
+// Then times Fit and culling random boxes against the cascades. Writes a report including how often each cascade moved
+// for a camera walking steadily to the given stream and returns the number of checks failed
+unsigned int RunShadowCascadeBenchmark(std::ostream& report, unsigned int numTests /*= 1000*/)
+{
+	const float FOV = PI / 3, ASPECT_RATIO = 16.0f / 9.0f, NEAR_CLIP = 0.1f, SHADOW_DISTANCE = 500;
+	const unsigned int SNAP_RESOLUTION = 128;
+	const CAABB sceneBounds({ -500, -20, -500 }, { 500, 100, 500 });
+	std::vector<std::string> failures;
+	auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+	auto randomLightDirection = []()  { return Normalise({ Random(-1, 1), Random(-1, -0.2f), Random(-1, 1) }); };
+
+	//// Coverage ////
+	// Random points in each slice of the camera's view must be across its cascade, and points between them and the light,
+	// which is where their casters are, must be in it
+	unsigned int numPointsMissed = 0, numCastersMissed = 0;
+	for (unsigned int test = 0; test < numTests; ++test)
+	{
+		ShadowCascades cascades(ShadowCascades::MIN_CASCADES + test % 3, Random(0, 1), SNAP_RESOLUTION);
+		CVector3 cameraPosition = { Random(-400, 400), Random(0, 50), Random(-400, 400) };
+		CMatrix4x4 cameraMatrix = CameraMatrix(cameraPosition, Random(-1.5f, 1.5f), Random(-PI, PI));
+		CVector3 lightDirection = randomLightDirection();
+		cascades.Fit(cameraMatrix, FOV, ASPECT_RATIO, NEAR_CLIP, SHADOW_DISTANCE, lightDirection, sceneBounds);
+
+		float tanX = std::tan(FOV / 2), tanY = tanX / ASPECT_RATIO;
+		for (unsigned int c = 0; c < cascades.NumCascades(); ++c)
+		{
+			const ShadowCascades::Cascade& cascade = cascades.GetCascade(c);
+			for (int p = 0; p < 20; ++p)
+			{
+				// The corners of the slice most of all, they are on the edge of its sphere
+				float distance = (p < 8) ? ((p & 1) ? cascade.farDistance : cascade.nearDistance) : Random(cascade.nearDistance, cascade.farDistance);
+				float across   = (p < 8) ? ((p & 2) ? 1.0f : -1.0f) : Random(-1, 1);
+				float down     = (p < 8) ? ((p & 4) ? 1.0f : -1.0f) : Random(-1, 1);
+				CVector3 point = cameraPosition + cameraMatrix.GetXAxis() * (across * tanX * distance) +
+				                 cameraMatrix.GetYAxis() * (down * tanY * distance) + cameraMatrix.GetZAxis() * distance;
+				if (!InCascade(cascade, point))  ++numPointsMissed;
+
+				CVector3 caster = point - lightDirection * Random(0, 1000);
+				if (sceneBounds.Contains(caster) && !cascade.casterVolume.Intersects(CAABB(caster, caster)))  ++numCastersMissed;
+			}
+		}
+	}
+	check(numPointsMissed == 0, "part of the camera's view outside its cascade");
+	check(numCastersMissed == 0, "caster that can shadow the view culled from its cascade");
+
+	//// Stability ////
+	// A camera walking and turning steadily. The cascades must keep their sizes and move only in whole snap steps
+	ShadowCascades cascades(ShadowCascades::MAX_CASCADES, 0.75f, SNAP_RESOLUTION);
+	CVector3 lightDirection = randomLightDirection();
+	ShadowCascades::Cascade previous[ShadowCascades::MAX_CASCADES];
+	unsigned int numMoves[ShadowCascades::MAX_CASCADES] = {};
+	unsigned int numResized = 0, numPartSteps = 0;
+	CVector3 cameraPosition = { 0, 10, 0 };
+	float yaw = 0;
+	for (unsigned int frame = 0; frame < numTests; ++frame)
+	{
+		cameraPosition = cameraPosition + CVector3{ std::sin(yaw), 0, std::cos(yaw) } * 0.05f;
+		yaw += 0.002f;
+		cascades.Fit(CameraMatrix(cameraPosition, 0.2f, yaw), FOV, ASPECT_RATIO, NEAR_CLIP, SHADOW_DISTANCE, lightDirection, sceneBounds);
+		for (unsigned int c = 0; c < cascades.NumCascades(); ++c)
+		{
+			const ShadowCascades::Cascade& cascade = cascades.GetCascade(c);
+			if (frame > 0)
+			{
+				if (std::memcmp(&cascade.projectionMatrix, &previous[c].projectionMatrix, sizeof(CMatrix4x4)) != 0)  ++numResized;
+				if (std::memcmp(&cascade.viewMatrix, &previous[c].viewMatrix, sizeof(CMatrix4x4)) != 0)  ++numMoves[c];
+
+				// How far the cascade moved across the light's view, in snap steps
+				CVector3 move = cascade.viewMatrix.GetPosition() - previous[c].viewMatrix.GetPosition();
+				float stepsX = move.x / cascades.SnapStep(c), stepsY = move.y / cascades.SnapStep(c);
+				if (std::abs(stepsX - std::round(stepsX)) > 0.01f || std::abs(stepsY - std::round(stepsY)) > 0.01f)  ++numPartSteps;
+			}
+			previous[c] = cascade;
+		}
+	}
+	check(numResized == 0, "cascade size or depth range changed as the camera moved");
+	check(numPartSteps == 0, "cascade moved by part of a snap step");
+
+	//// Timing ////
+	const unsigned int NUM_BOXES = 1000;
+	std::vector<CAABB> boxes(NUM_BOXES);
+	for (auto& box : boxes)
+	{
+		CVector3 centre = { Random(-500, 500), Random(0, 50), Random(-500, 500) };
+		box = CAABB(centre - CVector3{ 2, 2, 2 }, centre + CVector3{ 2, 2, 2 });
+	}
+	std::vector<CMatrix4x4> cameraMatrices(numTests);
+	for (auto& cameraMatrix : cameraMatrices)
+	{
+		cameraMatrix = CameraMatrix({ Random(-400, 400), Random(0, 50), Random(-400, 400) }, Random(-1.5f, 1.5f), Random(-PI, PI));
+	}
+
+	Timer timer;
+	timer.GetLapTime();
+	for (auto& cameraMatrix : cameraMatrices)
+	{
+		cascades.Fit(cameraMatrix, FOV, ASPECT_RATIO, NEAR_CLIP, SHADOW_DISTANCE, lightDirection, sceneBounds);
+	}
+	float fitTime = timer.GetLapTime() / numTests;
+
+	unsigned int numCulled = 0;
+	const unsigned int NUM_CULL_REPEATS = 100;
+	timer.GetLapTime();
+	for (unsigned int repeat = 0; repeat < NUM_CULL_REPEATS; ++repeat)
+	{
+		for (unsigned int c = 0; c < cascades.NumCascades(); ++c)
+		{
+			for (auto& box : boxes)  numCulled += cascades.GetCascade(c).casterVolume.Intersects(box) ? 0 : 1;
+		}
+	}
+	float cullTime = timer.GetLapTime() / NUM_CULL_REPEATS;
+
+	report.precision(3);
+	report << std::fixed;
+	report << "Shadow cascade benchmark: " << cascades.NumCascades() << " cascades to " << SHADOW_DISTANCE << " units, snapped to 1/"
+	       << SNAP_RESOLUTION << " of their width\n"
+	       << "  Fit: " << fitTime * 1000000.0f << "us, culling " << NUM_BOXES << " boxes against every cascade: " << cullTime * 1000000.0f
+	       << "us (" << 100.0f * numCulled / (NUM_CULL_REPEATS * NUM_BOXES * cascades.NumCascades()) << "% culled)\n"
+	       << "  Splits and widths:";
+	for (unsigned int c = 0; c < cascades.NumCascades(); ++c)
+	{
+		report << " " << cascades.GetCascade(c).nearDistance << "-" << cascades.GetCascade(c).farDistance << " ("
+		       << 2.0f / cascades.GetCascade(c).projectionMatrix.e00 << ")";
+	}
+	report << "\n  Frames each cascade moved while walking:";
+	for (unsigned int c = 0; c < cascades.NumCascades(); ++c)  report << " " << 100.0f * numMoves[c] / numTests << "%";
+	report << "\n  Checks: " << (failures.empty() ? "all passed" : std::to_string(failures.size()) + " FAILED") << "\n";
+	for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+	return static_cast<unsigned int>(failures.size());
+}
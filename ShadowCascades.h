@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Shadow cascades - fits a directional light's shadow maps to the camera's view
+//--------------------------------------------------------------------------------------
+// A directional light reaches everything, so one shadow map over the whole scene would give every pixel on screen only a
+// few texels. Instead the camera's view out to a shadow distance is cut by depth into 2 to 4 slices and each slice gets
+// its own orthographic shadow map (a cascade): small ones close to the camera where detail shows, larger ones further away.
+//
+// The slices are placed with the "practical split scheme" of Zhang et al, "Parallel-Split Shadow Maps" (2006): a blend of
+// logarithmic splits, which give each slice the same ratio of far to near distance, and even splits, which don't crowd
+// the near slices so much. The blend is set by the split lambda, 1 for logarithmic and 0 for even.
+//
+// Each cascade is fitted around a bounding sphere of its slice rather than the slice itself, so its size doesn't change as
+// the camera turns. Its position across the light's view is then snapped to a grid a whole number of texels apart, so as
+// the camera moves the shadow map moves in whole texels and the edges of shadows don't crawl. The grid is 1/snapResolution
+// of the cascade's width, which is a whole number of texels for a shadow map of that size or larger, so the cascades stay
+// stable whatever shadow atlas tile sizes they are given. Casters keep the same cascade matrices until the camera moves a
+// whole step, so a cached shadow map stays valid between steps (see ShadowAtlas.h).
+//
+// Each cascade's depth range covers every caster in the given caster bounds, so it doesn't move with the camera either.
+// Points on screen are given the first cascade they are across, whatever their depth. A point beyond the far end of the
+// range would be past the shadow map's far plane, where the cleared depth is, so the shader clamps its depth to the far
+// plane: it is then shadowed by any caster drawn at its texel and lit otherwise (see Lighting.hlsli). The cascade's box is
+// the volume to cull its shadow casters with, so each cascade draws only the casters that can reach across its own slice.
+//
+// Uses only the maths classes and the standard library, so it can be built and tested without a window or GPU
+
+#ifndef _SHADOW_CASCADES_H_INCLUDED_
+#define _SHADOW_CASCADES_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CBoundingVolumes.h"
+#include "CConvexVolume.h"
+
+#include <ostream>
+
+
+class ShadowCascades
+{
+public:
+	static const unsigned int MIN_CASCADES = 2;
+	static const unsigned int MAX_CASCADES = 4; // Must match MAX_SHADOW_CASCADES in Common.h
+
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// The given number of cascades, kept within MIN_CASCADES and MAX_CASCADES. The split lambda blends from even splits (0)
+	// to logarithmic splits (1). Cascades move in steps of 1/snapResolution of their width, see the top of this file
+	ShadowCascades(unsigned int numCascades = 4, float splitLambda = 0.75f, unsigned int snapResolution = 128);
+
+	// Fit the cascades to a camera with the given world matrix, horizontal field of view (radians), aspect ratio and near
+	// clip distance, shadowed out to the given distance. The light travels in the given direction. Casters are anywhere
+	// within the given box, which should change as little as possible from frame to frame
+	void Fit(const CMatrix4x4& cameraMatrix, float fovX, float aspectRatio, float nearClip, float shadowDistance,
+	         const CVector3& lightDirection, const CAABB& casterBounds);
+
+	void SetNumCascades(unsigned int numCascades);
+	void SetSplitLambda(float splitLambda)  { mSplitLambda = splitLambda; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// One cascade after Fit
+	struct Cascade
+	{
+		float         nearDistance, farDistance; // The slice of the camera's view covered, as distances along its facing
+		CSphere       bounds;                    // Around the slice
+		CMatrix4x4    viewMatrix;
+		CMatrix4x4    projectionMatrix;          // Orthographic
+		CMatrix4x4    viewProjectionMatrix;
+		CConvexVolume casterVolume;              // The cascade's box, casters outside it needn't be drawn into its shadow map
+	};
+
+	unsigned int   NumCascades()                 { return mNumCascades; }
+	const Cascade& GetCascade(unsigned int index) { return mCascades[index]; } // Nearest the camera first
+
+	// Distance on the light's view between the positions a cascade can take, 1/snapResolution of its width
+	float SnapStep(unsigned int index)  { return 2.0f / (mCascades[index].projectionMatrix.e00 * mSnapResolution); }
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	unsigned int mNumCascades;
+	float        mSplitLambda;
+	unsigned int mSnapResolution;
+
+	Cascade mCascades[MAX_CASCADES];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Fit cascades to many random cameras and light directions and check that:
+// - each cascade is across its whole slice of the camera's view, and contains every caster between the slice and the
+//   light that is within the caster bounds
+// - moving or turning the camera never changes a cascade's size, and moves each cascade by a whole number of snap steps
+// Then times Fit and culling random boxes against the cascades. Writes a report including how often each cascade moved
+// for a camera walking steadily to the given stream and returns the number of checks failed (see Tests.cpp)
+unsigned int RunShadowCascadeBenchmark(std::ostream& report, unsigned int numTests = 1000);
+
+
+#endif //_SHADOW_CASCADES_H_INCLUDED_
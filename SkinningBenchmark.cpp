@@ -0,0 +1,158 @@
+//--------------------------------------------------------------------------------------
+// CPU reference skinning and a benchmark comparing linear blend and dual quaternion skinning
+//--------------------------------------------------------------------------------------
+
+#include "SkinningBenchmark.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+#include "Timer.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+
+//--------------------------------------------------------------------------------------
+// Reference skinning
+//--------------------------------------------------------------------------------------
+
+// Skin a single position with linear blend skinning, same as Skinning_vs.hlsl. Pass the bone palette, and the four
+// bone indexes and weights from the vertex
+CVector3 SkinPositionLinear(const CMatrix3x4* palette, const unsigned char* bones, const float* weights, const CVector3& position)
+{
+    // Blend the matrices first then transform once, as the shader does
+    CMatrix3x4 blend = {};
+    for (int i = 0; i < 4; ++i)
+    {
+        const float* bone = &palette[bones[i]].e00;
+        float*       out  = &blend.e00;
+        for (int j = 0; j < 12; ++j)  out[j] += bone[j] * weights[i];
+    }
+
+    // Each row of a 3x4 matrix is a column of the original matrix (see CMatrix3x4.h)
+    return { blend.e00 * position.x + blend.e01 * position.y + blend.e02 * position.z + blend.e03,
+             blend.e10 * position.x + blend.e11 * position.y + blend.e12 * position.z + blend.e13,
+             blend.e20 * position.x + blend.e21 * position.y + blend.e22 * position.z + blend.e23 };
+}
+
+// Skin a single position with dual quaternion skinning, same as SkinningDQ_vs.hlsl (without the final world matrix)
+CVector3 SkinPositionDualQuaternion(const CDualQuaternion* palette, const unsigned char* bones, const float* weights, const CVector3& position)
+{
+    unsigned int indexes[4] = { bones[0], bones[1], bones[2], bones[3] };
+    return TransformPosition(BlendDualQuaternions(palette, indexes, weights, 4), position);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Time building the bone palettes and skinning vertices on the CPU for both skinning modes, using random rigid bones and
+// vertices. Also checks both modes match the bone matrices for vertices with a single bone. Writes a report to the given
+// stream and returns the number of checks that failed (see Tests.cpp). The default of 64 bones is MAX_BONES in Common.h,
+// which isn't included so the benchmark builds without the Windows headers
+unsigned int RunSkinningBenchmark(std::ostream& report, unsigned int numBones /*= 64*/, unsigned int numVertices /*= 10000*/, unsigned int numRepeats /*= 100*/)
+{
+    numBones = std::min(std::max(numBones, 1u), 256u); // Bone indexes are stored in a byte
+
+    // Random rigid bone matrices and a palette that uses all of them
+    std::vector<CMatrix4x4> boneMatrices(numBones);
+    std::vector<unsigned int> bonePalette(numBones);
+    for (unsigned int i = 0; i < numBones; ++i)
+    {
+        boneMatrices[i] = MatrixRotationZ(Random(-PI, PI)) * MatrixRotationX(Random(-PI, PI)) * MatrixRotationY(Random(-PI, PI)) *
+                          MatrixTranslation({ Random(-10, 10), Random(-10, 10), Random(-10, 10) });
+        bonePalette[i] = i;
+    }
+
+    // Random vertices with four bones each, weights add up to 1
+    std::vector<CVector3>      positions(numVertices);
+    std::vector<unsigned char> bones(numVertices * 4);
+    std::vector<float>         weights(numVertices * 4);
+    for (unsigned int v = 0; v < numVertices; ++v)
+    {
+        positions[v] = { Random(-1, 1), Random(-1, 1), Random(-1, 1) };
+        float totalWeight = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            bones[v * 4 + i] = static_cast<unsigned char>(rand() % numBones);
+            weights[v * 4 + i] = Random(0.01f, 1);
+            totalWeight += weights[v * 4 + i];
+        }
+        for (int i = 0; i < 4; ++i)  weights[v * 4 + i] /= totalWeight;
+    }
+
+    std::vector<CMatrix3x4>      matrixPalette(numBones);
+    std::vector<CDualQuaternion> dualQuaternionPalette(numBones);
+    float checkSum = 0; // Results are summed so the compiler can't remove the work being timed
+    Timer timer;
+
+    // Palette building, the per-frame cost for each skinned sub-mesh
+    timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        PackMatrices3x4(boneMatrices.data(), bonePalette.data(), matrixPalette.data(), numBones);
+        checkSum += matrixPalette[r % numBones].e03;
+    }
+    float linearPaletteTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        BuildDualQuaternionPalette(boneMatrices.data(), bonePalette.data(), dualQuaternionPalette.data(), numBones);
+        checkSum += dualQuaternionPalette[r % numBones].dual.x;
+    }
+    float dualQuaternionPaletteTime = timer.GetLapTime();
+
+    // Per-vertex cost, mirrors the work done in the vertex shaders
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        for (unsigned int v = 0; v < numVertices; ++v)
+        {
+            checkSum += SkinPositionLinear(matrixPalette.data(), &bones[v * 4], &weights[v * 4], positions[v]).x;
+        }
+    }
+    float linearVertexTime = timer.GetLapTime();
+    for (unsigned int r = 0; r < numRepeats; ++r)
+    {
+        for (unsigned int v = 0; v < numVertices; ++v)
+        {
+            checkSum += SkinPositionDualQuaternion(dualQuaternionPalette.data(), &bones[v * 4], &weights[v * 4], positions[v]).x;
+        }
+    }
+    float dualQuaternionVertexTime = timer.GetLapTime();
+
+    // With a single bone both methods are an exact rigid transform, so both should match transforming by the bone matrix
+    // itself, within float rounding for positions this far from the origin
+    const float MAX_SINGLE_BONE_ERROR = 0.0001f;
+    float maxLinearError = 0, maxDualQuaternionError = 0;
+    const float singleWeight[4] = { 1, 0, 0, 0 };
+    for (unsigned int v = 0; v < numVertices; ++v)
+    {
+        CVector3 expected = boneMatrices[bones[v * 4]].TransformPoint(positions[v]);
+        CVector3 linear = SkinPositionLinear(matrixPalette.data(), &bones[v * 4], singleWeight, positions[v]);
+        CVector3 dualQuaternion = SkinPositionDualQuaternion(dualQuaternionPalette.data(), &bones[v * 4], singleWeight, positions[v]);
+        maxLinearError = std::max(maxLinearError, Length(linear - expected));
+        maxDualQuaternionError = std::max(maxDualQuaternionError, Length(dualQuaternion - expected));
+    }
+
+    std::vector<std::string> failures;
+    auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+    check(maxLinearError <= MAX_SINGLE_BONE_ERROR, "linear skinning doesn't match the bone matrix for single bone vertices");
+    check(maxDualQuaternionError <= MAX_SINGLE_BONE_ERROR, "dual quaternion skinning doesn't match the bone matrix for single bone vertices");
+
+    // Report times in microseconds per palette / per thousand vertices
+    float paletteScale = 1000000.0f / numRepeats;
+    float vertexScale  = 1000000.0f * 1000.0f / (static_cast<float>(numRepeats) * std::max(numVertices, 1u));
+    report.precision(3);
+    report << std::fixed;
+    report << "Skinning benchmark: " << numBones << " bones, " << numVertices << " vertices, " << numRepeats << " repeats\n";
+    report << "  Palette build (us):     linear " << linearPaletteTime * paletteScale
+           << " (" << numBones * sizeof(CMatrix3x4) << " bytes), dual quaternion " << dualQuaternionPaletteTime * paletteScale
+           << " (" << numBones * sizeof(CDualQuaternion) << " bytes)\n";
+    report << "  Skinning (us/1000 verts): linear " << linearVertexTime * vertexScale
+           << ", dual quaternion " << dualQuaternionVertexTime * vertexScale << "\n";
+    report << "  Max single bone error (x1000): linear " << maxLinearError * 1000 << ", dual quaternion " << maxDualQuaternionError * 1000
+           << " (checksum " << checkSum << ")\n"
+           << "  Checks: " << (failures.empty() ? "all passed" : std::to_string(failures.size()) + " FAILED") << "\n";
+    for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+    return static_cast<unsigned int>(failures.size());
+}
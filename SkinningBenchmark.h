@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// CPU reference skinning and a benchmark comparing linear blend and dual quaternion skinning
+//--------------------------------------------------------------------------------------
+// The reference functions do exactly what the skinning vertex shaders do, so results can be checked on the CPU
+
+#ifndef _SKINNING_BENCHMARK_H_INCLUDED_
+#define _SKINNING_BENCHMARK_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix3x4.h"
+#include "CDualQuaternion.h"
+
+#include <ostream>
+
+
+// Skin a single position with linear blend skinning, same as Skinning_vs.hlsl. Pass the bone palette, and the four
+// bone indexes and weights from the vertex
+CVector3 SkinPositionLinear(const CMatrix3x4* palette, const unsigned char* bones, const float* weights, const CVector3& position);
+
+// Skin a single position with dual quaternion skinning, same as SkinningDQ_vs.hlsl (without the final world matrix)
+CVector3 SkinPositionDualQuaternion(const CDualQuaternion* palette, const unsigned char* bones, const float* weights, const CVector3& position);
+
+
+// Time building the bone palettes and skinning vertices on the CPU for both skinning modes, using random rigid bones and
+// vertices. Also checks both modes match the bone matrices for vertices with a single bone. Writes a report to the given
+// stream and returns the number of checks that failed (see Tests.cpp). The default of 64 bones is MAX_BONES in Common.h,
+// which isn't included so the benchmark builds without the Windows headers
+unsigned int RunSkinningBenchmark(std::ostream& report, unsigned int numBones = 64, unsigned int numVertices = 10000, unsigned int numRepeats = 100);
+
+
+#endif //_SKINNING_BENCHMARK_H_INCLUDED_
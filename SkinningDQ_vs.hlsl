@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// Dual Quaternion Skinning Vertex Shader
+//--------------------------------------------------------------------------------------
+// Same as the skinning vertex shader, but blends a dual quaternion for each of the four nearby bones rather than a matrix.
+// Twisting joints keep their volume instead of collapsing. Bones are relative to the world matrix, which holds any scaling
+
+#define DUAL_QUATERNION_SKINNING // Select dual quaternion bones in the per-model constant buffer
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Vertex shader gets vertices from the mesh one at a time. It transforms their positions
+// from 3D into 2D (see lectures) and passes that position down the pipeline so pixels can
+// be rendered. For skinning the transformation includes blending the dual quaternions of 4 nearby bones.
+LightingPixelShaderInput main(SkinningVertex modelVertex)
+{
+    LightingPixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    // Fetch the four influencing bones, each is two float4s: real part (rotation) then dual part (translation)
+    float4 real0 = gBoneDualQuaternions[modelVertex.bones[0] * 2];
+    float4 dual0 = gBoneDualQuaternions[modelVertex.bones[0] * 2 + 1];
+    float4 real1 = gBoneDualQuaternions[modelVertex.bones[1] * 2];
+    float4 dual1 = gBoneDualQuaternions[modelVertex.bones[1] * 2 + 1];
+    float4 real2 = gBoneDualQuaternions[modelVertex.bones[2] * 2];
+    float4 dual2 = gBoneDualQuaternions[modelVertex.bones[2] * 2 + 1];
+    float4 real3 = gBoneDualQuaternions[modelVertex.bones[3] * 2];
+    float4 dual3 = gBoneDualQuaternions[modelVertex.bones[3] * 2 + 1];
+
+    // q and -q are the same rotation, flip each bone to the same side as the first so the blend takes the short way round
+    float4 weights = modelVertex.weights;
+    weights.y *= sign(dot(real0, real1) + 1e-6f);
+    weights.z *= sign(dot(real0, real2) + 1e-6f);
+    weights.w *= sign(dot(real0, real3) + 1e-6f);
+
+    // Blend and renormalise (the dual part is scaled by the length of the real part too)
+    float4 real = real0 * weights.x + real1 * weights.y + real2 * weights.z + real3 * weights.w;
+    float4 dual = dual0 * weights.x + dual1 * weights.y + dual2 * weights.z + dual3 * weights.w;
+    float invLength = rsqrt(dot(real, real));
+    real *= invLength;
+    dual *= invLength;
+
+    // Rotate position and normal by the real part, then add the translation held in the dual part
+    // Same calculation as TransformPosition in CDualQuaternion.cpp
+    float3 rotatedPosition = modelVertex.position + 2 * cross(real.xyz, cross(real.xyz, modelVertex.position) + real.w * modelVertex.position);
+    float3 rotatedNormal   = modelVertex.normal   + 2 * cross(real.xyz, cross(real.xyz, modelVertex.normal)   + real.w * modelVertex.normal);
+    float3 translation     = 2 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+
+    // Bones are relative to the model's root, so finish with the world matrix
+    float4 worldPosition = mul(gWorldMatrix, float4(rotatedPosition + translation, 1));
+    float3 worldNormal   = mul(gWorldMatrix, float4(rotatedNormal, 0)).xyz;
+
+    // Use the view matrix to transform the final vertex position from world space into view space (camera's point of view)
+    // and then use the projection matrix to transform the vertex to 2D projection space (project onto the 2D screen)
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+
+    // Pass world position and normal to pixel shader for lighting
+    output.worldPosition = worldPosition.xyz;
+    output.worldNormal   = worldNormal;
+    
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
+    output.uv = modelVertex.uv;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
@@ -22,19 +22,16 @@ LightingPixelShaderInput main(SkinningVertex modelVertex)
     float4 modelPosition = float4(modelVertex.position, 1);
     float4 modelNormal = float4(modelVertex.normal, 0);
 
-    float4 worldPosition;
-	worldPosition = mul(gBoneMatrices[modelVertex.bones[0]], modelPosition) * modelVertex.weights[0] +
-        mul(gBoneMatrices[modelVertex.bones[1]], modelPosition) * modelVertex.weights[1] +
-        mul(gBoneMatrices[modelVertex.bones[2]], modelPosition) * modelVertex.weights[2] +
-        mul(gBoneMatrices[modelVertex.bones[3]], modelPosition) * modelVertex.weights[3];
-                     //*** MISSING - The above line multiplies the vertex position by the first bone's matrix, using the weight of the first bone
-	                 //***           Now you need to do the same for each bone, adding all the results together to get a weighted average for this vertex (as discussed in lecture)
-	
-	float4 worldNormal = mul(gBoneMatrices[modelVertex.bones[0]], modelNormal) * modelVertex.weights[0] +
-        mul(gBoneMatrices[modelVertex.bones[1]], modelNormal) * modelVertex.weights[1] +
-        mul(gBoneMatrices[modelVertex.bones[2]], modelNormal) * modelVertex.weights[2] +
-        mul(gBoneMatrices[modelVertex.bones[3]], modelNormal) * modelVertex.weights[3];
-     //*** ` - Do the same process as above to calculate the world normal using the influencing bones
+    // Blend the four influencing bone matrices together first, then transform the position and normal once with the
+    // result. Gives the same weighted average as transforming by each bone separately but with far fewer instructions
+    row_major float3x4 boneMatrix = gBoneMatrices[modelVertex.bones[0]] * modelVertex.weights[0] +
+                                    gBoneMatrices[modelVertex.bones[1]] * modelVertex.weights[1] +
+                                    gBoneMatrices[modelVertex.bones[2]] * modelVertex.weights[2] +
+                                    gBoneMatrices[modelVertex.bones[3]] * modelVertex.weights[3];
+
+    // Bone matrices are 3x4 (see Common.hlsli) so the results are 3 elements, add the 4th back for the matrices below
+    float4 worldPosition = float4(mul(boneMatrix, modelPosition), 1);
+    float3 worldNormal   = mul(boneMatrix, modelNormal);
 
     // Use the view matrix to transform the final vertex position from world space into view space (camera's point of view)
     // and then use the projection matrix to transform the vertex to 2D projection space (project onto the 2D screen)
@@ -44,7 +41,7 @@ LightingPixelShaderInput main(SkinningVertex modelVertex)
 
     // Pass world position and normal to pixel shader for lighting
     output.worldPosition = worldPosition.xyz;
-    output.worldNormal   = worldNormal.xyz;
+    output.worldNormal   = worldNormal;
     
     output.projectedPosition = mul(gProjectionMatrix, viewPosition);
 
@@ -38,6 +38,7 @@ ID3D11DepthStencilState* gUseDepthBufferState  = nullptr;
 ID3D11DepthStencilState* gDepthReadOnlyState   = nullptr;
 ID3D11DepthStencilState* gNoDepthBufferState   = nullptr;
 ID3D11DepthStencilState* gLessEqualDepthBufferState = nullptr;
+ID3D11DepthStencilState* gOverwriteDepthState   = nullptr;
 
 
 
@@ -302,6 +303,20 @@ bool CreateStates()
         return false;
     }
 
+	////-------- Overwrite depth buffer --------////
+    // Writes every depth without testing - used to clear and copy parts of the shadow atlas (see ShadowAtlas.h)
+    depthStencilDesc.DepthEnable      = TRUE;
+    depthStencilDesc.DepthWriteMask   = D3D11_DEPTH_WRITE_MASK_ALL;
+    depthStencilDesc.DepthFunc        = D3D11_COMPARISON_ALWAYS;
+    depthStencilDesc.StencilEnable    = FALSE;
+
+    // Create a DirectX object for the description above that can be used by a shader
+    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gOverwriteDepthState)))
+    {
+        gLastError = "Error creating overwrite-depth state";
+        return false;
+    }
+
     return true;
 }
 
@@ -313,6 +328,7 @@ void ReleaseStates()
     if (gDepthReadOnlyState)            gDepthReadOnlyState->Release();
     if (gNoDepthBufferState)            gNoDepthBufferState->Release();
     if (gLessEqualDepthBufferState)     gLessEqualDepthBufferState->Release();
+    if (gOverwriteDepthState)           gOverwriteDepthState->Release();
     if (gCullBackState)                 gCullBackState->Release();
     if (gCullFrontState)                gCullFrontState->Release();
     if (gCullNoneState)                 gCullNoneState->Release();
@@ -35,6 +35,7 @@ extern ID3D11DepthStencilState* gUseDepthBufferState;
 extern ID3D11DepthStencilState* gDepthReadOnlyState;
 extern ID3D11DepthStencilState* gNoDepthBufferState;
 extern ID3D11DepthStencilState* gLessEqualDepthBufferState;
+extern ID3D11DepthStencilState* gOverwriteDepthState;
 
 
 //--------------------------------------------------------------------------------------
@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// The state cache used by the app - StateCacheT (see StateCacheT.h) wrapping the render backend
+//--------------------------------------------------------------------------------------
+
+#ifndef _STATE_CACHE_H_INCLUDED_
+#define _STATE_CACHE_H_INCLUDED_
+
+#include "StateCacheT.h"
+#include "RenderBackend.h"
+
+
+// The render backend objects the app's state cache passes on (see RenderTypes.h)
+struct RenderStateCacheHandles
+{
+	typedef RenderVertexShader      VertexShader;
+	typedef RenderGeometryShader    GeometryShader;
+	typedef RenderPixelShader       PixelShader;
+	typedef RenderBlendState        BlendState;
+	typedef RenderDepthStencilState DepthStencilState;
+	typedef RenderRasterizerState   RasterizerState;
+	typedef RenderSamplerState      SamplerState;
+	typedef RenderInputLayout       InputLayout;
+	typedef ERenderTopology         PrimitiveTopology;
+};
+
+
+// The state cache used by the app, wrapping gRenderBackend (set up in Direct3DSetup.cpp)
+typedef StateCacheT<RenderBackend, RenderStateCacheHandles> StateCache;
+extern StateCache gStateCache;
+
+
+#endif //_STATE_CACHE_H_INCLUDED_
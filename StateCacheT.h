@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// Class that filters out redundant pipeline state changes before they reach the device context
+//--------------------------------------------------------------------------------------
+// Setting a state that is already set still costs a call into the driver. This class remembers the shaders, states,
+// samplers, input layout and topology last set and only passes on calls that change them. Use it for every change to
+// those states, any set directly on the context would leave it out of date - call Invalidate if that is unavoidable.
+// Shader resources (textures) are not filtered, the device unbinds them itself when they are bound as render targets.
+//
+// It is a template on the context type so it can be used with anything with the same member functions as a device
+// context (e.g. the mock in Tests.cpp), and on a class giving the types of the shaders, states and topology it passes
+// on. It uses no graphics API headers. The app uses StateCache, which wraps the render backend (see StateCache.h).
+// Code is all in this file
+
+#ifndef _STATE_CACHE_T_H_INCLUDED_
+#define _STATE_CACHE_T_H_INCLUDED_
+
+// Number of pixel shader sampler slots tracked, calls for later slots are always passed on
+static const unsigned int STATE_CACHE_SAMPLER_SLOTS = 16;
+
+
+// Handles is a class with these typedefs (see RenderStateCacheHandles in StateCache.h):
+//   VertexShader, GeometryShader, PixelShader, BlendState, DepthStencilState, RasterizerState, SamplerState, InputLayout
+//   - the object types, which are only used through pointers so can be incomplete
+//   PrimitiveTopology - the type of the topology value
+template <class Context, class Handles>
+class StateCacheT
+{
+public:
+	// Types of the objects and values passed on to the context
+	typedef typename Handles::VertexShader      VertexShader;
+	typedef typename Handles::GeometryShader    GeometryShader;
+	typedef typename Handles::PixelShader       PixelShader;
+	typedef typename Handles::BlendState        BlendState;
+	typedef typename Handles::DepthStencilState DepthStencilState;
+	typedef typename Handles::RasterizerState   RasterizerState;
+	typedef typename Handles::SamplerState      SamplerState;
+	typedef typename Handles::InputLayout       InputLayout;
+	typedef typename Handles::PrimitiveTopology PrimitiveTopology;
+
+
+	//-------------------------------------
+	// Construction and Usage
+	//-------------------------------------
+
+	// Pass the context to send state changes to. Can be nullptr, then call SetContext before use
+	StateCacheT(Context* context = nullptr)  { SetContext(context); }
+
+	// Change the context to send state changes to. Nothing is assumed to be set on it
+	void SetContext(Context* context)  { mContext = context; Invalidate(); }
+
+	// Forget the states that have been set, so the next call for each is passed on. Call if something other than this class
+	// changes the context state (e.g. ClearState)
+	void Invalidate()  { mKnownStates = 0; }
+
+
+	// State changes, same parameters as the device context functions. Only single objects are supported, no class instances
+	void VSSetShader(VertexShader* shader)
+	{
+		if (Filter(mVertexShader, shader, VERTEX_SHADER))  mContext->VSSetShader(shader, nullptr, 0);
+	}
+	void GSSetShader(GeometryShader* shader)
+	{
+		if (Filter(mGeometryShader, shader, GEOMETRY_SHADER))  mContext->GSSetShader(shader, nullptr, 0);
+	}
+	void PSSetShader(PixelShader* shader)
+	{
+		if (Filter(mPixelShader, shader, PIXEL_SHADER))  mContext->PSSetShader(shader, nullptr, 0);
+	}
+
+	// The blend factor and sample mask used by the app are fixed, they are always nullptr and 0xffffff
+	void OMSetBlendState(BlendState* state)
+	{
+		if (Filter(mBlendState, state, BLEND_STATE))  mContext->OMSetBlendState(state, nullptr, 0xffffff);
+	}
+	void OMSetDepthStencilState(DepthStencilState* state, unsigned int stencilRef = 0)
+	{
+		bool changed = mStencilRef != stencilRef; // The stencil reference is remembered along with the state
+		mStencilRef = stencilRef;
+		if (changed)  mKnownStates &= ~DEPTH_STENCIL_STATE;
+		if (Filter(mDepthStencilState, state, DEPTH_STENCIL_STATE))  mContext->OMSetDepthStencilState(state, stencilRef);
+	}
+	void RSSetState(RasterizerState* state)
+	{
+		if (Filter(mRasterizerState, state, RASTERIZER_STATE))  mContext->RSSetState(state);
+	}
+
+	void PSSetSampler(unsigned int slot, SamplerState* sampler)
+	{
+		if (slot >= STATE_CACHE_SAMPLER_SLOTS)
+		{
+			++mNumIssued;
+			mContext->PSSetSamplers(slot, 1, &sampler);
+			return;
+		}
+		if (Filter(mSamplers[slot], sampler, FIRST_SAMPLER << slot))  mContext->PSSetSamplers(slot, 1, &sampler);
+	}
+
+	void IASetInputLayout(InputLayout* layout)
+	{
+		if (Filter(mInputLayout, layout, INPUT_LAYOUT))  mContext->IASetInputLayout(layout);
+	}
+	void IASetPrimitiveTopology(PrimitiveTopology topology)
+	{
+		if (Filter(mTopology, topology, TOPOLOGY))  mContext->IASetPrimitiveTopology(topology);
+	}
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Totals since the statistics were last reset
+	unsigned int NumIssued()    { return mNumIssued; }   // Calls passed on to the context
+	unsigned int NumFiltered()  { return mNumFiltered; } // Redundant calls dropped
+	void ResetStatistics()  { mNumIssued = mNumFiltered = 0; }
+
+
+	//-------------------------------------
+	// Private support functions
+	//-------------------------------------
+private:
+	// Returns true if the call for a state must be passed on - the value is different or the state is not known (given
+	// as one of the bits below). Updates the remembered value and the statistics
+	template <class T>
+	bool Filter(T& current, T value, unsigned int stateBit)
+	{
+		if ((mKnownStates & stateBit) && current == value)
+		{
+			++mNumFiltered;
+			return false;
+		}
+		current = value;
+		mKnownStates |= stateBit;
+		++mNumIssued;
+		return true;
+	}
+
+
+	//-------------------------------------
+	// Data
+	//-------------------------------------
+private:
+	Context* mContext;
+
+	// One bit for each state, set when the remembered value of that state is known to be what is on the context
+	enum : unsigned int
+	{
+		VERTEX_SHADER = 1, GEOMETRY_SHADER = 2, PIXEL_SHADER = 4, BLEND_STATE = 8, DEPTH_STENCIL_STATE = 16,
+		RASTERIZER_STATE = 32, INPUT_LAYOUT = 64, TOPOLOGY = 128, FIRST_SAMPLER = 256 // Then one bit for each sampler slot
+	};
+	unsigned int mKnownStates;
+
+	VertexShader*      mVertexShader;
+	GeometryShader*    mGeometryShader;
+	PixelShader*       mPixelShader;
+	BlendState*        mBlendState;
+	DepthStencilState* mDepthStencilState;
+	unsigned int       mStencilRef = 0;
+	RasterizerState*   mRasterizerState;
+	InputLayout*       mInputLayout;
+	PrimitiveTopology  mTopology;
+
+	SamplerState* mSamplers[STATE_CACHE_SAMPLER_SLOTS];
+
+	unsigned int mNumIssued = 0;
+	unsigned int mNumFiltered = 0;
+};
+
+
+#endif //_STATE_CACHE_T_H_INCLUDED_
@@ -0,0 +1,406 @@
+//--------------------------------------------------------------------------------------
+// Entry point for the tests - a console program that runs the checks of the systems that
+// can be built without a window or GPU
+//--------------------------------------------------------------------------------------
+// Each check writes a report, including its timings, to the console and returns how many of its checks failed. The program
+// exits with 1 if any check failed, so a build script can stop on it. Most systems have their checks next to their code
+// (the Run...Benchmark functions), the smaller ones are checked here.
+//
+// On Windows this is built by Tests.vcxproj. Elsewhere CMakeLists.txt builds it from the sources that don't need the
+// Windows or Direct3D headers, leaving out the light cluster checks. Rendering is checked headless on both, through a
+// RecordingRenderBackend with no GPU (see TestRecordedRenderPath)
+
+#include "ControlSpeeds.h"
+#include "CullingBenchmark.h"
+#include "OcclusionCuller.h"
+#include "ShadowAtlas.h"
+#include "ShadowCascades.h"
+#include "SkinningBenchmark.h"
+#include "RingAllocator.h"
+#include "StateCacheT.h"
+#include "StateCache.h"
+#include "RecordingRenderBackend.h"
+#include "ConstantBufferRing.h"
+#include "Timer.h"
+#ifdef _WIN32
+#include "LightClusters.h"
+#endif
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+
+// Movement speeds declared in ControlSpeeds.h, which the app sets in Scene.cpp. The tests use cameras but never control them
+const float ROTATION_SPEED = 2.0f;
+const float MOVEMENT_SPEED = 50.0f;
+
+// Rendering globals from Direct3DSetup.cpp and Scene.cpp, used by the recorded render path check
+RenderBackend*     gRenderBackend = nullptr;
+StateCache         gStateCache;
+ConstantBufferRing gConstantBufferRing(1024 * 1024);
+
+#ifdef _WIN32
+// The device from Direct3DSetup.cpp, used by the light manager and light clusters for their GPU buffers. The tests never
+// upload to the GPU so it stays null. Both need the Direct3D headers, so they are only checked in the Windows build
+ID3D11Device* gD3DDevice = nullptr;
+#endif
+
+
+namespace
+{
+	// Check that the ring allocator aligns allocations, holds each frame's space until the frames in flight after it have
+	// ended, wraps at the end of its area, and never gives out space still in use over many frames of random allocations
+	unsigned int TestRingAllocator(std::ostream& report)
+	{
+		std::vector<std::string> failures;
+		auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+
+		// Sizes are rounded to the alignment, and an empty allocation fails
+		{
+			RingAllocator ring(1000, 256, 2);
+			check(ring.Size() == 768, "area size not rounded down to the alignment");
+			check(ring.Allocate(1) == 0 && ring.Allocate(1) == 256 && ring.NumBytesInUse() == 512, "allocations not aligned");
+			check(ring.Allocate(0) == RingAllocator::ALLOCATION_FAILED, "empty allocation didn't fail");
+		}
+
+		// A full area fails until the frame that filled it has had two more frames end after it
+		{
+			RingAllocator ring(1024, 256, 2);
+			bool filled = true;
+			for (size_t i = 0; i < 4; ++i)  filled = filled && ring.Allocate(256) == i * 256;
+			check(filled, "allocations not placed in order");
+			check(ring.Allocate(1) == RingAllocator::ALLOCATION_FAILED, "allocation from a full area didn't fail");
+			ring.EndFrame();
+			ring.EndFrame();
+			check(ring.Allocate(1) == RingAllocator::ALLOCATION_FAILED, "space reused while its frame was in flight");
+			ring.EndFrame();
+			check(ring.NumBytesInUse() == 0 && ring.Allocate(1024) == 0, "space not freed after its frames in flight");
+		}
+
+		// An allocation too large for the space left at the end skips it and starts again from the beginning
+		{
+			RingAllocator ring(1024, 256, 1);
+			ring.Allocate(512);
+			ring.EndFrame();
+			ring.Allocate(256);
+			ring.EndFrame(); // Frees the first 512 bytes
+			check(ring.Allocate(512) == 0 && ring.NumBytesInUse() == 1024, "allocation didn't wrap, or skipped space not counted");
+			ring.EndFrame();
+			ring.EndFrame();
+			check(ring.NumBytesInUse() == 0, "skipped space not freed with its frame");
+		}
+
+		// Reset frees everything, including frames in flight
+		{
+			RingAllocator ring(1024, 256, 3);
+			ring.Allocate(768);
+			ring.EndFrame();
+			ring.Allocate(256);
+			ring.Reset();
+			check(ring.NumBytesInUse() == 0 && ring.Allocate(1024) == 0, "reset didn't free the whole area");
+		}
+
+		// Random allocations over many frames. Allocations of the current frame and those in flight must never overlap
+		{
+			const unsigned int NUM_FRAMES_IN_FLIGHT = 3;
+			RingAllocator ring(64 * 1024, 256, NUM_FRAMES_IN_FLIGHT);
+			std::vector<std::vector<std::pair<size_t, size_t>>> liveFrames(1); // Offset and size, current frame last
+			unsigned int numOverlaps = 0, numOutside = 0, numAllocations = 0;
+			for (unsigned int frame = 0; frame < 1000; ++frame)
+			{
+				unsigned int frameAllocations = rand() % 20;
+				for (unsigned int a = 0; a < frameAllocations; ++a)
+				{
+					size_t size = 1 + rand() % 4000;
+					size_t offset = ring.Allocate(size);
+					if (offset == RingAllocator::ALLOCATION_FAILED)  continue;
+					++numAllocations;
+					size = (size + 255) & ~size_t(255);
+					if (offset % 256 != 0 || offset + size > ring.Size())  ++numOutside;
+					for (auto& liveFrame : liveFrames)
+					{
+						for (auto& live : liveFrame)
+						{
+							if (offset < live.first + live.second && live.first < offset + size)  ++numOverlaps;
+						}
+					}
+					liveFrames.back().push_back({ offset, size });
+				}
+				ring.EndFrame();
+				liveFrames.emplace_back();
+				if (liveFrames.size() > NUM_FRAMES_IN_FLIGHT + 1)  liveFrames.erase(liveFrames.begin());
+			}
+			check(numOverlaps == 0, "allocation overlapped space still in use");
+			check(numOutside == 0, "allocation unaligned or outside the area");
+			check(numAllocations > 1000, "too few random allocations succeeded");
+		}
+
+		report << "Ring allocator: " << (failures.empty() ? "checks all passed" : std::to_string(failures.size()) + " checks FAILED") << "\n";
+		for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+		return static_cast<unsigned int>(failures.size());
+	}
+
+
+	// Object types for the state cache test. They are never defined, the test only passes pointers to them around
+	struct MockShader;
+	struct MockState;
+	enum class EMockTopology { TriangleList, TriangleStrip };
+
+	struct MockHandles
+	{
+		typedef MockShader    VertexShader;
+		typedef MockShader    GeometryShader;
+		typedef MockShader    PixelShader;
+		typedef MockState     BlendState;
+		typedef MockState     DepthStencilState;
+		typedef MockState     RasterizerState;
+		typedef MockState     SamplerState;
+		typedef MockState     InputLayout;
+		typedef EMockTopology PrimitiveTopology;
+	};
+
+	// Stands in for a device context in the state cache test, counting the calls that reach it and keeping the last values
+	struct MockContext
+	{
+		unsigned int numCalls = 0;
+		MockShader*  vertexShader = nullptr;
+		MockState*   depthStencilState = nullptr;
+		unsigned int stencilRef = 0;
+		MockState*   samplers[32] = {};
+
+		void VSSetShader(MockShader* shader, const void*, unsigned int)                     { ++numCalls; vertexShader = shader; }
+		void GSSetShader(MockShader*, const void*, unsigned int)                            { ++numCalls; }
+		void PSSetShader(MockShader*, const void*, unsigned int)                            { ++numCalls; }
+		void OMSetBlendState(MockState*, const float*, unsigned int)                        { ++numCalls; }
+		void OMSetDepthStencilState(MockState* state, unsigned int ref)                     { ++numCalls; depthStencilState = state; stencilRef = ref; }
+		void RSSetState(MockState*)                                                         { ++numCalls; }
+		void PSSetSamplers(unsigned int slot, unsigned int, MockState* const* sampler)      { ++numCalls; samplers[slot] = *sampler; }
+		void IASetInputLayout(MockState*)                                                   { ++numCalls; }
+		void IASetPrimitiveTopology(EMockTopology)                                          { ++numCalls; }
+	};
+
+	// A distinct pointer to stand for a graphics object, never dereferenced
+	template <class T>
+	T* FakeObject(uintptr_t n)  { return reinterpret_cast<T*>(n * 64); }
+
+	// Check that the state cache passes on the first call for each state and every change, drops repeated values, tracks the
+	// stencil reference and each sampler slot separately, and forgets everything on Invalidate or a new context
+	unsigned int TestStateCache(std::ostream& report)
+	{
+		std::vector<std::string> failures;
+		auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+
+		MockContext context;
+		StateCacheT<MockContext, MockHandles> cache(&context);
+
+		// Nothing is known at first, so even nullptr is passed on
+		cache.VSSetShader(nullptr);
+		cache.GSSetShader(nullptr);
+		cache.PSSetShader(nullptr);
+		cache.OMSetBlendState(nullptr);
+		cache.OMSetDepthStencilState(nullptr);
+		cache.RSSetState(nullptr);
+		cache.PSSetSampler(0, nullptr);
+		cache.IASetInputLayout(nullptr);
+		cache.IASetPrimitiveTopology(EMockTopology::TriangleList);
+		check(context.numCalls == 9, "first call for a state not passed on");
+
+		// Repeats are dropped, changes are passed on
+		unsigned int numCalls = context.numCalls;
+		cache.VSSetShader(nullptr);
+		cache.IASetPrimitiveTopology(EMockTopology::TriangleList);
+		check(context.numCalls == numCalls, "repeated state passed on");
+		cache.VSSetShader(FakeObject<MockShader>(1));
+		cache.VSSetShader(FakeObject<MockShader>(1));
+		cache.IASetPrimitiveTopology(EMockTopology::TriangleStrip);
+		check(context.numCalls == numCalls + 2 && context.vertexShader == FakeObject<MockShader>(1), "changed state not passed on");
+
+		// The same depth-stencil state with a new stencil reference must be passed on
+		numCalls = context.numCalls;
+		cache.OMSetDepthStencilState(FakeObject<MockState>(2), 0);
+		cache.OMSetDepthStencilState(FakeObject<MockState>(2), 1);
+		cache.OMSetDepthStencilState(FakeObject<MockState>(2), 1);
+		check(context.numCalls == numCalls + 2 && context.stencilRef == 1, "stencil reference change not passed on");
+
+		// Each sampler slot is separate, and slots past those tracked are always passed on
+		numCalls = context.numCalls;
+		cache.PSSetSampler(1, nullptr);
+		cache.PSSetSampler(0, nullptr);
+		cache.PSSetSampler(1, FakeObject<MockState>(3));
+		cache.PSSetSampler(STATE_CACHE_SAMPLER_SLOTS, nullptr);
+		cache.PSSetSampler(STATE_CACHE_SAMPLER_SLOTS, nullptr);
+		check(context.numCalls == numCalls + 4 && context.samplers[1] == FakeObject<MockState>(3), "sampler slots not tracked separately");
+
+		// After Invalidate or on a new context every state is passed on again
+		cache.Invalidate();
+		numCalls = context.numCalls;
+		cache.VSSetShader(FakeObject<MockShader>(1));
+		cache.PSSetSampler(1, FakeObject<MockState>(3));
+		check(context.numCalls == numCalls + 2, "state passed on before Invalidate was dropped after it");
+		MockContext newContext;
+		cache.SetContext(&newContext);
+		cache.VSSetShader(FakeObject<MockShader>(1));
+		check(newContext.numCalls == 1 && newContext.vertexShader == FakeObject<MockShader>(1), "state not sent to a new context");
+
+		// The statistics count every call
+		cache.ResetStatistics();
+		cache.RSSetState(FakeObject<MockState>(4));
+		cache.RSSetState(FakeObject<MockState>(4));
+		cache.RSSetState(FakeObject<MockState>(4));
+		check(cache.NumIssued() == 1 && cache.NumFiltered() == 2, "statistics don't match the calls");
+
+		report << "State cache: " << (failures.empty() ? "checks all passed" : std::to_string(failures.size()) + " checks FAILED") << "\n";
+		for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+		return static_cast<unsigned int>(failures.size());
+	}
+
+	// Render frames of a simple scene through a RecordingRenderBackend with no GPU, the same way the app draws its models:
+	// shaders and states through gStateCache, per-draw constants through gConstantBufferRing (see SetDrawConstants), then
+	// the buffers and the draw. Models are in material order, as the render queue submits them. Checks that every draw
+	// reaches the backend, that only state changes do, and that each draw's constants get their own part of the ring
+	unsigned int TestRecordedRenderPath(std::ostream& report)
+	{
+		std::vector<std::string> failures;
+		auto check = [&](bool passed, const char* description)  { if (!passed)  failures.push_back(description); };
+
+		const unsigned int NUM_MODELS    = 500;
+		const unsigned int NUM_MATERIALS = 8;
+		const unsigned int NUM_FRAMES    = 100;
+		struct PerDrawConstants { float worldMatrix[16]; float colour[4]; };
+
+		RecordingRenderBackend recorder;
+		gRenderBackend = &recorder;
+		gStateCache.SetContext(gRenderBackend);
+		check(gConstantBufferRing.Init(), "constant buffer ring not created");
+
+		// The ordinary constant buffer SetDrawConstants would use without the ring
+		RenderBufferDesc bufferDesc;
+		bufferDesc.type  = ERenderBufferType::Constant;
+		bufferDesc.usage = ERenderBufferUsage::Dynamic;
+		bufferDesc.size  = sizeof(PerDrawConstants);
+		RenderBuffer* perDrawBuffer = nullptr;
+		check(gRenderBackend->CreateBuffer(bufferDesc, nullptr, &perDrawBuffer) && perDrawBuffer != nullptr, "buffer not created");
+
+		RenderTargetView*       renderTarget = FakeObject<RenderTargetView>(1);
+		RenderDepthStencilView* depthStencil = FakeObject<RenderDepthStencilView>(2);
+		const float clearColour[4] = { 0, 0, 0, 1 };
+		RenderViewport viewport;
+		viewport.width  = 1280;
+		viewport.height = 720;
+		PerDrawConstants constants = {};
+		unsigned int vertexStride = 32, vertexOffset = 0;
+
+		Timer timer;
+		timer.GetLapTime();
+		for (unsigned int frame = 0; frame < NUM_FRAMES; ++frame)
+		{
+			recorder.ClearCommands(); // Keep only the last frame
+			gRenderBackend->OMSetRenderTargets(1, &renderTarget, depthStencil);
+			gRenderBackend->ClearRenderTargetView(renderTarget, clearColour);
+			gRenderBackend->ClearDepthStencilView(depthStencil, RENDER_CLEAR_DEPTH, 1.0f, 0);
+			gRenderBackend->RSSetViewports(1, &viewport);
+
+			for (unsigned int m = 0; m < NUM_MODELS; ++m)
+			{
+				// Materials alternate between two vertex shaders and input layouts, each has its own pixel shader
+				uintptr_t material = m * NUM_MATERIALS / NUM_MODELS;
+				gStateCache.VSSetShader(FakeObject<RenderVertexShader>(10 + material % 2));
+				gStateCache.PSSetShader(FakeObject<RenderPixelShader>(20 + material));
+				gStateCache.OMSetBlendState(FakeObject<RenderBlendState>(30));
+				gStateCache.OMSetDepthStencilState(FakeObject<RenderDepthStencilState>(31));
+				gStateCache.RSSetState(FakeObject<RenderRasterizerState>(32));
+				gStateCache.PSSetSampler(0, FakeObject<RenderSamplerState>(33));
+				gStateCache.IASetInputLayout(FakeObject<RenderInputLayout>(40 + material % 2));
+				gStateCache.IASetPrimitiveTopology(ERenderTopology::TriangleList);
+
+				constants.worldMatrix[12] = static_cast<float>(m);
+				SetDrawConstants(perDrawBuffer, 1, &constants, sizeof(constants), true);
+
+				RenderBuffer* vertexBuffer = FakeObject<RenderBuffer>(100 + m);
+				gRenderBackend->IASetVertexBuffers(0, 1, &vertexBuffer, &vertexStride, &vertexOffset);
+				gRenderBackend->IASetIndexBuffer(FakeObject<RenderBuffer>(100 + NUM_MODELS + m), ERenderIndexFormat::UInt32, 0);
+				gRenderBackend->DrawIndexed(36, 0, 0);
+			}
+
+			gRenderBackend->Present(0, 0);
+			gConstantBufferRing.EndFrame();
+		}
+		float renderTime = timer.GetLapTime();
+
+		// Count the commands of the last frame. The first model's states were all set in the previous frame, so only
+		// changes of material pass the state cache
+		unsigned int numStateCommands = 0, numConstantWrites = 0, numConstantUpdates = 0, numDraws = 0;
+		std::vector<uint32_t> firstConstants;
+		for (auto& command : recorder.Commands())
+		{
+			switch (command.type)
+			{
+				case ERenderCommand::VSSetShader:            case ERenderCommand::PSSetShader:
+				case ERenderCommand::OMSetBlendState:        case ERenderCommand::OMSetDepthStencilState:
+				case ERenderCommand::RSSetState:             case ERenderCommand::PSSetSamplers:
+				case ERenderCommand::IASetInputLayout:       case ERenderCommand::IASetPrimitiveTopology:
+					++numStateCommands;
+					break;
+				case ERenderCommand::WriteBuffer:            ++numConstantWrites;  break;
+				case ERenderCommand::UpdateBuffer:           ++numConstantUpdates; break;
+				case ERenderCommand::VSSetConstantBuffers1:  firstConstants.push_back(command.value); break;
+				case ERenderCommand::DrawIndexed:            ++numDraws; break;
+				default: break;
+			}
+		}
+		std::sort(firstConstants.begin(), firstConstants.end());
+		bool separateConstants = std::adjacent_find(firstConstants.begin(), firstConstants.end()) == firstConstants.end();
+
+		check(recorder.NumDraws() == NUM_FRAMES * NUM_MODELS && numDraws == NUM_MODELS, "draws missing");
+		check(numStateCommands == 3 * NUM_MATERIALS, "state changes not passed on, or repeated states not filtered");
+		check(numConstantWrites == NUM_MODELS && numConstantUpdates == 0 && firstConstants.size() == NUM_MODELS,
+		      "constants not written to and bound from the ring");
+		check(separateConstants, "two draws in a frame share constants in the ring");
+		check(gConstantBufferRing.NumDiscards() == 0, "ring discarded with space for the frames in flight");
+		check(recorder.NumBytesUploaded() == NUM_FRAMES * NUM_MODELS * sizeof(PerDrawConstants), "bytes uploaded don't match the constants");
+
+		size_t numLogLines = 0;
+		for (char c : recorder.CommandLog())  numLogLines += (c == '\n') ? 1 : 0;
+		check(numLogLines == recorder.Commands().size(), "command log doesn't have a line for each command");
+
+		gConstantBufferRing.Release();
+		gRenderBackend->ReleaseBuffer(perDrawBuffer);
+		gStateCache.SetContext(nullptr);
+		gRenderBackend = nullptr;
+
+		report.precision(3);
+		report << std::fixed;
+		report << "Recorded render path: " << NUM_MODELS << " models, " << NUM_MATERIALS << " materials, " << NUM_FRAMES << " frames with no GPU\n"
+		       << "  CPU time per frame: " << renderTime * 1000 / NUM_FRAMES << "ms, commands in the last frame: " << recorder.Commands().size()
+		       << ", state changes passed on: " << numStateCommands << "\n"
+		       << "  Checks: " << (failures.empty() ? "all passed" : std::to_string(failures.size()) + " FAILED") << "\n";
+		for (auto& failure : failures)  report << "    FAILED: " << failure << "\n";
+		return static_cast<unsigned int>(failures.size());
+	}
+}
+
+
+int main()
+{
+	unsigned int numFailures = 0;
+
+	numFailures += RunCullingBenchmark(std::cout);
+	numFailures += RunOcclusionBenchmark(std::cout);
+	numFailures += RunShadowAtlasBenchmark(std::cout);
+	numFailures += RunShadowCascadeBenchmark(std::cout);
+	numFailures += RunSkinningBenchmark(std::cout);
+#ifdef _WIN32
+	numFailures += RunLightClusterBenchmark(std::cout);
+#endif
+	numFailures += TestRingAllocator(std::cout);
+	numFailures += TestStateCache(std::cout);
+	numFailures += TestRecordedRenderPath(std::cout);
+
+	std::cout << (numFailures == 0 ? "All checks passed" : std::to_string(numFailures) + " CHECKS FAILED") << std::endl;
+	return numFailures == 0 ? 0 : 1;
+}
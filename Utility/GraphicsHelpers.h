@@ -11,6 +11,7 @@
 
 #include "CMatrix4x4.h"
 #include "../Common.h"
+#include "../RenderBackend.h"
 
 
 //--------------------------------------------------------------------------------------
@@ -23,10 +24,15 @@
 template <class T>
 void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 {
-    D3D11_MAPPED_SUBRESOURCE cb;
-    gD3DContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
-    memcpy(cb.pData, &bufferData, sizeof(T));
-    gD3DContext->Unmap(buffer, 0);
+    gRenderBackend->UpdateBuffer(buffer, &bufferData, sizeof(T));
+}
+
+// As above but only the first "size" bytes of the structure are copied. Use when a structure ends in an array that is
+// only partly in use (e.g. bone matrices), the shaders must not read the part of the buffer that wasn't copied
+template <class T>
+void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData, size_t size)
+{
+    gRenderBackend->UpdateBuffer(buffer, &bufferData, size < sizeof(T) ? size : sizeof(T));
 }
 
 
@@ -0,0 +1,26 @@
+//--------------------------------------------------------------------------------------
+// Hashing of names (e.g. mesh node names) so they can be looked up without string compares
+//--------------------------------------------------------------------------------------
+// Uses 32-bit FNV-1a, which is simple and spreads short similar names (e.g. "LeftHand", "LeftFoot") well.
+// The function is constexpr, so hashes of literal names are worked out by the compiler, e.g.
+//     unsigned int head = mesh->FindNode(HashName("Head"));
+
+#ifndef _NAMEHASH_H_DEFINED_
+#define _NAMEHASH_H_DEFINED_
+
+#include <cstdint>
+
+// Return the hash of a null-terminated name
+constexpr uint32_t HashName(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name != '\0')
+    {
+        hash ^= static_cast<unsigned char>(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+#endif // _NAMEHASH_H_DEFINED_
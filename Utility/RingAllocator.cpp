@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------------------
+// Allocation of space from a ring buffer, with space held until the frames using it have finished on the GPU
+//--------------------------------------------------------------------------------------
+
+#include "RingAllocator.h"
+
+
+// Pass the size of the area to allocate from, the alignment of each allocation (a power of 2) and the number of
+// frames after the frame that made an allocation until its space can be reused
+RingAllocator::RingAllocator(size_t size, size_t alignment /*= 256*/, unsigned int numFramesInFlight /*= 3*/)
+    : mSize(size & ~(alignment - 1)), mAlignment(alignment), mNumFramesInFlight(numFramesInFlight)
+{
+}
+
+
+// Return the offset of a new allocation of the given size, rounded up to the alignment, or ALLOCATION_FAILED if
+// there is not enough free space
+size_t RingAllocator::Allocate(size_t size)
+{
+    size = (size + mAlignment - 1) & ~(mAlignment - 1);
+    if (size == 0 || size > mSize - mNumBytesInUse)  return ALLOCATION_FAILED;
+
+    // Free space runs from the head to the tail, wrapping at the end. Allocations must be contiguous, so if the space up to
+    // the end is too small, skip it and allocate from the start instead
+    if (mHead >= mTail && mSize - mHead < size)
+    {
+        size_t skipped = mSize - mHead;
+        if (mTail < size)  return ALLOCATION_FAILED;
+        mNumBytesInUse     += skipped;
+        mCurrentFrameBytes += skipped;
+        mHead = 0;
+    }
+    else if (mHead < mTail && mTail - mHead < size)
+    {
+        return ALLOCATION_FAILED;
+    }
+
+    size_t offset = mHead;
+    mHead = (mHead + size) % mSize;
+    mNumBytesInUse     += size;
+    mCurrentFrameBytes += size;
+    return offset;
+}
+
+
+// Call at the end of each frame. Frees the space used by the frame that ended numFramesInFlight frames ago
+void RingAllocator::EndFrame()
+{
+    mFrameBytes.push_back(mCurrentFrameBytes);
+    mCurrentFrameBytes = 0;
+    if (mFrameBytes.size() <= mNumFramesInFlight)  return;
+
+    // Space is used in order, so the oldest frame's space starts at the tail
+    size_t freed = mFrameBytes.front();
+    mFrameBytes.erase(mFrameBytes.begin());
+    mTail = (mTail + freed) % mSize;
+    mNumBytesInUse -= freed;
+
+    // When empty start from the beginning again, so the largest allocations possible fit without wrapping
+    if (mNumBytesInUse == 0)  mHead = mTail = 0;
+}
+
+
+// Free all space at once, including that of frames still in flight. Only call when the memory for the area has been
+// replaced (e.g. a Direct3D buffer mapped with discard)
+void RingAllocator::Reset()
+{
+    mHead = mTail = 0;
+    mNumBytesInUse = 0;
+    mCurrentFrameBytes = 0;
+    mFrameBytes.clear();
+}
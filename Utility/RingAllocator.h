@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Allocation of space from a ring buffer, with space held until the frames using it have finished on the GPU
+//--------------------------------------------------------------------------------------
+// Only keeps track of offsets, it holds no memory itself and has no Direct3D code so it can be tested on its own.
+// Allocations are taken in order from a fixed size area, wrapping back to the start when they reach the end (the space
+// at the end that was too small is skipped). Call EndFrame after each frame: the space used by a frame is only reused once
+// the given number of frames have ended after it - the GPU may still be reading it until then. When there is no space
+// left, Allocate fails - the caller must then make other arrangements, e.g. discard the whole buffer and call Reset.
+// Code in .cpp file
+
+#ifndef _RING_ALLOCATOR_H_INCLUDED_
+#define _RING_ALLOCATOR_H_INCLUDED_
+
+#include <vector>
+#include <cstddef>
+
+
+class RingAllocator
+{
+public:
+    // Returned by Allocate when there is not enough space
+    static const size_t ALLOCATION_FAILED = static_cast<size_t>(-1);
+
+
+    //-------------------------------------
+    // Construction and Usage
+    //-------------------------------------
+
+    // Pass the size of the area to allocate from, the alignment of each allocation (a power of 2) and the number of
+    // frames after the frame that made an allocation until its space can be reused
+    RingAllocator(size_t size, size_t alignment = 256, unsigned int numFramesInFlight = 3);
+
+    // Return the offset of a new allocation of the given size, rounded up to the alignment, or ALLOCATION_FAILED if
+    // there is not enough free space
+    size_t Allocate(size_t size);
+
+    // Call at the end of each frame. Frees the space used by the frame that ended numFramesInFlight frames ago
+    void EndFrame();
+
+    // Free all space at once, including that of frames still in flight. Only call when the memory for the area has been
+    // replaced (e.g. a Direct3D buffer mapped with discard)
+    void Reset();
+
+
+    //-------------------------------------
+    // Data access
+    //-------------------------------------
+
+    size_t Size()       { return mSize; }
+    size_t Alignment()  { return mAlignment; }
+
+    // Bytes not free, including space skipped when wrapping
+    size_t NumBytesInUse()  { return mNumBytesInUse; }
+
+
+    //-------------------------------------
+    // Data
+    //-------------------------------------
+private:
+    size_t       mSize;
+    size_t       mAlignment;
+    unsigned int mNumFramesInFlight;
+
+    size_t mHead = 0; // Offset of the next allocation
+    size_t mTail = 0; // Offset of the oldest space still in use
+    size_t mNumBytesInUse = 0;
+
+    // Bytes used by the current frame, and by each frame still in flight (oldest first, used as a queue)
+    size_t              mCurrentFrameBytes = 0;
+    std::vector<size_t> mFrameBytes;
+};
+
+
+#endif //_RING_ALLOCATOR_H_INCLUDED_
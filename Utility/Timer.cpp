@@ -2,9 +2,30 @@
 // Timer class - works like a stopwatch
 //--------------------------------------------------------------------------------------
 
-#include "Windows.h"
 #include "Timer.h"
 
+#ifndef _WIN32
+#include <chrono>
+
+// Stand-ins for the Windows timing functions, see Timer.h. Counts are in nanoseconds
+int QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000;
+	return 1;
+}
+
+int QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+	count->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return 1;
+}
+
+DWORD timeGetTime()
+{
+	return static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
 // Constructor //
 
 Timer::Timer()
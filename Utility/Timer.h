@@ -5,7 +5,18 @@
 #ifndef _TIMER_H_INCLUDED_
 #define _TIMER_H_INCLUDED_
 
+#ifdef _WIN32
 #include "Windows.h"
+#else
+// Stand-ins for the Windows timing functions used here, so the timer and the benchmarks that use it also build elsewhere
+// (e.g. to run the CPU benchmarks headless on Linux). Implemented in Timer.cpp with std::chrono
+#include <cstdint>
+typedef uint32_t DWORD;
+union LARGE_INTEGER { int64_t QuadPart; };
+int   QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+int   QueryPerformanceCounter(LARGE_INTEGER* count);
+DWORD timeGetTime();
+#endif
 
 class Timer
 {